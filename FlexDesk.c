@@ -1,18 +1,125 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <pthread.h>
 #include <time.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <limits.h>
 
 #define MEMBERS_FILE "members.csv"
 #define WORKSPACES_FILE "workspaces.csv"
 #define BOOKINGS_FILE "bookings.csv"
 #define PAYMENTS_FILE "payments.csv"
 #define LOG_FILE "system.log"
+#define SNAPSHOT_FILE "flexdesk.snap"
+#define WAL_FILE "flexdesk.wal"
+#define WAL_PREV_FILE "flexdesk.wal.prev" // Log being retired by an in-flight checkpoint
 
 // HASH MAP CONFIGURATION
-#define INDEX_SIZE 1009 // Prime number to reduce collisions
+#define INDEX_INITIAL_CAPACITY 16 // Slots in a fresh table (always a power of two)
+#define INDEX_MAX_LOAD_PCT 85     // Start doubling once the table is this full
+#define INDEX_MIGRATE_STEP 16     // Old slots moved per write while a resize is in flight
+#define INDEX_RELEASE_BYTES 65536 // Drained old-table memory is unmapped in pieces this big
+
+// AUDIT LOGGER CONFIGURATION
+#define LOG_QUEUE_SIZE 8192          // Ring slots (power of two); bounds logger memory
+#define LOG_MESSAGE_MAX 192          // Longer messages are truncated
+#define LOG_FLUSH_INTERVAL_MS 200    // Default; override with FLEXDESK_LOG_FLUSH_MS
+// Full-queue policy: drop (default) or block; override with FLEXDESK_LOG_POLICY=drop|block
+
+// SLAB ALLOCATOR CONFIGURATION
+#define SLAB_CHUNK_NODES 4096 // Nodes carved from each malloc'd chunk
+
+// MEMBER TABLE STRIPES
+#define MEMBER_STRIPE_BITS 4
+#define MEMBER_STRIPES (1 << MEMBER_STRIPE_BITS) // Independently locked member partitions
+
+// MEMBER ROWS
+#define MEMBER_TEXT_MAX 99        // Longest name or email; longer input is rejected
+#define MEMBER_INLINE_TEXT 11     // Strings up to this long are kept inside the node
+#define STR_HEAP_CHUNK (64 << 10) // Bytes per member string heap chunk
+#define STR_HEAP_ALIGN 16         // Heap blocks are whole multiples of this
+
+// LOCK-FREE READS
+#define ID_MAP_LEAF_BITS 12     // Ids per leaf (4096 pointers, 32 KB)
+#define ID_MAP_MID_BITS 10      // Leaves per middle node
+#define ID_MAP_TOP (1 << (31 - ID_MAP_LEAF_BITS - ID_MAP_MID_BITS)) // Covers every positive int
+#define EPOCH_MAX_THREADS 256   // Threads reading lock-free at once; others fall back to locks
+#define EPOCH_RECLAIM_BATCH 64  // Retired nodes per stripe before a reclaim pass
+
+// CSV LOADER
+#define CSV_MAX_RANGES 8               // Parser threads per file
+#define CSV_MIN_RANGE_BYTES (1 << 20)  // Smaller files are not split further
+
+// BUFFER POOL (booking and payment rows)
+#define POOL_PAGE_SIZE 4096
+#define POOL_DEFAULT_FRAMES 4096 // 16 MB of frames; override with FLEXDESK_POOL_PAGES
+#define POOL_MIN_FRAMES 16
+#define POOL_NO_PAGE UINT32_MAX
+#define POOL_FILE_TEMPLATE "flexdesk.pages.XXXXXX" // Scratch file, unlinked once opened
+
+// ORDERED INDEXES (B+tree on booking start / payment date)
+#define ORDERED_FANOUT 64      // Keys per node; a node splits when it would hold one more
+#define ORDERED_MAX_HEIGHT 16  // Levels a descent can record (64^16 keys: never reached)
+#define RANGE_PAGE_ROWS 20     // Rows per page in the menu's range listings
+
+// QUERY ENGINE
+#define QUERY_MAX_ITEMS 8      // Select-list entries (SELECT * counts every column)
+#define QUERY_MAX_PREDICATES 8 // WHERE terms, joined by AND
+#define QUERY_TEXT_MAX 100     // Longest identifier or literal
+#define QUERY_PLAN_LINES 8
+#define QUERY_FETCH_PAGE 1024  // Rows per page of an ordered-index scan
+
+// HASH JOIN (billing reconciliation)
+#define JOIN_MAX_THREADS 16        // Partitioning and probing workers
+#define JOIN_PARTITION_ROWS 4096   // Target build rows per partition (its table stays in L2)
+#define JOIN_MAX_PARTITION_BITS 14 // At most 16384 partitions
+#define RECONCILE_TOP_ROWS 20      // Members listed by the menu report
+
+// MATERIALIZED AGGREGATES
+#define MAT_TOP_ROWS 10 // Keys listed per aggregate on the dashboard
+
+// TRANSACTIONS
+#define TXN_MAX_READS 128 // Rows one transaction may read (validated at commit)
+#define TXN_MAX_WRITES 64 // Statements one transaction may buffer
+#define TXN_MAX_RETRIES 5 // Re-runs after a stale read before giving up
+
+// STRING DICTIONARY
+#define STR_BLOCK_BITS 12    // Codes per block of the code -> text table
+#define STR_MAX_BLOCKS 4096  // Room for 16M distinct strings
+#define STR_COLUMN_MAX (1 << 16) // Distinct values clients may add to each encoded column
+
+// Batch Mode
+#define BATCH_SYNC_EVERY 1000          // Commands per WAL fsync / response flush
+#define BATCH_IO_BUFFER (1 << 20)      // stdin/stdout stdio buffers
+#define BATCH_OUTPUT_FLUSH (256 << 10) // Flush early once this many response bytes queue up
+
+// Network Server
+#define SERVER_PORT 7070
+#define SERVER_WORKERS 4
+#define SERVER_MAX_CONNECTIONS 4096   // Accepted fds at or above this are refused
+#define SERVER_MAX_FRAME (64 << 10)   // Largest request payload; bigger frames drop the client
+#define SERVER_BATCH_FRAMES 64        // Requests a worker takes from one connection per turn
+#define SERVER_OUTPUT_LIMIT (4 << 20) // Stop serving a client with this much unsent output
+#define SERVER_INPUT_LIMIT (1 << 20)  // Stop reading from a client with this much unserved input
 
 /* * ==========================================
  * DATA STRUCTURES
@@ -22,8 +129,8 @@
 typedef struct
 {
     int memberId;
-    char name[100];
-    char email[100];
+    char name[MEMBER_TEXT_MAX + 1];
+    char email[MEMBER_TEXT_MAX + 1];
 } Member;
 
 typedef struct
@@ -54,68 +161,909 @@ typedef struct
     char status[20];
 } Payment;
 
+// -- Stored Row Forms --
+// Workspace type/location and the booking/payment status hold a handful of
+// distinct values, so the stored rows keep a code into the string dictionary
+// instead of a char array. The structs above stay the interface (menus, CSV,
+// WAL after-images, batch responses); *_encode / *_decode convert at the
+// storage boundary.
+typedef uint32_t StrCode;
+
+typedef struct
+{
+    int workspaceId;
+    StrCode type;
+    StrCode location;
+    int capacity;
+    int price_in_cents;
+} WorkspaceRecord;
+
+typedef struct
+{
+    int bookingId;
+    int memberId;
+    int workspaceId;
+    char startTime[20];
+    char endTime[20];
+    StrCode status;
+} BookingRecord;
+
+typedef struct
+{
+    int paymentId;
+    int bookingId;
+    int amount_in_cents;
+    char paymentDate[11];
+    StrCode status;
+} PaymentRecord;
+
 // -- Doubly Linked List Nodes (Storage) --
+// Bookings and payments are also threaded onto per-parent lists (the reverse
+// foreign-key indexes); the list heads live in bookings_by_member etc.
+// Their nodes keep only the index keys, flags and links; the full row lives
+// in a page of the buffer pool (as a BookingRecord / PaymentRecord) and is
+// read with booking_read / payment_read. A node sits at its row's slot in
+// the table's node array (see paged_node), so the links are 32-bit slots and
+// table scans walk the slots instead of a list of their own.
+typedef uint32_t RecordId; // Slot of a row in its table's pages
+#define NO_RECORD UINT32_MAX
+enum { FK_BY_MEMBER, FK_BY_WORKSPACE, FK_BOOKING_LISTS };
+enum { FK_RESTRICT, FK_CASCADE };
+
+typedef struct
+{
+    RecordId next, prev;
+} BookingLink;
+
+typedef struct
+{
+    RecordId next, prev;
+} PaymentLink;
+
+// -- Compact Member Rows --
+// Member text is stored by length instead of in 100-byte arrays. A string of
+// up to MEMBER_INLINE_TEXT bytes sits in 'text' (NUL-terminated). A longer one
+// keeps its first 4 bytes there, so most mismatches are rejected without a
+// pointer hop, followed by a pointer to its copy in the stripe's string heap.
+typedef struct
+{
+    uint32_t length;
+    char text[MEMBER_INLINE_TEXT + 1]; // Inline string, or 4-byte prefix + heap pointer
+} CompactStr;
+
 typedef struct MemberNode
 {
-    Member data;
+    int memberId;
+    CompactStr name, email;
+    uint64_t version; // record_clock at its last write (see TRANSACTIONS)
     struct MemberNode *next, *prev;
 } MemberNode;
 
 typedef struct WorkspaceNode
 {
-    Workspace data;
+    WorkspaceRecord data;
+    uint64_t version;
     struct WorkspaceNode *next, *prev;
 } WorkspaceNode;
 
 typedef struct BookingNode
 {
-    Booking data;
-    struct BookingNode *next, *prev;
+    int bookingId, memberId, workspaceId;
+    RecordId rid;        // Full Booking row in the page store
+    int64_t start_min;   // Parsed startTime (minutes since epoch, -1 if unparseable)
+    uint32_t length_min; // Parsed endTime - start_min; 0 unless both parse and the end is later
+    unsigned live : 1;      // The slot holds a row (scans skip free slots)
+    unsigned cancelled : 1; // Status starts with "Cancel"
+    unsigned scheduled : 1; // Listed in its workspace's schedule
+    unsigned ordered : 1;   // Listed in bookings_by_start
+    unsigned counted : 1;   // Included in the materialized aggregates
+    uint64_t version;
+    BookingLink fk[FK_BOOKING_LISTS]; // Siblings with the same memberId / workspaceId
 } BookingNode;
 
 typedef struct PaymentNode
 {
-    Payment data;
-    struct PaymentNode *next, *prev;
+    int paymentId, bookingId;
+    RecordId rid; // Full Payment row in the page store
+    int paid_day; // Parsed paymentDate (days since epoch, -1 if unparseable)
+    int workspaceId; // Its booking's, cached for revenue_by_workspace
+    unsigned live : 1;    // The slot holds a row (scans skip free slots)
+    unsigned ordered : 1; // Listed in payments_by_date
+    unsigned counted : 1; // Included in the materialized aggregates
+    uint64_t version;
+    PaymentLink by_booking; // Siblings with the same bookingId
 } PaymentNode;
 
-// -- Index Nodes (Lookup) --
-// This structure lives in the Hash Map buckets.
-// It points TO the actual data in the main linked list.
-typedef struct IndexNode
+// -- Binary Snapshot Format --
+// [SnapshotHeader][members][workspaces][bookings][payments][strings]
+// Each table section is a packed array of the fixed-width stored records
+// above, so a mapped file can be bulk-loaded without parsing. The strings
+// section is the dictionary the records' codes refer to, written once as
+// [uint32 length][text] entries in code order. Bump the version whenever a
+// record layout changes.
+#define SNAPSHOT_MAGIC "FLEXSNAP"
+#define SNAPSHOT_VERSION 2
+
+enum { SNAP_MEMBERS, SNAP_WORKSPACES, SNAP_BOOKINGS, SNAP_PAYMENTS, SNAP_TABLES };
+enum { SNAPSHOT_OK = 0, SNAPSHOT_MISSING = 1, SNAPSHOT_CORRUPT = -1 };
+
+typedef struct
+{
+    uint64_t offset;      // Byte offset of the first record
+    uint64_t count;       // Number of records
+    uint32_t record_size; // sizeof(record) when written; must match on load
+    int32_t next_id;      // The table's id counter at save time
+    uint64_t checksum;    // Chained checksum64 of every record
+} SnapshotSection;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t table_count;
+    SnapshotSection sections[SNAP_TABLES];
+    SnapshotSection strings;  // record_size 0: entries vary in length
+    uint64_t header_checksum; // checksum64 of everything above
+} SnapshotHeader;
+
+// Version 1: the same tables as char-array rows, and no strings section
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t table_count;
+    SnapshotSection sections[SNAP_TABLES];
+    uint64_t header_checksum;
+} SnapshotHeaderV1;
+
+// -- Write-Ahead Log --
+// Every mutation is appended as [WalRecordHeader][payload] before it is
+// acknowledged. Inserts and updates carry the full after-image of the record,
+// deletes carry the id, so replaying a record twice converges to the same state.
+// A committed transaction is one WAL_TXN record whose payload is its
+// changes as [WalRecordHeader][payload] entries (checksum unused), so
+// replay applies all of them or, for a torn record, none.
+enum { WAL_INSERT = 1, WAL_UPDATE = 2, WAL_DELETE = 3, WAL_TXN = 4 };
+
+typedef struct
+{
+    uint32_t length;   // Payload bytes that follow
+    uint8_t op;        // WAL_INSERT / WAL_UPDATE / WAL_DELETE / WAL_TXN
+    uint8_t table;     // SNAP_MEMBERS ... SNAP_PAYMENTS
+    uint16_t reserved;
+    uint64_t checksum; // checksum64 of op, table and payload
+} WalRecordHeader;
+
+// Group commit: writers append to 'buffer' under 'mutex' and then wait for
+// their LSN to become durable. Whoever finds no flush in progress becomes the
+// leader, swaps the buffers and fsyncs everything queued so far in one call.
+typedef struct
+{
+    int fd;                    // -1 while the log is closed (tools, benchmarks)
+    pthread_mutex_t mutex;
+    pthread_cond_t flushed_cond;
+    char *buffer, *spare;      // Pending bytes / buffer handed back by the last flush
+    size_t used, capacity, spare_capacity;
+    uint64_t appended_lsn;     // Bytes appended so far (LSN of the newest record's end)
+    uint64_t durable_lsn;      // Bytes known to be on disk
+    int flushing;              // A leader is in write()/fdatasync()
+
+    // Counters
+    unsigned long records;
+    unsigned long syncs;
+    unsigned long max_batch;   // Most records made durable by one fsync
+    unsigned long replayed;
+    unsigned long batch_records; // Records appended since the last flush started
+} WriteAheadLog;
+
+// -- Audit Logger --
+// Bounded multi-producer ring (one sequence number per slot, no locks on the
+// enqueue path). A background thread drains it in batches into system.log.
+typedef struct
+{
+    _Atomic size_t sequence; // == position when free, position + 1 when filled
+    time_t timestamp;
+    char message[LOG_MESSAGE_MAX];
+} LogSlot;
+
+enum { LOG_POLICY_DROP, LOG_POLICY_BLOCK };
+
+typedef struct
+{
+    LogSlot slots[LOG_QUEUE_SIZE];
+    _Atomic size_t head;       // Next position producers claim
+    _Atomic size_t tail;       // Next position the drain thread reads
+    int fd;                    // system.log, kept open while running
+    atomic_int running;        // Read by every producer without a lock
+    int policy;
+    int flush_interval_ms;
+    pthread_t thread;
+    pthread_mutex_t wake_mutex;
+    pthread_cond_t wake_cond;
+
+    // Counters
+    _Atomic unsigned long enqueued;
+    _Atomic unsigned long dropped;
+    _Atomic unsigned long blocked; // Enqueues that had to wait (block policy)
+    _Atomic unsigned long written;
+    _Atomic unsigned long batches;
+    _Atomic size_t max_depth;
+} AuditLogger;
+
+// -- Index Slots (Lookup) --
+// Open-addressing slot living directly in the table array (no per-entry node).
+// It points TO the actual data in the main linked list of any table.
+#define INDEX_TOMBSTONE 0x80000000u // Set on old-table slots removed before migration
+
+typedef struct
+{
+    uint64_t key;   // Inline key, so probes never touch the record
+    void *target;   // Pointer to the actual data node
+    uint32_t dist;  // Probe distance + 1 (0 = empty slot)
+} IndexSlot;
+
+typedef struct
+{
+    IndexSlot *slots;
+    size_t mask;    // capacity - 1
+    size_t count;   // Live entries
+} IndexTable;
+
+// -- Slab Allocator --
+// Nodes are carved out of large contiguous chunks instead of one malloc each.
+// Freed nodes go onto a free list and are recycled by the next allocation.
+// A slab is owned by one table and is only touched under that table's write lock.
+typedef struct SlabFreeNode
+{
+    struct SlabFreeNode *next;
+} SlabFreeNode;
+
+typedef struct SlabChunk
+{
+    struct SlabChunk *next;
+    // Keeps the node area that follows the header suitably aligned
+    union { long long l; double d; void *p; } align;
+} SlabChunk;
+
+typedef struct
+{
+    const char *name;
+    size_t node_size;
+    SlabChunk *chunks;        // Every chunk ever allocated (released together)
+    char *bump, *bump_end;    // Uncarved space in the newest chunk
+    SlabFreeNode *free_list;  // Recycled slots
+
+    // Counters
+    unsigned long allocs;     // slab_alloc calls
+    unsigned long frees;      // slab_free calls
+    unsigned long reused;     // allocations served from the free list
+    unsigned long chunk_count;// malloc calls actually made
+} Slab;
+
+// Match callback for secondary indexes whose keys are hashes of the real value
+// (several targets may share a key, the callback picks the right one)
+typedef int (*IndexMatchFn)(const void *target, const void *ctx);
+
+// -- Hash Index --
+// Reusable Robin Hood index: one per table, guarded by that table's lock.
+// Doubling is incremental: while 'old' is non-empty every write also moves
+// INDEX_MIGRATE_STEP of its slots into 'cur', so no insert pays for a full rehash.
+typedef struct
+{
+    const char *name;
+    IndexTable cur;         // Receives every insert
+    IndexTable old;         // Table being drained (slots == NULL when idle)
+    size_t migrate_pos;     // Next old slot to move (everything below is gone)
+    size_t old_released;    // Bytes at the front of 'old' already unmapped
+
+    // Counters
+    unsigned long resizes;
+    unsigned long migrated;
+} HashIndex;
+
+// -- Ordered Index (B+Tree) --
+// Secondary index in key order, for range scans and time-ordered listings.
+// Keys are (time, id) pairs, unique because ids are. Inner nodes route by
+// separator keys; leaves hold the targets and are chained in key order, so a
+// range scan is one descent followed by a walk along the leaves. Guarded by
+// the lock of the table it indexes.
+typedef struct
+{
+    int64_t time;
+    int id;
+} OrderedKey;
+
+typedef struct OrderedNode
+{
+    int leaf;
+    int count;                              // Keys in use (an inner node has count + 1 children)
+    OrderedKey keys[ORDERED_FANOUT + 1];    // One spare: a node splits right after overflowing
+    void *ptrs[ORDERED_FANOUT + 2];         // Children, or a leaf's targets
+    struct OrderedNode *next, *prev;        // Leaf chain in key order
+} OrderedNode;
+
+typedef struct
+{
+    const char *name;
+    OrderedNode *root; // NULL while empty
+    int height;        // Levels, leaves included
+    size_t count;
+    Slab nodes;
+
+    // Counters
+    unsigned long splits;
+    unsigned long freed; // Nodes released after their last key was removed
+} OrderedIndex;
+
+// Position in a leaf; valid only while the index's table lock is held
+typedef struct
+{
+    OrderedNode *leaf;
+    int pos;
+} OrderedCursor;
+
+// -- CRUD Core Results --
+typedef enum
+{
+    DB_OK = 0,
+    DB_NOT_FOUND,      // No row with that id
+    DB_DUPLICATE,      // Unique constraint (member email)
+    DB_MISSING_PARENT, // Referenced member/workspace/booking does not exist
+    DB_CONFLICT,       // Booking overlaps an occupying booking
+    DB_RESTRICTED,     // Delete refused: dependents exist (FK_RESTRICT)
+    DB_INVALID,        // Malformed input (e.g. booking times)
+    DB_ABORTED,        // Transaction read a row that changed before it committed
+    DB_FULL,           // Text column already holds STR_COLUMN_MAX distinct values
+    DB_NO_MEMORY       // A result buffer could not be allocated
+} DbStatus;
+
+typedef struct
+{
+    int dependents; // Children blocking a RESTRICT delete
+    int bookings;   // Children removed by a CASCADE delete
+    int payments;
+} DbDeleteInfo;
+
+// -- Transactions --
+// Writes are buffered and every row read is remembered with its version
+// (0 = it did not exist). Nothing is locked until txn_commit.
+typedef struct
+{
+    uint8_t table; // SNAP_*
+    int id;
+    uint64_t version;
+} TxnRead;
+
+typedef struct
+{
+    uint8_t op;    // WAL_INSERT / WAL_UPDATE / WAL_DELETE
+    uint8_t table; // SNAP_WORKSPACES ... SNAP_PAYMENTS
+    union
+    {
+        Workspace workspace;
+        Booking booking;
+        Payment payment;
+        int id;    // WAL_DELETE
+    } row;         // After-image, or the id to delete
+} TxnWrite;
+
+typedef struct
+{
+    TxnRead reads[TXN_MAX_READS];
+    TxnWrite writes[TXN_MAX_WRITES];
+    int read_count, write_count;
+    int open;
+    int conflict_id; // Booking holding the slot when a commit fails with DB_CONFLICT
+} Txn;
+
+// Does a transaction's reads and writes; re-run from scratch on a retry
+typedef DbStatus (*TxnBody)(Txn *txn, void *ctx);
+
+// -- Command Responses --
+// Growable text buffer the dispatcher writes response lines into
+typedef struct
+{
+    char *data;
+    size_t used, capacity;
+} OutBuffer;
+
+enum { COMMAND_DONE = 0, COMMAND_FLUSH = 1, COMMAND_SKIPPED = 2 };
+
+// Per-client state: the whole batch run, or one server connection
+typedef struct
+{
+    Txn *txn; // Open transaction (BEGIN ... COMMIT / ABORT), NULL outside one
+} CommandSession;
+
+// -- Query Results --
+// One cell per selected column per row. Text cells point into the rows the
+// query fetched (kept in 'source') until query_result_free.
+enum { QVAL_INT, QVAL_REAL, QVAL_TEXT };
+
+typedef struct
+{
+    int type; // QVAL_*
+    int64_t i;
+    double d;
+    const char *s;
+} QueryCell;
+
+// -- Table Snapshots --
+// Private point-in-time copy of one table's records
+typedef struct
+{
+    void *rows; // Records in list order, row_size bytes apart
+    size_t count, capacity, row_size;
+    int next_id; // The table's id counter when the copy was taken
+} TableSnapshot;
+
+typedef struct
+{
+    int explain;   // Only the plan was asked for
+    int columns;
+    char names[QUERY_MAX_ITEMS][QUERY_TEXT_MAX + 8];
+    QueryCell *cells; // rows * columns, row by row
+    size_t rows, capacity;
+    char plan[QUERY_PLAN_LINES][160];
+    int plan_lines;
+    char error[160];
+    TableSnapshot source; // Fetched rows
+} QueryResult;
+
+// -- Hash Join --
+// An input row of hash_join: the join key plus three payload columns whose
+// meaning belongs to the caller (an amount, a row index, a flag, ...).
+typedef struct
+{
+    int key;
+    int a, b, c;
+} JoinTuple;
+
+// Called once per matching pair, from any worker thread at once
+typedef void (*JoinMatchFn)(void *ctx, const JoinTuple *left, const JoinTuple *right);
+
+typedef struct
+{
+    int threads;
+    int partitions;
+    int built_left; // The hash tables were built over the left input
+    size_t build_rows, probe_rows, matches;
+    double partition_ms, join_ms;
+} JoinStats;
+
+// Expected vs paid per member: payments -> bookings -> workspaces
+typedef struct
+{
+    int memberId;
+    int bookings;          // Not cancelled
+    int64_t expected;      // Workspace price summed over those bookings
+    int64_t paid, pending; // Payments with status Paid / any other status
+} ReconcileRow;
+
+typedef struct
+{
+    ReconcileRow *rows; // Members with bookings or payments, largest balance (expected - paid) first
+    size_t count;
+    int64_t expected, paid, pending;
+    size_t workspaces, bookings, payments;
+    JoinStats joins[2]; // bookings x workspaces, payments x bookings
+    double extract_ms, total_ms;
+} ReconcileReport;
+
+// -- Materialized Aggregates --
+// Running COUNT and SUM per key, kept up to date by the storage helpers
+enum { MAT_REVENUE_BY_WORKSPACE, MAT_ACTIVE_BOOKINGS_BY_MEMBER, MAT_PAYMENTS_BY_STATUS, MAT_AGGREGATES };
+
+typedef struct AggregateCell
+{
+    int key;
+    int64_t count, sum;
+    struct AggregateCell *next, *prev;
+} AggregateCell;
+
+typedef struct
+{
+    const char *name;
+    const char *key_name;
+    int table;            // SNAP_* whose lock guards it
+    HashIndex cells;      // key -> AggregateCell; keys with nothing counted are dropped
+    AggregateCell *head;  // Every cell, for listings and verification
+    Slab slab;
+    int64_t count, sum;   // Over all keys
+    unsigned long updates;
+} MatAggregate;
+
+typedef struct
+{
+    size_t cells[MAT_AGGREGATES];   // Recomputed keys per aggregate
+    size_t drifted[MAT_AGGREGATES]; // Keys (or totals) whose live value differs
+    char first_drift[160];          // The first difference found, "" if none
+    double ms;
+} MatVerifyReport;
+
+// -- Lock-Free Id Map --
+// Radix tree from id to node. Nodes are created on first use and never move
+// or shrink while the table is live, so readers need only atomic loads.
+typedef struct
+{
+    _Atomic(void *) slots[1 << ID_MAP_LEAF_BITS];
+} IdMapLeaf;
+
+typedef struct
+{
+    _Atomic(IdMapLeaf *) leaves[1 << ID_MAP_MID_BITS];
+} IdMapMid;
+
+typedef struct
+{
+    _Atomic(IdMapMid *) top[ID_MAP_TOP];
+    atomic_size_t leaf_count;
+} IdMap;
+
+// -- Epoch Reclamation --
+// A reader publishes the global epoch it entered in; 0 means it holds nothing
+typedef struct
+{
+    _Alignas(64) atomic_uint_fast64_t epoch;
+    atomic_int in_use;
+} EpochSlot;
+
+typedef struct
+{
+    void *node;
+    uint64_t epoch; // Global epoch at retirement; freed once every reader is past it
+} RetiredNode;
+
+// -- Member String Heap --
+// Text of member strings too long to inline, carved from chunks in
+// STR_HEAP_ALIGN steps. Freed blocks go onto a free list per size and are
+// reused first. Guarded by the owning stripe's lock.
+typedef struct StrHeapChunk
+{
+    struct StrHeapChunk *next;
+} StrHeapChunk; // Followed by STR_HEAP_CHUNK bytes of blocks
+
+typedef struct StrHeapBlock
+{
+    struct StrHeapBlock *next;
+} StrHeapBlock;
+
+typedef struct
+{
+    StrHeapChunk *chunks;
+    char *cursor;   // Uncarved tail of the newest chunk
+    size_t left;
+    StrHeapBlock *free_lists[(MEMBER_TEXT_MAX + STR_HEAP_ALIGN) / STR_HEAP_ALIGN];
+    size_t live_bytes, chunk_count;
+    unsigned long inline_strings, heap_strings;
+} StrHeap;
+
+// -- Member Stripes --
+// The member table is split into partitions, each with its own lock, so
+// writers to different members do not queue behind one table lock. A member
+// row (list entry, slab node) lives in the stripe chosen by its id. Its email
+// entry lives in the stripe chosen by the email, so the unique check needs
+// exactly one lock. Id lookups go through the shared lock-free member_ids map.
+typedef struct
+{
+    _Alignas(64) pthread_rwlock_t lock; // Own cache line: stripes must not share lock traffic
+    MemberNode *head, *tail;
+    size_t count;
+    HashIndex email_index; // hash_string(email) -> MemberNode, for emails of this stripe
+    Slab slab;
+    StrHeap heap;          // Long names and emails of this stripe's rows
+    RetiredNode *limbo; // Unlinked nodes lock-free readers may still hold
+    size_t limbo_count, limbo_capacity;
+    size_t reclaim_at;  // limbo_count that triggers the next reclaim pass (0: EPOCH_RECLAIM_BATCH)
+} MemberStripe;
+
+// -- Buffer Pool --
+// Fixed-size pages in a scratch file, cached in a bounded set of frames.
+// CLOCK picks the frame to reuse; a dirty frame is written back first. The
+// snapshot and WAL remain the durable copy, so the page file starts empty on
+// every run and needs no recovery of its own.
+//
+// Pages are placed in file slots through disk_of. While a background save's
+// child reads the file ('shadow' mode), writebacks go to other slots, so the
+// child keeps seeing the pages as they were when it forked.
+//
+// A frame's writeback and read run without the pool lock; meanwhile it is
+// marked with the I/O in flight and both pages map to it, so pinners of
+// either page wait on 'loaded' instead of reading a half-filled frame.
+enum { POOL_IO_NONE, POOL_IO_WRITE, POOL_IO_READ };
+
+typedef struct
+{
+    uint32_t page;       // File page held, or POOL_NO_PAGE
+    int pins;            // Copies in progress; pinned frames are never reused
+    int referenced;      // CLOCK second chance
+    int dirty;           // Written since it was read in
+    int io;              // POOL_IO_WRITE: old page going out, POOL_IO_READ: 'page' coming in
+    unsigned char *data; // POOL_PAGE_SIZE bytes
+} PoolFrame;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t unpinned; // Pinners wait here when every frame is pinned
+    pthread_cond_t loaded;   // ... and here while their page's frame does I/O
+    int fd;
+    PoolFrame *frames;
+    size_t frame_count, hand;
+    int32_t *frame_of; // Page -> frame, -1 when not resident
+    uint32_t *disk_of; // Page -> file slot, POOL_NO_PAGE until first written back
+    uint32_t page_count, page_capacity;
+    uint32_t slot_count;                // File slots ever used
+    uint32_t *free_slots, *held_slots;  // Reusable / still visible to a save child
+    size_t free_slot_count, free_slot_capacity, held_slot_count, held_slot_capacity;
+    int shadow;       // A background save child is reading the file
+    int forked_child; // This process is that child: read-only, no locking
+
+    // Counters
+    unsigned long hits, misses, evictions, writebacks, waits, io_waits, shadow_writes;
+} BufferPool;
+
+// One table's rows packed into pool pages (guarded by the table's lock).
+// Each table page has a matching block of resident nodes, never moved.
+typedef struct
+{
+    const char *name;
+    size_t record_size, per_page, node_size;
+    uint32_t *pages; // Table page -> file page
+    unsigned char **nodes; // Table page -> its rows' nodes (zeroed: not live)
+    size_t page_count, page_capacity;
+    RecordId *free_ids; // Slots of deleted rows, reused first
+    size_t free_count, free_capacity;
+    RecordId next_id;   // First slot never handed out
+} PagedTable;
+
+// -- String Dictionary --
+// Every distinct value of the dictionary-encoded columns, stored once and
+// numbered in order of first use. Codes are never reused or renumbered, so a
+// code read from a row decodes without the lock: the row was written after
+// its code was published, and its table lock orders the two. The lock itself
+// is a leaf; str_intern is called with table locks held.
+//
+// Entries are never freed, so what clients write is capped per column
+// (str_admit). Rows stored by any path count their values against their
+// column (str_count_use), so a restart does not reset the caps.
+enum { STR_COL_TYPE, STR_COL_LOCATION, STR_COL_BOOKING_STATUS, STR_COL_PAYMENT_STATUS, STR_COLUMNS };
+
+#define STR_CANCELLED 1 // Starts with "Cancel": the booking does not hold its slot
+#define STR_PAID 2      // "Paid" in any case
+
+typedef struct
+{
+    StrCode code;
+    uint32_t length;
+    uint8_t flags;   // STR_CANCELLED / STR_PAID, worked out once
+    _Atomic uint8_t columns; // Bit per STR_COL_* column that holds it (set under the write lock)
+    char text[];
+} StrEntry;
+
+typedef struct
+{
+    pthread_rwlock_t lock;              // Guards 'index' and appends
+    HashIndex index;                    // hash_string(text) -> StrEntry
+    StrEntry **blocks[STR_MAX_BLOCKS];  // Code -> entry, 1 << STR_BLOCK_BITS per block
+    uint32_t count;
+    uint32_t column_counts[STR_COLUMNS]; // Values each column has admitted
+    size_t bytes;                       // Entries plus blocks
+
+    // Counters
+    _Atomic unsigned long interns;      // Encodes (each one a lookup)
+} StringDictionary;
+
+// -- Workspace Schedule --
+// Occupying bookings of one workspace, sorted by start time. max_len is the
+// longest interval listed, so every booking overlapping [from, to) starts in
+// [from - max_len, to) and a binary search finds the first candidate. It is
+// recomputed when the last booking of that length leaves, so one long
+// booking that was cancelled does not widen every later search.
+typedef struct WorkspaceSchedule
 {
-    MemberNode *target;     // Pointer to the actual data node
-    struct IndexNode *next; // Chaining for collisions
-} IndexNode;
+    int workspaceId;
+    BookingNode **items;
+    size_t count, capacity;
+    int64_t max_len;
+    size_t max_holders; // Listed bookings max_len long
+    struct WorkspaceSchedule *next; // All schedules, for cleanup
+} WorkspaceSchedule;
 
 // -- Global List Pointers --
-MemberNode *member_head = NULL, *member_tail = NULL;
+MemberStripe member_stripes[MEMBER_STRIPES]; // Member list, email index and slab per stripe
+IdMap member_ids; // memberId -> MemberNode, read without locks
 WorkspaceNode *workspace_head = NULL, *workspace_tail = NULL;
-BookingNode *booking_head = NULL, *booking_tail = NULL;
-PaymentNode *payment_head = NULL, *payment_tail = NULL;
+// Bookings and payments are scanned by slot: see first_booking / next_booking
+
+// -- Global Hash Maps (one per table) --
+HashIndex workspace_index, booking_index, payment_index;
+
+// -- String Dictionary (codes of the encoded text columns) --
+StringDictionary strings = { .lock = PTHREAD_RWLOCK_INITIALIZER };
+
+// -- Secondary Indexes --
+HashIndex schedule_index;     // workspaceId -> WorkspaceSchedule (guarded by bookings_lock)
+WorkspaceSchedule *schedule_list = NULL;
+
+// -- Reverse Foreign-Key Indexes (parent id -> first child) --
+HashIndex bookings_by_member;    // memberId -> BookingNode (guarded by bookings_lock)
+HashIndex bookings_by_workspace; // workspaceId -> BookingNode (guarded by bookings_lock)
+HashIndex payments_by_booking;   // bookingId -> PaymentNode (guarded by payments_lock)
+int fk_delete_policy = FK_RESTRICT; // FLEXDESK_FK_DELETE=restrict|cascade
+
+// -- Ordered Indexes (range scans by time) --
+OrderedIndex bookings_by_start; // (start_min, bookingId) -> BookingNode (guarded by bookings_lock)
+OrderedIndex payments_by_date;  // (paid_day, paymentId) -> PaymentNode (guarded by payments_lock)
+unsigned long booking_conflicts = 0; // Bookings rejected for overlapping
 
-// -- Global Hash Map --
-IndexNode *member_index[INDEX_SIZE]; // Array of pointers (Buckets)
+// -- Materialized Aggregates (each guarded by its table's lock) --
+MatAggregate mat_aggregates[MAT_AGGREGATES];
+int mat_live = 1; // Storage helpers apply deltas (off during a parallel CSV load)
+
+// -- Transactions --
+atomic_ullong record_clock; // Last row version handed out (versions are never reused)
+atomic_ulong txn_begun, txn_committed, txn_retries;
+atomic_ulong txn_aborted; // Stale read found at commit
+atomic_ulong txn_failed;  // Reads were current but a write broke a constraint
+
+// -- Per-Table Slabs --
+Slab workspace_slab; // Booking and payment nodes live in their PagedTable
+
+// -- Paged Rows --
+BufferPool pool = { .fd = -1 };
+PagedTable booking_pages, payment_pages;
 
 /* * ==========================================
  * CONCURRENCY CONTROL
  * ==========================================
  */
-pthread_rwlock_t members_lock, workspaces_lock, bookings_lock, payments_lock;
+pthread_rwlock_t workspaces_lock, bookings_lock, payments_lock; // Members lock per stripe
 pthread_mutex_t log_mutex;
 
-int next_member_id = 1, next_workspace_id = 1, next_booking_id = 1, next_payment_id = 1;
+WriteAheadLog wal = { .fd = -1 };
+// Batch mode: while set, wal_commit only notes the LSN and wal_commit_deferred()
+// later makes the whole group durable with one fsync
+_Thread_local int wal_defer_commits = 0;
+static _Thread_local uint64_t wal_deferred_lsn = 0;
+AuditLogger audit_log = { .fd = -1 };
+
+atomic_int next_member_id = 1; // Member inserts hold only their own stripes
+int next_workspace_id = 1, next_booking_id = 1, next_payment_id = 1;
 
 // -- Forward Declarations --
+void init_database();
 void load_all_data();
 void save_all_data();
 void free_all_lists();
+void reset_all_tables();
+
+// Persistence
+uint64_t checksum64(const void *data, size_t len);
+int load_snapshot(const char *path);
+int save_snapshot(const char *path);
+void load_csv_data();
+void csv_print_load_stats();
+void save_csv_data();
+void sync_directory();
+
+// Write-Ahead Log
+int wal_open();
+void wal_close();
+uint64_t wal_append(uint8_t op, uint8_t table, const void *payload, uint32_t length);
+void wal_commit(uint64_t lsn);
+void wal_commit_deferred();
+void wal_recover();
+int wal_checkpoint();
+void wal_rotate();
+
+// Background Save
+enum { BGSAVE_STARTED = 0, BGSAVE_BUSY = 1, BGSAVE_FAILED = -1 };
+int bgsave_start();
+int bgsave_wait();
+void bgsave_print_stats();
+void wal_print_stats();
 void log_operation(const char *message);
+int logger_start();
+void logger_stop();
+void logger_print_stats();
+void show_system_stats();
+void backgroundSave();
+
+// Member Stripes
+MemberStripe *member_stripe(int memberId);
+MemberStripe *email_stripe(const char *email);
+void member_wrlock_pair(MemberStripe *a, MemberStripe *b);
+void member_unlock_pair(MemberStripe *a, MemberStripe *b);
+void members_rdlock_all();
+void members_unlock_all();
+size_t member_count();
+void member_tables_init();
+void member_tables_free();
+void member_rows_free();
+void member_print_slab_stats();
+void member_print_heap_stats();
+void member_print_index_stats();
+
+// Buffer Pool
+void pool_init();
+unsigned char *pool_pin(uint32_t page);
+void pool_unpin(uint32_t page, int dirty);
+uint32_t pool_new_page();
+void pool_counters(unsigned long *hits, unsigned long *misses);
+void pool_begin_shadow_locked();
+void pool_end_shadow();
+void pool_reset();
+void pool_print_stats();
+void paged_table_init(PagedTable *table, const char *name, size_t record_size, size_t node_size);
+RecordId paged_alloc(PagedTable *table);
+void *paged_node(const PagedTable *table, RecordId rid);
+void paged_free(PagedTable *table, RecordId rid);
+void paged_read(PagedTable *table, RecordId rid, void *out);
+void paged_write(PagedTable *table, RecordId rid, const void *record);
+void paged_table_reset(PagedTable *table);
+void booking_read(const BookingNode *node, Booking *out);
+void payment_read(const PaymentNode *node, Payment *out);
+BookingNode *booking_at(RecordId rid);
+PaymentNode *payment_at(RecordId rid);
+BookingNode *first_booking();
+int64_t booking_end(const BookingNode *node);
+BookingNode *next_booking(const BookingNode *node);
+PaymentNode *first_payment();
+PaymentNode *next_payment(const PaymentNode *node);
+
+// String Dictionary
+StrCode str_intern(const char *text);
+DbStatus str_admit(int column, const char *text, StrCode *code);
+void str_count_use(StrCode code, int column);
+const char *str_text(StrCode code);
+int str_flags(StrCode code);
+uint32_t str_count();
+void workspace_encode(const Workspace *row, WorkspaceRecord *out);
+void workspace_decode(const WorkspaceRecord *record, Workspace *out);
+void booking_encode(const Booking *row, BookingRecord *out);
+void booking_decode(const BookingRecord *record, Booking *out);
+void payment_encode(const Payment *row, PaymentRecord *out);
+void payment_decode(const PaymentRecord *record, Payment *out);
+void str_print_stats();
+
+// Lock-Free Reads
+int epoch_enter();
+void epoch_exit();
+uint64_t epoch_retire_stamp();
+uint64_t epoch_oldest_reader();
+void epoch_print_stats();
+void *id_map_find(IdMap *map, int id);
+void id_map_store(IdMap *map, int id, void *node);
+void id_map_free(IdMap *map);
+
+// Table Snapshots
+void table_snapshot(int table, TableSnapshot *snap);
+enum { COPY_ROWS, COPY_RECORDS }; // Interface structs / stored form
+void database_snapshot(TableSnapshot snaps[SNAP_TABLES], int form);
+void table_snapshot_free(TableSnapshot *snap);
+void snapshot_print_stats();
+
+// Slab Allocator
+void slab_init(Slab *slab, const char *name, size_t node_size);
+void *slab_alloc(Slab *slab);
+void slab_free(Slab *slab, void *node);
+void slab_release(Slab *slab);
+void slab_print_stats(const Slab *slab);
 
 // Indexing Functions
-int hash_function(int id);
-void add_to_index(MemberNode *node);
-void remove_from_index(int id);
+uint64_t hash_function(uint64_t key);
+void index_init(HashIndex *idx, const char *name);
+void index_insert(HashIndex *idx, uint64_t key, void *target);
+void index_remove(HashIndex *idx, uint64_t key);
+void *index_find(HashIndex *idx, uint64_t key);
+void *index_find_match(HashIndex *idx, uint64_t key, IndexMatchFn match, const void *ctx);
+void index_remove_target(HashIndex *idx, uint64_t key, void *target);
+uint64_t hash_string(const char *str);
+void index_free(HashIndex *idx);
+size_t index_count(const HashIndex *idx);
+void index_print_stats(const HashIndex *idx);
+void index_reserve(HashIndex *idx, size_t entries);
 void free_index();
 
 // CRUD Prototypes
@@ -124,42 +1072,190 @@ void displayAllMembers();
 void updateMember();
 void deleteMember();
 MemberNode *findMemberNodeById(int id);
+MemberNode *findMemberNodeByEmail(const char *email);
+void findMemberByEmail();
+MemberNode *insert_member_node(const Member *data);
+void remove_member_node(MemberNode *node);
+void replace_member_node(MemberNode *old, MemberNode *fresh);
 
 void addWorkspace();
 void displayAllWorkspaces();
 void updateWorkspace();
 void deleteWorkspace();
 WorkspaceNode *findWorkspaceNodeById(int id);
+WorkspaceNode *insert_workspace_node(const Workspace *data);
+WorkspaceNode *insert_workspace_record(const WorkspaceRecord *data);
+void remove_workspace_node(WorkspaceNode *node);
 
 void addBooking();
 void displayAllBookings();
 void updateBooking();
 void deleteBooking();
 BookingNode *findBookingNodeById(int id);
+BookingNode *insert_booking_node(const Booking *data);
+BookingNode *insert_booking_record(const BookingRecord *data);
+void remove_booking_node(BookingNode *node);
+void set_booking_data(BookingNode *node, const Booking *data);
+void set_booking_record(BookingNode *node, const BookingRecord *data);
+void showWorkspaceOccupancy();
+void showBookingsInRange();
+
+// Booking Schedule
+int64_t parse_booking_time(const char *text);
+void schedule_add(BookingNode *node);
+void schedule_remove(BookingNode *node);
+BookingNode *schedule_find_conflict(int workspaceId, int64_t start, int64_t end, int excludeId);
+void schedule_free();
+void schedule_print_stats();
+
+// Ordered Indexes
+int64_t parse_payment_date(const char *text);
+void ordered_init(OrderedIndex *idx, const char *name);
+void ordered_insert(OrderedIndex *idx, int64_t time, int id, void *target);
+int ordered_remove(OrderedIndex *idx, int64_t time, int id);
+void ordered_seek(const OrderedIndex *idx, int64_t time, int id, OrderedCursor *cursor);
+void ordered_seek_after(const OrderedIndex *idx, const OrderedKey *after, OrderedCursor *cursor);
+void *ordered_next(OrderedCursor *cursor, OrderedKey *key);
+void ordered_free(OrderedIndex *idx);
+void ordered_print_stats(const OrderedIndex *idx);
+
+// Referential Integrity
+BookingNode *first_booking_of(int list, int parentId);
+PaymentNode *first_payment_of(int bookingId);
+void booking_fk_link(BookingNode *node);
+void booking_fk_unlink(BookingNode *node);
+void payment_fk_link(PaymentNode *node);
+void payment_fk_unlink(PaymentNode *node);
+int count_bookings_of(int list, int parentId);
+int count_payments_of(int bookingId);
+int cascade_delete_payments(int bookingId, uint64_t *lsn);
+int cascade_delete_bookings(int list, int parentId, uint64_t *lsn, int *payments);
 
 void addPayment();
 void displayAllPayments();
 void updatePayment();
 void deletePayment();
 PaymentNode *findPaymentNodeById(int id);
+PaymentNode *insert_payment_node(const Payment *data);
+PaymentNode *insert_payment_record(const PaymentRecord *data);
+void remove_payment_node(PaymentNode *node);
+void set_payment_data(PaymentNode *node, const Payment *data);
+void set_payment_record(PaymentNode *node, const PaymentRecord *data);
+void showPaymentsInRange();
+
+// CRUD Core (no prompts; used by the menu, benchmarks and tools)
+const char *db_status_name(DbStatus status);
+DbStatus db_add_member(const char *name, const char *email, int *newId);
+DbStatus db_get_member(int id, Member *out);
+DbStatus db_find_member_by_email(const char *email, Member *out);
+DbStatus db_update_member(int id, const char *name);
+DbStatus db_delete_member(int id, DbDeleteInfo *info);
+DbStatus db_add_workspace(const char *type, const char *location, int capacity, int price_in_cents, int *newId);
+DbStatus db_get_workspace(int id, Workspace *out);
+DbStatus db_update_workspace(int id, int capacity, int price_in_cents);
+DbStatus db_delete_workspace(int id, DbDeleteInfo *info);
+DbStatus db_add_booking(int memberId, int workspaceId, const char *startTime, const char *endTime,
+                        const char *status, int *newId, int *conflictId);
+DbStatus db_get_booking(int id, Booking *out);
+DbStatus db_update_booking(int id, const char *status, int *conflictId);
+DbStatus db_delete_booking(int id, DbDeleteInfo *info);
+DbStatus db_add_payment(int bookingId, int amount_in_cents, const char *paymentDate, const char *status, int *newId);
+DbStatus db_get_payment(int id, Payment *out);
+DbStatus db_update_payment(int id, const char *status);
+DbStatus db_delete_payment(int id);
+int db_workspace_occupancy(int workspaceId, int64_t from, int64_t to, Booking *out, int max);
+int db_member_bookings(int memberId, Booking *out, int max);
+int db_booking_payments(int bookingId, Payment *out, int max);
+int db_bookings_starting(int64_t from, int64_t to, OrderedKey *cursor, Booking *out, int max, int *more);
+int db_payments_dated(int64_t from, int64_t to, OrderedKey *cursor, Payment *out, int max, int *more);
+
+// Query Engine
+DbStatus db_query(const char *text, QueryResult *result);
+void query_result_free(QueryResult *result);
+void runQuery();
+
+// Hash Join
+void hash_join(const JoinTuple *left, size_t left_count, const JoinTuple *right, size_t right_count,
+               int threads, JoinMatchFn match, void *ctx, JoinStats *stats);
+int join_default_threads();
+void db_reconcile_billing(ReconcileReport *report, int threads);
+void reconcile_report_free(ReconcileReport *report);
+void showBillingReconciliation();
+
+// Materialized Aggregates
+void mat_aggregates_init();
+void mat_aggregates_free();
+void mat_aggregates_rebuild();
+void mat_booking_changed(const BookingNode *node, int sign);
+void mat_payment_changed(const PaymentNode *node, const PaymentRecord *row, int sign);
+DbStatus db_aggregate_get(const char *name, int key, int64_t *count, int64_t *sum);
+DbStatus db_aggregate_total(const char *name, int64_t *count, int64_t *sum);
+size_t mat_aggregates_verify(MatVerifyReport *report);
+void mat_print_stats();
+void showDashboardTotals();
+void verifyAggregates();
+
+// Transactions
+uint64_t record_version_next();
+void txn_begin(Txn *txn);
+void txn_abort(Txn *txn);
+DbStatus txn_get_member(Txn *txn, int id, Member *out);
+DbStatus txn_get_workspace(Txn *txn, int id, Workspace *out);
+DbStatus txn_get_booking(Txn *txn, int id, Booking *out);
+DbStatus txn_get_payment(Txn *txn, int id, Payment *out);
+DbStatus txn_update_workspace(Txn *txn, int id, int capacity, int price_in_cents);
+DbStatus txn_add_booking(Txn *txn, int memberId, int workspaceId, const char *startTime, const char *endTime,
+                         const char *status, int *newId);
+DbStatus txn_update_booking(Txn *txn, int id, const char *status);
+DbStatus txn_delete_booking(Txn *txn, int id);
+DbStatus txn_add_payment(Txn *txn, int bookingId, int amount_in_cents, const char *paymentDate, const char *status,
+                         int *newId);
+DbStatus txn_update_payment(Txn *txn, int id, const char *status);
+DbStatus txn_delete_payment(Txn *txn, int id);
+DbStatus txn_commit(Txn *txn);
+DbStatus txn_commit_retry(Txn *txn, TxnBody body, void *ctx);
+DbStatus txn_run(TxnBody body, void *ctx);
+void txn_print_stats();
 
 void run_concurrency_test();
 
-int main()
+// Command-Line Tools
+long long now_ns();
+int run_command_line(int argc, char *argv[]);
+void run_index_benchmark(int n);
+void run_startup_benchmark(int n);
+void run_range_benchmark(int n);
+void run_join_benchmark(int n);
+void run_aggregate_benchmark(int n);
+void run_txn_benchmark(int n);
+int crud_bench_tool(int argc, char *argv[]);
+int batch_tool(int argc, char *argv[]);
+int server_tool(int argc, char *argv[]);
+int loadtest_tool(int argc, char *argv[]);
+
+// Command Dispatcher (batch mode and server)
+void out_printf(OutBuffer *out, const char *fmt, ...);
+int execute_command(char *line, OutBuffer *out, CommandSession *session);
+
+int main(int argc, char *argv[])
 {
-    // 1. Initialize Locks
-    pthread_rwlock_init(&members_lock, NULL);
-    pthread_rwlock_init(&workspaces_lock, NULL);
-    pthread_rwlock_init(&bookings_lock, NULL);
-    pthread_rwlock_init(&payments_lock, NULL);
-    pthread_mutex_init(&log_mutex, NULL);
+    // Headless tools (benchmarks etc.) run instead of the interactive menu
+    if (argc > 1)
+        return run_command_line(argc, argv);
 
-    // 2. Initialize Hash Map
-    for(int i = 0; i < INDEX_SIZE; i++) member_index[i] = NULL;
+    // 1-2. Initialize Locks, Hash Maps and Slabs
+    init_database();
 
-    // 3. Load initial state
+    // 3. Load initial state (snapshot + WAL replay), then start logging
+    if (logger_start() != 0)
+        printf("Warning: audit logger unavailable, logging synchronously.\n");
     log_operation("System Started");
     load_all_data();
+    if (wal_open() != 0)
+    {
+        printf("Error: cannot open %s for writing.\n", WAL_FILE);
+        return 1;
+    }
 
     int choice = 0;
     while (1)
@@ -170,17 +1266,26 @@ int main()
         printf("--- Members ---\n");
         printf("  1. Add Member        2. Display Members\n");
         printf("  3. Update Member     4. Delete Member\n");
+        printf("  17. Find Member by Email\n");
         printf("--- Workspaces ---\n");
         printf("  5. Add Workspace     6. Display Workspaces\n");
         printf("  7. Update Workspace  8. Delete Workspace\n");
         printf("--- Bookings ---\n");
         printf("  9. Add Booking       10. Display Bookings\n");
         printf("  11. Update Booking   12. Delete Booking\n");
+        printf("  18. Workspace Occupancy  19. Bookings by Start Time\n");
         printf("--- Payments ---\n");
         printf("  13. Add Payment      14. Display Payments\n");
         printf("  15. Update Payment   16. Delete Payment\n");
+        printf("  20. Payments by Date\n");
+        printf("--- Reports ---\n");
+        printf("  21. Run Query (SELECT ... FROM ...)\n");
+        printf("  22. Billing Reconciliation (expected vs paid)\n");
+        printf("  23. Dashboard Totals     24. Verify Aggregates\n");
         printf("----------------------------------------\n");
-        printf("  88. RUN CONCURRENCY TEST (Demo)\n");
+        printf("  77. SHOW SYSTEM STATS\n");
+        printf("  78. BACKGROUND SAVE (BGSAVE)\n");
+        printf("  88. RUN CONCURRENCY BENCHMARK\n");
         printf("  99. Save & Exit\n");
         printf("========================================\n");
         printf("> ");
@@ -209,6 +1314,22 @@ int main()
         case 14: displayAllPayments(); break;
         case 15: updatePayment(); break;
         case 16: deletePayment(); break;
+        case 17: findMemberByEmail(); break;
+        case 18: showWorkspaceOccupancy(); break;
+        case 19: showBookingsInRange(); break;
+        case 20: showPaymentsInRange(); break;
+        case 21: runQuery(); break;
+        case 22: showBillingReconciliation(); break;
+        case 23: showDashboardTotals(); break;
+        case 24: verifyAggregates(); break;
+
+        case 77:
+            show_system_stats();
+            break;
+
+        case 78:
+            backgroundSave();
+            break;
 
         case 88:
             run_concurrency_test();
@@ -217,11 +1338,14 @@ int main()
         case 99:
             save_all_data();
             free_all_lists();
-            free_index(); // Clean up index memory
+            free_index(); // Clean up index memory (all four tables)
+            wal_close();
             log_operation("System Shutdown");
+            logger_stop(); // Drains everything still queued
             printf("All data saved. Exiting ...\n");
 
-            pthread_rwlock_destroy(&members_lock);
+            for (int i = 0; i < MEMBER_STRIPES; i++)
+                pthread_rwlock_destroy(&member_stripes[i].lock);
             pthread_rwlock_destroy(&workspaces_lock);
             pthread_rwlock_destroy(&bookings_lock);
             pthread_rwlock_destroy(&payments_lock);
@@ -231,16 +1355,73 @@ int main()
             printf("Invalid choice. Please try again.\n");
         }
     }
+
+    // Input closed without 99: nothing is saved, but flush the log and WAL
+    bgsave_wait();
+    logger_stop();
+    wal_close();
     return 0;
 }
 
 //  HELPER & GENERIC FUNCTIONS
 
+void init_database()
+{
+    // 1. Initialize Locks
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+        pthread_rwlock_init(&member_stripes[i].lock, NULL);
+    pthread_rwlock_init(&workspaces_lock, NULL);
+    pthread_rwlock_init(&bookings_lock, NULL);
+    pthread_rwlock_init(&payments_lock, NULL);
+    pthread_mutex_init(&log_mutex, NULL);
+
+    // 2. Initialize Hash Maps (member indexes and slabs live in the stripes)
+    member_tables_init();
+    index_init(&workspace_index, "Workspace Index");
+    index_init(&booking_index, "Booking Index");
+    index_init(&payment_index, "Payment Index");
+    index_init(&schedule_index, "Schedule Index");
+    index_init(&bookings_by_member, "Bookings/Member");
+    index_init(&bookings_by_workspace, "Bookings/Space");
+    index_init(&payments_by_booking, "Payments/Booking");
+    ordered_init(&bookings_by_start, "Bookings/Start");
+    ordered_init(&payments_by_date, "Payments/Date");
+    mat_aggregates_init();
+    index_init(&strings.index, "Strings"); // Kept for the whole run, like the codes
+
+    // 2b. Initialize Slab Allocators
+    slab_init(&workspace_slab, "Workspaces", sizeof(WorkspaceNode));
+
+    // 2c. Page store for booking and payment rows
+    pool_init();
+    paged_table_init(&booking_pages, "Bookings", sizeof(BookingRecord), sizeof(BookingNode));
+    paged_table_init(&payment_pages, "Payments", sizeof(PaymentRecord), sizeof(PaymentNode));
+
+    // 2d. Referential action for deletes with dependents
+    const char *policy = getenv("FLEXDESK_FK_DELETE");
+    fk_delete_policy = policy && strcmp(policy, "cascade") == 0 ? FK_CASCADE : FK_RESTRICT;
+}
+
+// Lines that do not fit are refused and asked for again, never cut short
 void getString(const char *prompt, char *buffer, int size)
 {
     printf("%s", prompt);
-    fgets(buffer, size, stdin);
-    buffer[strcspn(buffer, "\n")] = 0;
+    while (fgets(buffer, size, stdin))
+    {
+        size_t len = strcspn(buffer, "\n");
+        if (buffer[len] == '\n')
+        {
+            buffer[len] = 0;
+            return;
+        }
+        int c = getchar();
+        if (c == '\n' || c == EOF) // Exactly filled the buffer
+            return;
+        while (c != '\n' && c != EOF)
+            c = getchar();
+        printf("Too long (max %d characters). Try again: ", size - 1);
+    }
+    buffer[0] = 0;
 }
 
 int getInt(const char *prompt)
@@ -256,7 +1437,8 @@ int getInt(const char *prompt)
     return value;
 }
 
-void log_operation(const char *message)
+// Synchronous path, used only while the background logger is not running
+static void log_operation_sync(const char *message)
 {
     pthread_mutex_lock(&log_mutex);
     FILE *f = fopen(LOG_FILE, "a");
@@ -271,813 +1453,11417 @@ void log_operation(const char *message)
     pthread_mutex_unlock(&log_mutex);
 }
 
-/* * ==========================================
- * HASH MAP IMPLEMENTATION
- * ==========================================
- */
-
-// Simple Modulo Hash
-int hash_function(int id) {
-    return id % INDEX_SIZE;
-}
-
-// Add a MemberNode pointer to the index
-void add_to_index(MemberNode *node) {
-    if (!node) return;
-    int index = hash_function(node->data.memberId);
-
-    IndexNode *newIndexNode = (IndexNode*)malloc(sizeof(IndexNode));
-    newIndexNode->target = node;
-
-    // Insert at head of the bucket (Chain)
-    newIndexNode->next = member_index[index];
-    member_index[index] = newIndexNode;
-}
+// Queue an audit line. Never touches the disk, so it is cheap to call while
+// holding a table lock; when the ring is full the configured policy applies.
+void log_operation(const char *message)
+{
+    if (!atomic_load_explicit(&audit_log.running, memory_order_acquire))
+    {
+        log_operation_sync(message);
+        return;
+    }
 
-// Remove an entry from the index
-void remove_from_index(int id) {
-    int index = hash_function(id);
-    IndexNode *current = member_index[index];
-    IndexNode *prev = NULL;
-
-    while (current != NULL) {
-        if (current->target->data.memberId == id) {
-            // Found it
-            if (prev == NULL) {
-                // Head of bucket
-                member_index[index] = current->next;
-            } else {
-                // Middle of bucket
-                prev->next = current->next;
+    size_t pos = atomic_load_explicit(&audit_log.head, memory_order_relaxed);
+    LogSlot *slot;
+    while (1)
+    {
+        slot = &audit_log.slots[pos & (LOG_QUEUE_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&audit_log.head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Ring is full
+            if (audit_log.policy == LOG_POLICY_DROP)
+            {
+                atomic_fetch_add(&audit_log.dropped, 1);
+                return;
             }
-            free(current);
-            return;
+            atomic_fetch_add(&audit_log.blocked, 1);
+            pthread_cond_signal(&audit_log.wake_cond);
+            usleep(100);
+            pos = atomic_load_explicit(&audit_log.head, memory_order_relaxed);
         }
-        prev = current;
-        current = current->next;
+        else
+            pos = atomic_load_explicit(&audit_log.head, memory_order_relaxed);
     }
-}
 
-// Free all index memory on exit
-void free_index() {
-    for (int i = 0; i < INDEX_SIZE; i++) {
-        IndexNode *curr = member_index[i];
-        while (curr) {
-            IndexNode *temp = curr;
-            curr = curr->next;
-            free(temp);
-        }
-    }
+    slot->timestamp = time(NULL);
+    strncpy(slot->message, message, LOG_MESSAGE_MAX - 1);
+    slot->message[LOG_MESSAGE_MAX - 1] = 0;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    atomic_fetch_add_explicit(&audit_log.enqueued, 1, memory_order_relaxed);
+
+    size_t depth = pos + 1 - atomic_load_explicit(&audit_log.tail, memory_order_relaxed);
+    size_t max_depth = atomic_load_explicit(&audit_log.max_depth, memory_order_relaxed);
+    while (depth > max_depth &&
+           !atomic_compare_exchange_weak(&audit_log.max_depth, &max_depth, depth))
+        ;
+    // Wake the drain thread early once the ring is half full
+    if (depth == LOG_QUEUE_SIZE / 2)
+        pthread_cond_signal(&audit_log.wake_cond);
 }
 
 /* * ==========================================
- * MEMBER FUNCTIONS (Updated with Indexing)
+ * AUDIT LOGGER
  * ==========================================
  */
 
-// O(1) Lookup - The "Next Level" Upgrade
-MemberNode *findMemberNodeById(int id)
+// Formats and writes everything currently queued with one write() per 64KB
+static void logger_drain()
 {
-    int index = hash_function(id);
-    IndexNode *curr = member_index[index];
+    char batch[64 * 1024];
+    size_t used = 0;
+    time_t cached_time = 0;
+    char time_str[32] = "";
+    size_t tail = atomic_load_explicit(&audit_log.tail, memory_order_relaxed);
 
-    // Traverse the bucket (usually 1 or 2 items max)
-    while (curr != NULL) {
-        if (curr->target->data.memberId == id) {
-            return curr->target;
+    while (1)
+    {
+        LogSlot *slot = &audit_log.slots[tail & (LOG_QUEUE_SIZE - 1)];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != tail + 1)
+            break; // Empty (or the producer has not finished filling it yet)
+
+        // ctime_r is relatively slow: format each distinct second once
+        if (slot->timestamp != cached_time)
+        {
+            cached_time = slot->timestamp;
+            ctime_r(&cached_time, time_str);
+            time_str[strcspn(time_str, "\n")] = 0;
         }
-        curr = curr->next;
+        if (used + LOG_MESSAGE_MAX + sizeof(time_str) + 16 > sizeof(batch))
+        {
+            if (write(audit_log.fd, batch, used) < 0)
+                perror("Audit log write failed");
+            atomic_fetch_add(&audit_log.batches, 1);
+            used = 0;
+        }
+        used += (size_t)snprintf(batch + used, sizeof(batch) - used, "[%s] LOG: %s\n", time_str, slot->message);
+
+        // Hand the slot back to producers for the next lap of the ring
+        atomic_store_explicit(&slot->sequence, tail + LOG_QUEUE_SIZE, memory_order_release);
+        tail++;
+        atomic_store_explicit(&audit_log.tail, tail, memory_order_relaxed);
+        atomic_fetch_add(&audit_log.written, 1);
+    }
+
+    if (used > 0)
+    {
+        if (write(audit_log.fd, batch, used) < 0)
+            perror("Audit log write failed");
+        atomic_fetch_add(&audit_log.batches, 1);
     }
-    // Note: No linear search of member_head needed anymore!
-    return NULL;
 }
 
-void addMember()
+static void *logger_thread(void *arg)
 {
-    MemberNode *newNode = (MemberNode *)malloc(sizeof(MemberNode));
-    newNode->next = newNode->prev = NULL;
-    getString("Enter name: ", newNode->data.name, 100);
-    getString("Enter email: ", newNode->data.email, 100);
-
-    pthread_rwlock_wrlock(&members_lock);
-
-    // Check duplicate email (still O(N) unless we add a second index for email!)
-    MemberNode *curr = member_head;
-    int emailExists = 0;
-    while(curr != NULL) {
-        if(strcmp(curr->data.email, newNode->data.email) == 0) {
-            emailExists = 1;
-            break;
+    (void)arg;
+    pthread_mutex_lock(&audit_log.wake_mutex);
+    while (atomic_load(&audit_log.running))
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += audit_log.flush_interval_ms / 1000;
+        deadline.tv_nsec += (long)(audit_log.flush_interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
         }
-        curr = curr->next;
-    }
+        pthread_cond_timedwait(&audit_log.wake_cond, &audit_log.wake_mutex, &deadline);
 
-    if (emailExists) {
-        printf("Error: Email already exists.\n");
-        free(newNode);
-        pthread_rwlock_unlock(&members_lock);
-        return;
+        pthread_mutex_unlock(&audit_log.wake_mutex);
+        logger_drain();
+        pthread_mutex_lock(&audit_log.wake_mutex);
     }
+    pthread_mutex_unlock(&audit_log.wake_mutex);
+    logger_drain(); // Whatever arrived while shutting down
+    return NULL;
+}
 
-    newNode->data.memberId = next_member_id++;
-
-    // 1. Add to Main List (Storage)
-    if (!member_head)
-        member_head = member_tail = newNode;
-    else
+int logger_start()
+{
+    audit_log.fd = open(LOG_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (audit_log.fd < 0)
+        return -1;
+
+    const char *interval = getenv("FLEXDESK_LOG_FLUSH_MS");
+    audit_log.flush_interval_ms = interval && atoi(interval) > 0 ? atoi(interval) : LOG_FLUSH_INTERVAL_MS;
+    const char *policy = getenv("FLEXDESK_LOG_POLICY");
+    audit_log.policy = policy && strcmp(policy, "block") == 0 ? LOG_POLICY_BLOCK : LOG_POLICY_DROP;
+
+    for (size_t i = 0; i < LOG_QUEUE_SIZE; i++)
+        atomic_init(&audit_log.slots[i].sequence, i);
+    atomic_init(&audit_log.head, 0);
+    atomic_init(&audit_log.tail, 0);
+    pthread_mutex_init(&audit_log.wake_mutex, NULL);
+    pthread_cond_init(&audit_log.wake_cond, NULL);
+
+    atomic_store(&audit_log.running, 1);
+    if (pthread_create(&audit_log.thread, NULL, logger_thread, NULL) != 0)
     {
-        member_tail->next = newNode;
-        newNode->prev = member_tail;
-        member_tail = newNode;
+        atomic_store(&audit_log.running, 0);
+        close(audit_log.fd);
+        audit_log.fd = -1;
+        return -1;
     }
-
-    // 2. Add to Hash Index (Lookup)
-    add_to_index(newNode);
-
-    char logMsg[150];
-    sprintf(logMsg, "Added Member ID %d (%s)", newNode->data.memberId, newNode->data.name);
-    log_operation(logMsg);
-
-    pthread_rwlock_unlock(&members_lock);
-    printf("Member added with ID %d.\n", newNode->data.memberId);
+    return 0;
 }
 
-void displayAllMembers()
+void logger_stop()
 {
-    printf("\n--- All Members ---\n%-5s | %-30s | %-30s\n", "ID", "Name", "Email");
-    printf("------|--------------------------------|--------------------------------\n");
+    if (!atomic_load(&audit_log.running)) return;
+
+    pthread_mutex_lock(&audit_log.wake_mutex);
+    atomic_store(&audit_log.running, 0);
+    pthread_cond_signal(&audit_log.wake_cond);
+    pthread_mutex_unlock(&audit_log.wake_mutex);
+    pthread_join(audit_log.thread, NULL);
+
+    close(audit_log.fd);
+    audit_log.fd = -1;
+    pthread_cond_destroy(&audit_log.wake_cond);
+    pthread_mutex_destroy(&audit_log.wake_mutex);
+}
 
-    pthread_rwlock_rdlock(&members_lock);
-    // Iterate the main list for display (Indices are not good for iteration)
-    for (MemberNode *curr = member_head; curr != NULL; curr = curr->next)
+void logger_print_stats()
+{
+    printf("\n--- Audit Logger ---\n");
+    if (!atomic_load(&audit_log.running))
     {
-        printf("%-5d | %-30s | %-30s\n", curr->data.memberId, curr->data.name, curr->data.email);
+        printf("Background logger is not running (synchronous mode).\n");
+        return;
     }
-    pthread_rwlock_unlock(&members_lock);
+    size_t head = atomic_load(&audit_log.head);
+    size_t tail = atomic_load(&audit_log.tail);
+    printf("Queue depth: %zu/%d (max %zu) | Enqueued: %lu | Written: %lu | Batches: %lu | Dropped: %lu | Blocked: %lu\n",
+           head - tail, LOG_QUEUE_SIZE, (size_t)atomic_load(&audit_log.max_depth),
+           (unsigned long)atomic_load(&audit_log.enqueued), (unsigned long)atomic_load(&audit_log.written),
+           (unsigned long)atomic_load(&audit_log.batches),
+           (unsigned long)atomic_load(&audit_log.dropped), (unsigned long)atomic_load(&audit_log.blocked));
+    printf("Flush interval: %d ms | Full-queue policy: %s\n", audit_log.flush_interval_ms,
+           audit_log.policy == LOG_POLICY_BLOCK ? "block" : "drop");
 }
 
-void updateMember()
-{
-    int id = getInt("Enter ID of member to update: ");
-
-    pthread_rwlock_wrlock(&members_lock);
-    MemberNode *node = findMemberNodeById(id); // Uses Index O(1)
-    if (node)
-    {
-        printf("Updating Member ID %d (Name: %s)\n", id, node->data.name);
-        getString("Enter new name (or Enter to skip): ", node->data.name, 100);
+/* * ==========================================
+ * SLAB ALLOCATOR
+ * ==========================================
+ */
 
-        char logMsg[100];
-        sprintf(logMsg, "Updated Member ID %d", id);
-        log_operation(logMsg);
-        printf("Member ID %d updated.\n", id);
-    }
-    else
-        printf("Member not found.\n");
-    pthread_rwlock_unlock(&members_lock);
+void slab_init(Slab *slab, const char *name, size_t node_size)
+{
+    // Every slot must be able to hold a free-list link and stay pointer aligned
+    if (node_size < sizeof(SlabFreeNode))
+        node_size = sizeof(SlabFreeNode);
+    node_size = (node_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    memset(slab, 0, sizeof(*slab));
+    slab->name = name;
+    slab->node_size = node_size;
 }
 
-void deleteMember()
+void *slab_alloc(Slab *slab)
 {
-    int id = getInt("Enter ID of member to delete: ");
+    slab->allocs++;
 
-    pthread_rwlock_wrlock(&members_lock);
-    MemberNode *node = findMemberNodeById(id); // Uses Index O(1)
-    if (node)
+    // 1. Recycle a freed slot if we have one
+    if (slab->free_list)
     {
-        // 1. Remove from Main List
-        if (node->prev)
-            node->prev->next = node->next;
-        else
-            member_head = node->next;
-        if (node->next)
-            node->next->prev = node->prev;
-        else
-            member_tail = node->prev;
-
-        // 2. Remove from Index
-        remove_from_index(id);
-
-        free(node);
+        SlabFreeNode *node = slab->free_list;
+        slab->free_list = node->next;
+        slab->reused++;
+        return node;
+    }
 
-        char logMsg[100];
-        sprintf(logMsg, "Deleted Member ID %d", id);
-        log_operation(logMsg);
-        printf("Member ID %d deleted.\n", id);
+    // 2. Otherwise carve from the current chunk, grabbing a new one when it runs out
+    if (slab->bump == slab->bump_end)
+    {
+        SlabChunk *chunk = (SlabChunk *)malloc(sizeof(SlabChunk) + SLAB_CHUNK_NODES * slab->node_size);
+        if (!chunk)
+        {
+            fprintf(stderr, "Fatal: out of memory in %s slab.\n", slab->name);
+            exit(1);
+        }
+        chunk->next = slab->chunks;
+        slab->chunks = chunk;
+        slab->chunk_count++;
+        slab->bump = (char *)(chunk + 1);
+        slab->bump_end = slab->bump + SLAB_CHUNK_NODES * slab->node_size;
     }
-    else
-        printf("Member not found.\n");
-    pthread_rwlock_unlock(&members_lock);
+
+    void *node = slab->bump;
+    slab->bump += slab->node_size;
+    return node;
 }
 
-/* * ==========================================
- * OTHER FUNCTIONS (Unchanged, but they benefit from Indexing indirectly via bookings)
- * ==========================================
- */
+void slab_free(Slab *slab, void *node)
+{
+    if (!node) return;
+    SlabFreeNode *freed = (SlabFreeNode *)node;
+    freed->next = slab->free_list;
+    slab->free_list = freed;
+    slab->frees++;
+}
 
-WorkspaceNode *findWorkspaceNodeById(int id)
+// Drops every node at once: one free() per chunk instead of one per node
+void slab_release(Slab *slab)
 {
-    WorkspaceNode *current = workspace_head;
-    while (current != NULL)
+    SlabChunk *chunk = slab->chunks;
+    while (chunk)
     {
-        if (current->data.workspaceId == id)
-            return current;
-        current = current->next;
+        SlabChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
     }
-    return NULL;
+    // Back to the freshly initialised state (counters included)
+    slab_init(slab, slab->name, slab->node_size);
 }
 
-void addWorkspace()
+void slab_print_stats(const Slab *slab)
 {
-    WorkspaceNode *newNode = (WorkspaceNode *)malloc(sizeof(WorkspaceNode));
-    newNode->next = newNode->prev = NULL;
-    getString("Enter type: ", newNode->data.type, 50);
-    getString("Enter location: ", newNode->data.location, 100);
-    newNode->data.capacity = getInt("Enter capacity: ");
-    newNode->data.price_in_cents = getInt("Enter price (in cents): ");
+    unsigned long live = slab->allocs - slab->frees;
+    size_t reserved = slab->chunk_count * (sizeof(SlabChunk) + SLAB_CHUNK_NODES * slab->node_size);
+    printf("%-16s | %10lu | %10lu | %10lu | %10lu | %8lu | %10.2f\n",
+           slab->name, slab->allocs, slab->frees, slab->reused, live,
+           slab->chunk_count, reserved / (1024.0 * 1024.0));
+}
 
-    pthread_rwlock_wrlock(&workspaces_lock);
-    newNode->data.workspaceId = next_workspace_id++;
-    if (!workspace_head)
-        workspace_head = workspace_tail = newNode;
-    else
-    {
-        workspace_tail->next = newNode;
-        newNode->prev = workspace_tail;
-        workspace_tail = newNode;
-    }
+void show_system_stats()
+{
+    printf("\n--- Allocator Stats ---\n%-16s | %10s | %10s | %10s | %10s | %8s | %10s\n",
+           "Slab", "Allocs", "Frees", "Reused", "Live", "Chunks", "Reserved MB");
+    printf("-----------------|------------|------------|------------|------------|----------|------------\n");
 
-    char logMsg[150];
-    sprintf(logMsg, "Added Workspace ID %d (%s)", newNode->data.workspaceId, newNode->data.type);
-    log_operation(logMsg);
+    // Each slab is guarded by its table's lock, so read the counters under it
+    member_print_slab_stats();
 
+    pthread_rwlock_rdlock(&workspaces_lock);
+    slab_print_stats(&workspace_slab);
     pthread_rwlock_unlock(&workspaces_lock);
-    printf("Workspace added with ID %d.\n", newNode->data.workspaceId);
-}
+    // Booking and payment nodes: see the Buffer Pool section
+    member_print_heap_stats();
 
-void displayAllWorkspaces()
-{
-    printf("\n--- All Workspaces ---\n%-5s | %-20s | %-20s | %-10s | %s\n", "ID", "Type", "Location", "Capacity", "Price(cents)");
-    printf("------|----------------------|----------------------|------------|-------------\n");
+    printf("\n--- Index Stats ---\n%-16s | %10s | %10s | %6s | %8s | %s\n",
+           "Index", "Entries", "Capacity", "Load", "Resizes", "Migrating");
+    printf("-----------------|------------|------------|--------|----------|----------\n");
+
+    member_print_index_stats();
 
     pthread_rwlock_rdlock(&workspaces_lock);
-    for (WorkspaceNode *curr = workspace_head; curr != NULL; curr = curr->next)
-    {
-        printf("%-5d | %-20s | %-20s | %-10d | %d\n", curr->data.workspaceId, curr->data.type, curr->data.location, curr->data.capacity, curr->data.price_in_cents);
-    }
+    index_print_stats(&workspace_index);
     pthread_rwlock_unlock(&workspaces_lock);
+
+    pthread_rwlock_rdlock(&bookings_lock);
+    index_print_stats(&booking_index);
+    index_print_stats(&schedule_index);
+    index_print_stats(&bookings_by_member);
+    index_print_stats(&bookings_by_workspace);
+    pthread_rwlock_unlock(&bookings_lock);
+
+    pthread_rwlock_rdlock(&payments_lock);
+    index_print_stats(&payment_index);
+    index_print_stats(&payments_by_booking);
+    pthread_rwlock_unlock(&payments_lock);
+
+    pthread_rwlock_rdlock(&strings.lock);
+    index_print_stats(&strings.index);
+    pthread_rwlock_unlock(&strings.lock);
+
+    printf("\n--- Ordered Index Stats ---\n%-16s | %10s | %6s | %10s | %10s | %10s\n",
+           "Index", "Entries", "Height", "Nodes", "Splits", "Freed");
+    printf("-----------------|------------|--------|------------|------------|-----------\n");
+    pthread_rwlock_rdlock(&bookings_lock);
+    ordered_print_stats(&bookings_by_start);
+    pthread_rwlock_unlock(&bookings_lock);
+    pthread_rwlock_rdlock(&payments_lock);
+    ordered_print_stats(&payments_by_date);
+    pthread_rwlock_unlock(&payments_lock);
+
+    schedule_print_stats();
+    mat_print_stats();
+    txn_print_stats();
+    pool_print_stats();
+    str_print_stats();
+    epoch_print_stats();
+    snapshot_print_stats();
+    wal_print_stats();
+    bgsave_print_stats();
+    logger_print_stats();
 }
 
-void updateWorkspace()
+// Snapshot from a forked child; the menu stays usable while it runs
+void backgroundSave()
 {
-    int id = getInt("Enter ID of workspace to update: ");
-
-    pthread_rwlock_wrlock(&workspaces_lock);
-    WorkspaceNode *node = findWorkspaceNodeById(id);
-    if (node)
+    switch (bgsave_start())
     {
-        printf("Updating Workspace ID %d (Type: %s)\n", id, node->data.type);
-        node->data.capacity = getInt("Enter new capacity: ");
-        node->data.price_in_cents = getInt("Enter new price (in cents): ");
-
-        char logMsg[100];
-        sprintf(logMsg, "Updated Workspace ID %d", id);
-        log_operation(logMsg);
-        printf("Workspace ID %d updated.\n", id);
+    case BGSAVE_STARTED:
+        printf("Background save started. Option 77 shows its progress and cost.\n");
+        break;
+    case BGSAVE_BUSY:
+        printf("A background save is already running.\n");
+        break;
+    default:
+        printf("Error: could not start a background save.\n");
     }
-    else
-        printf("Workspace not found.\n");
-    pthread_rwlock_unlock(&workspaces_lock);
 }
 
-void deleteWorkspace()
-{
-    int id = getInt("Enter ID of workspace to delete: ");
+/* * ==========================================
+ * BUFFER POOL (Paged Booking & Payment Rows)
+ * ==========================================
+ */
+// Rows are copied in and out of pinned frames; nobody keeps a pointer into a
+// page once it is unpinned. The pool lock only covers the frame table: the
+// copy itself runs unlocked, ordered by the table lock of the row's owner
+// (pages are never shared between tables), and so do the pread/pwrite of a
+// miss (see pool_load_locked).
 
-    pthread_rwlock_wrlock(&workspaces_lock);
-    WorkspaceNode *node = findWorkspaceNodeById(id);
-    if (node)
-    {
-        if (node->prev)
-            node->prev->next = node->next;
-        else
-            workspace_head = node->next;
-        if (node->next)
-            node->next->prev = node->prev;
-        else
-            workspace_tail = node->prev;
-        free(node);
+static void pool_fatal(const char *what)
+{
+    perror(what);
+    exit(1);
+}
 
-        char logMsg[100];
-        sprintf(logMsg, "Deleted Workspace ID %d", id);
-        log_operation(logMsg);
-        printf("Workspace ID %d deleted.\n", id);
+void pool_init()
+{
+    const char *env = getenv("FLEXDESK_POOL_PAGES");
+    long frames = env ? atol(env) : POOL_DEFAULT_FRAMES;
+    if (frames < POOL_MIN_FRAMES)
+        frames = POOL_MIN_FRAMES;
+
+    char path[] = POOL_FILE_TEMPLATE;
+    pool.fd = mkstemp(path);
+    if (pool.fd < 0)
+        pool_fatal("Failed to create page file");
+    unlink(path); // Scratch: disappears with the process
+
+    pool.frame_count = (size_t)frames;
+    pool.frames = (PoolFrame *)calloc(pool.frame_count, sizeof(PoolFrame));
+    unsigned char *memory = NULL;
+    if (!pool.frames || posix_memalign((void **)&memory, POOL_PAGE_SIZE, pool.frame_count * POOL_PAGE_SIZE) != 0)
+        pool_fatal("Failed to allocate buffer pool");
+    for (size_t i = 0; i < pool.frame_count; i++) {
+        pool.frames[i].page = POOL_NO_PAGE;
+        pool.frames[i].data = memory + i * POOL_PAGE_SIZE;
     }
-    else
-        printf("Workspace not found.\n");
-    pthread_rwlock_unlock(&workspaces_lock);
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.unpinned, NULL);
+    pthread_cond_init(&pool.loaded, NULL);
 }
 
-//  BOOKING FUNCTIONS
-
-BookingNode *findBookingNodeById(int id)
+// CLOCK: skip pinned frames, clear reference bits on the way, take the first
+// frame found unreferenced. NULL when everything is pinned.
+static PoolFrame *pool_victim_locked()
 {
-    BookingNode *current = booking_head;
-    while (current != NULL)
-    {
-        if (current->data.bookingId == id)
-            return current;
-        current = current->next;
+    for (size_t scanned = 0; scanned < 2 * pool.frame_count; scanned++) {
+        PoolFrame *frame = &pool.frames[pool.hand];
+        pool.hand = (pool.hand + 1) % pool.frame_count;
+        if (frame->pins)
+            continue;
+        if (frame->referenced) {
+            frame->referenced = 0;
+            continue;
+        }
+        return frame;
     }
     return NULL;
 }
 
-void addBooking()
+static void slot_list_push(uint32_t **list, size_t *count, size_t *capacity, uint32_t slot)
 {
-    int mId = getInt("Enter Member ID: ");
-    int wId = getInt("Enter Workspace ID: ");
-
-    // INTEGRITY CHECK: Verify Member Exists
-    // Now uses Hash Map Index (Fast Lookup)
-    pthread_rwlock_rdlock(&members_lock);
-    MemberNode *mCheck = findMemberNodeById(mId);
-    if (mCheck == NULL) {
-        printf("Error: Member ID %d does not exist. Cannot create booking.\n", mId);
-        pthread_rwlock_unlock(&members_lock);
-        return;
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *list = (uint32_t *)realloc(*list, *capacity * sizeof(uint32_t));
+        if (!*list)
+            pool_fatal("Failed to grow page slot list");
     }
-    pthread_rwlock_unlock(&members_lock);
+    (*list)[(*count)++] = slot;
+}
 
-    // INTEGRITY CHECK: Verify Workspace Exists
-    pthread_rwlock_rdlock(&workspaces_lock);
-    WorkspaceNode *wCheck = findWorkspaceNodeById(wId);
-    if (wCheck == NULL) {
-        printf("Error: Workspace ID %d does not exist. Cannot create booking.\n", wId);
-        pthread_rwlock_unlock(&workspaces_lock);
-        return;
+// Where a dirty page goes. In shadow mode its old slot may still be read by
+// the save child, so it moves to a free one and the old slot is held until
+// the child exits (a page written back twice moves twice; the save is short).
+static uint32_t pool_writeback_slot_locked(uint32_t page)
+{
+    uint32_t slot = pool.disk_of[page];
+    if (slot != POOL_NO_PAGE && !pool.shadow)
+        return slot;
+    if (slot != POOL_NO_PAGE) {
+        slot_list_push(&pool.held_slots, &pool.held_slot_count, &pool.held_slot_capacity, slot);
+        pool.shadow_writes++;
     }
-    pthread_rwlock_unlock(&workspaces_lock);
+    slot = pool.free_slot_count ? pool.free_slots[--pool.free_slot_count] : pool.slot_count++;
+    pool.disk_of[page] = slot;
+    return slot;
+}
 
-    // If we passed checks, proceed to creation
-    BookingNode *newNode = (BookingNode *)malloc(sizeof(BookingNode));
-    newNode->next = newNode->prev = NULL;
-    newNode->data.memberId = mId;
-    newNode->data.workspaceId = wId;
-    getString("Enter Start Time (YYYY-MM-DDTHH:MM): ", newNode->data.startTime, 20);
-    getString("Enter End Time (YYYY-MM-DDTHH:MM): ", newNode->data.endTime, 20);
-    getString("Enter Status (e.g., Confirmed): ", newNode->data.status, 20);
+// Reads one page from a file slot; pages never written back are all zeros
+static void pool_read_slot(uint32_t slot, unsigned char *out)
+{
+    ssize_t got = 0;
+    if (slot != POOL_NO_PAGE) {
+        got = pread(pool.fd, out, POOL_PAGE_SIZE, (off_t)slot * POOL_PAGE_SIZE);
+        if (got < 0)
+            pool_fatal("Failed to read page");
+    }
+    memset(out + got, 0, POOL_PAGE_SIZE - (size_t)got);
+}
 
-    pthread_rwlock_wrlock(&bookings_lock);
-    newNode->data.bookingId = next_booking_id++;
-    if (!booking_head)
-        booking_head = booking_tail = newNode;
-    else
-    {
-        booking_tail->next = newNode;
-        newNode->prev = booking_tail;
-        booking_tail = newNode;
+// Refills a victim frame with 'page'. The lock is dropped around the write
+// back and the read; the loader's pin keeps the frame from being chosen
+// again, and the page table already points both pages at it (marked 'io'),
+// so nobody else starts a second load of either. Slots are picked under the
+// lock, before the I/O, so a save fork in between still sees a consistent map.
+static void pool_load_locked(PoolFrame *frame, uint32_t page)
+{
+    frame->pins++;
+    pool.frame_of[page] = (int32_t)(frame - pool.frames);
+
+    if (frame->page != POOL_NO_PAGE) {
+        if (frame->dirty) {
+            uint32_t slot = pool_writeback_slot_locked(frame->page);
+            frame->io = POOL_IO_WRITE;
+            pthread_mutex_unlock(&pool.lock);
+            if (pwrite(pool.fd, frame->data, POOL_PAGE_SIZE, (off_t)slot * POOL_PAGE_SIZE) != POOL_PAGE_SIZE)
+                pool_fatal("Failed to write back page");
+            pthread_mutex_lock(&pool.lock);
+            pool.writebacks++;
+        }
+        pool.frame_of[frame->page] = -1;
+        pool.evictions++;
     }
 
-    char logMsg[150];
-    sprintf(logMsg, "Added Booking ID %d (Mem: %d, WS: %d)", newNode->data.bookingId, mId, wId);
-    log_operation(logMsg);
+    frame->page = page;
+    frame->dirty = 0;
+    frame->io = POOL_IO_READ;
+    uint32_t slot = pool.disk_of[page];
+    pthread_mutex_unlock(&pool.lock);
+    pool_read_slot(slot, frame->data);
+    pthread_mutex_lock(&pool.lock);
+    frame->io = POOL_IO_NONE;
+    frame->pins--;
+    pthread_cond_broadcast(&pool.loaded);
+}
 
-    pthread_rwlock_unlock(&bookings_lock);
-    printf("Booking added with ID %d.\n", newNode->data.bookingId);
+// The returned page stays in memory until the matching pool_unpin
+unsigned char *pool_pin(uint32_t page)
+{
+    pthread_mutex_lock(&pool.lock);
+    PoolFrame *frame;
+    for (;;) {
+        int32_t resident = pool.frame_of[page];
+        if (resident >= 0 && pool.frames[resident].io != POOL_IO_NONE) {
+            pool.io_waits++;
+            pthread_cond_wait(&pool.loaded, &pool.lock);
+            continue;
+        }
+        if (resident >= 0) {
+            frame = &pool.frames[resident];
+            pool.hits++;
+            break;
+        }
+        frame = pool_victim_locked();
+        if (frame) {
+            pool.misses++;
+            pool_load_locked(frame, page);
+            break;
+        }
+        // More pinners than frames: wait, then look again (the page may have come in)
+        pool.waits++;
+        pthread_cond_wait(&pool.unpinned, &pool.lock);
+    }
+    frame->pins++;
+    frame->referenced = 1;
+    pthread_mutex_unlock(&pool.lock);
+    return frame->data;
 }
 
-void displayAllBookings()
+void pool_unpin(uint32_t page, int dirty)
 {
-    printf("\n--- All Bookings ---\n%-5s | %-10s | %-12s | %-18s | %-18s | %s\n", "ID", "Member ID", "Workspace ID", "Start Time", "End Time", "Status");
-    printf("------|------------|--------------|--------------------|--------------------|----------\n");
+    pthread_mutex_lock(&pool.lock);
+    PoolFrame *frame = &pool.frames[pool.frame_of[page]];
+    frame->dirty |= dirty;
+    if (--frame->pins == 0)
+        pthread_cond_signal(&pool.unpinned);
+    pthread_mutex_unlock(&pool.lock);
+}
 
-    pthread_rwlock_rdlock(&bookings_lock);
-    for (BookingNode *curr = booking_head; curr != NULL; curr = curr->next)
-    {
-        printf("%-5d | %-10d | %-12d | %-18s | %-18s | %s\n", curr->data.bookingId, curr->data.memberId, curr->data.workspaceId, curr->data.startTime, curr->data.endTime, curr->data.status);
+// Hands out the next file page; it is only read or written once pinned
+uint32_t pool_new_page()
+{
+    pthread_mutex_lock(&pool.lock);
+    if (pool.page_count == pool.page_capacity) {
+        uint32_t capacity = pool.page_capacity ? pool.page_capacity * 2 : 1024;
+        int32_t *frames = (int32_t *)realloc(pool.frame_of, capacity * sizeof(int32_t));
+        if (frames)
+            pool.frame_of = frames;
+        uint32_t *slots = (uint32_t *)realloc(pool.disk_of, capacity * sizeof(uint32_t));
+        if (slots)
+            pool.disk_of = slots;
+        if (!frames || !slots)
+            pool_fatal("Failed to grow page table");
+        for (uint32_t i = pool.page_capacity; i < capacity; i++) {
+            pool.frame_of[i] = -1;
+            pool.disk_of[i] = POOL_NO_PAGE;
+        }
+        pool.page_capacity = capacity;
     }
-    pthread_rwlock_unlock(&bookings_lock);
+    uint32_t page = pool.page_count++;
+    pthread_mutex_unlock(&pool.lock);
+    return page;
 }
 
-void updateBooking()
+void pool_counters(unsigned long *hits, unsigned long *misses)
 {
-    int id = getInt("Enter ID of booking to update: ");
+    pthread_mutex_lock(&pool.lock);
+    *hits = pool.hits;
+    *misses = pool.misses;
+    pthread_mutex_unlock(&pool.lock);
+}
 
-    pthread_rwlock_wrlock(&bookings_lock);
-    BookingNode *node = findBookingNodeById(id);
-    if (node)
-    {
-        printf("Updating Booking ID %d. Current status: %s\n", id, node->data.status);
-        getString("Enter new status (e.g., Cancelled): ", node->data.status, 20);
+// Shadow mode starts with the pool lock held across the fork (see bgsave_start)
+void pool_begin_shadow_locked()
+{
+    pool.shadow = 1;
+}
 
-        char logMsg[100];
-        sprintf(logMsg, "Updated Booking ID %d status to %s", id, node->data.status);
-        log_operation(logMsg);
-        printf("Booking ID %d updated.\n", id);
-    }
-    else
-        printf("Booking not found.\n");
-    pthread_rwlock_unlock(&bookings_lock);
+// The save child has exited: the slots it could see are free again
+void pool_end_shadow()
+{
+    pthread_mutex_lock(&pool.lock);
+    pool.shadow = 0;
+    while (pool.held_slot_count)
+        slot_list_push(&pool.free_slots, &pool.free_slot_count, &pool.free_slot_capacity,
+                       pool.held_slots[--pool.held_slot_count]);
+    pthread_mutex_unlock(&pool.lock);
 }
 
-void deleteBooking()
+// Drops every page (tables are being emptied; nothing may be pinned)
+void pool_reset()
 {
-    int id = getInt("Enter ID of booking to delete: ");
+    pthread_mutex_lock(&pool.lock);
+    for (size_t i = 0; i < pool.frame_count; i++) {
+        pool.frames[i].page = POOL_NO_PAGE;
+        pool.frames[i].pins = pool.frames[i].referenced = pool.frames[i].dirty = pool.frames[i].io = 0;
+    }
+    for (uint32_t i = 0; i < pool.page_count; i++) {
+        pool.frame_of[i] = -1;
+        pool.disk_of[i] = POOL_NO_PAGE;
+    }
+    pool.page_count = pool.slot_count = 0;
+    pool.free_slot_count = pool.held_slot_count = 0;
+    pool.hand = 0;
+    pool.hits = pool.misses = pool.evictions = pool.writebacks = pool.waits = pool.io_waits = pool.shadow_writes = 0;
+    if (ftruncate(pool.fd, 0) != 0)
+        perror("Failed to truncate page file");
+    pthread_mutex_unlock(&pool.lock);
+}
 
-    pthread_rwlock_wrlock(&bookings_lock);
-    BookingNode *node = findBookingNodeById(id);
-    if (node)
-    {
-        if (node->prev)
-            node->prev->next = node->next;
-        else
-            booking_head = node->next;
-        if (node->next)
-            node->next->prev = node->prev;
-        else
-            booking_tail = node->prev;
-        free(node);
+static void paged_print_stats(const PagedTable *table)
+{
+    size_t rows = table->next_id - table->free_count;
+    printf("%-8s: %zu page(s), %zu rows/page | %zu row(s) | Resident per row: %zu B node (row: %zu B) | Nodes: %.1f MB\n",
+           table->name, table->page_count, table->per_page, rows, table->node_size, table->record_size,
+           table->page_count * table->per_page * (double)table->node_size / (1 << 20));
+}
 
-        char logMsg[100];
-        sprintf(logMsg, "Deleted Booking ID %d", id);
-        log_operation(logMsg);
-        printf("Booking ID %d deleted.\n", id);
+void pool_print_stats()
+{
+    pthread_mutex_lock(&pool.lock);
+    size_t resident = 0, dirty = 0;
+    for (size_t i = 0; i < pool.frame_count; i++) {
+        resident += pool.frames[i].page != POOL_NO_PAGE;
+        dirty += pool.frames[i].dirty;
     }
-    else
-        printf("Booking not found.\n");
+    unsigned long lookups = pool.hits + pool.misses;
+    printf("\n--- Buffer Pool ---\n");
+    printf("Frames: %zu x %d KB (%.1f MB) | Resident: %zu | Dirty: %zu | Pages: %u (%.1f MB)\n",
+           pool.frame_count, POOL_PAGE_SIZE / 1024, pool.frame_count * (double)POOL_PAGE_SIZE / (1 << 20),
+           resident, dirty, pool.page_count, pool.page_count * (double)POOL_PAGE_SIZE / (1 << 20));
+    printf("Hits: %lu | Misses: %lu | Hit rate: %.1f%% | Evictions: %lu | Writebacks: %lu | Waits: %lu (%lu on I/O)\n",
+           pool.hits, pool.misses, lookups ? 100.0 * pool.hits / lookups : 0.0,
+           pool.evictions, pool.writebacks, pool.waits, pool.io_waits);
+    printf("File slots: %u (%zu free, %zu held for a save) | Writebacks moved during saves: %lu\n",
+           pool.slot_count, pool.free_slot_count, pool.held_slot_count, pool.shadow_writes);
+    pthread_mutex_unlock(&pool.lock);
+
+    pthread_rwlock_rdlock(&bookings_lock);
+    paged_print_stats(&booking_pages);
     pthread_rwlock_unlock(&bookings_lock);
+    pthread_rwlock_rdlock(&payments_lock);
+    paged_print_stats(&payment_pages);
+    pthread_rwlock_unlock(&payments_lock);
 }
 
-//  PAYMENT FUNCTIONS
+// -- Paged Tables --
 
-PaymentNode *findPaymentNodeById(int id)
+void paged_table_init(PagedTable *table, const char *name, size_t record_size, size_t node_size)
 {
-    PaymentNode *current = payment_head;
-    while (current != NULL)
-    {
-        if (current->data.paymentId == id)
-            return current;
-        current = current->next;
+    memset(table, 0, sizeof(*table));
+    table->name = name;
+    table->record_size = record_size;
+    table->per_page = POOL_PAGE_SIZE / record_size;
+    table->node_size = node_size;
+}
+
+RecordId paged_alloc(PagedTable *table)
+{
+    if (table->free_count)
+        return table->free_ids[--table->free_count];
+
+    if (table->next_id == table->page_count * table->per_page) {
+        if (table->page_count == table->page_capacity) {
+            table->page_capacity = table->page_capacity ? table->page_capacity * 2 : 64;
+            table->pages = (uint32_t *)realloc(table->pages, table->page_capacity * sizeof(uint32_t));
+            table->nodes = (unsigned char **)realloc(table->nodes, table->page_capacity * sizeof(unsigned char *));
+            if (!table->pages || !table->nodes)
+                pool_fatal("Failed to grow paged table");
+        }
+        table->nodes[table->page_count] = (unsigned char *)calloc(table->per_page, table->node_size);
+        if (!table->nodes[table->page_count])
+            pool_fatal("Failed to grow paged table");
+        table->pages[table->page_count++] = pool_new_page();
     }
-    return NULL;
+    return table->next_id++;
 }
 
-void addPayment()
+// The resident node of a slot (zeroed until its first row)
+void *paged_node(const PagedTable *table, RecordId rid)
 {
-    int bId = getInt("Enter Booking ID: ");
+    return table->nodes[rid / table->per_page] + (rid % table->per_page) * table->node_size;
+}
 
-    // INTEGRITY CHECK: Verify Booking Exists
-    pthread_rwlock_rdlock(&bookings_lock);
-    BookingNode *bCheck = findBookingNodeById(bId);
-    if (bCheck == NULL) {
-        printf("Error: Booking ID %d does not exist. Cannot process payment.\n", bId);
-        pthread_rwlock_unlock(&bookings_lock);
-        return;
+void paged_free(PagedTable *table, RecordId rid)
+{
+    if (table->free_count == table->free_capacity) {
+        table->free_capacity = table->free_capacity ? table->free_capacity * 2 : 64;
+        table->free_ids = (RecordId *)realloc(table->free_ids, table->free_capacity * sizeof(RecordId));
+        if (!table->free_ids)
+            pool_fatal("Failed to grow paged table");
     }
-    pthread_rwlock_unlock(&bookings_lock);
-
-    PaymentNode *newNode = (PaymentNode *)malloc(sizeof(PaymentNode));
-    newNode->next = newNode->prev = NULL;
-    newNode->data.bookingId = bId;
-    newNode->data.amount_in_cents = getInt("Enter amount (in cents): ");
-    getString("Enter Payment Date (YYYY-MM-DD): ", newNode->data.paymentDate, 11);
-    getString("Enter Status (e.g., Paid): ", newNode->data.status, 20);
+    table->free_ids[table->free_count++] = rid;
+}
 
-    pthread_rwlock_wrlock(&payments_lock);
-    newNode->data.paymentId = next_payment_id++;
-    if (!payment_head)
-        payment_head = payment_tail = newNode;
-    else
+void paged_read(PagedTable *table, RecordId rid, void *out)
+{
+    uint32_t page = table->pages[rid / table->per_page];
+    if (pool.forked_child)
     {
-        payment_tail->next = newNode;
-        newNode->prev = payment_tail;
-        payment_tail = newNode;
+        // Save child: the frames and slot map are its fork-time copy, and the
+        // parent never overwrites a slot the child can see. Single-threaded,
+        // so the last page read from the file is simply kept in a buffer.
+        static unsigned char buffer[POOL_PAGE_SIZE];
+        static uint32_t buffered = POOL_NO_PAGE;
+        size_t offset = (rid % table->per_page) * table->record_size;
+        // A frame caught mid-read at the fork holds garbage; its slot is current
+        int32_t resident = pool.frame_of[page];
+        if (resident >= 0 && pool.frames[resident].page == page && pool.frames[resident].io != POOL_IO_READ)
+        {
+            memcpy(out, pool.frames[resident].data + offset, table->record_size);
+            return;
+        }
+        if (buffered != page)
+        {
+            pool_read_slot(pool.disk_of[page], buffer);
+            buffered = page;
+        }
+        memcpy(out, buffer + offset, table->record_size);
+        return;
     }
+    unsigned char *data = pool_pin(page);
+    memcpy(out, data + (rid % table->per_page) * table->record_size, table->record_size);
+    pool_unpin(page, 0);
+}
 
-    char logMsg[150];
-    sprintf(logMsg, "Added Payment ID %d for Booking %d", newNode->data.paymentId, bId);
-    log_operation(logMsg);
-
-    pthread_rwlock_unlock(&payments_lock);
-    printf("Payment added with ID %d.\n", newNode->data.paymentId);
+void paged_write(PagedTable *table, RecordId rid, const void *record)
+{
+    uint32_t page = table->pages[rid / table->per_page];
+    unsigned char *data = pool_pin(page);
+    memcpy(data + (rid % table->per_page) * table->record_size, record, table->record_size);
+    pool_unpin(page, 1);
 }
 
-void displayAllPayments()
+// Forgets every row; the pages themselves go with pool_reset
+void paged_table_reset(PagedTable *table)
 {
-    printf("\n--- All Payments ---\n%-5s | %-10s | %-15s | %-12s | %s\n", "ID", "Booking ID", "Amount (cents)", "Date", "Status");
-    printf("------|------------|-----------------|--------------|----------\n");
+    for (size_t i = 0; i < table->page_count; i++)
+        free(table->nodes[i]);
+    free(table->nodes);
+    free(table->pages);
+    free(table->free_ids);
+    paged_table_init(table, table->name, table->record_size, table->node_size);
+}
 
-    pthread_rwlock_rdlock(&payments_lock);
-    for (PaymentNode *curr = payment_head; curr != NULL; curr = curr->next)
-    {
-        printf("%-5d | %-10d | %-15d | %-12s | %s\n", curr->data.paymentId, curr->data.bookingId, curr->data.amount_in_cents, curr->data.paymentDate, curr->data.status);
-    }
-    pthread_rwlock_unlock(&payments_lock);
+// Caller holds the table's lock (read or write)
+void booking_read(const BookingNode *node, Booking *out)
+{
+    BookingRecord record;
+    paged_read(&booking_pages, node->rid, &record);
+    booking_decode(&record, out);
 }
 
-void updatePayment()
+void payment_read(const PaymentNode *node, Payment *out)
 {
-    int id = getInt("Enter ID of payment to update: ");
+    PaymentRecord record;
+    paged_read(&payment_pages, node->rid, &record);
+    payment_decode(&record, out);
+}
 
+// Node of a slot, NULL for NO_RECORD (links end there)
+BookingNode *booking_at(RecordId rid)
+{
+    return rid == NO_RECORD ? NULL : (BookingNode *)paged_node(&booking_pages, rid);
+}
+
+PaymentNode *payment_at(RecordId rid)
+{
+    return rid == NO_RECORD ? NULL : (PaymentNode *)paged_node(&payment_pages, rid);
+}
+
+// Table scans: live rows in slot order (a reused slot comes up where it is,
+// not at the end). Caller holds the table's lock.
+static BookingNode *booking_scan_from(RecordId rid)
+{
+    for (; rid < booking_pages.next_id; rid++) {
+        BookingNode *node = booking_at(rid);
+        if (node->live)
+            return node;
+    }
+    return NULL;
+}
+
+BookingNode *first_booking()
+{
+    return booking_scan_from(0);
+}
+
+BookingNode *next_booking(const BookingNode *node)
+{
+    return booking_scan_from(node->rid + 1);
+}
+
+static PaymentNode *payment_scan_from(RecordId rid)
+{
+    for (; rid < payment_pages.next_id; rid++) {
+        PaymentNode *node = payment_at(rid);
+        if (node->live)
+            return node;
+    }
+    return NULL;
+}
+
+PaymentNode *first_payment()
+{
+    return payment_scan_from(0);
+}
+
+PaymentNode *next_payment(const PaymentNode *node)
+{
+    return payment_scan_from(node->rid + 1);
+}
+
+/* * ==========================================
+ * STRING DICTIONARY (Encoded Type / Location / Status)
+ * ==========================================
+ */
+
+static int str_entry_matches(const void *target, const void *ctx)
+{
+    return strcmp(((const StrEntry *)target)->text, (const char *)ctx) == 0;
+}
+
+// Caller holds the write lock. NULL once every code is taken.
+static StrEntry *str_add_locked(const char *text, uint64_t key)
+{
+    StrCode code = strings.count;
+    if (code >> STR_BLOCK_BITS >= STR_MAX_BLOCKS)
+        return NULL;
+    StrEntry ***block = &strings.blocks[code >> STR_BLOCK_BITS];
+    if (!*block) {
+        *block = (StrEntry **)calloc((size_t)1 << STR_BLOCK_BITS, sizeof(StrEntry *));
+        strings.bytes += sizeof(StrEntry *) << STR_BLOCK_BITS;
+    }
+    size_t length = strlen(text);
+    StrEntry *entry = (StrEntry *)malloc(sizeof(StrEntry) + length + 1);
+    if (!*block || !entry) {
+        perror("Failed to grow string dictionary");
+        exit(1);
+    }
+    entry->code = code;
+    entry->length = (uint32_t)length;
+    entry->flags = (strncasecmp(text, "Cancel", 6) == 0 ? STR_CANCELLED : 0) |
+                   (strcasecmp(text, "Paid") == 0 ? STR_PAID : 0);
+    entry->columns = 0;
+    memcpy(entry->text, text, length + 1);
+    (*block)[code & ((1u << STR_BLOCK_BITS) - 1)] = entry;
+    index_insert(&strings.index, key, entry);
+    strings.bytes += sizeof(StrEntry) + length + 1;
+    strings.count = code + 1;
+    return entry;
+}
+
+// Code of 'text', added on first sight. Known values (nearly every call) only
+// take the read lock. Clients' values are admitted first (str_admit), so only
+// a load of more than 16M distinct values from local files can fill it.
+StrCode str_intern(const char *text)
+{
+    uint64_t key = hash_string(text);
+    atomic_fetch_add_explicit(&strings.interns, 1, memory_order_relaxed);
+    pthread_rwlock_rdlock(&strings.lock);
+    StrEntry *entry = (StrEntry *)index_find_match(&strings.index, key, str_entry_matches, text);
+    pthread_rwlock_unlock(&strings.lock);
+    if (entry)
+        return entry->code;
+
+    pthread_rwlock_wrlock(&strings.lock);
+    entry = (StrEntry *)index_find_match(&strings.index, key, str_entry_matches, text); // Raced with another writer?
+    if (!entry)
+        entry = str_add_locked(text, key);
+    if (!entry) {
+        fprintf(stderr, "String dictionary is full (%u values)\n", strings.count);
+        exit(1);
+    }
+    StrCode code = entry->code;
+    pthread_rwlock_unlock(&strings.lock);
+    return code;
+}
+
+// str_intern for a value a client writes into 'column': DB_FULL if it is new
+// to the column and the column already holds STR_COLUMN_MAX values. The db_*
+// writers admit their text before taking table locks, so the encode that
+// follows finds the entry.
+DbStatus str_admit(int column, const char *text, StrCode *code)
+{
+    uint64_t key = hash_string(text);
+    pthread_rwlock_rdlock(&strings.lock);
+    StrEntry *entry = (StrEntry *)index_find_match(&strings.index, key, str_entry_matches, text);
+    int known = entry && (entry->columns & (1u << column));
+    pthread_rwlock_unlock(&strings.lock);
+
+    DbStatus rc = DB_OK;
+    if (!known)
+    {
+        pthread_rwlock_wrlock(&strings.lock);
+        entry = (StrEntry *)index_find_match(&strings.index, key, str_entry_matches, text);
+        if (!entry || !(entry->columns & (1u << column)))
+        {
+            if (strings.column_counts[column] >= STR_COLUMN_MAX)
+                rc = DB_FULL;
+            else if (!entry && !(entry = str_add_locked(text, key)))
+                rc = DB_FULL;
+            else
+            {
+                entry->columns |= 1u << column;
+                strings.column_counts[column]++;
+            }
+        }
+        pthread_rwlock_unlock(&strings.lock);
+    }
+    if (rc == DB_OK && code)
+        *code = entry->code;
+    return rc;
+}
+
+// Lock-free: 'code' came from a row, so its entry is already published
+const char *str_text(StrCode code)
+{
+    return strings.blocks[code >> STR_BLOCK_BITS][code & ((1u << STR_BLOCK_BITS) - 1)]->text;
+}
+
+// Notes that a stored row holds 'code' in 'column'. Loads and replay are not
+// capped, so a column may end up over STR_COLUMN_MAX; clients then get
+// DB_FULL for new values. Lock-free once the column has it.
+void str_count_use(StrCode code, int column)
+{
+    StrEntry *entry = strings.blocks[code >> STR_BLOCK_BITS][code & ((1u << STR_BLOCK_BITS) - 1)];
+    if (atomic_load_explicit(&entry->columns, memory_order_relaxed) & (1u << column))
+        return;
+    pthread_rwlock_wrlock(&strings.lock);
+    if (!(entry->columns & (1u << column)))
+    {
+        entry->columns |= 1u << column;
+        strings.column_counts[column]++;
+    }
+    pthread_rwlock_unlock(&strings.lock);
+}
+
+// STR_CANCELLED / STR_PAID; lock-free like str_text
+int str_flags(StrCode code)
+{
+    return strings.blocks[code >> STR_BLOCK_BITS][code & ((1u << STR_BLOCK_BITS) - 1)]->flags;
+}
+
+// Codes handed out so far (the snapshot writes entries 0 .. count-1)
+uint32_t str_count()
+{
+    pthread_rwlock_rdlock(&strings.lock);
+    uint32_t count = strings.count;
+    pthread_rwlock_unlock(&strings.lock);
+    return count;
+}
+
+// Records are zero-filled first so padding never carries stale bytes into pages or files
+void workspace_encode(const Workspace *row, WorkspaceRecord *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->workspaceId = row->workspaceId;
+    out->type = str_intern(row->type);
+    out->location = str_intern(row->location);
+    out->capacity = row->capacity;
+    out->price_in_cents = row->price_in_cents;
+}
+
+void workspace_decode(const WorkspaceRecord *record, Workspace *out)
+{
+    out->workspaceId = record->workspaceId;
+    snprintf(out->type, sizeof(out->type), "%s", str_text(record->type));
+    snprintf(out->location, sizeof(out->location), "%s", str_text(record->location));
+    out->capacity = record->capacity;
+    out->price_in_cents = record->price_in_cents;
+}
+
+void booking_encode(const Booking *row, BookingRecord *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->bookingId = row->bookingId;
+    out->memberId = row->memberId;
+    out->workspaceId = row->workspaceId;
+    memcpy(out->startTime, row->startTime, sizeof(out->startTime));
+    memcpy(out->endTime, row->endTime, sizeof(out->endTime));
+    out->status = str_intern(row->status);
+}
+
+void booking_decode(const BookingRecord *record, Booking *out)
+{
+    out->bookingId = record->bookingId;
+    out->memberId = record->memberId;
+    out->workspaceId = record->workspaceId;
+    memcpy(out->startTime, record->startTime, sizeof(out->startTime));
+    memcpy(out->endTime, record->endTime, sizeof(out->endTime));
+    snprintf(out->status, sizeof(out->status), "%s", str_text(record->status));
+}
+
+void payment_encode(const Payment *row, PaymentRecord *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->paymentId = row->paymentId;
+    out->bookingId = row->bookingId;
+    out->amount_in_cents = row->amount_in_cents;
+    memcpy(out->paymentDate, row->paymentDate, sizeof(out->paymentDate));
+    out->status = str_intern(row->status);
+}
+
+void payment_decode(const PaymentRecord *record, Payment *out)
+{
+    out->paymentId = record->paymentId;
+    out->bookingId = record->bookingId;
+    out->amount_in_cents = record->amount_in_cents;
+    memcpy(out->paymentDate, record->paymentDate, sizeof(out->paymentDate));
+    snprintf(out->status, sizeof(out->status), "%s", str_text(record->status));
+}
+
+// Dictionary size and what the encoding saves against the char-array rows
+void str_print_stats()
+{
+    pthread_rwlock_rdlock(&strings.lock);
+    uint32_t count = strings.count;
+    size_t bytes = strings.bytes;
+    uint32_t columns[STR_COLUMNS];
+    memcpy(columns, strings.column_counts, sizeof(columns));
+    pthread_rwlock_unlock(&strings.lock);
+
+    pthread_rwlock_rdlock(&workspaces_lock);
+    size_t workspaces = index_count(&workspace_index);
+    pthread_rwlock_unlock(&workspaces_lock);
+    pthread_rwlock_rdlock(&bookings_lock);
+    size_t bookings = index_count(&booking_index);
+    pthread_rwlock_unlock(&bookings_lock);
+    pthread_rwlock_rdlock(&payments_lock);
+    size_t payments = index_count(&payment_index);
+    pthread_rwlock_unlock(&payments_lock);
+
+    const size_t booking_saved = sizeof(Booking) - sizeof(BookingRecord);
+    const size_t payment_saved = sizeof(Payment) - sizeof(PaymentRecord);
+    const size_t workspace_saved = sizeof(Workspace) - sizeof(WorkspaceRecord);
+    double saved_mb = (workspaces * workspace_saved + bookings * booking_saved + payments * payment_saved) / (1024.0 * 1024.0);
+
+    printf("\n--- String Dictionary ---\n");
+    printf("Values: %u (%.1f KB) | Encodes: %lu\n", count, bytes / 1024.0,
+           atomic_load(&strings.interns));
+    printf("Admitted per column (cap %d): type %u | location %u | booking status %u | payment status %u\n",
+           STR_COLUMN_MAX, columns[STR_COL_TYPE], columns[STR_COL_LOCATION], columns[STR_COL_BOOKING_STATUS],
+           columns[STR_COL_PAYMENT_STATUS]);
+    printf("Row bytes: Workspace %zu -> %zu | Booking %zu -> %zu | Payment %zu -> %zu\n",
+           sizeof(Workspace), sizeof(WorkspaceRecord), sizeof(Booking), sizeof(BookingRecord),
+           sizeof(Payment), sizeof(PaymentRecord));
+    printf("Saved: %.1f MB per million bookings, %.2f MB on the current rows\n",
+           booking_saved * 1e6 / (1024.0 * 1024.0), saved_mb);
+}
+
+/* * ==========================================
+ * HASH MAP IMPLEMENTATION
+ * ==========================================
+ */
+
+// 64-bit finalizer (splitmix64): sequential IDs spread evenly over the table
+uint64_t hash_function(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+// FNV-1a: turns a string key into an index key (hash_function mixes it further)
+uint64_t hash_string(const char *str) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (*str) {
+        h ^= (unsigned char)*str++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Tables come straight from mmap: pages arrive zeroed on first touch, so a
+// doubling never pays for a multi-megabyte memset the way calloc can.
+static void index_table_alloc(IndexTable *t, size_t capacity) {
+    void *mem = mmap(NULL, capacity * sizeof(IndexSlot), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "Fatal: out of memory growing index.\n");
+        exit(1);
+    }
+    t->slots = (IndexSlot *)mem;
+    t->mask = capacity - 1;
+    t->count = 0;
+}
+
+static void index_table_release(IndexTable *t) {
+    if (t->slots)
+        munmap(t->slots, (t->mask + 1) * sizeof(IndexSlot));
+    t->slots = NULL;
+    t->count = 0;
+}
+
+// Robin Hood insert: an entry that has probed further than the resident
+// takes its slot, which keeps every probe sequence short and bounded.
+static void index_table_put(IndexTable *t, uint64_t key, void *target) {
+    IndexSlot entry = { key, target, 1 };
+    size_t pos = hash_function(key) & t->mask;
+
+    while (1) {
+        IndexSlot *slot = &t->slots[pos];
+        if (slot->dist == 0) {
+            *slot = entry;
+            t->count++;
+            return;
+        }
+        if ((slot->dist & ~INDEX_TOMBSTONE) < entry.dist) {
+            IndexSlot tmp = *slot;
+            *slot = entry;
+            entry = tmp;
+        }
+        pos = (pos + 1) & t->mask;
+        entry.dist++;
+    }
+}
+
+// Returns the slot holding key, or NULL. The probe stops as soon as it meets a
+// resident closer to home than we are (Robin Hood invariant: key can't be later).
+// Slots below 'floor' have been migrated (and maybe unmapped), so the probe
+// steps over them while still counting their distance.
+static IndexSlot *index_table_get(const IndexTable *t, uint64_t key, size_t floor,
+                                  IndexMatchFn match, const void *ctx) {
+    if (!t->slots) return NULL;
+    size_t capacity = t->mask + 1;
+    size_t pos = hash_function(key) & t->mask;
+    uint32_t dist = 1;
+
+    for (size_t probed = 0; probed < capacity - floor; probed++) {
+        if (pos < floor) {
+            dist += (uint32_t)(floor - pos);
+            pos = floor;
+        }
+        IndexSlot *slot = &t->slots[pos];
+        uint32_t d = slot->dist & ~INDEX_TOMBSTONE;
+        if (slot->dist == 0 || d < dist)
+            return NULL;
+        if (slot->key == key && !(slot->dist & INDEX_TOMBSTONE) &&
+            (!match || match(slot->target, ctx)))
+            return slot;
+        pos = (pos + 1) & t->mask;
+        dist++;
+    }
+    return NULL;
+}
+
+// Backward-shift delete: pull followers one slot closer to home (no tombstones)
+static void index_table_erase(IndexTable *t, IndexSlot *slot) {
+    size_t pos = (size_t)(slot - t->slots);
+    while (1) {
+        size_t next = (pos + 1) & t->mask;
+        if (t->slots[next].dist <= 1) {
+            t->slots[pos].dist = 0;
+            break;
+        }
+        t->slots[pos] = t->slots[next];
+        t->slots[pos].dist--;
+        pos = next;
+    }
+    t->count--;
+}
+
+// Unmap the old table up to 'upto' bytes; unmapping a big table in one go
+// would cost as much as the memset we avoided, so it trails the migration.
+static void index_release_old(HashIndex *idx, size_t upto) {
+    if (upto > idx->old_released) {
+        munmap((char *)idx->old.slots + idx->old_released, upto - idx->old_released);
+        idx->old_released = upto;
+    }
+}
+
+// Move up to 'steps' slots of the old table into the current one
+static void index_migrate(HashIndex *idx, size_t steps) {
+    if (!idx->old.slots) return;
+    size_t capacity = idx->old.mask + 1;
+
+    while (steps-- > 0 && idx->migrate_pos < capacity) {
+        IndexSlot *slot = &idx->old.slots[idx->migrate_pos++];
+        if (slot->dist != 0 && !(slot->dist & INDEX_TOMBSTONE)) {
+            index_table_put(&idx->cur, slot->key, slot->target);
+            idx->old.count--;
+            idx->migrated++;
+        }
+    }
+
+    size_t bytes = capacity * sizeof(IndexSlot);
+    if (idx->migrate_pos == capacity) {
+        index_release_old(idx, bytes);
+        idx->old.slots = NULL;
+        idx->old.count = 0;
+    } else {
+        index_release_old(idx, (idx->migrate_pos * sizeof(IndexSlot)) & ~(size_t)(INDEX_RELEASE_BYTES - 1));
+    }
+}
+
+void index_init(HashIndex *idx, const char *name) {
+    memset(idx, 0, sizeof(*idx));
+    idx->name = name;
+    index_table_alloc(&idx->cur, INDEX_INITIAL_CAPACITY);
+}
+
+// Add a node pointer to the index under its key
+void index_insert(HashIndex *idx, uint64_t key, void *target) {
+    if (!target) return;
+    index_migrate(idx, INDEX_MIGRATE_STEP);
+
+    size_t capacity = idx->cur.mask + 1;
+    if ((idx->cur.count + 1) * 100 > capacity * INDEX_MAX_LOAD_PCT) {
+        // A previous doubling must finish before the next one starts
+        index_migrate(idx, (size_t)-1);
+        idx->old = idx->cur;
+        idx->migrate_pos = 0;
+        idx->old_released = 0;
+        index_table_alloc(&idx->cur, capacity * 2);
+        idx->resizes++;
+        index_migrate(idx, INDEX_MIGRATE_STEP);
+    }
+
+    index_table_put(&idx->cur, key, target);
+}
+
+static void index_remove_match(HashIndex *idx, uint64_t key, IndexMatchFn match, const void *ctx) {
+    IndexSlot *slot = index_table_get(&idx->cur, key, 0, match, ctx);
+    if (slot) {
+        index_table_erase(&idx->cur, slot);
+    } else if ((slot = index_table_get(&idx->old, key, idx->migrate_pos, match, ctx)) != NULL) {
+        // Not migrated yet: tombstone it so the drain skips it
+        slot->dist |= INDEX_TOMBSTONE;
+        idx->old.count--;
+    }
+    index_migrate(idx, INDEX_MIGRATE_STEP);
+}
+
+static int index_same_target(const void *target, const void *ctx) {
+    return target == ctx;
+}
+
+// Remove an entry from the index
+void index_remove(HashIndex *idx, uint64_t key) {
+    index_remove_match(idx, key, NULL, NULL);
+}
+
+// Remove one specific (key, target) pair; for indexes where keys can repeat
+void index_remove_target(HashIndex *idx, uint64_t key, void *target) {
+    index_remove_match(idx, key, index_same_target, target);
+}
+
+// O(1) Lookup: returns the data node stored under key, or NULL
+void *index_find(HashIndex *idx, uint64_t key) {
+    return index_find_match(idx, key, NULL, NULL);
+}
+
+// Lookup for hashed keys: returns the first target under key that 'match' accepts
+void *index_find_match(HashIndex *idx, uint64_t key, IndexMatchFn match, const void *ctx) {
+    IndexSlot *slot = index_table_get(&idx->cur, key, 0, match, ctx);
+    if (!slot)
+        slot = index_table_get(&idx->old, key, idx->migrate_pos, match, ctx);
+    return slot ? slot->target : NULL;
+}
+
+// Pre-size an index for a bulk load so it never doubles while loading
+void index_reserve(HashIndex *idx, size_t entries) {
+    size_t capacity = idx->cur.mask + 1;
+    size_t needed = entries + index_count(idx);
+    if (needed * 100 <= capacity * INDEX_MAX_LOAD_PCT)
+        return;
+    while (needed * 100 > capacity * INDEX_MAX_LOAD_PCT)
+        capacity *= 2;
+
+    index_migrate(idx, (size_t)-1);
+    IndexTable prev = idx->cur;
+    index_table_alloc(&idx->cur, capacity);
+    for (size_t i = 0; i <= prev.mask; i++)
+        if (prev.slots[i].dist != 0)
+            index_table_put(&idx->cur, prev.slots[i].key, prev.slots[i].target);
+    index_table_release(&prev);
+}
+
+size_t index_count(const HashIndex *idx) {
+    return idx->cur.count + idx->old.count;
+}
+
+// Drop every entry and release the tables (index_init before reusing it)
+void index_free(HashIndex *idx) {
+    index_table_release(&idx->cur);
+    if (idx->old.slots) {
+        index_release_old(idx, (idx->old.mask + 1) * sizeof(IndexSlot));
+        idx->old.slots = NULL;
+        idx->old.count = 0;
+    }
+}
+
+void index_print_stats(const HashIndex *idx) {
+    size_t capacity = idx->cur.mask + 1;
+    printf("%-16s | %10zu | %10zu | %5.1f%% | %8lu | %s\n",
+           idx->name, index_count(idx), capacity,
+           100.0 * idx->cur.count / capacity, idx->resizes,
+           idx->old.slots ? "yes" : "no");
+}
+
+// Free all index memory on exit
+void free_index() {
+    member_tables_free();
+    index_free(&workspace_index);
+    index_free(&booking_index);
+    index_free(&payment_index);
+    index_free(&bookings_by_member);
+    index_free(&bookings_by_workspace);
+    index_free(&payments_by_booking);
+    ordered_free(&bookings_by_start);
+    ordered_free(&payments_by_date);
+    mat_aggregates_free();
+    schedule_free();
+}
+
+/* * ==========================================
+ * BOOKING SCHEDULE (Per-Workspace Interval Index)
+ * ==========================================
+ */
+
+// Days from 1970-01-01 to a calendar date, or -1 if the date is out of range
+static int64_t days_since_epoch(int year, int month, int day)
+{
+    static const int days_in_month[] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (year < 1970 || month < 1 || month > 12 || day < 1 || day > days_in_month[month - 1])
+        return -1;
+
+    // Civil calendar, March-based year
+    int y = month <= 2 ? year - 1 : year;
+    int era = y / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + doe - 719468;
+}
+
+// Parses "YYYY-MM-DDTHH:MM" (or a space instead of 'T') into minutes since
+// 1970-01-01. Returns -1 for anything else.
+int64_t parse_booking_time(const char *text)
+{
+    int year, month, day, hour, minute, used = 0;
+    char sep;
+    if (sscanf(text, "%4d-%2d-%2d%c%2d:%2d%n", &year, &month, &day, &sep, &hour, &minute, &used) != 6 ||
+        text[used] != '\0' || (sep != 'T' && sep != ' '))
+        return -1;
+    int64_t days = days_since_epoch(year, month, day);
+    if (days < 0 || hour > 23 || hour < 0 || minute > 59 || minute < 0)
+        return -1;
+    return (days * 24 + hour) * 60 + minute;
+}
+
+// Parses a payment date "YYYY-MM-DD" into days since 1970-01-01, or -1
+int64_t parse_payment_date(const char *text)
+{
+    int year, month, day, used = 0;
+    if (sscanf(text, "%4d-%2d-%2d%n", &year, &month, &day, &used) != 3 || text[used] != '\0')
+        return -1;
+    return days_since_epoch(year, month, day);
+}
+
+// Parsed endTime, or -1 unless both times parse and the end is later
+int64_t booking_end(const BookingNode *node)
+{
+    return node->length_min ? node->start_min + node->length_min : -1;
+}
+
+// Only bookings with valid times that are not cancelled hold the workspace
+static int booking_occupies(const BookingNode *node)
+{
+    return node->length_min && !node->cancelled;
+}
+
+static WorkspaceSchedule *schedule_get(int workspaceId, int create)
+{
+    WorkspaceSchedule *sched = (WorkspaceSchedule *)index_find(&schedule_index, workspaceId);
+    if (sched || !create)
+        return sched;
+
+    sched = (WorkspaceSchedule *)calloc(1, sizeof(WorkspaceSchedule));
+    if (!sched) {
+        perror("Failed to allocate workspace schedule");
+        exit(1);
+    }
+    sched->workspaceId = workspaceId;
+    sched->next = schedule_list;
+    schedule_list = sched;
+    index_insert(&schedule_index, workspaceId, sched);
+    return sched;
+}
+
+// First position whose booking starts at or after 'start'
+static size_t schedule_lower_bound(const WorkspaceSchedule *sched, int64_t start)
+{
+    size_t lo = 0, hi = sched->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sched->items[mid]->start_min < start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// First position that can overlap [from, ...)
+static size_t schedule_scan_start(const WorkspaceSchedule *sched, int64_t from)
+{
+    return schedule_lower_bound(sched, from - sched->max_len);
+}
+
+void schedule_add(BookingNode *node)
+{
+    if (node->scheduled || !booking_occupies(node))
+        return;
+
+    WorkspaceSchedule *sched = schedule_get(node->workspaceId, 1);
+    if (sched->count == sched->capacity) {
+        size_t capacity = sched->capacity ? sched->capacity * 2 : 8;
+        BookingNode **items = (BookingNode **)realloc(sched->items, capacity * sizeof(BookingNode *));
+        if (!items) {
+            perror("Failed to grow workspace schedule");
+            exit(1);
+        }
+        sched->items = items;
+        sched->capacity = capacity;
+    }
+
+    // Bookings are mostly added in time order, so this usually appends
+    size_t pos = schedule_lower_bound(sched, node->start_min);
+    memmove(&sched->items[pos + 1], &sched->items[pos], (sched->count - pos) * sizeof(BookingNode *));
+    sched->items[pos] = node;
+    sched->count++;
+    if (node->length_min > sched->max_len) {
+        sched->max_len = node->length_min;
+        sched->max_holders = 0;
+    }
+    if (node->length_min == sched->max_len)
+        sched->max_holders++;
+    node->scheduled = 1;
+}
+
+// The longest listing left (O(count), only when the last longest one goes)
+static void schedule_recompute_max(WorkspaceSchedule *sched)
+{
+    sched->max_len = 0;
+    sched->max_holders = 0;
+    for (size_t i = 0; i < sched->count; i++) {
+        int64_t length = sched->items[i]->length_min;
+        if (length > sched->max_len) {
+            sched->max_len = length;
+            sched->max_holders = 0;
+        }
+        if (length == sched->max_len)
+            sched->max_holders++;
+    }
+}
+
+void schedule_remove(BookingNode *node)
+{
+    if (!node->scheduled)
+        return;
+
+    WorkspaceSchedule *sched = schedule_get(node->workspaceId, 0);
+    node->scheduled = 0;
+    if (!sched)
+        return;
+    for (size_t i = schedule_lower_bound(sched, node->start_min);
+         i < sched->count && sched->items[i]->start_min == node->start_min; i++) {
+        if (sched->items[i] == node) {
+            memmove(&sched->items[i], &sched->items[i + 1], (sched->count - i - 1) * sizeof(BookingNode *));
+            sched->count--;
+            if (node->length_min == sched->max_len && --sched->max_holders == 0)
+                schedule_recompute_max(sched);
+            break;
+        }
+    }
+}
+
+// Returns an occupying booking (other than excludeId) overlapping [start, end), or NULL
+BookingNode *schedule_find_conflict(int workspaceId, int64_t start, int64_t end, int excludeId)
+{
+    WorkspaceSchedule *sched = schedule_get(workspaceId, 0);
+    if (!sched)
+        return NULL;
+    for (size_t i = schedule_scan_start(sched, start);
+         i < sched->count && sched->items[i]->start_min < end; i++) {
+        BookingNode *node = sched->items[i];
+        if (booking_end(node) > start && node->bookingId != excludeId)
+            return node;
+    }
+    return NULL;
+}
+
+void schedule_free() {
+    while (schedule_list) {
+        WorkspaceSchedule *next = schedule_list->next;
+        free(schedule_list->items);
+        free(schedule_list);
+        schedule_list = next;
+    }
+    index_free(&schedule_index);
+}
+
+void schedule_print_stats()
+{
+    size_t schedules = 0, listed = 0, longest = 0;
+
+    pthread_rwlock_rdlock(&bookings_lock);
+    for (WorkspaceSchedule *sched = schedule_list; sched; sched = sched->next) {
+        schedules++;
+        listed += sched->count;
+        if (sched->count > longest)
+            longest = sched->count;
+    }
+    unsigned long conflicts = booking_conflicts;
+    pthread_rwlock_unlock(&bookings_lock);
+
+    printf("\n--- Booking Schedule ---\n");
+    printf("Workspaces scheduled : %zu\n", schedules);
+    printf("Occupying bookings   : %zu (longest schedule %zu)\n", listed, longest);
+    printf("Conflicts rejected   : %lu\n", conflicts);
+}
+
+/* * ==========================================
+ * ORDERED INDEXES (B+Tree on Booking Start / Payment Date)
+ * ==========================================
+ */
+// Nodes come from the index's own slab. Deletes never merge nodes: a leaf is
+// freed when its last key goes, and so is an inner node left without
+// children. Keys arrive roughly in time order and leave the same way, so
+// half-empty leaves are rare and rebalancing would only add write cost.
+
+static int ordered_key_less(const OrderedKey *a, const OrderedKey *b)
+{
+    return a->time < b->time || (a->time == b->time && a->id < b->id);
+}
+
+// First position in a leaf whose key is >= *key
+static int ordered_lower_bound(const OrderedNode *node, const OrderedKey *key)
+{
+    int lo = 0, hi = node->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ordered_key_less(&node->keys[mid], key))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Child of an inner node that covers *key (separators equal to it route right)
+static int ordered_child_of(const OrderedNode *node, const OrderedKey *key)
+{
+    int lo = 0, hi = node->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ordered_key_less(key, &node->keys[mid]))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+static OrderedNode *ordered_new_node(OrderedIndex *idx, int leaf)
+{
+    OrderedNode *node = (OrderedNode *)slab_alloc(&idx->nodes);
+    node->leaf = leaf;
+    node->count = 0;
+    node->next = node->prev = NULL;
+    return node;
+}
+
+static void ordered_free_node(OrderedIndex *idx, OrderedNode *node)
+{
+    slab_free(&idx->nodes, node);
+    idx->freed++;
+}
+
+// Walks from the root to the leaf covering *key. When 'path' is given it
+// records each inner node and the child taken (height - 1 entries).
+static OrderedNode *ordered_descend(const OrderedIndex *idx, const OrderedKey *key, OrderedNode **path, int *slots)
+{
+    OrderedNode *node = idx->root;
+    for (int depth = 0; !node->leaf; depth++) {
+        int child = ordered_child_of(node, key);
+        if (path) {
+            path[depth] = node;
+            slots[depth] = child;
+        }
+        node = (OrderedNode *)node->ptrs[child];
+    }
+    return node;
+}
+
+void ordered_init(OrderedIndex *idx, const char *name)
+{
+    memset(idx, 0, sizeof(*idx));
+    idx->name = name;
+    slab_init(&idx->nodes, name, sizeof(OrderedNode));
+}
+
+void ordered_insert(OrderedIndex *idx, int64_t time, int id, void *target)
+{
+    OrderedKey key = { time, id };
+    if (!idx->root) {
+        idx->root = ordered_new_node(idx, 1);
+        idx->height = 1;
+    }
+
+    OrderedNode *path[ORDERED_MAX_HEIGHT];
+    int slots[ORDERED_MAX_HEIGHT];
+    OrderedNode *leaf = ordered_descend(idx, &key, path, slots);
+    int pos = ordered_lower_bound(leaf, &key);
+    memmove(&leaf->keys[pos + 1], &leaf->keys[pos], (leaf->count - pos) * sizeof(OrderedKey));
+    memmove(&leaf->ptrs[pos + 1], &leaf->ptrs[pos], (leaf->count - pos) * sizeof(void *));
+    leaf->keys[pos] = key;
+    leaf->ptrs[pos] = target;
+    leaf->count++;
+    idx->count++;
+    if (leaf->count <= ORDERED_FANOUT)
+        return;
+
+    // Leaf split: the upper half moves to a new right sibling, whose first
+    // key is copied up as the separator
+    OrderedNode *right = ordered_new_node(idx, 1);
+    int keep = leaf->count / 2;
+    right->count = leaf->count - keep;
+    memcpy(right->keys, &leaf->keys[keep], right->count * sizeof(OrderedKey));
+    memcpy(right->ptrs, &leaf->ptrs[keep], right->count * sizeof(void *));
+    leaf->count = keep;
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next)
+        leaf->next->prev = right;
+    leaf->next = right;
+    idx->splits++;
+
+    OrderedKey up = right->keys[0];
+    OrderedNode *child = right;
+    for (int depth = idx->height - 2; depth >= 0; depth--) {
+        OrderedNode *node = path[depth];
+        int slot = slots[depth];
+        memmove(&node->keys[slot + 1], &node->keys[slot], (node->count - slot) * sizeof(OrderedKey));
+        memmove(&node->ptrs[slot + 2], &node->ptrs[slot + 1], (node->count - slot) * sizeof(void *));
+        node->keys[slot] = up;
+        node->ptrs[slot + 1] = child;
+        node->count++;
+        if (node->count <= ORDERED_FANOUT)
+            return;
+
+        // Inner split: the middle separator moves up rather than being copied
+        OrderedNode *sibling = ordered_new_node(idx, 0);
+        int mid = node->count / 2;
+        up = node->keys[mid];
+        sibling->count = node->count - mid - 1;
+        memcpy(sibling->keys, &node->keys[mid + 1], sibling->count * sizeof(OrderedKey));
+        memcpy(sibling->ptrs, &node->ptrs[mid + 1], (sibling->count + 1) * sizeof(void *));
+        node->count = mid;
+        child = sibling;
+        idx->splits++;
+    }
+
+    // The root split: grow by one level
+    OrderedNode *root = ordered_new_node(idx, 0);
+    root->count = 1;
+    root->keys[0] = up;
+    root->ptrs[0] = idx->root;
+    root->ptrs[1] = child;
+    idx->root = root;
+    idx->height++;
+}
+
+// Returns 1 if the key was present
+int ordered_remove(OrderedIndex *idx, int64_t time, int id)
+{
+    OrderedKey key = { time, id };
+    if (!idx->root)
+        return 0;
+
+    OrderedNode *path[ORDERED_MAX_HEIGHT];
+    int slots[ORDERED_MAX_HEIGHT];
+    OrderedNode *leaf = ordered_descend(idx, &key, path, slots);
+    int pos = ordered_lower_bound(leaf, &key);
+    if (pos == leaf->count || leaf->keys[pos].time != time || leaf->keys[pos].id != id)
+        return 0;
+    memmove(&leaf->keys[pos], &leaf->keys[pos + 1], (leaf->count - pos - 1) * sizeof(OrderedKey));
+    memmove(&leaf->ptrs[pos], &leaf->ptrs[pos + 1], (leaf->count - pos - 1) * sizeof(void *));
+    leaf->count--;
+    idx->count--;
+    if (leaf->count > 0)
+        return 1;
+
+    // Empty leaf: unchain it and drop it from its parent, and any ancestor
+    // that loses its only child with it
+    if (leaf->prev)
+        leaf->prev->next = leaf->next;
+    if (leaf->next)
+        leaf->next->prev = leaf->prev;
+    ordered_free_node(idx, leaf);
+    int depth = idx->height - 2;
+    for (; depth >= 0; depth--) {
+        OrderedNode *node = path[depth];
+        int slot = slots[depth];
+        if (node->count > 0) {
+            // Remove the child and the separator on its left (or right, for the first child)
+            int sep = slot > 0 ? slot - 1 : 0;
+            memmove(&node->keys[sep], &node->keys[sep + 1], (node->count - sep - 1) * sizeof(OrderedKey));
+            memmove(&node->ptrs[slot], &node->ptrs[slot + 1], (node->count - slot) * sizeof(void *));
+            node->count--;
+            break;
+        }
+        ordered_free_node(idx, node);
+    }
+    if (depth < 0) { // The whole tree emptied
+        idx->root = NULL;
+        idx->height = 0;
+        return 1;
+    }
+
+    // A root left with one child hands the root over to it
+    while (!idx->root->leaf && idx->root->count == 0) {
+        OrderedNode *old = idx->root;
+        idx->root = (OrderedNode *)old->ptrs[0];
+        ordered_free_node(idx, old);
+        idx->height--;
+    }
+    return 1;
+}
+
+// Positions the cursor at the first key >= (time, id)
+void ordered_seek(const OrderedIndex *idx, int64_t time, int id, OrderedCursor *cursor)
+{
+    OrderedKey key = { time, id };
+    cursor->leaf = NULL;
+    cursor->pos = 0;
+    if (!idx->root)
+        return;
+    cursor->leaf = ordered_descend(idx, &key, NULL, NULL);
+    cursor->pos = ordered_lower_bound(cursor->leaf, &key);
+}
+
+// Positions the cursor at the first key > *after (keys past id INT_MAX are
+// in the next time, so a paging cursor cannot overflow)
+void ordered_seek_after(const OrderedIndex *idx, const OrderedKey *after, OrderedCursor *cursor)
+{
+    if (after->id == INT_MAX && after->time == INT64_MAX)
+        *cursor = (OrderedCursor){ NULL, 0 };
+    else if (after->id == INT_MAX)
+        ordered_seek(idx, after->time + 1, INT_MIN, cursor);
+    else
+        ordered_seek(idx, after->time, after->id + 1, cursor);
+}
+
+// Returns the target under the cursor (its key in *key) and steps past it,
+// or NULL once the index is exhausted
+void *ordered_next(OrderedCursor *cursor, OrderedKey *key)
+{
+    while (cursor->leaf && cursor->pos >= cursor->leaf->count) {
+        cursor->leaf = cursor->leaf->next;
+        cursor->pos = 0;
+    }
+    if (!cursor->leaf)
+        return NULL;
+    if (key)
+        *key = cursor->leaf->keys[cursor->pos];
+    return cursor->leaf->ptrs[cursor->pos++];
+}
+
+// Drop every entry and node (ordered_init before reusing it)
+void ordered_free(OrderedIndex *idx)
+{
+    slab_release(&idx->nodes);
+    idx->root = NULL;
+    idx->height = 0;
+    idx->count = 0;
+}
+
+void ordered_print_stats(const OrderedIndex *idx)
+{
+    unsigned long nodes = idx->nodes.allocs - idx->nodes.frees;
+    printf("%-16s | %10zu | %6d | %10lu | %10lu | %10lu\n", idx->name, idx->count, idx->height,
+           nodes, idx->splits, idx->freed);
+}
+
+/* * ==========================================
+ * REFERENTIAL INTEGRITY (Reverse FK Indexes)
+ * ==========================================
+ */
+// Each parent id maps to the first child in an intrusive sibling list, so a
+// parent's dependents are found in O(dependents) instead of scanning a table.
+
+static HashIndex *booking_list_index(int list)
+{
+    return list == FK_BY_MEMBER ? &bookings_by_member : &bookings_by_workspace;
+}
+
+static int booking_list_key(const BookingNode *node, int list)
+{
+    return list == FK_BY_MEMBER ? node->memberId : node->workspaceId;
+}
+
+BookingNode *first_booking_of(int list, int parentId)
+{
+    return (BookingNode *)index_find(booking_list_index(list), parentId);
+}
+
+BookingNode *next_booking_of(const BookingNode *node, int list)
+{
+    return booking_at(node->fk[list].next);
+}
+
+PaymentNode *first_payment_of(int bookingId)
+{
+    return (PaymentNode *)index_find(&payments_by_booking, bookingId);
+}
+
+PaymentNode *next_payment_of(const PaymentNode *node)
+{
+    return payment_at(node->by_booking.next);
+}
+
+// Caller holds bookings_lock for writing
+void booking_fk_link(BookingNode *node)
+{
+    for (int list = 0; list < FK_BOOKING_LISTS; list++) {
+        int key = booking_list_key(node, list);
+        BookingNode *head = first_booking_of(list, key);
+        node->fk[list].prev = NO_RECORD;
+        node->fk[list].next = NO_RECORD;
+        if (!head) {
+            index_insert(booking_list_index(list), key, node);
+            continue;
+        }
+        // Link behind the head so the index entry never has to change
+        node->fk[list].prev = head->rid;
+        node->fk[list].next = head->fk[list].next;
+        if (head->fk[list].next != NO_RECORD)
+            booking_at(head->fk[list].next)->fk[list].prev = node->rid;
+        head->fk[list].next = node->rid;
+    }
+}
+
+void booking_fk_unlink(BookingNode *node)
+{
+    for (int list = 0; list < FK_BOOKING_LISTS; list++) {
+        BookingLink *link = &node->fk[list];
+        if (link->next != NO_RECORD)
+            booking_at(link->next)->fk[list].prev = link->prev;
+        if (link->prev != NO_RECORD)
+            booking_at(link->prev)->fk[list].next = link->next;
+        else {
+            int key = booking_list_key(node, list);
+            index_remove(booking_list_index(list), key);
+            if (link->next != NO_RECORD)
+                index_insert(booking_list_index(list), key, booking_at(link->next));
+        }
+        link->next = link->prev = NO_RECORD;
+    }
+}
+
+// Caller holds payments_lock for writing
+void payment_fk_link(PaymentNode *node)
+{
+    PaymentNode *head = first_payment_of(node->bookingId);
+    node->by_booking.prev = NO_RECORD;
+    node->by_booking.next = NO_RECORD;
+    if (!head) {
+        index_insert(&payments_by_booking, node->bookingId, node);
+        return;
+    }
+    node->by_booking.prev = head->rid;
+    node->by_booking.next = head->by_booking.next;
+    if (head->by_booking.next != NO_RECORD)
+        payment_at(head->by_booking.next)->by_booking.prev = node->rid;
+    head->by_booking.next = node->rid;
+}
+
+void payment_fk_unlink(PaymentNode *node)
+{
+    PaymentLink *link = &node->by_booking;
+    if (link->next != NO_RECORD)
+        payment_at(link->next)->by_booking.prev = link->prev;
+    if (link->prev != NO_RECORD)
+        payment_at(link->prev)->by_booking.next = link->next;
+    else {
+        index_remove(&payments_by_booking, node->bookingId);
+        if (link->next != NO_RECORD)
+            index_insert(&payments_by_booking, node->bookingId, payment_at(link->next));
+    }
+    link->next = link->prev = NO_RECORD;
+}
+
+int count_bookings_of(int list, int parentId)
+{
+    int count = 0;
+    for (BookingNode *node = first_booking_of(list, parentId); node; node = next_booking_of(node, list))
+        count++;
+    return count;
+}
+
+int count_payments_of(int bookingId)
+{
+    int count = 0;
+    for (PaymentNode *node = first_payment_of(bookingId); node; node = next_payment_of(node))
+        count++;
+    return count;
+}
+
+// CASCADE helpers: remove dependents and log one WAL delete per row, so replay
+// needs no referential logic. Caller holds the child tables' write locks.
+int cascade_delete_payments(int bookingId, uint64_t *lsn)
+{
+    int count = 0;
+    PaymentNode *node;
+    while ((node = first_payment_of(bookingId)) != NULL) {
+        int id = node->paymentId;
+        remove_payment_node(node);
+        *lsn = wal_append(WAL_DELETE, SNAP_PAYMENTS, &id, sizeof(id));
+        count++;
+    }
+    return count;
+}
+
+int cascade_delete_bookings(int list, int parentId, uint64_t *lsn, int *payments)
+{
+    int count = 0;
+    BookingNode *node;
+    while ((node = first_booking_of(list, parentId)) != NULL) {
+        int id = node->bookingId;
+        *payments += cascade_delete_payments(id, lsn);
+        remove_booking_node(node);
+        *lsn = wal_append(WAL_DELETE, SNAP_BOOKINGS, &id, sizeof(id));
+        count++;
+    }
+    return count;
+}
+
+/* * ==========================================
+ * LOCK-FREE READS (Id Map + Epoch Reclamation)
+ * ==========================================
+ */
+// Readers look ids up without taking any lock. A reader announces the epoch
+// it runs in, follows the id map with atomic loads and copies what it needs.
+// Writers publish with atomic stores and never modify a published member
+// record (updates install a new copy). A node taken out of the map is
+// retired with the current epoch. It is freed only once every active reader
+// has announced a later epoch, so a reader can never touch freed memory.
+//
+// The map, the announcements and the retire stamps all use sequentially
+// consistent atomics: a reader that missed a retirement is guaranteed to see
+// the map without the node.
+
+EpochSlot epoch_slots[EPOCH_MAX_THREADS];
+atomic_uint_fast64_t global_epoch = 1; // 0 is reserved for "not reading"
+atomic_int epoch_slots_high;           // Slots ever claimed; reclaim scans stop here
+atomic_ulong epoch_reclaimed, epoch_fallbacks;
+static _Thread_local EpochSlot *epoch_self;
+static pthread_key_t epoch_key;
+static pthread_once_t epoch_key_once = PTHREAD_ONCE_INIT;
+
+static void epoch_release_slot(void *slot)
+{
+    atomic_store(&((EpochSlot *)slot)->epoch, 0);
+    atomic_store(&((EpochSlot *)slot)->in_use, 0);
+}
+
+static void epoch_create_key()
+{
+    pthread_key_create(&epoch_key, epoch_release_slot);
+}
+
+// A thread claims a slot on its first lock-free read and frees it on exit
+static EpochSlot *epoch_register()
+{
+    pthread_once(&epoch_key_once, epoch_create_key);
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++)
+    {
+        int unused = 0;
+        if (!atomic_compare_exchange_strong(&epoch_slots[i].in_use, &unused, 1))
+            continue;
+        int high = atomic_load(&epoch_slots_high);
+        while (high < i + 1 && !atomic_compare_exchange_weak(&epoch_slots_high, &high, i + 1))
+            ;
+        epoch_self = &epoch_slots[i];
+        pthread_setspecific(epoch_key, epoch_self);
+        return epoch_self;
+    }
+    return NULL;
+}
+
+// Returns 0 when every slot is taken; the caller then uses the locked path
+int epoch_enter()
+{
+    EpochSlot *slot = epoch_self ? epoch_self : epoch_register();
+    if (!slot)
+    {
+        atomic_fetch_add_explicit(&epoch_fallbacks, 1, memory_order_relaxed);
+        return 0;
+    }
+    atomic_store(&slot->epoch, atomic_load(&global_epoch));
+    return 1;
+}
+
+void epoch_exit()
+{
+    atomic_store_explicit(&epoch_self->epoch, 0, memory_order_release);
+}
+
+// Stamp for a node that was just unlinked: readers that entered before the
+// bump may still hold it, readers after it cannot reach it
+uint64_t epoch_retire_stamp()
+{
+    return atomic_fetch_add(&global_epoch, 1);
+}
+
+// Nodes stamped below this are unreachable by every reader
+uint64_t epoch_oldest_reader()
+{
+    uint64_t oldest = UINT64_MAX;
+    int high = atomic_load(&epoch_slots_high);
+    for (int i = 0; i < high; i++)
+    {
+        uint64_t epoch = atomic_load(&epoch_slots[i].epoch);
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+    return oldest;
+}
+
+void epoch_print_stats()
+{
+    size_t pending = 0;
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+    {
+        pthread_rwlock_rdlock(&member_stripes[i].lock);
+        pending += member_stripes[i].limbo_count;
+        pthread_rwlock_unlock(&member_stripes[i].lock);
+    }
+    printf("\n--- Lock-Free Reads ---\n");
+    printf("Epoch: %llu | Reader slots used: %d/%d | Retired pending: %zu | Reclaimed: %lu | Locked fallbacks: %lu\n",
+           (unsigned long long)atomic_load(&global_epoch), atomic_load(&epoch_slots_high), EPOCH_MAX_THREADS,
+           pending, (unsigned long)atomic_load(&epoch_reclaimed), (unsigned long)atomic_load(&epoch_fallbacks));
+}
+
+void *id_map_find(IdMap *map, int id)
+{
+    if (id <= 0)
+        return NULL;
+    IdMapMid *mid = atomic_load(&map->top[id >> (ID_MAP_LEAF_BITS + ID_MAP_MID_BITS)]);
+    if (!mid)
+        return NULL;
+    IdMapLeaf *leaf = atomic_load(&mid->leaves[(id >> ID_MAP_LEAF_BITS) & ((1 << ID_MAP_MID_BITS) - 1)]);
+    if (!leaf)
+        return NULL;
+    return atomic_load(&leaf->slots[id & ((1 << ID_MAP_LEAF_BITS) - 1)]);
+}
+
+// Writers of different stripes can race to create the same leaf; the first
+// CAS wins and the loser frees its copy. Ids must be positive.
+void id_map_store(IdMap *map, int id, void *node)
+{
+    if (id <= 0)
+        return;
+    _Atomic(IdMapMid *) *mid_ref = &map->top[id >> (ID_MAP_LEAF_BITS + ID_MAP_MID_BITS)];
+    IdMapMid *mid = atomic_load(mid_ref);
+    if (!mid)
+    {
+        IdMapMid *fresh = (IdMapMid *)calloc(1, sizeof(IdMapMid));
+        if (!fresh) {
+            perror("Failed to grow id map");
+            exit(1);
+        }
+        if (atomic_compare_exchange_strong(mid_ref, &mid, fresh))
+            mid = fresh;
+        else
+            free(fresh);
+    }
+    _Atomic(IdMapLeaf *) *leaf_ref = &mid->leaves[(id >> ID_MAP_LEAF_BITS) & ((1 << ID_MAP_MID_BITS) - 1)];
+    IdMapLeaf *leaf = atomic_load(leaf_ref);
+    if (!leaf)
+    {
+        IdMapLeaf *fresh = (IdMapLeaf *)calloc(1, sizeof(IdMapLeaf));
+        if (!fresh) {
+            perror("Failed to grow id map");
+            exit(1);
+        }
+        if (atomic_compare_exchange_strong(leaf_ref, &leaf, fresh))
+        {
+            leaf = fresh;
+            atomic_fetch_add(&map->leaf_count, 1);
+        }
+        else
+            free(fresh);
+    }
+    atomic_store(&leaf->slots[id & ((1 << ID_MAP_LEAF_BITS) - 1)], node);
+}
+
+// Teardown only: no reader may be running
+void id_map_free(IdMap *map)
+{
+    for (int top = 0; top < ID_MAP_TOP; top++)
+    {
+        IdMapMid *mid = atomic_load(&map->top[top]);
+        if (!mid)
+            continue;
+        for (int i = 0; i < (1 << ID_MAP_MID_BITS); i++)
+            free(atomic_load(&mid->leaves[i]));
+        free(mid);
+        atomic_store(&map->top[top], NULL);
+    }
+    atomic_store(&map->leaf_count, 0);
+}
+
+/* * ==========================================
+ * COMPACT MEMBER ROWS (String Heap)
+ * ==========================================
+ */
+
+static size_t str_heap_block_size(size_t length)
+{
+    return (length + STR_HEAP_ALIGN) / STR_HEAP_ALIGN * STR_HEAP_ALIGN; // Room for the NUL too
+}
+
+// Copy of text[0 .. length) and a NUL, in a recycled block of the same size
+// if there is one
+static const char *str_heap_alloc(StrHeap *heap, const char *text, size_t length)
+{
+    size_t size = str_heap_block_size(length);
+    StrHeapBlock **list = &heap->free_lists[size / STR_HEAP_ALIGN - 1];
+    char *block;
+    if (*list)
+    {
+        block = (char *)*list;
+        *list = (*list)->next;
+    }
+    else
+    {
+        if (heap->left < size)
+        {
+            StrHeapChunk *chunk = (StrHeapChunk *)malloc(sizeof(StrHeapChunk) + STR_HEAP_CHUNK);
+            if (!chunk) {
+                perror("Failed to grow member string heap");
+                exit(1);
+            }
+            chunk->next = heap->chunks;
+            heap->chunks = chunk;
+            heap->chunk_count++;
+            heap->cursor = (char *)(chunk + 1);
+            heap->left = STR_HEAP_CHUNK;
+        }
+        block = heap->cursor;
+        heap->cursor += size;
+        heap->left -= size;
+    }
+    memcpy(block, text, length);
+    block[length] = '\0';
+    heap->live_bytes += size;
+    return block;
+}
+
+static void str_heap_free(StrHeap *heap, const char *text, size_t length)
+{
+    size_t size = str_heap_block_size(length);
+    StrHeapBlock *block = (StrHeapBlock *)(uintptr_t)text;
+    block->next = heap->free_lists[size / STR_HEAP_ALIGN - 1];
+    heap->free_lists[size / STR_HEAP_ALIGN - 1] = block;
+    heap->live_bytes -= size;
+}
+
+static void str_heap_release(StrHeap *heap)
+{
+    while (heap->chunks)
+    {
+        StrHeapChunk *next = heap->chunks->next;
+        free(heap->chunks);
+        heap->chunks = next;
+    }
+    memset(heap, 0, sizeof(*heap));
+}
+
+static const char *compact_str_heap(const CompactStr *str)
+{
+    const char *text;
+    memcpy(&text, str->text + 4, sizeof(text));
+    return text;
+}
+
+// NUL-terminated text, wherever it is stored
+const char *compact_str_cstr(const CompactStr *str)
+{
+    return str->length <= MEMBER_INLINE_TEXT ? str->text : compact_str_heap(str);
+}
+
+// Caller bounds text to MEMBER_TEXT_MAX and holds the heap's stripe
+static void compact_str_set(StrHeap *heap, CompactStr *str, const char *text)
+{
+    size_t length = strlen(text);
+    memset(str, 0, sizeof(*str));
+    str->length = (uint32_t)length;
+    if (length <= MEMBER_INLINE_TEXT)
+    {
+        memcpy(str->text, text, length);
+        heap->inline_strings++;
+        return;
+    }
+    const char *copy = str_heap_alloc(heap, text, length);
+    memcpy(str->text, text, 4);
+    memcpy(str->text + 4, &copy, sizeof(copy));
+    heap->heap_strings++;
+}
+
+static void compact_str_clear(StrHeap *heap, CompactStr *str)
+{
+    if (str->length > MEMBER_INLINE_TEXT)
+    {
+        str_heap_free(heap, compact_str_heap(str), str->length);
+        heap->heap_strings--;
+    }
+    else
+        heap->inline_strings--;
+    memset(str, 0, sizeof(*str));
+}
+
+// Length, then the inline prefix: most unequal strings never touch the heap
+int compact_str_equals(const CompactStr *str, const char *text, size_t length)
+{
+    if (str->length != length)
+        return 0;
+    if (length <= MEMBER_INLINE_TEXT)
+        return memcmp(str->text, text, length) == 0;
+    return memcmp(str->text, text, 4) == 0 && memcmp(compact_str_heap(str), text, length) == 0;
+}
+
+// Interface row from a stored node (caller holds its stripe or an epoch)
+void member_decode(const MemberNode *node, Member *out)
+{
+    out->memberId = node->memberId;
+    memcpy(out->name, compact_str_cstr(&node->name), node->name.length + 1);
+    memcpy(out->email, compact_str_cstr(&node->email), node->email.length + 1);
+}
+
+// Fills a fresh node's fields from its stripe's heap
+static void member_encode(MemberStripe *stripe, MemberNode *node, const Member *data)
+{
+    node->memberId = data->memberId;
+    node->version = record_version_next();
+    compact_str_set(&stripe->heap, &node->name, data->name);
+    compact_str_set(&stripe->heap, &node->email, data->email);
+}
+
+static void member_release_text(MemberStripe *stripe, MemberNode *node)
+{
+    compact_str_clear(&stripe->heap, &node->name);
+    compact_str_clear(&stripe->heap, &node->email);
+}
+
+const char *member_email(const MemberNode *node)
+{
+    return compact_str_cstr(&node->email);
+}
+
+/* * ==========================================
+ * MEMBER STRIPES (Lock Striping)
+ * ==========================================
+ */
+// Point operations lock one stripe. Adding or deleting a member also locks
+// its email stripe. Several stripes are always locked in ascending order,
+// and all of them come before the workspace lock in the global lock order.
+// Stripes are chosen by the top bits of the hash, because the per-stripe
+// indexes place entries by the low bits.
+
+static inline int stripe_of(uint64_t hash)
+{
+    return (int)(hash_function(hash) >> (64 - MEMBER_STRIPE_BITS));
+}
+
+MemberStripe *member_stripe(int memberId)
+{
+    return &member_stripes[stripe_of((uint64_t)memberId)];
+}
+
+MemberStripe *email_stripe(const char *email)
+{
+    return &member_stripes[stripe_of(hash_string(email))];
+}
+
+void member_wrlock_pair(MemberStripe *a, MemberStripe *b)
+{
+    MemberStripe *first = a < b ? a : b, *second = a < b ? b : a;
+    pthread_rwlock_wrlock(&first->lock);
+    if (second != first)
+        pthread_rwlock_wrlock(&second->lock);
+}
+
+void member_unlock_pair(MemberStripe *a, MemberStripe *b)
+{
+    pthread_rwlock_unlock(&a->lock);
+    if (b != a)
+        pthread_rwlock_unlock(&b->lock);
+}
+
+void members_rdlock_all()
+{
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+        pthread_rwlock_rdlock(&member_stripes[i].lock);
+}
+
+void members_unlock_all()
+{
+    for (int i = MEMBER_STRIPES - 1; i >= 0; i--)
+        pthread_rwlock_unlock(&member_stripes[i].lock);
+}
+
+// Exact when the stripes are locked (or during single-threaded load)
+size_t member_count()
+{
+    size_t count = 0;
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+        count += member_stripes[i].count;
+    return count;
+}
+
+void member_tables_init()
+{
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+    {
+        MemberStripe *stripe = &member_stripes[i];
+        stripe->head = stripe->tail = NULL;
+        stripe->count = 0;
+        index_init(&stripe->email_index, "Email Index");
+        slab_init(&stripe->slab, "Members", sizeof(MemberNode));
+    }
+}
+
+// Rows, retired nodes and the id map that points at them (no readers may run)
+void member_rows_free()
+{
+    id_map_free(&member_ids);
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+    {
+        MemberStripe *stripe = &member_stripes[i];
+        slab_release(&stripe->slab);
+        str_heap_release(&stripe->heap);
+        stripe->head = stripe->tail = NULL;
+        stripe->count = 0;
+        free(stripe->limbo);
+        stripe->limbo = NULL;
+        stripe->limbo_count = stripe->limbo_capacity = stripe->reclaim_at = 0;
+    }
+}
+
+// Drops every member row and index (locks are left alone)
+void member_tables_free()
+{
+    member_rows_free();
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+        index_free(&member_stripes[i].email_index);
+}
+
+// Bulk loads: spread the expected rows over the stripes (with headroom)
+static void member_tables_reserve(size_t rows)
+{
+    size_t per_stripe = rows / MEMBER_STRIPES + rows / (8 * MEMBER_STRIPES) + 16;
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+        index_reserve(&member_stripes[i].email_index, per_stripe);
+}
+
+// Frees retired nodes no reader can still hold. Stamps grow within a stripe
+// (retirements are serialised by its lock), so the free ones form a prefix.
+// The next pass comes a batch later, or once the limbo has doubled if this
+// one freed nothing (a stalled reader), so retires stay amortised O(1).
+static void member_reclaim(MemberStripe *stripe)
+{
+    uint64_t oldest = epoch_oldest_reader();
+    size_t freed = 0;
+    while (freed < stripe->limbo_count && stripe->limbo[freed].epoch < oldest)
+    {
+        MemberNode *node = (MemberNode *)stripe->limbo[freed++].node;
+        member_release_text(stripe, node); // Its heap text was readable until now too
+        slab_free(&stripe->slab, node);
+    }
+    if (freed == 0) {
+        stripe->reclaim_at = stripe->limbo_count * 2;
+        return;
+    }
+    memmove(stripe->limbo, stripe->limbo + freed, (stripe->limbo_count - freed) * sizeof(RetiredNode));
+    stripe->limbo_count -= freed;
+    stripe->reclaim_at = stripe->limbo_count + EPOCH_RECLAIM_BATCH;
+    atomic_fetch_add_explicit(&epoch_reclaimed, freed, memory_order_relaxed);
+}
+
+// Caller holds the stripe for writing and has unlinked the node everywhere
+static void member_retire(MemberStripe *stripe, MemberNode *node)
+{
+    if (stripe->limbo_count == stripe->limbo_capacity)
+    {
+        stripe->limbo_capacity = stripe->limbo_capacity ? stripe->limbo_capacity * 2 : EPOCH_RECLAIM_BATCH * 2;
+        stripe->limbo = (RetiredNode *)realloc(stripe->limbo, stripe->limbo_capacity * sizeof(RetiredNode));
+        if (!stripe->limbo) {
+            perror("Failed to grow retire list");
+            exit(1);
+        }
+    }
+    stripe->limbo[stripe->limbo_count].node = node;
+    stripe->limbo[stripe->limbo_count].epoch = epoch_retire_stamp();
+    stripe->limbo_count++;
+    if (stripe->limbo_count >= (stripe->reclaim_at ? stripe->reclaim_at : EPOCH_RECLAIM_BATCH))
+        member_reclaim(stripe);
+}
+
+// One row for all stripes, in the layout of slab_print_stats (stripes locked one at a time)
+void member_print_slab_stats()
+{
+    Slab total;
+    memset(&total, 0, sizeof(total));
+    total.name = "Members";
+    total.node_size = sizeof(MemberNode);
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+    {
+        MemberStripe *stripe = &member_stripes[i];
+        pthread_rwlock_rdlock(&stripe->lock);
+        total.allocs += stripe->slab.allocs;
+        total.frees += stripe->slab.frees;
+        total.reused += stripe->slab.reused;
+        total.chunk_count += stripe->slab.chunk_count;
+        pthread_rwlock_unlock(&stripe->lock);
+    }
+    slab_print_stats(&total);
+}
+
+// Where member text lives, and the resulting bytes per row
+void member_print_heap_stats()
+{
+    unsigned long inline_strings = 0, heap_strings = 0;
+    size_t live = 0, chunks = 0, rows = 0;
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+    {
+        MemberStripe *stripe = &member_stripes[i];
+        pthread_rwlock_rdlock(&stripe->lock);
+        inline_strings += stripe->heap.inline_strings;
+        heap_strings += stripe->heap.heap_strings;
+        live += stripe->heap.live_bytes;
+        chunks += stripe->heap.chunk_count;
+        rows += stripe->count;
+        pthread_rwlock_unlock(&stripe->lock);
+    }
+    printf("Member text: %lu inline, %lu in heap (%.1f KB used of %.1f KB) | %zu-byte nodes, %.1f bytes/row with text\n",
+           inline_strings, heap_strings, live / 1024.0, chunks * (STR_HEAP_CHUNK / 1024.0), sizeof(MemberNode),
+           rows ? sizeof(MemberNode) + (double)live / rows : 0.0);
+}
+
+void member_print_index_stats()
+{
+    // The id map has fixed-size leaves and never resizes
+    size_t rows = member_count();
+    size_t slots = atomic_load(&member_ids.leaf_count) << ID_MAP_LEAF_BITS;
+    printf("%-16s | %10zu | %10zu | %5.1f%% | %8d | %s (radix, lock-free reads)\n",
+           "Member Id Map", rows, slots, slots ? 100.0 * rows / slots : 0.0, 0, "no");
+
+    size_t entries = 0, capacity = 0, busiest = 0;
+    unsigned long resizes = 0;
+    int migrating = 0;
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+    {
+        MemberStripe *stripe = &member_stripes[i];
+        pthread_rwlock_rdlock(&stripe->lock);
+        const HashIndex *idx = &stripe->email_index;
+        entries += index_count(idx);
+        capacity += idx->cur.mask + 1;
+        resizes += idx->resizes;
+        migrating |= idx->old.slots != NULL;
+        if (index_count(idx) > busiest)
+            busiest = index_count(idx);
+        pthread_rwlock_unlock(&stripe->lock);
+    }
+    printf("%-16s | %10zu | %10zu | %5.1f%% | %8lu | %s (%d stripes, busiest %zu)\n",
+           "Email Index", entries, capacity, 100.0 * entries / capacity, resizes,
+           migrating ? "yes" : "no", MEMBER_STRIPES, busiest);
+}
+
+/* * ==========================================
+ * TABLE SNAPSHOTS (Scans Without Held Locks)
+ * ==========================================
+ */
+// Full-table readers (displays, CSV export, snapshot saves) copy the records
+// under the read lock and drop it before producing any output, so a slow
+// terminal, pipe or disk never holds up writers. Copying runs at memcpy
+// speed; the copy is a consistent view that later writes do not touch.
+
+atomic_ulong snapshot_scans, snapshot_rows;
+atomic_llong snapshot_max_hold_ns; // Longest time a copy kept writers out
+
+// The member table is read-locked stripe by stripe, in ascending order
+static void table_rdlock(int table)
+{
+    switch (table)
+    {
+    case SNAP_MEMBERS: members_rdlock_all(); break;
+    case SNAP_WORKSPACES: pthread_rwlock_rdlock(&workspaces_lock); break;
+    case SNAP_BOOKINGS: pthread_rwlock_rdlock(&bookings_lock); break;
+    default: pthread_rwlock_rdlock(&payments_lock); break;
+    }
+}
+
+static void table_unlock(int table)
+{
+    switch (table)
+    {
+    case SNAP_MEMBERS: members_unlock_all(); break;
+    case SNAP_WORKSPACES: pthread_rwlock_unlock(&workspaces_lock); break;
+    case SNAP_BOOKINGS: pthread_rwlock_unlock(&bookings_lock); break;
+    default: pthread_rwlock_unlock(&payments_lock); break;
+    }
+}
+
+static int member_id_order(const void *a, const void *b)
+{
+    int x = ((const Member *)a)->memberId, y = ((const Member *)b)->memberId;
+    return (x > y) - (x < y);
+}
+
+static void snapshot_reserve(TableSnapshot *snap, size_t row_size, size_t rows, int next_id)
+{
+    memset(snap, 0, sizeof(*snap));
+    snap->row_size = row_size;
+    snap->next_id = next_id;
+    snap->capacity = rows;
+    snap->rows = rows ? malloc(rows * row_size) : NULL;
+    if (rows && !snap->rows) {
+        perror("Failed to allocate table snapshot");
+        exit(1);
+    }
+}
+
+// Room for one more row, filled in by the caller
+static void *snapshot_next(TableSnapshot *snap)
+{
+    if (snap->count == snap->capacity)
+    {
+        snap->capacity = snap->capacity ? snap->capacity * 2 : 64;
+        snap->rows = realloc(snap->rows, snap->capacity * snap->row_size);
+        if (!snap->rows) {
+            perror("Failed to allocate table snapshot");
+            exit(1);
+        }
+    }
+    return (char *)snap->rows + snap->count++ * snap->row_size;
+}
+
+static void snapshot_push(TableSnapshot *snap, const void *record)
+{
+    memcpy(snapshot_next(snap), record, snap->row_size);
+}
+
+// Caller holds the table's lock. The primary index count sizes the copy
+// exactly. COPY_ROWS decodes into the interface structs; COPY_RECORDS keeps
+// the stored form (dictionary codes) for the snapshot file.
+static void table_snapshot_locked(int table, TableSnapshot *snap, int form)
+{
+    switch (table)
+    {
+    case SNAP_MEMBERS:
+        snapshot_reserve(snap, sizeof(Member), member_count(), next_member_id);
+        for (int i = 0; i < MEMBER_STRIPES; i++)
+            for (MemberNode *curr = member_stripes[i].head; curr != NULL; curr = curr->next)
+                member_decode(curr, (Member *)snapshot_next(snap));
+        break;
+    case SNAP_WORKSPACES:
+        if (form == COPY_RECORDS) {
+            snapshot_reserve(snap, sizeof(WorkspaceRecord), index_count(&workspace_index), next_workspace_id);
+            for (WorkspaceNode *curr = workspace_head; curr != NULL; curr = curr->next)
+                snapshot_push(snap, &curr->data);
+            break;
+        }
+        snapshot_reserve(snap, sizeof(Workspace), index_count(&workspace_index), next_workspace_id);
+        for (WorkspaceNode *curr = workspace_head; curr != NULL; curr = curr->next)
+            workspace_decode(&curr->data, (Workspace *)snapshot_next(snap));
+        break;
+    case SNAP_BOOKINGS:
+        if (form == COPY_RECORDS) {
+            snapshot_reserve(snap, sizeof(BookingRecord), index_count(&booking_index), next_booking_id);
+            for (BookingNode *curr = first_booking(); curr != NULL; curr = next_booking(curr))
+                paged_read(&booking_pages, curr->rid, snapshot_next(snap));
+            break;
+        }
+        snapshot_reserve(snap, sizeof(Booking), index_count(&booking_index), next_booking_id);
+        for (BookingNode *curr = first_booking(); curr != NULL; curr = next_booking(curr))
+            booking_read(curr, (Booking *)snapshot_next(snap));
+        break;
+    default:
+        if (form == COPY_RECORDS) {
+            snapshot_reserve(snap, sizeof(PaymentRecord), index_count(&payment_index), next_payment_id);
+            for (PaymentNode *curr = first_payment(); curr != NULL; curr = next_payment(curr))
+                paged_read(&payment_pages, curr->rid, snapshot_next(snap));
+            break;
+        }
+        snapshot_reserve(snap, sizeof(Payment), index_count(&payment_index), next_payment_id);
+        for (PaymentNode *curr = first_payment(); curr != NULL; curr = next_payment(curr))
+            payment_read(curr, (Payment *)snapshot_next(snap));
+        break;
+    }
+}
+
+static void snapshot_note(long long started_ns, size_t rows)
+{
+    long long held = now_ns() - started_ns;
+    long long longest = atomic_load_explicit(&snapshot_max_hold_ns, memory_order_relaxed);
+    while (held > longest &&
+           !atomic_compare_exchange_weak_explicit(&snapshot_max_hold_ns, &longest, held,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        ;
+    atomic_fetch_add_explicit(&snapshot_scans, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&snapshot_rows, rows, memory_order_relaxed);
+}
+
+// Stripes interleave ids, so member copies are put back in id order (after
+// the locks are released) for stable displays and snapshot files
+static void snapshot_sort(int table, TableSnapshot *snap)
+{
+    if (table == SNAP_MEMBERS && snap->count > 1)
+        qsort(snap->rows, snap->count, snap->row_size, member_id_order);
+}
+
+void table_snapshot(int table, TableSnapshot *snap)
+{
+    table_rdlock(table);
+    long long t = now_ns();
+    table_snapshot_locked(table, snap, COPY_ROWS);
+    table_unlock(table);
+    snapshot_note(t, snap->count);
+    snapshot_sort(table, snap);
+}
+
+// Every table at one instant, so rows and their parents agree. The locks are
+// taken in the global order (member stripes, workspaces, bookings, payments),
+// which is also the SNAP_* order, and held together only while copying.
+void database_snapshot(TableSnapshot snaps[SNAP_TABLES], int form)
+{
+    for (int table = 0; table < SNAP_TABLES; table++)
+        table_rdlock(table);
+    long long t = now_ns();
+    size_t rows = 0;
+    for (int table = 0; table < SNAP_TABLES; table++)
+    {
+        table_snapshot_locked(table, &snaps[table], form);
+        rows += snaps[table].count;
+    }
+    for (int table = SNAP_TABLES - 1; table >= 0; table--)
+        table_unlock(table);
+    snapshot_note(t, rows);
+    for (int table = 0; table < SNAP_TABLES; table++)
+        snapshot_sort(table, &snaps[table]);
+}
+
+void table_snapshot_free(TableSnapshot *snap)
+{
+    free(snap->rows);
+    memset(snap, 0, sizeof(*snap));
+}
+
+void snapshot_print_stats()
+{
+    unsigned long scans = atomic_load(&snapshot_scans);
+    printf("\n--- Snapshot Scans ---\n");
+    printf("Scans: %lu | Rows copied: %lu | Longest lock hold: %.3f ms\n", scans,
+           (unsigned long)atomic_load(&snapshot_rows), atomic_load(&snapshot_max_hold_ns) / 1e6);
+}
+
+/* * ==========================================
+ * MEMBER FUNCTIONS (Updated with Indexing)
+ * ==========================================
+ */
+
+// O(1) Lookup - The "Next Level" Upgrade. Needs no lock to test existence;
+// reading the node needs its stripe or an epoch (see db_get_member).
+MemberNode *findMemberNodeById(int id)
+{
+    // Note: No linear search of the member list needed anymore!
+    return (MemberNode *)id_map_find(&member_ids, id);
+}
+
+static int member_email_matches(const void *target, const void *ctx)
+{
+    const char *email = (const char *)ctx;
+    return compact_str_equals(&((const MemberNode *)target)->email, email, strlen(email));
+}
+
+// O(1) Lookup by email via the secondary index (caller holds the email's stripe)
+MemberNode *findMemberNodeByEmail(const char *email)
+{
+    return (MemberNode *)index_find_match(&email_stripe(email)->email_index, hash_string(email), member_email_matches, email);
+}
+
+// Email entries can sit in a different stripe than their row (replay of an
+// email change moves one)
+static void member_email_link(MemberNode *node)
+{
+    index_insert(&email_stripe(member_email(node))->email_index, hash_string(member_email(node)), node);
+}
+
+static void member_email_unlink(MemberNode *node)
+{
+    index_remove_target(&email_stripe(member_email(node))->email_index, hash_string(member_email(node)), node);
+}
+
+// Storage helpers shared by the menu, loaders and tools (caller write-locks
+// the id's stripe and the email's stripe)
+MemberNode *insert_member_node(const Member *data)
+{
+    MemberStripe *stripe = member_stripe(data->memberId);
+    MemberNode *newNode = (MemberNode *)slab_alloc(&stripe->slab);
+    member_encode(stripe, newNode, data);
+    newNode->next = newNode->prev = NULL;
+
+    // 1. Add to Main List (Storage)
+    if (!stripe->head)
+        stripe->head = stripe->tail = newNode;
+    else
+    {
+        stripe->tail->next = newNode;
+        newNode->prev = stripe->tail;
+        stripe->tail = newNode;
+    }
+
+    // 2. Add to Indexes (Lookup). The id map store publishes the node
+    // to lock-free readers, so it comes after the record is filled in.
+    stripe->count++;
+    member_email_link(newNode);
+    id_map_store(&member_ids, data->memberId, newNode);
+    return newNode;
+}
+
+void remove_member_node(MemberNode *node)
+{
+    MemberStripe *stripe = member_stripe(node->memberId);
+
+    // 1. Remove from Main List
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        stripe->head = node->next;
+    if (node->next)
+        node->next->prev = node->prev;
+    else
+        stripe->tail = node->prev;
+
+    // 2. Remove from Indexes
+    id_map_store(&member_ids, node->memberId, NULL);
+    member_email_unlink(node);
+    stripe->count--;
+
+    // Lock-free readers may still be copying it
+    member_retire(stripe, node);
+}
+
+// Copy-on-write update: 'fresh' (already filled in) takes the old node's
+// place in the list and both indexes, then the old one is retired. Caller
+// write-locks the id's stripe and the email's stripe.
+void replace_member_node(MemberNode *old, MemberNode *fresh)
+{
+    MemberStripe *stripe = member_stripe(old->memberId);
+    fresh->prev = old->prev;
+    fresh->next = old->next;
+    if (old->prev)
+        old->prev->next = fresh;
+    else
+        stripe->head = fresh;
+    if (old->next)
+        old->next->prev = fresh;
+    else
+        stripe->tail = fresh;
+
+    member_email_unlink(old);
+    member_email_link(fresh);
+    id_map_store(&member_ids, fresh->memberId, fresh);
+    member_retire(stripe, old);
+}
+
+void addMember()
+{
+    char name[100], email[100];
+    getString("Enter name: ", name, 100);
+    getString("Enter email: ", email, 100);
+
+    int newId;
+    DbStatus rc = db_add_member(name, email, &newId);
+    if (rc == DB_DUPLICATE) {
+        printf("Error: Email already exists.\n");
+        return;
+    }
+    if (rc == DB_INVALID) {
+        printf("Error: Name and email cannot be empty.\n");
+        return;
+    }
+    printf("Member added with ID %d.\n", newId);
+}
+
+void displayAllMembers()
+{
+    printf("\n--- All Members ---\n%-5s | %-30s | %-30s\n", "ID", "Name", "Email");
+    printf("------|--------------------------------|--------------------------------\n");
+
+    // Print from a copy so writers are not blocked while the terminal drains
+    TableSnapshot snap;
+    table_snapshot(SNAP_MEMBERS, &snap);
+    const Member *rows = (const Member *)snap.rows;
+    for (size_t i = 0; i < snap.count; i++)
+    {
+        printf("%-5d | %-30s | %-30s\n", rows[i].memberId, rows[i].name, rows[i].email);
+    }
+    table_snapshot_free(&snap);
+}
+
+void findMemberByEmail()
+{
+    char email[100];
+    getString("Enter email: ", email, 100);
+
+    Member member;
+    if (db_find_member_by_email(email, &member) == DB_OK)
+    {
+        printf("%-5s | %-30s | %-30s\n", "ID", "Name", "Email");
+        printf("%-5d | %-30s | %-30s\n", member.memberId, member.name, member.email);
+    }
+    else
+        printf("Member not found.\n");
+}
+
+void updateMember()
+{
+    int id = getInt("Enter ID of member to update: ");
+
+    Member member;
+    if (db_get_member(id, &member) != DB_OK)
+    {
+        printf("Member not found.\n");
+        return;
+    }
+    printf("Updating Member ID %d (Name: %s)\n", id, member.name);
+    char name[100];
+    getString("Enter new name (or Enter to skip): ", name, 100);
+    if (name[0] == '\0')
+        return;
+
+    if (db_update_member(id, name) != DB_OK)
+    {
+        printf("Member not found.\n");
+        return;
+    }
+    printf("Member ID %d updated.\n", id);
+}
+
+void deleteMember()
+{
+    int id = getInt("Enter ID of member to delete: ");
+
+    DbDeleteInfo info;
+    DbStatus rc = db_delete_member(id, &info);
+    if (rc == DB_NOT_FOUND)
+    {
+        printf("Member not found.\n");
+        return;
+    }
+    if (rc == DB_RESTRICTED)
+    {
+        printf("Error: Member ID %d still has %d booking(s). Delete them first (or set FLEXDESK_FK_DELETE=cascade).\n", id, info.dependents);
+        return;
+    }
+    printf("Member ID %d deleted.\n", id);
+    if (info.bookings)
+        printf("Also deleted %d booking(s) and %d payment(s).\n", info.bookings, info.payments);
+}
+
+/* * ==========================================
+ * WORKSPACE FUNCTIONS
+ * ==========================================
+ */
+
+WorkspaceNode *findWorkspaceNodeById(int id)
+{
+    return (WorkspaceNode *)index_find(&workspace_index, id);
+}
+
+// Storage helpers (caller holds workspaces_lock for writing)
+WorkspaceNode *insert_workspace_node(const Workspace *data)
+{
+    WorkspaceRecord record;
+    workspace_encode(data, &record);
+    return insert_workspace_record(&record);
+}
+
+WorkspaceNode *insert_workspace_record(const WorkspaceRecord *data)
+{
+    WorkspaceNode *newNode = (WorkspaceNode *)slab_alloc(&workspace_slab);
+    newNode->data = *data;
+    str_count_use(data->type, STR_COL_TYPE); // Type and location never change afterwards
+    str_count_use(data->location, STR_COL_LOCATION);
+    newNode->version = record_version_next();
+    newNode->next = newNode->prev = NULL;
+    if (!workspace_head)
+        workspace_head = workspace_tail = newNode;
+    else
+    {
+        workspace_tail->next = newNode;
+        newNode->prev = workspace_tail;
+        workspace_tail = newNode;
+    }
+    index_insert(&workspace_index, data->workspaceId, newNode);
+    return newNode;
+}
+
+void remove_workspace_node(WorkspaceNode *node)
+{
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        workspace_head = node->next;
+    if (node->next)
+        node->next->prev = node->prev;
+    else
+        workspace_tail = node->prev;
+    index_remove(&workspace_index, node->data.workspaceId);
+    slab_free(&workspace_slab, node);
+}
+
+void addWorkspace()
+{
+    char type[50], location[100];
+    getString("Enter type: ", type, 50);
+    getString("Enter location: ", location, 100);
+    int capacity = getInt("Enter capacity: ");
+    int price = getInt("Enter price (in cents): ");
+
+    int newId;
+    if (db_add_workspace(type, location, capacity, price, &newId) == DB_FULL) {
+        printf("Error: Too many distinct workspace types or locations. Cannot add workspace.\n");
+        return;
+    }
+    printf("Workspace added with ID %d.\n", newId);
+}
+
+void displayAllWorkspaces()
+{
+    printf("\n--- All Workspaces ---\n%-5s | %-20s | %-20s | %-10s | %s\n", "ID", "Type", "Location", "Capacity", "Price(cents)");
+    printf("------|----------------------|----------------------|------------|-------------\n");
+
+    TableSnapshot snap;
+    table_snapshot(SNAP_WORKSPACES, &snap);
+    const Workspace *rows = (const Workspace *)snap.rows;
+    for (size_t i = 0; i < snap.count; i++)
+    {
+        printf("%-5d | %-20s | %-20s | %-10d | %d\n", rows[i].workspaceId, rows[i].type, rows[i].location, rows[i].capacity, rows[i].price_in_cents);
+    }
+    table_snapshot_free(&snap);
+}
+
+void updateWorkspace()
+{
+    int id = getInt("Enter ID of workspace to update: ");
+
+    Workspace workspace;
+    if (db_get_workspace(id, &workspace) != DB_OK)
+    {
+        printf("Workspace not found.\n");
+        return;
+    }
+    printf("Updating Workspace ID %d (Type: %s)\n", id, workspace.type);
+    int capacity = getInt("Enter new capacity: ");
+    int price = getInt("Enter new price (in cents): ");
+
+    if (db_update_workspace(id, capacity, price) != DB_OK)
+    {
+        printf("Workspace not found.\n");
+        return;
+    }
+    printf("Workspace ID %d updated.\n", id);
+}
+
+void deleteWorkspace()
+{
+    int id = getInt("Enter ID of workspace to delete: ");
+
+    DbDeleteInfo info;
+    DbStatus rc = db_delete_workspace(id, &info);
+    if (rc == DB_NOT_FOUND)
+    {
+        printf("Workspace not found.\n");
+        return;
+    }
+    if (rc == DB_RESTRICTED)
+    {
+        printf("Error: Workspace ID %d still has %d booking(s). Delete them first (or set FLEXDESK_FK_DELETE=cascade).\n", id, info.dependents);
+        return;
+    }
+    printf("Workspace ID %d deleted.\n", id);
+    if (info.bookings)
+        printf("Also deleted %d booking(s) and %d payment(s).\n", info.bookings, info.payments);
+}
+
+//  BOOKING FUNCTIONS
+
+BookingNode *findBookingNodeById(int id)
+{
+    return (BookingNode *)index_find(&booking_index, id);
+}
+
+// Storage helpers (caller holds bookings_lock for writing)
+BookingNode *insert_booking_node(const Booking *data)
+{
+    BookingRecord record;
+    booking_encode(data, &record);
+    return insert_booking_record(&record);
+}
+
+BookingNode *insert_booking_record(const BookingRecord *data)
+{
+    RecordId rid = paged_alloc(&booking_pages);
+    BookingNode *newNode = booking_at(rid);
+    memset(newNode, 0, sizeof(*newNode));
+    newNode->rid = rid;
+    newNode->live = 1;
+    set_booking_record(newNode, data);
+    booking_fk_link(newNode);
+    index_insert(&booking_index, data->bookingId, newNode);
+    return newNode;
+}
+
+void remove_booking_node(BookingNode *node)
+{
+    index_remove(&booking_index, node->bookingId);
+    if (node->counted)
+        mat_booking_changed(node, -1);
+    schedule_remove(node);
+    if (node->ordered)
+        ordered_remove(&bookings_by_start, node->start_min, node->bookingId);
+    booking_fk_unlink(node);
+    node->live = 0;
+    paged_free(&booking_pages, node->rid);
+}
+
+// Replaces a booking's fields (row page and resident keys) and re-files it
+// in its workspace schedule and, if its start moved, in bookings_by_start
+// (which only lists bookings whose start time parses)
+void set_booking_data(BookingNode *node, const Booking *data)
+{
+    BookingRecord record;
+    booking_encode(data, &record);
+    set_booking_record(node, &record);
+}
+
+void set_booking_record(BookingNode *node, const BookingRecord *data)
+{
+    if (node->counted)
+        mat_booking_changed(node, -1);
+    schedule_remove(node);
+    int64_t start = parse_booking_time(data->startTime);
+    if (node->ordered && (start != node->start_min || data->bookingId != node->bookingId)) {
+        ordered_remove(&bookings_by_start, node->start_min, node->bookingId);
+        node->ordered = 0;
+    }
+    paged_write(&booking_pages, node->rid, data);
+    node->bookingId = data->bookingId;
+    node->memberId = data->memberId;
+    node->workspaceId = data->workspaceId;
+    int64_t end = parse_booking_time(data->endTime);
+    node->start_min = start;
+    node->length_min = start >= 0 && end > start ? (uint32_t)(end - start) : 0;
+    node->cancelled = (str_flags(data->status) & STR_CANCELLED) != 0;
+    str_count_use(data->status, STR_COL_BOOKING_STATUS);
+    node->version = record_version_next();
+    schedule_add(node);
+    if (!node->ordered && start >= 0) {
+        ordered_insert(&bookings_by_start, node->start_min, node->bookingId, node);
+        node->ordered = 1;
+    }
+    node->counted = mat_live;
+    if (node->counted)
+        mat_booking_changed(node, +1);
+}
+
+typedef struct
+{
+    int memberId, workspaceId;
+    char startTime[20], endTime[20], status[20];
+    int newId;
+} BookingRequest;
+
+// Transaction body: reads both parents again and buffers the insert
+static DbStatus add_booking_txn(Txn *txn, void *ctx)
+{
+    BookingRequest *r = (BookingRequest *)ctx;
+    return txn_add_booking(txn, r->memberId, r->workspaceId, r->startTime, r->endTime, r->status, &r->newId);
+}
+
+void addBooking()
+{
+    BookingRequest r;
+    r.memberId = getInt("Enter Member ID: ");
+    r.workspaceId = getInt("Enter Workspace ID: ");
+
+    // INTEGRITY CHECK: fail early, before asking for the rest. The reads
+    // belong to a transaction, so the booking only commits if neither row
+    // changed while the rest is typed in; no lock is held meanwhile.
+    Txn txn;
+    txn_begin(&txn);
+    if (txn_get_member(&txn, r.memberId, NULL) != DB_OK) {
+        printf("Error: Member ID %d does not exist. Cannot create booking.\n", r.memberId);
+        txn_abort(&txn);
+        return;
+    }
+    if (txn_get_workspace(&txn, r.workspaceId, NULL) != DB_OK) {
+        printf("Error: Workspace ID %d does not exist. Cannot create booking.\n", r.workspaceId);
+        txn_abort(&txn);
+        return;
+    }
+
+    getString("Enter Start Time (YYYY-MM-DDTHH:MM): ", r.startTime, 20);
+    getString("Enter End Time (YYYY-MM-DDTHH:MM): ", r.endTime, 20);
+    getString("Enter Status (e.g., Confirmed): ", r.status, 20);
+
+    // A member or workspace changed meanwhile: re-checked and retried
+    DbStatus rc = add_booking_txn(&txn, &r);
+    if (rc == DB_OK)
+        rc = txn_commit_retry(&txn, add_booking_txn, &r);
+    else
+        txn_abort(&txn);
+    switch (rc)
+    {
+    case DB_OK:
+        printf("Booking added with ID %d.\n", r.newId);
+        break;
+    case DB_INVALID:
+        printf("Error: Times must look like YYYY-MM-DDTHH:MM and end after they start. Cannot create booking.\n");
+        break;
+    case DB_CONFLICT:
+        printf("Error: Workspace ID %d is already booked by Booking ID %d in that slot. Cannot create booking.\n",
+               r.workspaceId, txn.conflict_id);
+        break;
+    case DB_ABORTED:
+        printf("Error: Member or workspace kept changing. Cannot create booking; please try again.\n");
+        break;
+    case DB_FULL:
+        printf("Error: Too many distinct booking statuses. Cannot create booking.\n");
+        break;
+    default:
+        printf("Error: Member or workspace was deleted meanwhile. Cannot create booking.\n");
+    }
+}
+
+void displayAllBookings()
+{
+    printf("\n--- All Bookings ---\n%-5s | %-10s | %-12s | %-18s | %-18s | %s\n", "ID", "Member ID", "Workspace ID", "Start Time", "End Time", "Status");
+    printf("------|------------|--------------|--------------------|--------------------|----------\n");
+
+    TableSnapshot snap;
+    table_snapshot(SNAP_BOOKINGS, &snap);
+    const Booking *rows = (const Booking *)snap.rows;
+    for (size_t i = 0; i < snap.count; i++)
+    {
+        printf("%-5d | %-10d | %-12d | %-18s | %-18s | %s\n", rows[i].bookingId, rows[i].memberId, rows[i].workspaceId, rows[i].startTime, rows[i].endTime, rows[i].status);
+    }
+    table_snapshot_free(&snap);
+}
+
+// Lists the bookings holding a workspace at any point in [from, to)
+void showWorkspaceOccupancy()
+{
+    char fromText[20], toText[20];
+    int wId = getInt("Enter Workspace ID: ");
+    getString("Enter From (YYYY-MM-DDTHH:MM): ", fromText, 20);
+    getString("Enter To (YYYY-MM-DDTHH:MM): ", toText, 20);
+
+    int64_t from = parse_booking_time(fromText);
+    int64_t to = parse_booking_time(toText);
+    if (from < 0 || to <= from)
+    {
+        printf("Error: Invalid time range.\n");
+        return;
+    }
+
+    Booking matches[64];
+    int found = db_workspace_occupancy(wId, from, to, matches, 64);
+    if (!found)
+    {
+        printf("Workspace ID %d is free for the whole range.\n", wId);
+        return;
+    }
+
+    printf("\n--- Workspace %d: %s to %s ---\n%-5s | %-10s | %-18s | %-18s | %s\n", wId, fromText, toText, "ID", "Member ID", "Start Time", "End Time", "Status");
+    printf("------|------------|--------------------|--------------------|----------\n");
+    for (int i = 0; i < found && i < 64; i++)
+        printf("%-5d | %-10d | %-18s | %-18s | %s\n", matches[i].bookingId, matches[i].memberId, matches[i].startTime, matches[i].endTime, matches[i].status);
+    if (found > 64)
+        printf("... and %d more.\n", found - 64);
+}
+
+// Asked between pages of a range listing
+static int next_page_wanted()
+{
+    char answer[8];
+    getString("-- Enter for more, q to stop: ", answer, sizeof(answer));
+    return answer[0] != 'q' && answer[0] != 'Q';
+}
+
+// Bookings starting in [from, to), in start-time order, a page at a time
+void showBookingsInRange()
+{
+    char fromText[20], toText[20];
+    getString("Enter From (YYYY-MM-DDTHH:MM): ", fromText, 20);
+    getString("Enter To (YYYY-MM-DDTHH:MM): ", toText, 20);
+
+    int64_t from = parse_booking_time(fromText);
+    int64_t to = parse_booking_time(toText);
+    if (from < 0 || to <= from)
+    {
+        printf("Error: Invalid time range.\n");
+        return;
+    }
+
+    printf("\n--- Bookings starting %s to %s ---\n%-5s | %-10s | %-12s | %-18s | %-18s | %s\n", fromText, toText, "ID", "Member ID", "Workspace ID", "Start Time", "End Time", "Status");
+    printf("------|------------|--------------|--------------------|--------------------|----------\n");
+    Booking rows[RANGE_PAGE_ROWS];
+    OrderedKey cursor = { from, 0 };
+    int more = 0, total = 0;
+    do
+    {
+        int n = db_bookings_starting(from, to, &cursor, rows, RANGE_PAGE_ROWS, &more);
+        for (int i = 0; i < n; i++)
+            printf("%-5d | %-10d | %-12d | %-18s | %-18s | %s\n", rows[i].bookingId, rows[i].memberId, rows[i].workspaceId, rows[i].startTime, rows[i].endTime, rows[i].status);
+        total += n;
+    } while (more && next_page_wanted());
+    printf("%d booking(s) listed.\n", total);
+}
+
+void updateBooking()
+{
+    int id = getInt("Enter ID of booking to update: ");
+
+    Booking booking;
+    if (db_get_booking(id, &booking) != DB_OK)
+    {
+        printf("Booking not found.\n");
+        return;
+    }
+    printf("Updating Booking ID %d. Current status: %s\n", id, booking.status);
+    char status[20];
+    getString("Enter new status (e.g., Cancelled): ", status, 20);
+
+    int conflictId = 0;
+    DbStatus rc = db_update_booking(id, status, &conflictId);
+    if (rc == DB_NOT_FOUND)
+    {
+        printf("Booking not found.\n");
+        return;
+    }
+    if (rc == DB_CONFLICT)
+    {
+        printf("Error: Workspace is already booked by Booking ID %d in that slot. Booking not updated.\n", conflictId);
+        return;
+    }
+    if (rc == DB_FULL)
+    {
+        printf("Error: Too many distinct booking statuses. Booking not updated.\n");
+        return;
+    }
+    printf("Booking ID %d updated.\n", id);
+}
+
+void deleteBooking()
+{
+    int id = getInt("Enter ID of booking to delete: ");
+
+    DbDeleteInfo info;
+    DbStatus rc = db_delete_booking(id, &info);
+    if (rc == DB_NOT_FOUND)
+    {
+        printf("Booking not found.\n");
+        return;
+    }
+    if (rc == DB_RESTRICTED)
+    {
+        printf("Error: Booking ID %d still has %d payment(s). Delete them first (or set FLEXDESK_FK_DELETE=cascade).\n", id, info.dependents);
+        return;
+    }
+    printf("Booking ID %d deleted.\n", id);
+    if (info.payments)
+        printf("Also deleted %d payment(s).\n", info.payments);
+}
+
+//  PAYMENT FUNCTIONS
+
+PaymentNode *findPaymentNodeById(int id)
+{
+    return (PaymentNode *)index_find(&payment_index, id);
+}
+
+// Storage helpers (caller holds payments_lock for writing)
+PaymentNode *insert_payment_node(const Payment *data)
+{
+    PaymentRecord record;
+    payment_encode(data, &record);
+    return insert_payment_record(&record);
+}
+
+PaymentNode *insert_payment_record(const PaymentRecord *data)
+{
+    RecordId rid = paged_alloc(&payment_pages);
+    PaymentNode *newNode = payment_at(rid);
+    memset(newNode, 0, sizeof(*newNode));
+    newNode->rid = rid;
+    newNode->live = 1;
+    set_payment_record(newNode, data);
+    index_insert(&payment_index, data->paymentId, newNode);
+    payment_fk_link(newNode);
+    return newNode;
+}
+
+void remove_payment_node(PaymentNode *node)
+{
+    index_remove(&payment_index, node->paymentId);
+    if (node->ordered)
+        ordered_remove(&payments_by_date, node->paid_day, node->paymentId);
+    if (node->counted) {
+        PaymentRecord old;
+        paged_read(&payment_pages, node->rid, &old);
+        mat_payment_changed(node, &old, -1);
+    }
+    payment_fk_unlink(node);
+    node->live = 0;
+    paged_free(&payment_pages, node->rid);
+}
+
+// Replaces a payment's fields (row page and resident keys) and re-files it
+// in payments_by_date if its date moved (only parsed dates are listed)
+void set_payment_data(PaymentNode *node, const Payment *data)
+{
+    PaymentRecord record;
+    payment_encode(data, &record);
+    set_payment_record(node, &record);
+}
+
+void set_payment_record(PaymentNode *node, const PaymentRecord *data)
+{
+    int day = (int)parse_payment_date(data->paymentDate);
+    int relinked = !node->counted || data->bookingId != node->bookingId;
+    if (node->ordered && (day != node->paid_day || data->paymentId != node->paymentId)) {
+        ordered_remove(&payments_by_date, node->paid_day, node->paymentId);
+        node->ordered = 0;
+    }
+    if (node->counted) {
+        PaymentRecord old;
+        paged_read(&payment_pages, node->rid, &old);
+        mat_payment_changed(node, &old, -1);
+    }
+    paged_write(&payment_pages, node->rid, data);
+    str_count_use(data->status, STR_COL_PAYMENT_STATUS);
+    node->paymentId = data->paymentId;
+    node->bookingId = data->bookingId;
+    node->paid_day = day;
+    node->version = record_version_next();
+    if (!node->ordered && day >= 0) {
+        ordered_insert(&payments_by_date, node->paid_day, node->paymentId, node);
+        node->ordered = 1;
+    }
+    // Whoever adds or re-parents a payment also holds bookings_lock
+    // (db_add_payment) or runs alone (WAL replay, snapshot load)
+    if (mat_live && relinked) {
+        BookingNode *booking = findBookingNodeById(data->bookingId);
+        node->workspaceId = booking ? booking->workspaceId : 0;
+    }
+    node->counted = mat_live;
+    if (node->counted)
+        mat_payment_changed(node, data, +1);
+}
+
+void addPayment()
+{
+    int bId = getInt("Enter Booking ID: ");
+
+    // INTEGRITY CHECK: Verify Booking Exists (db_add_payment checks again under the lock)
+    if (db_get_booking(bId, NULL) != DB_OK) {
+        printf("Error: Booking ID %d does not exist. Cannot process payment.\n", bId);
+        return;
+    }
+
+    char paymentDate[11], status[20];
+    int amount = getInt("Enter amount (in cents): ");
+    getString("Enter Payment Date (YYYY-MM-DD): ", paymentDate, 11);
+    getString("Enter Status (e.g., Paid): ", status, 20);
+
+    int newId;
+    DbStatus rc = db_add_payment(bId, amount, paymentDate, status, &newId);
+    if (rc == DB_FULL) {
+        printf("Error: Too many distinct payment statuses. Cannot process payment.\n");
+        return;
+    }
+    if (rc != DB_OK) {
+        printf("Error: Booking ID %d was deleted meanwhile. Cannot process payment.\n", bId);
+        return;
+    }
+    printf("Payment added with ID %d.\n", newId);
+}
+
+void displayAllPayments()
+{
+    printf("\n--- All Payments ---\n%-5s | %-10s | %-15s | %-12s | %s\n", "ID", "Booking ID", "Amount (cents)", "Date", "Status");
+    printf("------|------------|-----------------|--------------|----------\n");
+
+    TableSnapshot snap;
+    table_snapshot(SNAP_PAYMENTS, &snap);
+    const Payment *rows = (const Payment *)snap.rows;
+    for (size_t i = 0; i < snap.count; i++)
+    {
+        printf("%-5d | %-10d | %-15d | %-12s | %s\n", rows[i].paymentId, rows[i].bookingId, rows[i].amount_in_cents, rows[i].paymentDate, rows[i].status);
+    }
+    table_snapshot_free(&snap);
+}
+
+// Payments dated in [from, to), in date order, a page at a time
+void showPaymentsInRange()
+{
+    char fromText[11], toText[11];
+    getString("Enter From (YYYY-MM-DD): ", fromText, 11);
+    getString("Enter To (YYYY-MM-DD, exclusive): ", toText, 11);
+
+    int64_t from = parse_payment_date(fromText);
+    int64_t to = parse_payment_date(toText);
+    if (from < 0 || to <= from)
+    {
+        printf("Error: Invalid date range.\n");
+        return;
+    }
+
+    printf("\n--- Payments dated %s to %s ---\n%-5s | %-10s | %-15s | %-12s | %s\n", fromText, toText, "ID", "Booking ID", "Amount (cents)", "Date", "Status");
+    printf("------|------------|-----------------|--------------|----------\n");
+    Payment rows[RANGE_PAGE_ROWS];
+    OrderedKey cursor = { from, 0 };
+    int more = 0, total = 0;
+    do
+    {
+        int n = db_payments_dated(from, to, &cursor, rows, RANGE_PAGE_ROWS, &more);
+        for (int i = 0; i < n; i++)
+            printf("%-5d | %-10d | %-15d | %-12s | %s\n", rows[i].paymentId, rows[i].bookingId, rows[i].amount_in_cents, rows[i].paymentDate, rows[i].status);
+        total += n;
+    } while (more && next_page_wanted());
+    printf("%d payment(s) listed.\n", total);
+}
+
+void updatePayment()
+{
+    int id = getInt("Enter ID of payment to update: ");
+
+    Payment payment;
+    if (db_get_payment(id, &payment) != DB_OK)
+    {
+        printf("Payment not found.\n");
+        return;
+    }
+    printf("Updating Payment ID %d. Current status: %s\n", id, payment.status);
+    char status[20];
+    getString("Enter new status (e.g., Refunded): ", status, 20);
+
+    DbStatus rc = db_update_payment(id, status);
+    if (rc == DB_FULL)
+    {
+        printf("Error: Too many distinct payment statuses. Payment not updated.\n");
+        return;
+    }
+    if (rc != DB_OK)
+    {
+        printf("Payment not found.\n");
+        return;
+    }
+    printf("Payment ID %d updated.\n", id);
+}
+
+void deletePayment()
+{
+    int id = getInt("Enter ID of payment to delete: ");
+
+    if (db_delete_payment(id) != DB_OK)
+    {
+        printf("Payment not found.\n");
+        return;
+    }
+    printf("Payment ID %d deleted.\n", id);
+}
+
+/*
+ * ==========================================
+ * CRUD CORE (shared by the menu, benchmarks and tools)
+ * ==========================================
+ */
+// Each operation takes plain arguments, does its own locking, logging and WAL
+// commit, and reports a DbStatus instead of printing. The menu functions above
+// are thin prompt/print wrappers around these.
+
+const char *db_status_name(DbStatus status)
+{
+    switch (status)
+    {
+    case DB_OK: return "OK";
+    case DB_NOT_FOUND: return "NOT_FOUND";
+    case DB_DUPLICATE: return "DUPLICATE";
+    case DB_MISSING_PARENT: return "MISSING_PARENT";
+    case DB_CONFLICT: return "CONFLICT";
+    case DB_RESTRICTED: return "RESTRICTED";
+    case DB_INVALID: return "INVALID";
+    case DB_ABORTED: return "ABORTED";
+    case DB_FULL: return "FULL";
+    case DB_NO_MEMORY: return "NO_MEMORY";
+    }
+    return "UNKNOWN";
+}
+
+// -- Members --
+
+// Names and emails are required and bounded
+static int member_text_ok(const char *text)
+{
+    size_t length = strlen(text);
+    return length > 0 && length <= MEMBER_TEXT_MAX;
+}
+
+DbStatus db_add_member(const char *name, const char *email, int *newId)
+{
+    if (!member_text_ok(name) || !member_text_ok(email))
+        return DB_INVALID;
+    Member temp;
+    memset(&temp, 0, sizeof(temp));
+    snprintf(temp.name, sizeof(temp.name), "%s", name);
+    snprintf(temp.email, sizeof(temp.email), "%s", email);
+
+    // The email's stripe serialises inserts of the same address
+    MemberStripe *byEmail = email_stripe(temp.email);
+    pthread_rwlock_wrlock(&byEmail->lock);
+
+    // Check duplicate email (O(1) through the email index)
+    if (findMemberNodeByEmail(temp.email)) {
+        pthread_rwlock_unlock(&byEmail->lock);
+        return DB_DUPLICATE;
+    }
+
+    // The id decides the row's stripe. One below the email stripe cannot be
+    // waited for while holding it, so back off and retake both in order.
+    temp.memberId = next_member_id++;
+    MemberStripe *byId = member_stripe(temp.memberId);
+    if (byId < byEmail && pthread_rwlock_trywrlock(&byId->lock) != 0)
+    {
+        pthread_rwlock_unlock(&byEmail->lock);
+        member_wrlock_pair(byId, byEmail);
+        if (findMemberNodeByEmail(temp.email)) { // Lost a race for the address
+            member_unlock_pair(byId, byEmail);
+            return DB_DUPLICATE;
+        }
+    }
+    else if (byId > byEmail)
+        pthread_rwlock_wrlock(&byId->lock);
+
+    // Node is carved from the member slab only once we know the insert succeeds
+    insert_member_node(&temp);
+
+    char logMsg[150];
+    sprintf(logMsg, "Added Member ID %d (%.100s)", temp.memberId, temp.name);
+    log_operation(logMsg);
+
+    uint64_t lsn = wal_append(WAL_INSERT, SNAP_MEMBERS, &temp, sizeof(Member));
+    member_unlock_pair(byId, byEmail);
+
+    wal_commit(lsn); // Acknowledge only once the insert is durable
+    if (newId)
+        *newId = temp.memberId;
+    return DB_OK;
+}
+
+// Lock-free: the epoch keeps the node alive while it is copied. Published
+// records are never written, so the copy is always a consistent row.
+DbStatus db_get_member(int id, Member *out)
+{
+    if (!epoch_enter())
+    {
+        MemberStripe *stripe = member_stripe(id);
+        pthread_rwlock_rdlock(&stripe->lock);
+        MemberNode *node = findMemberNodeById(id);
+        if (node && out)
+            member_decode(node, out);
+        pthread_rwlock_unlock(&stripe->lock);
+        return node ? DB_OK : DB_NOT_FOUND;
+    }
+    MemberNode *node = findMemberNodeById(id); // Radix map, no lock
+    if (node && out)
+        member_decode(node, out);
+    epoch_exit();
+    return node ? DB_OK : DB_NOT_FOUND;
+}
+
+DbStatus db_find_member_by_email(const char *email, Member *out)
+{
+    // Updates and deletes hold the email stripe too, so it guards the row
+    MemberStripe *stripe = email_stripe(email);
+    pthread_rwlock_rdlock(&stripe->lock);
+    MemberNode *node = findMemberNodeByEmail(email); // Uses Email Index O(1)
+    if (node && out)
+        member_decode(node, out);
+    pthread_rwlock_unlock(&stripe->lock);
+    return node ? DB_OK : DB_NOT_FOUND;
+}
+
+// Write-locks the row's id stripe and email stripe (in order) and returns the
+// node, or NULL with only the id stripe held. The email stripe is only known
+// once the row is read; if it sorts below the id stripe, retake both in order
+// (emails never change at runtime). Release with member_unlock_pair.
+static MemberNode *member_lock_row(int id, MemberStripe **byId, MemberStripe **byEmail)
+{
+    *byId = *byEmail = member_stripe(id);
+    pthread_rwlock_wrlock(&(*byId)->lock);
+    MemberNode *node = findMemberNodeById(id);
+    if (node)
+        *byEmail = email_stripe(member_email(node));
+    if (*byEmail > *byId)
+        pthread_rwlock_wrlock(&(*byEmail)->lock);
+    else if (*byEmail < *byId)
+    {
+        pthread_rwlock_unlock(&(*byId)->lock);
+        member_wrlock_pair(*byId, *byEmail);
+        node = findMemberNodeById(id); // May have been deleted meanwhile
+    }
+    return node;
+}
+
+DbStatus db_update_member(int id, const char *name)
+{
+    uint64_t lsn = 0;
+    if (!member_text_ok(name))
+        return DB_INVALID;
+
+    // Copy-on-write: lock-free readers may be copying the current record
+    MemberStripe *byId, *byEmail;
+    MemberNode *node = member_lock_row(id, &byId, &byEmail);
+    if (node)
+    {
+        Member updated;
+        member_decode(node, &updated);
+        snprintf(updated.name, sizeof(updated.name), "%s", name);
+        MemberNode *fresh = (MemberNode *)slab_alloc(&byId->slab);
+        member_encode(byId, fresh, &updated); // Own copies: the old node's text goes with it
+        replace_member_node(node, fresh);
+
+        char logMsg[100];
+        sprintf(logMsg, "Updated Member ID %d", id);
+        log_operation(logMsg);
+        lsn = wal_append(WAL_UPDATE, SNAP_MEMBERS, &updated, sizeof(Member));
+    }
+    member_unlock_pair(byId, byEmail);
+
+    if (!node)
+        return DB_NOT_FOUND;
+    wal_commit(lsn); // Acknowledge only once the change is durable
+    return DB_OK;
+}
+
+DbStatus db_delete_member(int id, DbDeleteInfo *info)
+{
+    uint64_t lsn = 0;
+    DbDeleteInfo result = { 0, 0, 0 };
+
+    // Lock order: member stripes -> workspaces -> bookings -> payments
+    MemberStripe *byId, *byEmail;
+    MemberNode *node = member_lock_row(id, &byId, &byEmail);
+    pthread_rwlock_wrlock(&bookings_lock);
+    pthread_rwlock_wrlock(&payments_lock);
+    if (node && fk_delete_policy == FK_RESTRICT)
+        result.dependents = count_bookings_of(FK_BY_MEMBER, id);
+    if (node && !result.dependents)
+    {
+        // Leaves the id map under bookings_lock, which db_add_booking relies on
+        result.bookings = cascade_delete_bookings(FK_BY_MEMBER, id, &lsn, &result.payments);
+        remove_member_node(node);
+
+        char logMsg[100];
+        sprintf(logMsg, "Deleted Member ID %d (cascaded: %d bookings, %d payments)", id, result.bookings, result.payments);
+        log_operation(logMsg);
+        lsn = wal_append(WAL_DELETE, SNAP_MEMBERS, &id, sizeof(id));
+    }
+    pthread_rwlock_unlock(&payments_lock);
+    pthread_rwlock_unlock(&bookings_lock);
+    member_unlock_pair(byId, byEmail);
+
+    if (info)
+        *info = result;
+    if (!node)
+        return DB_NOT_FOUND;
+    if (result.dependents)
+        return DB_RESTRICTED;
+    wal_commit(lsn);
+    return DB_OK;
+}
+
+// -- Workspaces --
+
+DbStatus db_add_workspace(const char *type, const char *location, int capacity, int price_in_cents, int *newId)
+{
+    Workspace temp;
+    memset(&temp, 0, sizeof(temp));
+    snprintf(temp.type, sizeof(temp.type), "%s", type);
+    snprintf(temp.location, sizeof(temp.location), "%s", location);
+    temp.capacity = capacity;
+    temp.price_in_cents = price_in_cents;
+    if (str_admit(STR_COL_TYPE, temp.type, NULL) != DB_OK || str_admit(STR_COL_LOCATION, temp.location, NULL) != DB_OK)
+        return DB_FULL;
+
+    pthread_rwlock_wrlock(&workspaces_lock);
+    temp.workspaceId = next_workspace_id++;
+    insert_workspace_node(&temp);
+
+    char logMsg[150];
+    sprintf(logMsg, "Added Workspace ID %d (%s)", temp.workspaceId, temp.type);
+    log_operation(logMsg);
+
+    uint64_t lsn = wal_append(WAL_INSERT, SNAP_WORKSPACES, &temp, sizeof(Workspace));
+    pthread_rwlock_unlock(&workspaces_lock);
+
+    wal_commit(lsn); // Acknowledge only once the insert is durable
+    if (newId)
+        *newId = temp.workspaceId;
+    return DB_OK;
+}
+
+DbStatus db_get_workspace(int id, Workspace *out)
+{
+    pthread_rwlock_rdlock(&workspaces_lock);
+    WorkspaceNode *node = findWorkspaceNodeById(id);
+    if (node && out)
+        workspace_decode(&node->data, out);
+    pthread_rwlock_unlock(&workspaces_lock);
+    return node ? DB_OK : DB_NOT_FOUND;
+}
+
+DbStatus db_update_workspace(int id, int capacity, int price_in_cents)
+{
+    uint64_t lsn = 0;
+
+    pthread_rwlock_wrlock(&workspaces_lock);
+    WorkspaceNode *node = findWorkspaceNodeById(id);
+    if (node)
+    {
+        node->data.capacity = capacity;
+        node->data.price_in_cents = price_in_cents;
+        node->version = record_version_next();
+
+        char logMsg[100];
+        sprintf(logMsg, "Updated Workspace ID %d", id);
+        log_operation(logMsg);
+        Workspace updated; // The WAL keeps full after-images, text included
+        workspace_decode(&node->data, &updated);
+        lsn = wal_append(WAL_UPDATE, SNAP_WORKSPACES, &updated, sizeof(Workspace));
+    }
+    pthread_rwlock_unlock(&workspaces_lock);
+
+    if (!node)
+        return DB_NOT_FOUND;
+    wal_commit(lsn); // Acknowledge only once the change is durable
+    return DB_OK;
+}
+
+DbStatus db_delete_workspace(int id, DbDeleteInfo *info)
+{
+    uint64_t lsn = 0;
+    DbDeleteInfo result = { 0, 0, 0 };
+
+    pthread_rwlock_wrlock(&workspaces_lock);
+    pthread_rwlock_wrlock(&bookings_lock);
+    pthread_rwlock_wrlock(&payments_lock);
+    WorkspaceNode *node = findWorkspaceNodeById(id);
+    if (node && fk_delete_policy == FK_RESTRICT)
+        result.dependents = count_bookings_of(FK_BY_WORKSPACE, id);
+    if (node && !result.dependents)
+    {
+        result.bookings = cascade_delete_bookings(FK_BY_WORKSPACE, id, &lsn, &result.payments);
+        remove_workspace_node(node);
+
+        char logMsg[100];
+        sprintf(logMsg, "Deleted Workspace ID %d (cascaded: %d bookings, %d payments)", id, result.bookings, result.payments);
+        log_operation(logMsg);
+        lsn = wal_append(WAL_DELETE, SNAP_WORKSPACES, &id, sizeof(id));
+    }
+    pthread_rwlock_unlock(&payments_lock);
+    pthread_rwlock_unlock(&bookings_lock);
+    pthread_rwlock_unlock(&workspaces_lock);
+
+    if (info)
+        *info = result;
+    if (!node)
+        return DB_NOT_FOUND;
+    if (result.dependents)
+        return DB_RESTRICTED;
+    wal_commit(lsn);
+    return DB_OK;
+}
+
+// -- Bookings --
+
+// On DB_CONFLICT, *conflictId (if given) names the booking already holding the slot
+DbStatus db_add_booking(int memberId, int workspaceId, const char *startTime, const char *endTime,
+                        const char *status, int *newId, int *conflictId)
+{
+    Booking temp;
+    memset(&temp, 0, sizeof(temp));
+    temp.memberId = memberId;
+    temp.workspaceId = workspaceId;
+    snprintf(temp.startTime, sizeof(temp.startTime), "%s", startTime);
+    snprintf(temp.endTime, sizeof(temp.endTime), "%s", endTime);
+    snprintf(temp.status, sizeof(temp.status), "%s", status);
+
+    int64_t start = parse_booking_time(temp.startTime);
+    int64_t end = parse_booking_time(temp.endTime);
+    if (start < 0 || end <= start)
+        return DB_INVALID;
+    StrCode code;
+    if (str_admit(STR_COL_BOOKING_STATUS, temp.status, &code) != DB_OK)
+        return DB_FULL;
+
+    // Hold the workspace so it cannot be deleted before the insert. The
+    // member needs no lock: it leaves the id map only under bookings_lock,
+    // and the existence check does not read the record.
+    pthread_rwlock_rdlock(&workspaces_lock);
+    pthread_rwlock_wrlock(&bookings_lock);
+    DbStatus rc = DB_OK;
+    if (!findMemberNodeById(memberId) || !findWorkspaceNodeById(workspaceId))
+        rc = DB_MISSING_PARENT;
+    else if (!(str_flags(code) & STR_CANCELLED))
+    {
+        // CONFLICT CHECK: binary search in the workspace's schedule
+        BookingNode *conflict = schedule_find_conflict(workspaceId, start, end, -1);
+        if (conflict)
+        {
+            booking_conflicts++;
+            if (conflictId)
+                *conflictId = conflict->bookingId;
+            rc = DB_CONFLICT;
+        }
+    }
+    if (rc != DB_OK)
+    {
+        pthread_rwlock_unlock(&bookings_lock);
+        pthread_rwlock_unlock(&workspaces_lock);
+        return rc;
+    }
+
+    temp.bookingId = next_booking_id++;
+    BookingNode *newNode = insert_booking_node(&temp);
+
+    char logMsg[150];
+    sprintf(logMsg, "Added Booking ID %d (Mem: %d, WS: %d)", newNode->bookingId, memberId, workspaceId);
+    log_operation(logMsg);
+
+    uint64_t lsn = wal_append(WAL_INSERT, SNAP_BOOKINGS, &temp, sizeof(Booking));
+    pthread_rwlock_unlock(&bookings_lock);
+    pthread_rwlock_unlock(&workspaces_lock);
+
+    wal_commit(lsn); // Acknowledge only once the insert is durable
+    if (newId)
+        *newId = temp.bookingId;
+    return DB_OK;
+}
+
+DbStatus db_get_booking(int id, Booking *out)
+{
+    pthread_rwlock_rdlock(&bookings_lock);
+    BookingNode *node = findBookingNodeById(id);
+    if (node && out)
+        booking_read(node, out);
+    pthread_rwlock_unlock(&bookings_lock);
+    return node ? DB_OK : DB_NOT_FOUND;
+}
+
+DbStatus db_update_booking(int id, const char *status, int *conflictId)
+{
+    uint64_t lsn = 0;
+    char text[sizeof(((Booking *)0)->status)];
+    snprintf(text, sizeof(text), "%s", status);
+    StrCode code;
+    if (str_admit(STR_COL_BOOKING_STATUS, text, &code) != DB_OK)
+        return DB_FULL;
+    DbStatus rc = DB_OK;
+
+    pthread_rwlock_wrlock(&bookings_lock);
+    BookingNode *node = findBookingNodeById(id);
+    if (!node)
+        rc = DB_NOT_FOUND;
+    else
+    {
+        Booking updated;
+        booking_read(node, &updated);
+        snprintf(updated.status, sizeof(updated.status), "%s", status);
+
+        // Re-activating a cancelled booking must not double-book the workspace
+        BookingNode *conflict = NULL;
+        if (!node->scheduled && node->start_min >= 0 && !(str_flags(code) & STR_CANCELLED))
+            conflict = schedule_find_conflict(updated.workspaceId, node->start_min, booking_end(node), id);
+        if (conflict)
+        {
+            booking_conflicts++;
+            if (conflictId)
+                *conflictId = conflict->bookingId;
+            rc = DB_CONFLICT;
+        }
+        else
+        {
+            set_booking_data(node, &updated);
+
+            char logMsg[100];
+            sprintf(logMsg, "Updated Booking ID %d status to %s", id, updated.status);
+            log_operation(logMsg);
+            lsn = wal_append(WAL_UPDATE, SNAP_BOOKINGS, &updated, sizeof(Booking));
+        }
+    }
+    pthread_rwlock_unlock(&bookings_lock);
+
+    if (rc == DB_OK)
+        wal_commit(lsn); // Acknowledge only once the change is durable
+    return rc;
+}
+
+DbStatus db_delete_booking(int id, DbDeleteInfo *info)
+{
+    uint64_t lsn = 0;
+    DbDeleteInfo result = { 0, 0, 0 };
+
+    pthread_rwlock_wrlock(&bookings_lock);
+    pthread_rwlock_wrlock(&payments_lock);
+    BookingNode *node = findBookingNodeById(id);
+    if (node && fk_delete_policy == FK_RESTRICT)
+        result.dependents = count_payments_of(id);
+    if (node && !result.dependents)
+    {
+        result.payments = cascade_delete_payments(id, &lsn);
+        remove_booking_node(node);
+
+        char logMsg[100];
+        sprintf(logMsg, "Deleted Booking ID %d (cascaded: %d payments)", id, result.payments);
+        log_operation(logMsg);
+        lsn = wal_append(WAL_DELETE, SNAP_BOOKINGS, &id, sizeof(id));
+    }
+    pthread_rwlock_unlock(&payments_lock);
+    pthread_rwlock_unlock(&bookings_lock);
+
+    if (info)
+        *info = result;
+    if (!node)
+        return DB_NOT_FOUND;
+    if (result.dependents)
+        return DB_RESTRICTED;
+    wal_commit(lsn);
+    return DB_OK;
+}
+
+// -- Payments --
+
+DbStatus db_add_payment(int bookingId, int amount_in_cents, const char *paymentDate, const char *status, int *newId)
+{
+    Payment temp;
+    memset(&temp, 0, sizeof(temp));
+    temp.bookingId = bookingId;
+    temp.amount_in_cents = amount_in_cents;
+    snprintf(temp.paymentDate, sizeof(temp.paymentDate), "%s", paymentDate);
+    snprintf(temp.status, sizeof(temp.status), "%s", status);
+    if (str_admit(STR_COL_PAYMENT_STATUS, temp.status, NULL) != DB_OK)
+        return DB_FULL;
+
+    // Hold the booking so it cannot be deleted before the payment is linked to it
+    pthread_rwlock_rdlock(&bookings_lock);
+    if (findBookingNodeById(bookingId) == NULL) {
+        pthread_rwlock_unlock(&bookings_lock);
+        return DB_MISSING_PARENT;
+    }
+    pthread_rwlock_wrlock(&payments_lock);
+    temp.paymentId = next_payment_id++;
+    PaymentNode *newNode = insert_payment_node(&temp);
+
+    char logMsg[150];
+    sprintf(logMsg, "Added Payment ID %d for Booking %d", newNode->paymentId, bookingId);
+    log_operation(logMsg);
+
+    uint64_t lsn = wal_append(WAL_INSERT, SNAP_PAYMENTS, &temp, sizeof(Payment));
+    pthread_rwlock_unlock(&payments_lock);
+    pthread_rwlock_unlock(&bookings_lock);
+
+    wal_commit(lsn); // Acknowledge only once the insert is durable
+    if (newId)
+        *newId = temp.paymentId;
+    return DB_OK;
+}
+
+DbStatus db_get_payment(int id, Payment *out)
+{
+    pthread_rwlock_rdlock(&payments_lock);
+    PaymentNode *node = findPaymentNodeById(id);
+    if (node && out)
+        payment_read(node, out);
+    pthread_rwlock_unlock(&payments_lock);
+    return node ? DB_OK : DB_NOT_FOUND;
+}
+
+DbStatus db_update_payment(int id, const char *status)
+{
+    uint64_t lsn = 0;
+    char text[sizeof(((Payment *)0)->status)];
+    snprintf(text, sizeof(text), "%s", status);
+    if (str_admit(STR_COL_PAYMENT_STATUS, text, NULL) != DB_OK)
+        return DB_FULL;
+
+    pthread_rwlock_wrlock(&payments_lock);
+    PaymentNode *node = findPaymentNodeById(id);
+    if (node)
+    {
+        Payment updated;
+        payment_read(node, &updated);
+        snprintf(updated.status, sizeof(updated.status), "%s", status);
+        set_payment_data(node, &updated);
+
+        char logMsg[100];
+        sprintf(logMsg, "Updated Payment ID %d status", id);
+        log_operation(logMsg);
+        lsn = wal_append(WAL_UPDATE, SNAP_PAYMENTS, &updated, sizeof(Payment));
+    }
+    pthread_rwlock_unlock(&payments_lock);
+
+    if (!node)
+        return DB_NOT_FOUND;
+    wal_commit(lsn); // Acknowledge only once the change is durable
+    return DB_OK;
+}
+
+DbStatus db_delete_payment(int id)
+{
+    uint64_t lsn = 0;
+
+    pthread_rwlock_wrlock(&payments_lock);
+    PaymentNode *node = findPaymentNodeById(id);
+    if (node)
+    {
+        remove_payment_node(node);
+
+        char logMsg[100];
+        sprintf(logMsg, "Deleted Payment ID %d", id);
+        log_operation(logMsg);
+        lsn = wal_append(WAL_DELETE, SNAP_PAYMENTS, &id, sizeof(id));
+    }
+    pthread_rwlock_unlock(&payments_lock);
+
+    if (!node)
+        return DB_NOT_FOUND;
+    wal_commit(lsn);
+    return DB_OK;
+}
+
+// -- Secondary Lookups --
+// Each copies up to 'max' matches into 'out' and returns the total number found.
+
+// Bookings holding a workspace at any point in [from, to) (schedule binary search)
+int db_workspace_occupancy(int workspaceId, int64_t from, int64_t to, Booking *out, int max)
+{
+    int found = 0;
+    pthread_rwlock_rdlock(&bookings_lock);
+    WorkspaceSchedule *sched = (WorkspaceSchedule *)index_find(&schedule_index, workspaceId);
+    if (sched)
+    {
+        // Stop at the first booking starting at or after 'to'
+        for (size_t i = schedule_scan_start(sched, from);
+             i < sched->count && sched->items[i]->start_min < to; i++)
+        {
+            if (booking_end(sched->items[i]) <= from)
+                continue;
+            if (found < max)
+                booking_read(sched->items[i], &out[found]);
+            found++;
+        }
+    }
+    pthread_rwlock_unlock(&bookings_lock);
+    return found;
+}
+
+// A member's bookings (reverse FK index)
+int db_member_bookings(int memberId, Booking *out, int max)
+{
+    int found = 0;
+    pthread_rwlock_rdlock(&bookings_lock);
+    for (BookingNode *node = first_booking_of(FK_BY_MEMBER, memberId); node; node = next_booking_of(node, FK_BY_MEMBER))
+    {
+        if (found < max)
+            booking_read(node, &out[found]);
+        found++;
+    }
+    pthread_rwlock_unlock(&bookings_lock);
+    return found;
+}
+
+// A booking's payments (reverse FK index)
+int db_booking_payments(int bookingId, Payment *out, int max)
+{
+    int found = 0;
+    pthread_rwlock_rdlock(&payments_lock);
+    for (PaymentNode *node = first_payment_of(bookingId); node; node = next_payment_of(node))
+    {
+        if (found < max)
+            payment_read(node, &out[found]);
+        found++;
+    }
+    pthread_rwlock_unlock(&payments_lock);
+    return found;
+}
+
+// -- Range Scans (ordered indexes) --
+// Rows come in (time, id) order, a page at a time. *cursor is the key of the
+// last row already returned: start with { from, 0 } and pass it back for the
+// next page. Each call copies up to 'max' rows, advances *cursor to the last
+// one and sets *more when further rows fall inside the range.
+
+// Bookings starting in [from, to) (minutes since the epoch)
+int db_bookings_starting(int64_t from, int64_t to, OrderedKey *cursor, Booking *out, int max, int *more)
+{
+    int found = 0;
+    OrderedCursor pos;
+    OrderedKey key;
+    BookingNode *node;
+    if (cursor->time < from)
+        *cursor = (OrderedKey){ from, 0 };
+
+    pthread_rwlock_rdlock(&bookings_lock);
+    ordered_seek_after(&bookings_by_start, cursor, &pos);
+    while ((node = (BookingNode *)ordered_next(&pos, &key)) != NULL && key.time < to && found < max)
+    {
+        booking_read(node, &out[found++]);
+        *cursor = key;
+    }
+    *more = node != NULL && key.time < to;
+    pthread_rwlock_unlock(&bookings_lock);
+    return found;
+}
+
+// Payments dated in [from, to) (days since the epoch)
+int db_payments_dated(int64_t from, int64_t to, OrderedKey *cursor, Payment *out, int max, int *more)
+{
+    int found = 0;
+    OrderedCursor pos;
+    OrderedKey key;
+    PaymentNode *node;
+    if (cursor->time < from)
+        *cursor = (OrderedKey){ from, 0 };
+
+    pthread_rwlock_rdlock(&payments_lock);
+    ordered_seek_after(&payments_by_date, cursor, &pos);
+    while ((node = (PaymentNode *)ordered_next(&pos, &key)) != NULL && key.time < to && found < max)
+    {
+        payment_read(node, &out[found++]);
+        *cursor = key;
+    }
+    *more = node != NULL && key.time < to;
+    pthread_rwlock_unlock(&payments_lock);
+    return found;
+}
+
+/*
+ * ==========================================
+ * TRANSACTIONS (Optimistic Concurrency Control)
+ * ==========================================
+ */
+// A transaction reads committed rows under short locks, remembering each
+// row's version, and buffers its writes; nothing stays locked while the
+// caller (or a user at the menu) decides what to do next. txn_commit then
+// locks every table involved in the global order (member stripes ascending
+// -> workspaces -> bookings -> payments), aborts with DB_ABORTED if any row
+// read has a different version now, and otherwise applies the writes with
+// the usual constraint checks. If one of those fails, the writes already
+// applied are undone before the locks are released. A committed transaction
+// is logged as one WAL_TXN record, so replay sees all of it or none.
+//
+// Every write path stamps the row with a fresh record_clock value, so
+// single-statement db_* writes invalidate transactional reads too. Members
+// and workspaces cannot be added or deleted inside a transaction (unique
+// emails and cascades stay with db_*); workspaces can be updated.
+
+uint64_t record_version_next()
+{
+    return atomic_fetch_add_explicit(&record_clock, 1, memory_order_relaxed) + 1;
+}
+
+void txn_begin(Txn *txn)
+{
+    txn->read_count = txn->write_count = 0;
+    txn->conflict_id = 0;
+    txn->open = 1;
+    atomic_fetch_add(&txn_begun, 1);
+}
+
+// Drops the buffered writes; nothing was applied yet
+void txn_abort(Txn *txn)
+{
+    txn->open = 0;
+}
+
+// -- Reads --
+
+static DbStatus txn_note_read(Txn *txn, int table, int id, uint64_t version)
+{
+    for (int i = 0; i < txn->read_count; i++)
+        if (txn->reads[i].table == table && txn->reads[i].id == id && txn->reads[i].version == version)
+            return version ? DB_OK : DB_NOT_FOUND;
+    if (txn->read_count == TXN_MAX_READS)
+        return DB_INVALID;
+    txn->reads[txn->read_count++] = (TxnRead){ (uint8_t)table, id, version };
+    return version ? DB_OK : DB_NOT_FOUND;
+}
+
+static int txn_write_id(const TxnWrite *w)
+{
+    if (w->op == WAL_DELETE)
+        return w->row.id;
+    switch (w->table)
+    {
+    case SNAP_WORKSPACES: return w->row.workspace.workspaceId;
+    case SNAP_BOOKINGS: return w->row.booking.bookingId;
+    default: return w->row.payment.paymentId;
+    }
+}
+
+// The transaction's own latest write to a row, which its reads must see
+static const TxnWrite *txn_pending(const Txn *txn, int table, int id)
+{
+    for (int i = txn->write_count - 1; i >= 0; i--)
+        if (txn->writes[i].table == table && txn_write_id(&txn->writes[i]) == id)
+            return &txn->writes[i];
+    return NULL;
+}
+
+DbStatus txn_get_member(Txn *txn, int id, Member *out)
+{
+    MemberStripe *stripe = member_stripe(id);
+    pthread_rwlock_rdlock(&stripe->lock);
+    MemberNode *node = findMemberNodeById(id);
+    uint64_t version = node ? node->version : 0;
+    if (node && out)
+        member_decode(node, out);
+    pthread_rwlock_unlock(&stripe->lock);
+    return txn_note_read(txn, SNAP_MEMBERS, id, version);
+}
+
+DbStatus txn_get_workspace(Txn *txn, int id, Workspace *out)
+{
+    const TxnWrite *w = txn_pending(txn, SNAP_WORKSPACES, id);
+    if (w) {
+        if (out)
+            *out = w->row.workspace;
+        return DB_OK;
+    }
+    pthread_rwlock_rdlock(&workspaces_lock);
+    WorkspaceNode *node = findWorkspaceNodeById(id);
+    uint64_t version = node ? node->version : 0;
+    if (node && out)
+        workspace_decode(&node->data, out);
+    pthread_rwlock_unlock(&workspaces_lock);
+    return txn_note_read(txn, SNAP_WORKSPACES, id, version);
+}
+
+DbStatus txn_get_booking(Txn *txn, int id, Booking *out)
+{
+    const TxnWrite *w = txn_pending(txn, SNAP_BOOKINGS, id);
+    if (w) {
+        if (w->op == WAL_DELETE)
+            return DB_NOT_FOUND;
+        if (out)
+            *out = w->row.booking;
+        return DB_OK;
+    }
+    pthread_rwlock_rdlock(&bookings_lock);
+    BookingNode *node = findBookingNodeById(id);
+    uint64_t version = node ? node->version : 0;
+    if (node && out)
+        booking_read(node, out);
+    pthread_rwlock_unlock(&bookings_lock);
+    return txn_note_read(txn, SNAP_BOOKINGS, id, version);
+}
+
+DbStatus txn_get_payment(Txn *txn, int id, Payment *out)
+{
+    const TxnWrite *w = txn_pending(txn, SNAP_PAYMENTS, id);
+    if (w) {
+        if (w->op == WAL_DELETE)
+            return DB_NOT_FOUND;
+        if (out)
+            *out = w->row.payment;
+        return DB_OK;
+    }
+    pthread_rwlock_rdlock(&payments_lock);
+    PaymentNode *node = findPaymentNodeById(id);
+    uint64_t version = node ? node->version : 0;
+    if (node && out)
+        payment_read(node, out);
+    pthread_rwlock_unlock(&payments_lock);
+    return txn_note_read(txn, SNAP_PAYMENTS, id, version);
+}
+
+// -- Buffered Writes --
+// Each one reads the rows it depends on through the transaction (so they are
+// validated at commit) and fails early the way the db_* call would. New rows
+// get their id now, so later statements can refer to them.
+
+static TxnWrite *txn_push(Txn *txn, uint8_t op, uint8_t table)
+{
+    if (!txn->open || txn->write_count == TXN_MAX_WRITES)
+        return NULL;
+    TxnWrite *w = &txn->writes[txn->write_count++];
+    memset(w, 0, sizeof(*w));
+    w->op = op;
+    w->table = table;
+    return w;
+}
+
+// A missing parent is reported as such rather than as DB_NOT_FOUND
+static DbStatus txn_parent(DbStatus rc)
+{
+    return rc == DB_NOT_FOUND ? DB_MISSING_PARENT : rc;
+}
+
+DbStatus txn_update_workspace(Txn *txn, int id, int capacity, int price_in_cents)
+{
+    Workspace updated;
+    DbStatus rc = txn_get_workspace(txn, id, &updated);
+    if (rc != DB_OK)
+        return rc;
+    TxnWrite *w = txn_push(txn, WAL_UPDATE, SNAP_WORKSPACES);
+    if (!w)
+        return DB_INVALID;
+    updated.capacity = capacity;
+    updated.price_in_cents = price_in_cents;
+    w->row.workspace = updated;
+    return DB_OK;
+}
+
+DbStatus txn_add_booking(Txn *txn, int memberId, int workspaceId, const char *startTime, const char *endTime,
+                         const char *status, int *newId)
+{
+    Booking temp;
+    memset(&temp, 0, sizeof(temp));
+    temp.memberId = memberId;
+    temp.workspaceId = workspaceId;
+    snprintf(temp.startTime, sizeof(temp.startTime), "%s", startTime);
+    snprintf(temp.endTime, sizeof(temp.endTime), "%s", endTime);
+    snprintf(temp.status, sizeof(temp.status), "%s", status);
+
+    int64_t start = parse_booking_time(temp.startTime);
+    int64_t end = parse_booking_time(temp.endTime);
+    if (start < 0 || end <= start)
+        return DB_INVALID;
+    if (str_admit(STR_COL_BOOKING_STATUS, temp.status, NULL) != DB_OK)
+        return DB_FULL;
+    DbStatus rc = txn_parent(txn_get_member(txn, memberId, NULL));
+    if (rc == DB_OK)
+        rc = txn_parent(txn_get_workspace(txn, workspaceId, NULL));
+    if (rc != DB_OK)
+        return rc;
+
+    TxnWrite *w = txn_push(txn, WAL_INSERT, SNAP_BOOKINGS);
+    if (!w)
+        return DB_INVALID;
+    pthread_rwlock_wrlock(&bookings_lock);
+    temp.bookingId = next_booking_id++; // An aborted transaction leaves a gap
+    pthread_rwlock_unlock(&bookings_lock);
+    w->row.booking = temp;
+    if (newId)
+        *newId = temp.bookingId;
+    return DB_OK;
+}
+
+DbStatus txn_update_booking(Txn *txn, int id, const char *status)
+{
+    Booking updated;
+    DbStatus rc = txn_get_booking(txn, id, &updated);
+    if (rc != DB_OK)
+        return rc;
+    snprintf(updated.status, sizeof(updated.status), "%s", status);
+    if (str_admit(STR_COL_BOOKING_STATUS, updated.status, NULL) != DB_OK)
+        return DB_FULL;
+    TxnWrite *w = txn_push(txn, WAL_UPDATE, SNAP_BOOKINGS);
+    if (!w)
+        return DB_INVALID;
+    w->row.booking = updated;
+    return DB_OK;
+}
+
+DbStatus txn_delete_booking(Txn *txn, int id)
+{
+    DbStatus rc = txn_get_booking(txn, id, NULL);
+    if (rc != DB_OK)
+        return rc;
+    TxnWrite *w = txn_push(txn, WAL_DELETE, SNAP_BOOKINGS);
+    if (!w)
+        return DB_INVALID;
+    w->row.id = id;
+    return DB_OK;
+}
+
+DbStatus txn_add_payment(Txn *txn, int bookingId, int amount_in_cents, const char *paymentDate, const char *status,
+                         int *newId)
+{
+    Payment temp;
+    memset(&temp, 0, sizeof(temp));
+    temp.bookingId = bookingId;
+    temp.amount_in_cents = amount_in_cents;
+    snprintf(temp.paymentDate, sizeof(temp.paymentDate), "%s", paymentDate);
+    snprintf(temp.status, sizeof(temp.status), "%s", status);
+    if (str_admit(STR_COL_PAYMENT_STATUS, temp.status, NULL) != DB_OK)
+        return DB_FULL;
+    DbStatus rc = txn_parent(txn_get_booking(txn, bookingId, NULL));
+    if (rc != DB_OK)
+        return rc;
+    TxnWrite *w = txn_push(txn, WAL_INSERT, SNAP_PAYMENTS);
+    if (!w)
+        return DB_INVALID;
+    pthread_rwlock_wrlock(&payments_lock);
+    temp.paymentId = next_payment_id++; // An aborted transaction leaves a gap
+    pthread_rwlock_unlock(&payments_lock);
+    w->row.payment = temp;
+    if (newId)
+        *newId = temp.paymentId;
+    return DB_OK;
+}
+
+DbStatus txn_update_payment(Txn *txn, int id, const char *status)
+{
+    Payment updated;
+    DbStatus rc = txn_get_payment(txn, id, &updated);
+    if (rc != DB_OK)
+        return rc;
+    snprintf(updated.status, sizeof(updated.status), "%s", status);
+    if (str_admit(STR_COL_PAYMENT_STATUS, updated.status, NULL) != DB_OK)
+        return DB_FULL;
+    TxnWrite *w = txn_push(txn, WAL_UPDATE, SNAP_PAYMENTS);
+    if (!w)
+        return DB_INVALID;
+    w->row.payment = updated;
+    return DB_OK;
+}
+
+DbStatus txn_delete_payment(Txn *txn, int id)
+{
+    DbStatus rc = txn_get_payment(txn, id, NULL);
+    if (rc != DB_OK)
+        return rc;
+    TxnWrite *w = txn_push(txn, WAL_DELETE, SNAP_PAYMENTS);
+    if (!w)
+        return DB_INVALID;
+    w->row.id = id;
+    return DB_OK;
+}
+
+// -- Commit --
+
+enum { TXN_UNLOCKED, TXN_READ, TXN_WRITE };
+
+// Growable byte buffer: the WAL_TXN payload and the undo log
+typedef struct
+{
+    char *data;
+    size_t used, capacity;
+} TxnBuffer;
+
+// Before-image of one applied change
+typedef struct
+{
+    uint8_t op, table; // The change being undone
+    uint64_t version;  // The row's version before it
+    union
+    {
+        WorkspaceRecord workspace;
+        Booking booking;
+        Payment payment;
+        int id;        // Inserted row
+    } before;
+} TxnUndo;
+
+static void *txn_buffer_put(TxnBuffer *buf, const void *bytes, size_t length)
+{
+    if (buf->used + length > buf->capacity)
+    {
+        size_t capacity = buf->capacity ? buf->capacity : 1024;
+        while (buf->used + length > capacity)
+            capacity *= 2;
+        char *data = (char *)realloc(buf->data, capacity);
+        if (!data) {
+            perror("Failed to grow transaction buffer");
+            exit(1);
+        }
+        buf->data = data;
+        buf->capacity = capacity;
+    }
+    void *at = buf->data + buf->used;
+    if (bytes)
+        memcpy(at, bytes, length);
+    buf->used += length;
+    return at;
+}
+
+static void txn_log(TxnBuffer *log, uint8_t op, uint8_t table, const void *payload, uint32_t length)
+{
+    WalRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.length = length;
+    header.op = op;
+    header.table = table;
+    txn_buffer_put(log, &header, sizeof(header));
+    txn_buffer_put(log, payload, length);
+}
+
+static TxnUndo *txn_undo_push(TxnBuffer *undo, uint8_t op, uint8_t table, uint64_t version)
+{
+    TxnUndo *u = (TxnUndo *)txn_buffer_put(undo, NULL, sizeof(TxnUndo));
+    u->op = op;
+    u->table = table;
+    u->version = version;
+    return u;
+}
+
+static uint64_t txn_current_version(int table, int id)
+{
+    switch (table)
+    {
+    case SNAP_MEMBERS: {
+        MemberNode *node = findMemberNodeById(id);
+        return node ? node->version : 0;
+    }
+    case SNAP_WORKSPACES: {
+        WorkspaceNode *node = findWorkspaceNodeById(id);
+        return node ? node->version : 0;
+    }
+    case SNAP_BOOKINGS: {
+        BookingNode *node = findBookingNodeById(id);
+        return node ? node->version : 0;
+    }
+    default: {
+        PaymentNode *node = findPaymentNodeById(id);
+        return node ? node->version : 0;
+    }
+    }
+}
+
+static void txn_remove_payment(PaymentNode *node, TxnBuffer *log, TxnBuffer *undo)
+{
+    int id = node->paymentId;
+    payment_read(node, &txn_undo_push(undo, WAL_DELETE, SNAP_PAYMENTS, node->version)->before.payment);
+    remove_payment_node(node);
+    txn_log(log, WAL_DELETE, SNAP_PAYMENTS, &id, sizeof(id));
+}
+
+// Applies one buffered write with the checks its db_* counterpart makes.
+// Caller holds the commit locks.
+static DbStatus txn_apply(Txn *txn, const TxnWrite *w, TxnBuffer *log, TxnBuffer *undo)
+{
+    int id = txn_write_id(w);
+    if (w->table == SNAP_WORKSPACES)
+    {
+        WorkspaceNode *node = findWorkspaceNodeById(id);
+        if (!node)
+            return DB_NOT_FOUND;
+        txn_undo_push(undo, WAL_UPDATE, SNAP_WORKSPACES, node->version)->before.workspace = node->data;
+        node->data.capacity = w->row.workspace.capacity;
+        node->data.price_in_cents = w->row.workspace.price_in_cents;
+        node->version = record_version_next();
+        Workspace updated;
+        workspace_decode(&node->data, &updated);
+        txn_log(log, WAL_UPDATE, SNAP_WORKSPACES, &updated, sizeof(updated));
+        return DB_OK;
+    }
+
+    if (w->table == SNAP_BOOKINGS)
+    {
+        const Booking *data = &w->row.booking;
+        BookingNode *node = w->op == WAL_INSERT ? NULL : findBookingNodeById(id);
+        if (w->op != WAL_INSERT && !node)
+            return DB_NOT_FOUND;
+        if (w->op == WAL_DELETE)
+        {
+            if (fk_delete_policy == FK_RESTRICT && count_payments_of(id))
+                return DB_RESTRICTED;
+            PaymentNode *payment;
+            while ((payment = first_payment_of(id)) != NULL)
+                txn_remove_payment(payment, log, undo);
+            booking_read(node, &txn_undo_push(undo, WAL_DELETE, SNAP_BOOKINGS, node->version)->before.booking);
+            remove_booking_node(node);
+            txn_log(log, WAL_DELETE, SNAP_BOOKINGS, &id, sizeof(id));
+            return DB_OK;
+        }
+
+        // Same slot checks as db_add_booking / db_update_booking
+        BookingNode *conflict = NULL;
+        if (w->op == WAL_INSERT)
+        {
+            if (!findMemberNodeById(data->memberId) || !findWorkspaceNodeById(data->workspaceId))
+                return DB_MISSING_PARENT;
+            if (!(str_flags(str_intern(data->status)) & STR_CANCELLED))
+                conflict = schedule_find_conflict(data->workspaceId, parse_booking_time(data->startTime),
+                                                  parse_booking_time(data->endTime), -1);
+        }
+        else if (!node->scheduled && node->start_min >= 0 && !(str_flags(str_intern(data->status)) & STR_CANCELLED))
+            conflict = schedule_find_conflict(data->workspaceId, node->start_min, booking_end(node), id);
+        if (conflict)
+        {
+            booking_conflicts++;
+            txn->conflict_id = conflict->bookingId;
+            return DB_CONFLICT;
+        }
+        if (w->op == WAL_INSERT)
+        {
+            txn_undo_push(undo, WAL_INSERT, SNAP_BOOKINGS, 0)->before.id = id;
+            insert_booking_node(data);
+        }
+        else
+        {
+            booking_read(node, &txn_undo_push(undo, WAL_UPDATE, SNAP_BOOKINGS, node->version)->before.booking);
+            set_booking_data(node, data);
+        }
+        txn_log(log, w->op, SNAP_BOOKINGS, data, sizeof(Booking));
+        return DB_OK;
+    }
+
+    PaymentNode *node = w->op == WAL_INSERT ? NULL : findPaymentNodeById(id);
+    if (w->op != WAL_INSERT && !node)
+        return DB_NOT_FOUND;
+    switch (w->op)
+    {
+    case WAL_INSERT:
+        if (!findBookingNodeById(w->row.payment.bookingId))
+            return DB_MISSING_PARENT;
+        txn_undo_push(undo, WAL_INSERT, SNAP_PAYMENTS, 0)->before.id = id;
+        insert_payment_node(&w->row.payment);
+        break;
+    case WAL_UPDATE:
+        payment_read(node, &txn_undo_push(undo, WAL_UPDATE, SNAP_PAYMENTS, node->version)->before.payment);
+        set_payment_data(node, &w->row.payment);
+        break;
+    default:
+        txn_remove_payment(node, log, undo);
+        return DB_OK;
+    }
+    txn_log(log, w->op, SNAP_PAYMENTS, &w->row.payment, sizeof(Payment));
+    return DB_OK;
+}
+
+// Puts one row back as it was, version included, so concurrent readers of
+// it are not aborted by a change that never happened
+static void txn_undo(const TxnUndo *u)
+{
+    if (u->table == SNAP_WORKSPACES)
+    {
+        WorkspaceNode *node = findWorkspaceNodeById(u->before.workspace.workspaceId);
+        node->data = u->before.workspace;
+        node->version = u->version;
+    }
+    else if (u->table == SNAP_BOOKINGS)
+    {
+        if (u->op == WAL_INSERT) {
+            remove_booking_node(findBookingNodeById(u->before.id));
+            return;
+        }
+        BookingNode *node;
+        if (u->op == WAL_UPDATE)
+            set_booking_data(node = findBookingNodeById(u->before.booking.bookingId), &u->before.booking);
+        else
+            node = insert_booking_node(&u->before.booking);
+        node->version = u->version;
+    }
+    else
+    {
+        if (u->op == WAL_INSERT) {
+            remove_payment_node(findPaymentNodeById(u->before.id));
+            return;
+        }
+        PaymentNode *node;
+        if (u->op == WAL_UPDATE)
+            set_payment_data(node = findPaymentNodeById(u->before.payment.paymentId), &u->before.payment);
+        else
+            node = insert_payment_node(&u->before.payment);
+        node->version = u->version;
+    }
+}
+
+static void txn_lock_table(int table, int mode)
+{
+    pthread_rwlock_t *lock = table == SNAP_WORKSPACES ? &workspaces_lock
+                           : table == SNAP_BOOKINGS ? &bookings_lock : &payments_lock;
+    if (mode == TXN_WRITE)
+        pthread_rwlock_wrlock(lock);
+    else if (mode == TXN_READ)
+        pthread_rwlock_rdlock(lock);
+}
+
+static void txn_unlock_all(const int *modes, const char *stripes)
+{
+    pthread_rwlock_t *locks[SNAP_TABLES] = { NULL, &workspaces_lock, &bookings_lock, &payments_lock };
+    for (int table = SNAP_PAYMENTS; table > SNAP_MEMBERS; table--)
+        if (modes[table] != TXN_UNLOCKED)
+            pthread_rwlock_unlock(locks[table]);
+    for (int i = MEMBER_STRIPES - 1; i >= 0; i--)
+        if (stripes[i])
+            pthread_rwlock_unlock(&member_stripes[i].lock);
+}
+
+// DB_OK once every write is applied and logged. DB_ABORTED if a row read
+// has changed since (retry the whole transaction); any other status is the
+// first write that failed its checks, with nothing applied.
+DbStatus txn_commit(Txn *txn)
+{
+    if (!txn->open)
+        return DB_INVALID;
+    txn->open = 0;
+
+    // 1. Lock modes: reads need a read lock, writes (and the payments a
+    // booking delete restricts or cascades to) a write lock
+    int modes[SNAP_TABLES] = { TXN_UNLOCKED };
+    char stripes[MEMBER_STRIPES] = { 0 };
+    for (int i = 0; i < txn->read_count; i++)
+    {
+        const TxnRead *r = &txn->reads[i];
+        if (r->table == SNAP_MEMBERS)
+            stripes[member_stripe(r->id) - member_stripes] = 1;
+        else if (modes[r->table] == TXN_UNLOCKED)
+            modes[r->table] = TXN_READ;
+    }
+    for (int i = 0; i < txn->write_count; i++)
+    {
+        modes[txn->writes[i].table] = TXN_WRITE;
+        if (txn->writes[i].table == SNAP_BOOKINGS && txn->writes[i].op == WAL_DELETE)
+            modes[SNAP_PAYMENTS] = TXN_WRITE;
+    }
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+        if (stripes[i])
+            pthread_rwlock_rdlock(&member_stripes[i].lock);
+    for (int table = SNAP_WORKSPACES; table < SNAP_TABLES; table++)
+        txn_lock_table(table, modes[table]);
+
+    // 2. Validate: every row read is still at the version read
+    for (int i = 0; i < txn->read_count; i++)
+        if (txn_current_version(txn->reads[i].table, txn->reads[i].id) != txn->reads[i].version)
+        {
+            txn_unlock_all(modes, stripes);
+            atomic_fetch_add(&txn_aborted, 1);
+            return DB_ABORTED;
+        }
+
+    // 3. Apply, undoing everything on the first failed check
+    TxnBuffer log = { NULL, 0, 0 }, undo = { NULL, 0, 0 };
+    DbStatus rc = DB_OK;
+    for (int i = 0; i < txn->write_count && rc == DB_OK; i++)
+        rc = txn_apply(txn, &txn->writes[i], &log, &undo);
+    uint64_t lsn = 0;
+    if (rc != DB_OK)
+    {
+        for (size_t n = undo.used / sizeof(TxnUndo); n > 0; n--)
+            txn_undo((const TxnUndo *)undo.data + n - 1);
+        atomic_fetch_add(&txn_failed, 1);
+    }
+    else if (txn->write_count > 0)
+    {
+        char logMsg[100];
+        sprintf(logMsg, "Committed transaction (%d statements, %zu changes)", txn->write_count,
+                undo.used / sizeof(TxnUndo));
+        log_operation(logMsg);
+        lsn = wal_append(WAL_TXN, 0, log.data, (uint32_t)log.used);
+    }
+    txn_unlock_all(modes, stripes);
+    free(log.data);
+    free(undo.data);
+
+    if (rc != DB_OK)
+        return rc;
+    wal_commit(lsn); // Acknowledge only once the whole transaction is durable
+    atomic_fetch_add(&txn_committed, 1);
+    return DB_OK;
+}
+
+// Commits 'txn'. After a stale read, runs 'body' again in a fresh
+// transaction (it must redo every read and write) up to TXN_MAX_RETRIES times.
+DbStatus txn_commit_retry(Txn *txn, TxnBody body, void *ctx)
+{
+    DbStatus rc = txn_commit(txn);
+    for (int attempt = 0; rc == DB_ABORTED && attempt < TXN_MAX_RETRIES; attempt++)
+    {
+        atomic_fetch_add(&txn_retries, 1);
+        txn_begin(txn);
+        rc = body(txn, ctx);
+        if (rc == DB_OK)
+            rc = txn_commit(txn);
+        else
+            txn_abort(txn);
+    }
+    return rc;
+}
+
+DbStatus txn_run(TxnBody body, void *ctx)
+{
+    Txn *txn = (Txn *)malloc(sizeof(Txn));
+    if (!txn) {
+        perror("Failed to allocate transaction");
+        exit(1);
+    }
+    txn_begin(txn);
+    DbStatus rc = body(txn, ctx);
+    if (rc == DB_OK)
+        rc = txn_commit_retry(txn, body, ctx);
+    else
+        txn_abort(txn);
+    free(txn);
+    return rc;
+}
+
+void txn_print_stats()
+{
+    unsigned long committed = atomic_load(&txn_committed), aborted = atomic_load(&txn_aborted);
+    unsigned long failed = atomic_load(&txn_failed), tried = committed + aborted + failed;
+    printf("\n--- Transactions ---\n");
+    printf("Begun: %lu | Committed: %lu | Aborted (stale read): %lu (%.1f%% of commits) | "
+           "Failed (constraint): %lu | Retries: %lu\n",
+           (unsigned long)atomic_load(&txn_begun), committed, aborted, tried ? 100.0 * aborted / tried : 0.0, failed,
+           (unsigned long)atomic_load(&txn_retries));
+}
+
+/*
+ * ==========================================
+ * QUERY ENGINE (SELECT over the four tables)
+ * ==========================================
+ */
+// [EXPLAIN] SELECT item, ... FROM table [WHERE col op value [AND ...]]
+//     [GROUP BY col] [ORDER BY col|item|position [ASC|DESC]] [LIMIT n]
+// An item is a column, *, or COUNT/SUM/AVG/MIN/MAX of a column (COUNT(*)
+// too). Text values are quoted with single quotes. Keywords, table and column
+// names are case-insensitive.
+//
+// The planner picks one access path: a primary key or email lookup, a
+// reverse FK list, a range scan on an ordered index, or a full scan of a
+// point-in-time copy. The other WHERE terms filter the fetched rows. Rows are
+// copied out of the tables (under the table lock) before anything is
+// evaluated, so no lock is held while filtering, grouping or sorting.
+
+enum { QCOL_INT, QCOL_TEXT, QCOL_TIME, QCOL_DATE }; // TIME/DATE compare by parsed value
+enum { QOP_EQ, QOP_NE, QOP_LT, QOP_LE, QOP_GT, QOP_GE };
+enum { AGG_NONE, AGG_COUNT, AGG_SUM, AGG_AVG, AGG_MIN, AGG_MAX };
+enum { ACCESS_SCAN, ACCESS_PRIMARY, ACCESS_EMAIL, ACCESS_FK, ACCESS_RANGE };
+enum { TOK_END, TOK_WORD, TOK_NUMBER, TOK_STRING, TOK_OP, TOK_PUNCT };
+
+static const char *query_op_names[] = { "=", "!=", "<", "<=", ">", ">=" };
+static const char *query_agg_names[] = { "", "COUNT", "SUM", "AVG", "MIN", "MAX" };
+
+typedef struct
+{
+    const char *name;
+    int type; // QCOL_*
+    size_t offset; // In the interface struct (Member, Workspace, ...)
+} QueryColumn;
+
+typedef struct
+{
+    const char *name;
+    size_t row_size;
+    const QueryColumn *columns; // The first is the primary key
+    int column_count;
+    const char *primary_index;  // Shown by EXPLAIN
+    int ordered_column;         // Column with a B+tree, -1 if none
+    const OrderedIndex *ordered_index;
+} QueryTable;
+
+#define QCOL(type, field, kind) { #field, kind, offsetof(type, field) }
+
+static const QueryColumn query_member_columns[] = {
+    QCOL(Member, memberId, QCOL_INT), QCOL(Member, name, QCOL_TEXT), QCOL(Member, email, QCOL_TEXT)
+};
+static const QueryColumn query_workspace_columns[] = {
+    QCOL(Workspace, workspaceId, QCOL_INT), QCOL(Workspace, type, QCOL_TEXT), QCOL(Workspace, location, QCOL_TEXT),
+    QCOL(Workspace, capacity, QCOL_INT), QCOL(Workspace, price_in_cents, QCOL_INT)
+};
+static const QueryColumn query_booking_columns[] = {
+    QCOL(Booking, bookingId, QCOL_INT), QCOL(Booking, memberId, QCOL_INT), QCOL(Booking, workspaceId, QCOL_INT),
+    QCOL(Booking, startTime, QCOL_TIME), QCOL(Booking, endTime, QCOL_TIME), QCOL(Booking, status, QCOL_TEXT)
+};
+static const QueryColumn query_payment_columns[] = {
+    QCOL(Payment, paymentId, QCOL_INT), QCOL(Payment, bookingId, QCOL_INT), QCOL(Payment, amount_in_cents, QCOL_INT),
+    QCOL(Payment, paymentDate, QCOL_DATE), QCOL(Payment, status, QCOL_TEXT)
+};
+
+#undef QCOL
+
+// Indexed by SNAP_*
+static const QueryTable query_tables[SNAP_TABLES] = {
+    { "members", sizeof(Member), query_member_columns, 3, "member id map, lock-free", -1, NULL },
+    { "workspaces", sizeof(Workspace), query_workspace_columns, 5, "Workspace Index", -1, NULL },
+    { "bookings", sizeof(Booking), query_booking_columns, 6, "Booking Index", 3, &bookings_by_start },
+    { "payments", sizeof(Payment), query_payment_columns, 5, "Payment Index", 3, &payments_by_date },
+};
+
+typedef struct
+{
+    int agg;    // AGG_*
+    int column; // -1 for COUNT(*)
+} QueryItem;
+
+typedef struct
+{
+    int column;
+    int op;                            // QOP_*
+    int64_t number;                    // INT value, or parsed TIME/DATE (-1 if it does not parse)
+    char text[QUERY_TEXT_MAX + 1];     // The literal as written
+} QueryPredicate;
+
+typedef struct
+{
+    int table;
+    QueryItem items[QUERY_MAX_ITEMS];
+    int item_count;
+    QueryPredicate where[QUERY_MAX_PREDICATES];
+    int where_count;
+    int group_column; // -1: none
+    int aggregated;   // GROUP BY or an aggregate in the select list
+    int order_column; // Row column to sort by (plain queries), -1: none
+    int order_item;   // Output item to sort by (aggregated queries), -1: none
+    int order_desc;
+    long long limit;  // -1: none
+    int explain;
+} Query;
+
+typedef struct
+{
+    int access;     // ACCESS_*
+    int64_t key;    // ACCESS_PRIMARY / ACCESS_FK id
+    const char *email;
+    int fk_list;    // ACCESS_FK on bookings: FK_BY_MEMBER / FK_BY_WORKSPACE
+    int64_t from, to; // ACCESS_RANGE bounds on the ordered column, [from, to)
+    int consumed[QUERY_MAX_PREDICATES]; // Terms the access path already guarantees
+    int ordered;    // Rows arrive in ORDER BY order, so no sort
+    int early_stop; // Fetching ends once LIMIT rows matched
+} QueryPlan;
+
+// -- Parsing --
+
+typedef struct
+{
+    const char *p;
+    int type; // TOK_*
+    char text[QUERY_TEXT_MAX + 1];
+    int64_t number;
+    char *error;
+} QueryLexer;
+
+// A select item or ORDER BY term before its column is resolved
+typedef struct
+{
+    int agg;
+    char name[QUERY_TEXT_MAX + 1]; // "*" for * / COUNT(*)
+} QueryRef;
+
+static int query_fail(QueryLexer *lx, const char *fmt, ...)
+{
+    if (lx->error[0] == '\0')
+    {
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(lx->error, 160, fmt, args);
+        va_end(args);
+    }
+    return -1;
+}
+
+static int query_lex(QueryLexer *lx)
+{
+    while (isspace((unsigned char)*lx->p))
+        lx->p++;
+    const char *start = lx->p;
+    size_t length = 0;
+    if (*lx->p == '\0')
+        lx->type = TOK_END;
+    else if (isalpha((unsigned char)*lx->p) || *lx->p == '_')
+    {
+        while (isalnum((unsigned char)*lx->p) || *lx->p == '_')
+            lx->p++;
+        lx->type = TOK_WORD;
+        length = (size_t)(lx->p - start);
+    }
+    else if (isdigit((unsigned char)*lx->p) || (*lx->p == '-' && isdigit((unsigned char)lx->p[1])))
+    {
+        char *end;
+        errno = 0;
+        lx->number = strtoll(lx->p, &end, 10);
+        if (errno != 0)
+            return query_fail(lx, "number out of range");
+        lx->p = end;
+        lx->type = TOK_NUMBER;
+        length = (size_t)(lx->p - start);
+    }
+    else if (*lx->p == '\'')
+    {
+        const char *close = strchr(++start, '\'');
+        if (!close)
+            return query_fail(lx, "unterminated string");
+        lx->p = close + 1;
+        lx->type = TOK_STRING;
+        length = (size_t)(close - start);
+    }
+    else if (strchr("=<>!", *lx->p))
+    {
+        lx->p++;
+        if (*lx->p == '=' || (*start == '<' && *lx->p == '>'))
+            lx->p++;
+        lx->type = TOK_OP;
+        length = (size_t)(lx->p - start);
+    }
+    else if (strchr("(),*", *lx->p))
+    {
+        lx->p++;
+        lx->type = TOK_PUNCT;
+        length = 1;
+    }
+    else
+        return query_fail(lx, "unexpected character '%c'", *lx->p);
+
+    if (length > QUERY_TEXT_MAX)
+        return query_fail(lx, "token too long (max %d characters)", QUERY_TEXT_MAX);
+    memcpy(lx->text, start, length);
+    lx->text[length] = '\0';
+    return 0;
+}
+
+static int query_is_word(const QueryLexer *lx, const char *word)
+{
+    return lx->type == TOK_WORD && strcasecmp(lx->text, word) == 0;
+}
+
+static int query_is_punct(const QueryLexer *lx, char c)
+{
+    return lx->type == TOK_PUNCT && lx->text[0] == c;
+}
+
+// Consumes the keyword if it is next
+static int query_accept(QueryLexer *lx, const char *word)
+{
+    if (!query_is_word(lx, word))
+        return 0;
+    query_lex(lx);
+    return 1;
+}
+
+static int query_expect(QueryLexer *lx, const char *word)
+{
+    if (!query_accept(lx, word))
+        return query_fail(lx, "expected %s", word);
+    return 0;
+}
+
+static int query_column(int table, const char *name)
+{
+    const QueryTable *t = &query_tables[table];
+    for (int i = 0; i < t->column_count; i++)
+        if (strcasecmp(t->columns[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+static int query_parse_ref(QueryLexer *lx, QueryRef *ref)
+{
+    ref->agg = AGG_NONE;
+    if (query_is_punct(lx, '*'))
+    {
+        strcpy(ref->name, "*");
+        return query_lex(lx);
+    }
+    if (lx->type != TOK_WORD)
+        return query_fail(lx, "expected a column name");
+    snprintf(ref->name, sizeof(ref->name), "%s", lx->text);
+    if (query_lex(lx) != 0 || !query_is_punct(lx, '('))
+        return 0;
+
+    for (int agg = AGG_COUNT; agg <= AGG_MAX; agg++)
+        if (strcasecmp(ref->name, query_agg_names[agg]) == 0)
+            ref->agg = agg;
+    if (ref->agg == AGG_NONE)
+        return query_fail(lx, "unknown function %s", ref->name);
+    if (query_lex(lx) != 0)
+        return -1;
+    if (query_is_punct(lx, '*') && ref->agg == AGG_COUNT)
+        strcpy(ref->name, "*");
+    else if (lx->type == TOK_WORD)
+        snprintf(ref->name, sizeof(ref->name), "%s", lx->text);
+    else
+        return query_fail(lx, "expected a column inside %s()", query_agg_names[ref->agg]);
+    if (query_lex(lx) != 0)
+        return -1;
+    if (!query_is_punct(lx, ')'))
+        return query_fail(lx, "expected )");
+    return query_lex(lx);
+}
+
+// Turns a parsed item into a column reference of the table
+static int query_resolve_item(QueryLexer *lx, int table, const QueryRef *ref, QueryItem *item)
+{
+    item->agg = ref->agg;
+    item->column = strcmp(ref->name, "*") == 0 ? -1 : query_column(table, ref->name);
+    if (item->column < 0 && strcmp(ref->name, "*") != 0)
+        return query_fail(lx, "no column %s in %s", ref->name, query_tables[table].name);
+    if ((item->agg == AGG_SUM || item->agg == AGG_AVG) &&
+        query_tables[table].columns[item->column].type != QCOL_INT)
+        return query_fail(lx, "%s needs a numeric column", query_agg_names[item->agg]);
+    return 0;
+}
+
+static int query_parse_predicate(QueryLexer *lx, int table, QueryPredicate *pred)
+{
+    if (lx->type != TOK_WORD)
+        return query_fail(lx, "expected a column name in WHERE");
+    pred->column = query_column(table, lx->text);
+    if (pred->column < 0)
+        return query_fail(lx, "no column %s in %s", lx->text, query_tables[table].name);
+    if (query_lex(lx) != 0)
+        return -1;
+    if (lx->type != TOK_OP)
+        return query_fail(lx, "expected a comparison after %s", query_tables[table].columns[pred->column].name);
+    pred->op = -1;
+    for (int op = QOP_EQ; op <= QOP_GE; op++)
+        if (strcmp(lx->text, query_op_names[op]) == 0)
+            pred->op = op;
+    if (strcmp(lx->text, "<>") == 0)
+        pred->op = QOP_NE;
+    if (pred->op < 0)
+        return query_fail(lx, "unknown operator %s", lx->text);
+    if (query_lex(lx) != 0)
+        return -1;
+
+    int type = query_tables[table].columns[pred->column].type;
+    if (lx->type != TOK_NUMBER && lx->type != TOK_STRING && lx->type != TOK_WORD)
+        return query_fail(lx, "expected a value");
+    if (type == QCOL_INT && lx->type != TOK_NUMBER)
+        return query_fail(lx, "%s is numeric", query_tables[table].columns[pred->column].name);
+    snprintf(pred->text, sizeof(pred->text), "%s", lx->text);
+    pred->number = lx->type == TOK_NUMBER ? lx->number : 0;
+    if (type == QCOL_TIME)
+        pred->number = parse_booking_time(pred->text);
+    else if (type == QCOL_DATE)
+        pred->number = parse_payment_date(pred->text);
+    return query_lex(lx);
+}
+
+static int query_parse(const char *text, Query *q, char *error)
+{
+    QueryLexer lx = { .p = text, .error = error };
+    QueryRef refs[QUERY_MAX_ITEMS], order;
+    int ref_count = 0, have_order = 0, by_position = 0;
+    long long position = 0;
+
+    memset(q, 0, sizeof(*q));
+    q->group_column = q->order_column = q->order_item = -1;
+    q->limit = -1;
+    if (query_lex(&lx) != 0)
+        return -1;
+    q->explain = query_accept(&lx, "EXPLAIN");
+    if (query_expect(&lx, "SELECT") != 0)
+        return -1;
+    do
+    {
+        if (ref_count == QUERY_MAX_ITEMS)
+            return query_fail(&lx, "too many select items (max %d)", QUERY_MAX_ITEMS);
+        if (query_parse_ref(&lx, &refs[ref_count++]) != 0)
+            return -1;
+    } while (query_is_punct(&lx, ',') && query_lex(&lx) == 0);
+
+    if (query_expect(&lx, "FROM") != 0)
+        return -1;
+    q->table = -1;
+    for (int table = 0; table < SNAP_TABLES; table++)
+        if (query_is_word(&lx, query_tables[table].name))
+            q->table = table;
+    if (q->table < 0)
+        return query_fail(&lx, "unknown table %s (members, workspaces, bookings, payments)", lx.text);
+    if (query_lex(&lx) != 0)
+        return -1;
+
+    if (query_accept(&lx, "WHERE"))
+    {
+        do
+        {
+            if (q->where_count == QUERY_MAX_PREDICATES)
+                return query_fail(&lx, "too many WHERE terms (max %d)", QUERY_MAX_PREDICATES);
+            if (query_parse_predicate(&lx, q->table, &q->where[q->where_count++]) != 0)
+                return -1;
+        } while (query_accept(&lx, "AND"));
+    }
+    if (query_accept(&lx, "GROUP"))
+    {
+        if (query_expect(&lx, "BY") != 0)
+            return -1;
+        if (lx.type != TOK_WORD || (q->group_column = query_column(q->table, lx.text)) < 0)
+            return query_fail(&lx, "expected a %s column after GROUP BY", query_tables[q->table].name);
+        if (query_lex(&lx) != 0)
+            return -1;
+    }
+    if (query_accept(&lx, "ORDER"))
+    {
+        if (query_expect(&lx, "BY") != 0)
+            return -1;
+        have_order = 1;
+        if (lx.type == TOK_NUMBER)
+        {
+            by_position = 1;
+            position = lx.number;
+            if (query_lex(&lx) != 0)
+                return -1;
+        }
+        else if (query_parse_ref(&lx, &order) != 0)
+            return -1;
+        if (query_accept(&lx, "DESC"))
+            q->order_desc = 1;
+        else
+            query_accept(&lx, "ASC");
+    }
+    if (query_accept(&lx, "LIMIT"))
+    {
+        if (lx.type != TOK_NUMBER || lx.number < 0)
+            return query_fail(&lx, "LIMIT needs a non-negative number");
+        q->limit = lx.number;
+        if (query_lex(&lx) != 0)
+            return -1;
+    }
+    if (lx.type != TOK_END)
+        return query_fail(&lx, "unexpected '%s'", lx.text);
+
+    // Resolve the select list against the table
+    const QueryTable *t = &query_tables[q->table];
+    for (int i = 0; i < ref_count; i++)
+    {
+        if (refs[i].agg == AGG_NONE && strcmp(refs[i].name, "*") == 0)
+        {
+            for (int c = 0; c < t->column_count; c++)
+            {
+                if (q->item_count == QUERY_MAX_ITEMS)
+                    return query_fail(&lx, "too many select items (max %d)", QUERY_MAX_ITEMS);
+                q->items[q->item_count++] = (QueryItem){ AGG_NONE, c };
+            }
+            continue;
+        }
+        if (q->item_count == QUERY_MAX_ITEMS)
+            return query_fail(&lx, "too many select items (max %d)", QUERY_MAX_ITEMS);
+        if (query_resolve_item(&lx, q->table, &refs[i], &q->items[q->item_count++]) != 0)
+            return -1;
+    }
+    q->aggregated = q->group_column >= 0;
+    for (int i = 0; i < q->item_count; i++)
+        if (q->items[i].agg != AGG_NONE)
+            q->aggregated = 1;
+    for (int i = 0; q->aggregated && i < q->item_count; i++)
+        if (q->items[i].agg == AGG_NONE && q->items[i].column != q->group_column)
+            return query_fail(&lx, "%s must be aggregated or be the GROUP BY column", t->columns[q->items[i].column].name);
+
+    // ORDER BY: an output item when aggregated, otherwise any column
+    if (have_order && by_position)
+    {
+        if (position < 1 || position > q->item_count)
+            return query_fail(&lx, "ORDER BY position %lld is not in the select list", position);
+        if (q->aggregated)
+            q->order_item = (int)position - 1;
+        else
+            q->order_column = q->items[position - 1].column;
+    }
+    else if (have_order)
+    {
+        QueryItem key;
+        if (strcmp(order.name, "*") == 0 && order.agg == AGG_NONE)
+            return query_fail(&lx, "cannot ORDER BY *");
+        if (query_resolve_item(&lx, q->table, &order, &key) != 0)
+            return -1;
+        if (q->aggregated)
+        {
+            for (int i = 0; i < q->item_count; i++)
+                if (q->items[i].agg == key.agg && q->items[i].column == key.column)
+                    q->order_item = i;
+            if (q->order_item < 0)
+                return query_fail(&lx, "ORDER BY must name a selected column or aggregate");
+        }
+        else if (key.agg != AGG_NONE)
+            return query_fail(&lx, "ORDER BY an aggregate needs one in the select list");
+        else
+            q->order_column = key.column;
+    }
+    return 0;
+}
+
+// -- Planning --
+
+static void query_plan(const Query *q, QueryPlan *plan)
+{
+    const QueryTable *t = &query_tables[q->table];
+    int best = -1, rank = 0, ranged = 0;
+
+    memset(plan, 0, sizeof(*plan));
+    plan->access = ACCESS_SCAN;
+    plan->from = INT64_MIN;
+    plan->to = INT64_MAX;
+
+    // Equality on an indexed id or email: the highest-ranked one wins
+    for (int i = 0; i < q->where_count; i++)
+    {
+        const QueryPredicate *pred = &q->where[i];
+        if (pred->op != QOP_EQ)
+            continue;
+        int r = 0;
+        if (pred->column == 0)
+            r = 4;
+        else if (q->table == SNAP_MEMBERS && pred->column == 2)
+            r = 3;
+        else if ((q->table == SNAP_BOOKINGS && (pred->column == 1 || pred->column == 2)) ||
+                 (q->table == SNAP_PAYMENTS && pred->column == 1))
+            r = 2;
+        if (r > rank)
+        {
+            rank = r;
+            best = i;
+        }
+    }
+    if (best >= 0)
+    {
+        const QueryPredicate *pred = &q->where[best];
+        plan->access = rank == 4 ? ACCESS_PRIMARY : rank == 3 ? ACCESS_EMAIL : ACCESS_FK;
+        plan->key = pred->number;
+        plan->email = pred->text;
+        plan->fk_list = pred->column == 1 ? FK_BY_MEMBER : FK_BY_WORKSPACE;
+        plan->consumed[best] = 1;
+        return;
+    }
+
+    // Bounds on the ordered column narrow a range scan of its B+tree
+    for (int i = 0; t->ordered_column >= 0 && i < q->where_count; i++)
+    {
+        const QueryPredicate *pred = &q->where[i];
+        if (pred->column != t->ordered_column || pred->op == QOP_NE || pred->number < 0)
+            continue;
+        int64_t v = pred->number;
+        if ((pred->op == QOP_EQ || pred->op == QOP_GE) && v > plan->from)
+            plan->from = v;
+        if (pred->op == QOP_GT && v + 1 > plan->from)
+            plan->from = v + 1;
+        if (pred->op == QOP_LT && v < plan->to)
+            plan->to = v;
+        if ((pred->op == QOP_EQ || pred->op == QOP_LE) && v + 1 < plan->to)
+            plan->to = v + 1;
+        plan->consumed[i] = 1;
+        ranged = 1;
+    }
+    // Rows whose time does not parse are not in the tree, so only a bounded
+    // query may use it. Sorting by that column ascending then comes for free.
+    if (ranged)
+    {
+        plan->access = ACCESS_RANGE;
+        plan->ordered = !q->aggregated && q->order_column == t->ordered_column && !q->order_desc;
+        plan->early_stop = !q->aggregated && q->limit >= 0 && (plan->ordered || q->order_column < 0);
+    }
+}
+
+static int query_add_plan(QueryResult *result, const char *fmt, ...)
+{
+    if (result->plan_lines == QUERY_PLAN_LINES)
+        return -1;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(result->plan[result->plan_lines++], sizeof(result->plan[0]), fmt, args);
+    va_end(args);
+    return 0;
+}
+
+static void query_item_name(const Query *q, const QueryItem *item, char *out, size_t size)
+{
+    const QueryTable *t = &query_tables[q->table];
+    const char *column = item->column < 0 ? "*" : t->columns[item->column].name;
+    if (item->agg == AGG_NONE)
+        snprintf(out, size, "%s", column);
+    else
+        snprintf(out, size, "%s(%s)", query_agg_names[item->agg], column);
+}
+
+static void query_explain(const Query *q, const QueryPlan *plan, QueryResult *result)
+{
+    const QueryTable *t = &query_tables[q->table];
+    char terms[160] = "", name[QUERY_TEXT_MAX + 8];
+    size_t used = 0;
+
+    switch (plan->access)
+    {
+    case ACCESS_PRIMARY:
+        query_add_plan(result, "Access: primary key lookup %s = %lld (%s)", t->columns[0].name,
+                       (long long)plan->key, t->primary_index);
+        break;
+    case ACCESS_EMAIL:
+        query_add_plan(result, "Access: email index lookup email = '%s'", plan->email);
+        break;
+    case ACCESS_FK:
+        query_add_plan(result, "Access: reverse FK list %s = %lld (%s)",
+                       q->table == SNAP_PAYMENTS ? "bookingId" : plan->fk_list == FK_BY_MEMBER ? "memberId" : "workspaceId",
+                       (long long)plan->key,
+                       q->table == SNAP_PAYMENTS ? payments_by_booking.name : plan->fk_list == FK_BY_MEMBER ?
+                       bookings_by_member.name : bookings_by_workspace.name);
+        break;
+    case ACCESS_RANGE:
+        for (int i = 0; i < q->where_count; i++)
+            if (plan->consumed[i] && used < sizeof(terms))
+                used += snprintf(terms + used, sizeof(terms) - used, "%s%s %s '%s'", used ? " AND " : "",
+                                 t->columns[q->where[i].column].name, query_op_names[q->where[i].op], q->where[i].text);
+        query_add_plan(result, "Access: range scan of B+tree %s (%s)", t->ordered_index->name, terms);
+        break;
+    default:
+        query_add_plan(result, "Access: full scan of %s (point-in-time copy)", t->name);
+    }
+
+    used = 0;
+    terms[0] = '\0';
+    for (int i = 0; i < q->where_count; i++)
+        if (!plan->consumed[i] && used < sizeof(terms))
+            used += snprintf(terms + used, sizeof(terms) - used, "%s%s %s '%s'", used ? " AND " : "",
+                             t->columns[q->where[i].column].name, query_op_names[q->where[i].op], q->where[i].text);
+    if (used)
+        query_add_plan(result, "Filter: %s", terms);
+
+    if (q->aggregated)
+    {
+        used = 0;
+        terms[0] = '\0';
+        for (int i = 0; i < q->item_count; i++)
+            if (q->items[i].agg != AGG_NONE && used < sizeof(terms))
+            {
+                query_item_name(q, &q->items[i], name, sizeof(name));
+                used += snprintf(terms + used, sizeof(terms) - used, "%s%s", used ? ", " : "", name);
+            }
+        if (q->group_column >= 0)
+            query_add_plan(result, "Group: hash on %s%s%s", t->columns[q->group_column].name, used ? ", " : "", terms);
+        else
+            query_add_plan(result, "Aggregate: %s", terms);
+    }
+
+    if (q->order_item >= 0)
+        query_add_plan(result, "Sort: %s %s", result->names[q->order_item], q->order_desc ? "DESC" : "ASC");
+    else if (q->order_column >= 0 && plan->ordered)
+        query_add_plan(result, "Sort: none, %s arrives in index order", t->columns[q->order_column].name);
+    else if (q->order_column >= 0)
+        query_add_plan(result, "Sort: %s %s", t->columns[q->order_column].name, q->order_desc ? "DESC" : "ASC");
+    if (q->limit >= 0)
+        query_add_plan(result, "Limit: %lld%s", q->limit, plan->early_stop ? " (ends the scan early)" : "");
+}
+
+// -- Execution --
+
+static int64_t query_int(const QueryColumn *c, const void *row)
+{
+    int value;
+    memcpy(&value, (const char *)row + c->offset, sizeof(value));
+    return value;
+}
+
+static const char *query_text(const QueryColumn *c, const void *row)
+{
+    return (const char *)row + c->offset;
+}
+
+// Minutes (TIME) or days (DATE) since the epoch; -1 if the text does not parse
+static int64_t query_instant(int type, const char *text)
+{
+    if (type == QCOL_TIME)
+        return parse_booking_time(text);
+    return type == QCOL_DATE ? parse_payment_date(text) : -1;
+}
+
+// Times and dates compare as instants when both sides parse
+static int query_compare_text(int type, const char *a, const char *b)
+{
+    int64_t x = query_instant(type, a), y = x >= 0 ? query_instant(type, b) : -1;
+    if (x >= 0 && y >= 0)
+        return (x > y) - (x < y);
+    return strcmp(a, b);
+}
+
+static int query_compare_rows(const QueryColumn *c, const void *a, const void *b)
+{
+    if (c->type == QCOL_INT)
+    {
+        int64_t x = query_int(c, a), y = query_int(c, b);
+        return (x > y) - (x < y);
+    }
+    return query_compare_text(c->type, query_text(c, a), query_text(c, b));
+}
+
+static int query_row_matches(const Query *q, const QueryPlan *plan, const void *row)
+{
+    for (int i = 0; i < q->where_count; i++)
+    {
+        const QueryPredicate *pred = &q->where[i];
+        if (plan->consumed[i])
+            continue;
+        const QueryColumn *c = &query_tables[q->table].columns[pred->column];
+        int cmp;
+        if (c->type == QCOL_INT)
+        {
+            int64_t v = query_int(c, row);
+            cmp = (v > pred->number) - (v < pred->number);
+        }
+        else
+        {
+            // The literal was parsed once by the parser. Against a literal
+            // that parses, a row whose own time does not matches only !=,
+            // as the B+tree (which does not list such rows) would answer.
+            int64_t v = pred->number >= 0 ? query_instant(c->type, query_text(c, row)) : -1;
+            if (v >= 0)
+                cmp = (v > pred->number) - (v < pred->number);
+            else if (pred->number >= 0 && c->type != QCOL_TEXT)
+            {
+                if (pred->op != QOP_NE)
+                    return 0;
+                continue;
+            }
+            else
+                cmp = strcmp(query_text(c, row), pred->text);
+        }
+        int keep = pred->op == QOP_EQ ? cmp == 0 : pred->op == QOP_NE ? cmp != 0 :
+                   pred->op == QOP_LT ? cmp < 0 : pred->op == QOP_LE ? cmp <= 0 :
+                   pred->op == QOP_GT ? cmp > 0 : cmp >= 0;
+        if (!keep)
+            return 0;
+    }
+    return 1;
+}
+
+// Drops the rows from 'start' on that fail the filter; returns the new count
+static size_t query_filter(const Query *q, const QueryPlan *plan, TableSnapshot *snap, size_t start, size_t keep_max)
+{
+    size_t kept = start;
+    for (size_t i = start; i < snap->count && kept < keep_max; i++)
+    {
+        char *row = (char *)snap->rows + i * snap->row_size;
+        if (!query_row_matches(q, plan, row))
+            continue;
+        if (kept != i)
+            memcpy((char *)snap->rows + kept * snap->row_size, row, snap->row_size);
+        kept++;
+    }
+    snap->count = kept;
+    return kept;
+}
+
+// Pages through the ordered index; with early_stop, only until LIMIT rows matched
+static void query_fetch_range(const Query *q, const QueryPlan *plan, TableSnapshot *snap)
+{
+    OrderedKey cursor = { plan->from, 0 };
+    size_t keep_max = plan->early_stop ? (size_t)q->limit : SIZE_MAX;
+    int more = 1;
+    while (more && snap->count < keep_max)
+    {
+        if (snap->capacity < snap->count + QUERY_FETCH_PAGE)
+        {
+            snap->capacity = snap->count + QUERY_FETCH_PAGE;
+            snap->rows = realloc(snap->rows, snap->capacity * snap->row_size);
+            if (!snap->rows) {
+                perror("Failed to allocate query rows");
+                exit(1);
+            }
+        }
+        size_t start = snap->count;
+        void *page = (char *)snap->rows + start * snap->row_size;
+        int n = q->table == SNAP_BOOKINGS
+                    ? db_bookings_starting(plan->from, plan->to, &cursor, (Booking *)page, QUERY_FETCH_PAGE, &more)
+                    : db_payments_dated(plan->from, plan->to, &cursor, (Payment *)page, QUERY_FETCH_PAGE, &more);
+        snap->count = start + (size_t)n;
+        query_filter(q, plan, snap, start, keep_max);
+    }
+}
+
+static void query_fetch(const Query *q, const QueryPlan *plan, TableSnapshot *snap)
+{
+    const QueryTable *t = &query_tables[q->table];
+    int id = plan->key >= INT32_MIN && plan->key <= INT32_MAX ? (int)plan->key : 0;
+    DbStatus rc = DB_OK;
+
+    if (plan->access == ACCESS_SCAN)
+    {
+        table_snapshot(q->table, snap);
+        query_filter(q, plan, snap, 0, SIZE_MAX);
+        return;
+    }
+    snapshot_reserve(snap, t->row_size, 0, 0);
+    switch (plan->access)
+    {
+    case ACCESS_PRIMARY:
+        switch (q->table)
+        {
+        case SNAP_MEMBERS: rc = db_get_member(id, (Member *)snapshot_next(snap)); break;
+        case SNAP_WORKSPACES: rc = db_get_workspace(id, (Workspace *)snapshot_next(snap)); break;
+        case SNAP_BOOKINGS: rc = db_get_booking(id, (Booking *)snapshot_next(snap)); break;
+        default: rc = db_get_payment(id, (Payment *)snapshot_next(snap));
+        }
+        break;
+    case ACCESS_EMAIL:
+        rc = db_find_member_by_email(plan->email, (Member *)snapshot_next(snap));
+        break;
+    case ACCESS_FK:
+        if (q->table == SNAP_PAYMENTS)
+        {
+            pthread_rwlock_rdlock(&payments_lock);
+            for (PaymentNode *node = first_payment_of(id); node; node = next_payment_of(node))
+                payment_read(node, (Payment *)snapshot_next(snap));
+            pthread_rwlock_unlock(&payments_lock);
+            break;
+        }
+        pthread_rwlock_rdlock(&bookings_lock);
+        for (BookingNode *node = first_booking_of(plan->fk_list, id); node; node = next_booking_of(node, plan->fk_list))
+            booking_read(node, (Booking *)snapshot_next(snap));
+        pthread_rwlock_unlock(&bookings_lock);
+        break;
+    default:
+        query_fetch_range(q, plan, snap);
+        return;
+    }
+    if (rc != DB_OK || (plan->access != ACCESS_EMAIL && id != plan->key))
+        snap->count = 0;
+    query_filter(q, plan, snap, 0, SIZE_MAX);
+}
+
+// Rows sort through a key computed once per row, so times are not
+// re-parsed on every comparison. Text sorts by the string alone (key 0);
+// times that do not parse (key -1) sort first.
+typedef struct
+{
+    int64_t key;
+    const void *row;
+} QuerySortEntry;
+
+// qsort has no context argument; queries run on several threads at once
+static _Thread_local const QueryColumn *query_sort_column;
+static _Thread_local int query_sort_item, query_sort_desc;
+
+static int query_entry_order(const void *a, const void *b)
+{
+    const QuerySortEntry *x = (const QuerySortEntry *)a, *y = (const QuerySortEntry *)b;
+    int cmp = (x->key > y->key) - (x->key < y->key);
+    if (cmp == 0 && query_sort_column->type != QCOL_INT)
+        cmp = strcmp(query_text(query_sort_column, x->row), query_text(query_sort_column, y->row));
+    return query_sort_desc ? -cmp : cmp;
+}
+
+static void query_sort_rows(TableSnapshot *snap, const QueryColumn *c, int desc)
+{
+    QuerySortEntry *entries = (QuerySortEntry *)malloc(snap->count * sizeof(QuerySortEntry));
+    char *sorted = (char *)malloc(snap->count * snap->row_size);
+    if (!entries || !sorted) {
+        perror("Failed to allocate query sort");
+        exit(1);
+    }
+    for (size_t r = 0; r < snap->count; r++)
+    {
+        const void *row = (const char *)snap->rows + r * snap->row_size;
+        entries[r].row = row;
+        if (c->type == QCOL_INT)
+            entries[r].key = query_int(c, row);
+        else
+            entries[r].key = c->type == QCOL_TEXT ? 0 : query_instant(c->type, query_text(c, row));
+    }
+    query_sort_column = c;
+    query_sort_desc = desc;
+    qsort(entries, snap->count, sizeof(QuerySortEntry), query_entry_order);
+    for (size_t r = 0; r < snap->count; r++)
+        memcpy(sorted + r * snap->row_size, entries[r].row, snap->row_size);
+    free(entries);
+    free(snap->rows);
+    snap->rows = sorted;
+    snap->capacity = snap->count;
+}
+
+static int query_cell_order(const void *a, const void *b)
+{
+    const QueryCell *x = (const QueryCell *)a + query_sort_item;
+    const QueryCell *y = (const QueryCell *)b + query_sort_item;
+    int cmp;
+    if (x->type == QVAL_TEXT)
+        cmp = strcmp(x->s, y->s);
+    else if (x->type == QVAL_REAL)
+        cmp = (x->d > y->d) - (x->d < y->d);
+    else
+        cmp = (x->i > y->i) - (x->i < y->i);
+    return query_sort_desc ? -cmp : cmp;
+}
+
+static QueryCell *query_add_row(QueryResult *result)
+{
+    if (result->rows == result->capacity)
+    {
+        result->capacity = result->capacity ? result->capacity * 2 : 64;
+        result->cells = (QueryCell *)realloc(result->cells, result->capacity * result->columns * sizeof(QueryCell));
+        if (!result->cells) {
+            perror("Failed to allocate query result");
+            exit(1);
+        }
+    }
+    return &result->cells[result->rows++ * result->columns];
+}
+
+static void query_cell_of(const QueryColumn *c, const void *row, QueryCell *cell)
+{
+    memset(cell, 0, sizeof(*cell));
+    if (c->type == QCOL_INT)
+        cell->i = query_int(c, row);
+    else
+    {
+        cell->type = QVAL_TEXT;
+        cell->s = query_text(c, row);
+    }
+}
+
+// -- Grouping --
+typedef struct
+{
+    const void *row;    // First row of the group; supplies the key
+    int64_t count;
+    int64_t sum[QUERY_MAX_ITEMS];
+    const void *best[QUERY_MAX_ITEMS]; // Row holding the MIN / MAX so far
+} QueryGroup;
+
+typedef struct
+{
+    const QueryColumn *column;
+    const void *row;
+} QueryGroupKey;
+
+static int query_group_matches(const void *target, const void *ctx)
+{
+    const QueryGroupKey *key = (const QueryGroupKey *)ctx;
+    const QueryGroup *group = (const QueryGroup *)target;
+    if (key->column->type == QCOL_INT)
+        return query_int(key->column, group->row) == query_int(key->column, key->row);
+    return strcmp(query_text(key->column, group->row), query_text(key->column, key->row)) == 0;
+}
+
+static void query_aggregate(const Query *q, QueryResult *result)
+{
+    const QueryTable *t = &query_tables[q->table];
+    const TableSnapshot *snap = &result->source;
+    const QueryColumn *group_column = q->group_column >= 0 ? &t->columns[q->group_column] : NULL;
+    Slab slab;
+    HashIndex groups;
+    QueryGroup **list = NULL;
+    size_t count = 0, capacity = 0;
+
+    slab_init(&slab, "Query Groups", sizeof(QueryGroup));
+    index_init(&groups, "Query Groups");
+    for (size_t r = 0; r <= snap->count; r++)
+    {
+        const void *row = r < snap->count ? (const char *)snap->rows + r * snap->row_size : NULL;
+        QueryGroup *group = NULL;
+        uint64_t hash = 0;
+        if (!row && (group_column || count)) // No GROUP BY: one group, even over no rows
+            break;
+        if (group_column)
+        {
+            QueryGroupKey key = { group_column, row };
+            hash = group_column->type == QCOL_INT ? (uint64_t)query_int(group_column, row)
+                                                  : hash_string(query_text(group_column, row));
+            group = (QueryGroup *)index_find_match(&groups, hash, query_group_matches, &key);
+        }
+        else if (count)
+            group = list[0];
+        if (!group)
+        {
+            group = (QueryGroup *)slab_alloc(&slab);
+            memset(group, 0, sizeof(*group));
+            group->row = row;
+            if (group_column)
+                index_insert(&groups, hash, group);
+            if (count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 64;
+                list = (QueryGroup **)realloc(list, capacity * sizeof(QueryGroup *));
+                if (!list) {
+                    perror("Failed to allocate query groups");
+                    exit(1);
+                }
+            }
+            list[count++] = group;
+        }
+        if (!row)
+            break;
+
+        group->count++;
+        for (int i = 0; i < q->item_count; i++)
+        {
+            const QueryItem *item = &q->items[i];
+            if (item->column < 0 || item->agg == AGG_NONE || item->agg == AGG_COUNT)
+                continue;
+            const QueryColumn *c = &t->columns[item->column];
+            if (item->agg == AGG_SUM || item->agg == AGG_AVG)
+                group->sum[i] += query_int(c, row);
+            else if (!group->best[i] ||
+                     (query_compare_rows(c, row, group->best[i]) < 0) == (item->agg == AGG_MIN))
+                group->best[i] = row;
+        }
+    }
+
+    for (size_t g = 0; g < count; g++)
+    {
+        QueryCell *cells = query_add_row(result);
+        for (int i = 0; i < q->item_count; i++)
+        {
+            const QueryItem *item = &q->items[i];
+            QueryCell *cell = &cells[i];
+            memset(cell, 0, sizeof(*cell));
+            switch (item->agg)
+            {
+            case AGG_NONE: query_cell_of(group_column, list[g]->row, cell); break;
+            case AGG_COUNT: cell->i = list[g]->count; break;
+            case AGG_SUM: cell->i = list[g]->sum[i]; break;
+            case AGG_AVG:
+                cell->type = QVAL_REAL;
+                cell->d = list[g]->count ? (double)list[g]->sum[i] / list[g]->count : 0.0;
+                break;
+            default: // MIN / MAX; over no rows: 0 or ""
+                if (list[g]->best[i])
+                    query_cell_of(&t->columns[item->column], list[g]->best[i], cell);
+                else if (t->columns[item->column].type != QCOL_INT)
+                {
+                    cell->type = QVAL_TEXT;
+                    cell->s = "";
+                }
+            }
+        }
+    }
+    free(list);
+    index_free(&groups);
+    slab_release(&slab);
+}
+
+DbStatus db_query(const char *text, QueryResult *result)
+{
+    Query q;
+    QueryPlan plan;
+
+    memset(result, 0, sizeof(*result));
+    if (query_parse(text, &q, result->error) != 0)
+        return DB_INVALID;
+    query_plan(&q, &plan);
+    result->explain = q.explain;
+    result->columns = q.item_count;
+    for (int i = 0; i < q.item_count; i++)
+        query_item_name(&q, &q.items[i], result->names[i], sizeof(result->names[i]));
+    query_explain(&q, &plan, result);
+    if (q.explain)
+        return DB_OK;
+
+    const QueryTable *t = &query_tables[q.table];
+    query_fetch(&q, &plan, &result->source);
+    TableSnapshot *rows = &result->source;
+    if (q.aggregated)
+    {
+        query_aggregate(&q, result);
+        if (q.order_item >= 0 && result->rows > 1)
+        {
+            query_sort_item = q.order_item;
+            query_sort_desc = q.order_desc;
+            qsort(result->cells, result->rows, result->columns * sizeof(QueryCell), query_cell_order);
+        }
+        if (q.limit >= 0 && result->rows > (size_t)q.limit)
+            result->rows = (size_t)q.limit;
+        return DB_OK;
+    }
+
+    if (q.order_column >= 0 && !plan.ordered && rows->count > 1)
+        query_sort_rows(rows, &t->columns[q.order_column], q.order_desc);
+    size_t count = q.limit >= 0 && rows->count > (size_t)q.limit ? (size_t)q.limit : rows->count;
+    for (size_t r = 0; r < count; r++)
+    {
+        const void *row = (const char *)rows->rows + r * rows->row_size;
+        QueryCell *cells = query_add_row(result);
+        for (int i = 0; i < q.item_count; i++)
+            query_cell_of(&t->columns[q.items[i].column], row, &cells[i]);
+    }
+    return DB_OK;
+}
+
+void query_result_free(QueryResult *result)
+{
+    free(result->cells);
+    table_snapshot_free(&result->source);
+    memset(result, 0, sizeof(*result));
+}
+
+// Formats one cell for display
+static const char *query_cell_text(const QueryCell *cell, char *buffer, size_t size)
+{
+    if (cell->type == QVAL_TEXT)
+        return cell->s;
+    if (cell->type == QVAL_REAL)
+        snprintf(buffer, size, "%.2f", cell->d);
+    else
+        snprintf(buffer, size, "%lld", (long long)cell->i);
+    return buffer;
+}
+
+void runQuery()
+{
+    char text[512], number[32];
+    printf("Example: SELECT memberId, COUNT(*) FROM bookings GROUP BY memberId ORDER BY 2 DESC LIMIT 10\n");
+    printf("(start with EXPLAIN to see the plan only)\n");
+    getString("Query: ", text, sizeof(text));
+
+    QueryResult result;
+    long long t = now_ns();
+    if (db_query(text, &result) != DB_OK)
+    {
+        printf("Error: %s.\n", result.error);
+        return;
+    }
+    double ms = (now_ns() - t) / 1e6;
+    printf("\n");
+    for (int i = 0; i < result.plan_lines; i++)
+        printf("  %s\n", result.plan[i]);
+    if (!result.explain)
+    {
+        printf("\n");
+        for (int c = 0; c < result.columns; c++)
+            printf("%s%-18s", c ? " | " : "", result.names[c]);
+        printf("\n");
+        for (int c = 0; c < result.columns; c++)
+            printf("%s------------------", c ? "-|-" : "");
+        printf("\n");
+        for (size_t r = 0; r < result.rows; r++)
+        {
+            for (int c = 0; c < result.columns; c++)
+                printf("%s%-18s", c ? " | " : "",
+                       query_cell_text(&result.cells[r * result.columns + c], number, sizeof(number)));
+            printf("\n");
+        }
+        printf("%zu row(s) in %.3f ms.\n", result.rows, ms);
+    }
+    query_result_free(&result);
+}
+
+/*
+ * ==========================================
+ * HASH JOIN (Billing Reconciliation)
+ * ==========================================
+ */
+// hash_join is a radix-partitioned equi-join of two tuple arrays. Both
+// inputs are first scattered into 2^bits partitions by the high bits of the
+// key's hash; every worker counts and then scatters its own slice, so this
+// pass runs in parallel without locks. Workers then take partitions one at a
+// time, build a small open-addressing table over the partition of the smaller
+// input and probe it with the same partition of the other. Each table holds
+// about JOIN_PARTITION_ROWS rows, so probes hit cache instead of memory.
+
+static uint32_t join_hash(int key)
+{
+    return (uint32_t)key * 2654435761u; // Odd multiplier: a bijection on the low bits too
+}
+
+// Runs fn on 'threads' argument blocks; the caller's thread takes the first,
+// and any block whose thread could not be started
+static void join_parallel(int threads, void *(*fn)(void *), void *args, size_t arg_size)
+{
+    pthread_t workers[JOIN_MAX_THREADS];
+    int started[JOIN_MAX_THREADS] = { 0 };
+    for (int i = 1; i < threads; i++)
+        started[i] = pthread_create(&workers[i], NULL, fn, (char *)args + i * arg_size) == 0;
+    fn(args);
+    for (int i = 1; i < threads; i++) {
+        if (started[i])
+            pthread_join(workers[i], NULL);
+        else
+            fn((char *)args + i * arg_size);
+    }
+}
+
+int join_default_threads()
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1)
+        return 1;
+    return cores > JOIN_MAX_THREADS ? JOIN_MAX_THREADS : (int)cores;
+}
+
+// -- Partitioning --
+typedef struct
+{
+    const JoinTuple *input;
+    JoinTuple *output;
+    size_t begin, end; // This worker's slice of the input
+    int bits;
+    int scatter;       // 0: count rows per partition, 1: copy them out
+    size_t *counts;    // Per partition: rows in the slice, then the next write position
+} JoinSlice;
+
+static void *join_slice_run(void *arg)
+{
+    JoinSlice *slice = (JoinSlice *)arg;
+    for (size_t i = slice->begin; i < slice->end; i++)
+    {
+        uint32_t p = slice->bits ? join_hash(slice->input[i].key) >> (32 - slice->bits) : 0;
+        if (slice->scatter)
+            slice->output[slice->counts[p]++] = slice->input[i];
+        else
+            slice->counts[p]++;
+    }
+    return NULL;
+}
+
+// Partition p of 'input' ends up at output[starts[p] .. starts[p + 1]),
+// rows of one slice before those of the next, so the order is stable.
+static void join_partition(const JoinTuple *input, size_t count, int bits, int threads,
+                           JoinTuple *output, size_t *starts)
+{
+    size_t partitions = (size_t)1 << bits;
+    JoinSlice slices[JOIN_MAX_THREADS];
+    size_t *counts = (size_t *)calloc((size_t)threads * partitions, sizeof(size_t));
+    if (!counts) {
+        perror("Failed to allocate join partitions");
+        exit(1);
+    }
+    for (int t = 0; t < threads; t++)
+        slices[t] = (JoinSlice){ input, output, count * t / threads, count * (t + 1) / threads, bits, 0,
+                                 counts + t * partitions };
+    join_parallel(threads, join_slice_run, slices, sizeof(JoinSlice));
+
+    size_t at = 0;
+    for (size_t p = 0; p < partitions; p++)
+    {
+        starts[p] = at;
+        for (int t = 0; t < threads; t++)
+        {
+            size_t rows = slices[t].counts[p];
+            slices[t].counts[p] = at;
+            at += rows;
+        }
+    }
+    starts[partitions] = at;
+    for (int t = 0; t < threads; t++)
+        slices[t].scatter = 1;
+    join_parallel(threads, join_slice_run, slices, sizeof(JoinSlice));
+    free(counts);
+}
+
+// -- Build and Probe --
+typedef struct
+{
+    const JoinTuple *build, *probe; // Partitioned inputs
+    const size_t *build_starts, *probe_starts;
+    size_t partitions;
+    atomic_size_t *next_partition;  // Shared work queue
+    int built_left;
+    JoinMatchFn match;
+    void *ctx;
+    size_t matches;
+} JoinWorker;
+
+static void *join_worker_run(void *arg)
+{
+    JoinWorker *w = (JoinWorker *)arg;
+    uint32_t *slots = NULL; // Build row + 1; 0 = empty
+    size_t capacity = 0, p;
+
+    while ((p = atomic_fetch_add(w->next_partition, 1)) < w->partitions)
+    {
+        const JoinTuple *build = w->build + w->build_starts[p];
+        const JoinTuple *probe = w->probe + w->probe_starts[p];
+        size_t built = w->build_starts[p + 1] - w->build_starts[p];
+        size_t probes = w->probe_starts[p + 1] - w->probe_starts[p];
+        if (built == 0 || probes == 0)
+            continue;
+
+        size_t size = 16;
+        while (size < built * 2)
+            size <<= 1;
+        if (size > capacity)
+        {
+            free(slots);
+            slots = (uint32_t *)malloc(size * sizeof(uint32_t));
+            if (!slots) {
+                perror("Failed to allocate join table");
+                exit(1);
+            }
+            capacity = size;
+        }
+        memset(slots, 0, size * sizeof(uint32_t));
+        size_t mask = size - 1;
+        for (size_t i = 0; i < built; i++)
+        {
+            size_t s = join_hash(build[i].key) & mask;
+            while (slots[s])
+                s = (s + 1) & mask;
+            slots[s] = (uint32_t)i + 1;
+        }
+
+        for (size_t i = 0; i < probes; i++)
+            for (size_t s = join_hash(probe[i].key) & mask; slots[s]; s = (s + 1) & mask)
+            {
+                const JoinTuple *row = &build[slots[s] - 1];
+                if (row->key != probe[i].key)
+                    continue;
+                w->matches++;
+                if (w->built_left)
+                    w->match(w->ctx, row, &probe[i]);
+                else
+                    w->match(w->ctx, &probe[i], row);
+            }
+    }
+    free(slots);
+    return NULL;
+}
+
+// Calls match(ctx, left, right) for every pair with equal keys. The tables
+// are built over the smaller input; the inputs are not modified.
+void hash_join(const JoinTuple *left, size_t left_count, const JoinTuple *right, size_t right_count,
+               int threads, JoinMatchFn match, void *ctx, JoinStats *stats)
+{
+    long long t = now_ns();
+    if (threads < 1)
+        threads = 1;
+    if (threads > JOIN_MAX_THREADS)
+        threads = JOIN_MAX_THREADS;
+    int built_left = left_count <= right_count;
+    const JoinTuple *build = built_left ? left : right, *probe = built_left ? right : left;
+    size_t built = built_left ? left_count : right_count, probes = built_left ? right_count : left_count;
+
+    int bits = 0;
+    while (bits < JOIN_MAX_PARTITION_BITS && (built >> bits) > JOIN_PARTITION_ROWS)
+        bits++;
+    size_t partitions = (size_t)1 << bits;
+    JoinTuple *build_parts = (JoinTuple *)malloc((built + 1) * sizeof(JoinTuple));
+    JoinTuple *probe_parts = (JoinTuple *)malloc((probes + 1) * sizeof(JoinTuple));
+    size_t *build_starts = (size_t *)malloc((partitions + 1) * sizeof(size_t));
+    size_t *probe_starts = (size_t *)malloc((partitions + 1) * sizeof(size_t));
+    if (!build_parts || !probe_parts || !build_starts || !probe_starts) {
+        perror("Failed to allocate join partitions");
+        exit(1);
+    }
+    join_partition(build, built, bits, threads, build_parts, build_starts);
+    join_partition(probe, probes, bits, threads, probe_parts, probe_starts);
+    long long partitioned = now_ns();
+
+    atomic_size_t next_partition = 0;
+    JoinWorker workers[JOIN_MAX_THREADS];
+    for (int i = 0; i < threads; i++)
+        workers[i] = (JoinWorker){ build_parts, probe_parts, build_starts, probe_starts, partitions,
+                                   &next_partition, built_left, match, ctx, 0 };
+    join_parallel(threads, join_worker_run, workers, sizeof(JoinWorker));
+
+    memset(stats, 0, sizeof(*stats));
+    stats->threads = threads;
+    stats->partitions = (int)partitions;
+    stats->built_left = built_left;
+    stats->build_rows = built;
+    stats->probe_rows = probes;
+    for (int i = 0; i < threads; i++)
+        stats->matches += workers[i].matches;
+    stats->partition_ms = (partitioned - t) / 1e6;
+    stats->join_ms = (now_ns() - partitioned) / 1e6;
+    free(build_parts);
+    free(probe_parts);
+    free(build_starts);
+    free(probe_starts);
+}
+
+// -- Billing Reconciliation --
+// Expected = price of the booked workspace, once per booking that is not
+// cancelled. Paid / pending = payments of the member's bookings by status.
+// The three tables are copied as narrow tuples under their read locks (in
+// the global lock order, so the copy is one consistent instant); both joins
+// then run with no lock held.
+
+typedef struct
+{
+    int bookingId, memberId, cancelled;
+    int price; // Filled in by the bookings x workspaces join
+} ReconcileBooking;
+
+typedef struct
+{
+    int bookings;
+    int64_t expected;
+    _Atomic int64_t paid, pending; // Added to by the join workers
+} ReconcileAmounts;
+
+typedef struct
+{
+    ReconcileBooking *bookings;
+    ReconcileAmounts *members; // Indexed by memberId
+} Reconcile;
+
+// left: booking (a = index into bookings), right: workspace (a = price)
+static void reconcile_price(void *ctx, const JoinTuple *left, const JoinTuple *right)
+{
+    ((Reconcile *)ctx)->bookings[left->a].price = right->a;
+}
+
+// left: payment (a = amount, b = paid), right: booking (a = memberId)
+static void reconcile_payment(void *ctx, const JoinTuple *left, const JoinTuple *right)
+{
+    ReconcileAmounts *member = &((Reconcile *)ctx)->members[right->a];
+    atomic_fetch_add_explicit(left->b ? &member->paid : &member->pending, left->a, memory_order_relaxed);
+}
+
+static int reconcile_balance_order(const void *a, const void *b)
+{
+    const ReconcileRow *x = (const ReconcileRow *)a, *y = (const ReconcileRow *)b;
+    int64_t bx = x->expected - x->paid, by = y->expected - y->paid;
+    if (bx != by)
+        return bx < by ? 1 : -1;
+    return (x->memberId > y->memberId) - (x->memberId < y->memberId);
+}
+
+// Members that owe or paid anything, largest balance first
+static void reconcile_collect(const ReconcileAmounts *members, int max_member, ReconcileReport *report)
+{
+    report->rows = (ReconcileRow *)malloc(((size_t)max_member + 1) * sizeof(ReconcileRow));
+    if (!report->rows) {
+        perror("Failed to allocate reconciliation");
+        exit(1);
+    }
+    for (int id = 0; id <= max_member; id++)
+    {
+        const ReconcileAmounts *member = &members[id];
+        ReconcileRow row = { id, member->bookings, member->expected, atomic_load(&member->paid),
+                             atomic_load(&member->pending) };
+        if (row.bookings == 0 && row.paid == 0 && row.pending == 0)
+            continue;
+        report->rows[report->count++] = row;
+        report->expected += row.expected;
+        report->paid += row.paid;
+        report->pending += row.pending;
+    }
+    qsort(report->rows, report->count, sizeof(ReconcileRow), reconcile_balance_order);
+}
+
+static JoinTuple *join_tuples(size_t count)
+{
+    JoinTuple *tuples = (JoinTuple *)malloc((count + 1) * sizeof(JoinTuple));
+    if (!tuples) {
+        perror("Failed to allocate join input");
+        exit(1);
+    }
+    return tuples;
+}
+
+void db_reconcile_billing(ReconcileReport *report, int threads)
+{
+    long long t = now_ns();
+    memset(report, 0, sizeof(*report));
+
+    pthread_rwlock_rdlock(&workspaces_lock);
+    pthread_rwlock_rdlock(&bookings_lock);
+    pthread_rwlock_rdlock(&payments_lock);
+    size_t workspaces = index_count(&workspace_index);
+    size_t bookings = index_count(&booking_index);
+    size_t payments = index_count(&payment_index);
+    JoinTuple *workspace_rows = join_tuples(workspaces);
+    JoinTuple *booking_rows = join_tuples(bookings);
+    JoinTuple *payment_rows = join_tuples(payments);
+    Reconcile r;
+    r.bookings = (ReconcileBooking *)malloc((bookings + 1) * sizeof(ReconcileBooking));
+    if (!r.bookings) {
+        perror("Failed to allocate join input");
+        exit(1);
+    }
+
+    size_t n = 0;
+    for (WorkspaceNode *curr = workspace_head; curr != NULL; curr = curr->next, n++)
+        workspace_rows[n] = (JoinTuple){ curr->data.workspaceId, curr->data.price_in_cents, 0, 0 };
+    n = 0;
+    int max_member = 0;
+    for (BookingNode *curr = first_booking(); curr != NULL; curr = next_booking(curr), n++)
+    {
+        booking_rows[n] = (JoinTuple){ curr->workspaceId, (int)n, 0, 0 };
+        r.bookings[n] = (ReconcileBooking){ curr->bookingId, curr->memberId, curr->cancelled, 0 };
+        if (curr->memberId > max_member)
+            max_member = curr->memberId;
+    }
+    n = 0;
+    for (PaymentNode *curr = first_payment(); curr != NULL; curr = next_payment(curr), n++)
+    {
+        PaymentRecord record;
+        paged_read(&payment_pages, curr->rid, &record);
+        int paid = (str_flags(record.status) & STR_PAID) != 0;
+        payment_rows[n] = (JoinTuple){ record.bookingId, record.amount_in_cents, paid, 0 };
+    }
+    pthread_rwlock_unlock(&payments_lock);
+    pthread_rwlock_unlock(&bookings_lock);
+    pthread_rwlock_unlock(&workspaces_lock);
+    long long extracted = now_ns();
+
+    // 1. bookings x workspaces: the price each booking owes
+    hash_join(booking_rows, bookings, workspace_rows, workspaces, threads, reconcile_price, &r, &report->joins[0]);
+
+    // 2. payments x bookings: paid / pending per member. The booking side
+    // is rebuilt keyed by bookingId; expected is summed on the way.
+    r.members = (ReconcileAmounts *)calloc((size_t)max_member + 1, sizeof(ReconcileAmounts));
+    if (!r.members) {
+        perror("Failed to allocate reconciliation");
+        exit(1);
+    }
+    for (size_t i = 0; i < bookings; i++)
+    {
+        const ReconcileBooking *b = &r.bookings[i];
+        booking_rows[i] = (JoinTuple){ b->bookingId, b->memberId, 0, 0 };
+        if (!b->cancelled)
+        {
+            r.members[b->memberId].bookings++;
+            r.members[b->memberId].expected += b->price;
+        }
+    }
+    hash_join(payment_rows, payments, booking_rows, bookings, threads, reconcile_payment, &r, &report->joins[1]);
+
+    reconcile_collect(r.members, max_member, report);
+    report->workspaces = workspaces;
+    report->bookings = bookings;
+    report->payments = payments;
+    report->extract_ms = (extracted - t) / 1e6;
+    report->total_ms = (now_ns() - t) / 1e6;
+
+    free(r.members);
+    free(r.bookings);
+    free(workspace_rows);
+    free(booking_rows);
+    free(payment_rows);
+}
+
+void reconcile_report_free(ReconcileReport *report)
+{
+    free(report->rows);
+    memset(report, 0, sizeof(*report));
+}
+
+static void print_join_stats(const char *label, const JoinStats *stats)
+{
+    printf("%-22s | %9zu build (%s) | %9zu probe | %9zu matches | %5d partitions | %7.2f + %7.2f ms\n", label,
+           stats->build_rows, stats->built_left ? "left" : "right", stats->probe_rows, stats->matches,
+           stats->partitions, stats->partition_ms, stats->join_ms);
+}
+
+void showBillingReconciliation()
+{
+    ReconcileReport report;
+    db_reconcile_billing(&report, join_default_threads());
+
+    printf("\n--- Billing Reconciliation ---\n");
+    printf("Members billed: %zu | Expected: $%.2f | Paid: $%.2f | Pending: $%.2f | Outstanding: $%.2f\n",
+           report.count, report.expected / 100.0, report.paid / 100.0, report.pending / 100.0,
+           (report.expected - report.paid) / 100.0);
+    if (report.count > 0)
+    {
+        printf("\n%-8s | %-24s | %8s | %12s | %12s | %12s | %12s\n", "Member", "Name", "Bookings", "Expected",
+               "Paid", "Pending", "Balance");
+        printf("---------|--------------------------|----------|--------------|--------------|--------------|-------------\n");
+    }
+    for (size_t i = 0; i < report.count && i < RECONCILE_TOP_ROWS; i++)
+    {
+        const ReconcileRow *row = &report.rows[i];
+        Member m;
+        if (db_get_member(row->memberId, &m) != DB_OK)
+            strcpy(m.name, "(deleted)");
+        printf("%-8d | %-24.24s | %8d | %12.2f | %12.2f | %12.2f | %12.2f\n", row->memberId, m.name, row->bookings,
+               row->expected / 100.0, row->paid / 100.0, row->pending / 100.0, (row->expected - row->paid) / 100.0);
+    }
+    if (report.count > RECONCILE_TOP_ROWS)
+        printf("... %zu more member(s).\n", report.count - RECONCILE_TOP_ROWS);
+
+    printf("\nCopied %zu workspaces, %zu bookings, %zu payments in %.2f ms; total %.2f ms on %d thread(s).\n",
+           report.workspaces, report.bookings, report.payments, report.extract_ms, report.total_ms,
+           report.joins[0].threads);
+    print_join_stats("Bookings x Workspaces", &report.joins[0]);
+    print_join_stats("Payments x Bookings", &report.joins[1]);
+    reconcile_report_free(&report);
+}
+
+/*
+ * ==========================================
+ * MATERIALIZED AGGREGATES (Dashboard Totals)
+ * ==========================================
+ */
+// Dashboard totals are kept as a running COUNT and SUM per key instead of
+// being recomputed by a scan. The storage helpers (set_*_record and
+// remove_*_node) take a row's old contents out with sign -1 and put its new
+// ones in with +1, so CRUD, cascades, WAL replay and snapshot loads all keep
+// them current. Each aggregate is only touched under the write lock of the
+// table it counts, so a read is one hash lookup under that table's read lock.
+// Payments cache their booking's workspaceId; bookings never change
+// workspace (db_update_booking only sets the status).
+
+static const struct
+{
+    const char *name, *key_name;
+    int table;
+} mat_defs[MAT_AGGREGATES] = {
+    { "revenue_by_workspace", "workspaceId", SNAP_PAYMENTS },     // Paid payments, amount
+    { "active_bookings_by_member", "memberId", SNAP_BOOKINGS },   // Bookings not cancelled
+    { "payments_by_status", "paid", SNAP_PAYMENTS },              // 1 = Paid, 0 = anything else
+};
+
+static void mat_aggregate_init(MatAggregate *agg, int which)
+{
+    memset(agg, 0, sizeof(*agg));
+    agg->name = mat_defs[which].name;
+    agg->key_name = mat_defs[which].key_name;
+    agg->table = mat_defs[which].table;
+    index_init(&agg->cells, agg->name);
+    slab_init(&agg->slab, agg->name, sizeof(AggregateCell));
+}
+
+static void mat_aggregate_free(MatAggregate *agg)
+{
+    index_free(&agg->cells);
+    slab_release(&agg->slab);
+    agg->head = NULL;
+}
+
+void mat_aggregates_init()
+{
+    for (int i = 0; i < MAT_AGGREGATES; i++)
+        mat_aggregate_init(&mat_aggregates[i], i);
+}
+
+void mat_aggregates_free()
+{
+    for (int i = 0; i < MAT_AGGREGATES; i++)
+        mat_aggregate_free(&mat_aggregates[i]);
+}
+
+// Adds a delta to one key; a key whose count and sum return to zero is dropped
+static void mat_add(MatAggregate *agg, int key, int64_t count, int64_t sum)
+{
+    AggregateCell *cell = (AggregateCell *)index_find(&agg->cells, key);
+    if (!cell)
+    {
+        cell = (AggregateCell *)slab_alloc(&agg->slab);
+        cell->key = key;
+        cell->count = cell->sum = 0;
+        cell->prev = NULL;
+        cell->next = agg->head;
+        if (agg->head)
+            agg->head->prev = cell;
+        agg->head = cell;
+        index_insert(&agg->cells, key, cell);
+    }
+    cell->count += count;
+    cell->sum += sum;
+    agg->count += count;
+    agg->sum += sum;
+    agg->updates++;
+
+    if (cell->count == 0 && cell->sum == 0)
+    {
+        if (cell->prev)
+            cell->prev->next = cell->next;
+        else
+            agg->head = cell->next;
+        if (cell->next)
+            cell->next->prev = cell->prev;
+        index_remove(&agg->cells, key);
+        slab_free(&agg->slab, cell);
+    }
+}
+
+static void mat_count_booking(MatAggregate *aggs, int memberId, int cancelled, int sign)
+{
+    if (!cancelled)
+        mat_add(&aggs[MAT_ACTIVE_BOOKINGS_BY_MEMBER], memberId, sign, 0);
+}
+
+static void mat_count_payment(MatAggregate *aggs, int workspaceId, const PaymentRecord *row, int sign)
+{
+    int paid = (str_flags(row->status) & STR_PAID) != 0;
+    int64_t amount = (int64_t)sign * row->amount_in_cents;
+    if (paid)
+        mat_add(&aggs[MAT_REVENUE_BY_WORKSPACE], workspaceId, sign, amount);
+    mat_add(&aggs[MAT_PAYMENTS_BY_STATUS], paid, sign, amount);
+}
+
+// Caller holds bookings_lock for writing
+void mat_booking_changed(const BookingNode *node, int sign)
+{
+    mat_count_booking(mat_aggregates, node->memberId, node->cancelled, sign);
+}
+
+// Caller holds payments_lock for writing; row is the payment's stored record
+void mat_payment_changed(const PaymentNode *node, const PaymentRecord *row, int sign)
+{
+    mat_count_payment(mat_aggregates, node->workspaceId, row, sign);
+}
+
+// Recounts everything from the tables; used after loads that bypass the
+// deltas (the parallel CSV load, where payments can arrive before their bookings)
+void mat_aggregates_rebuild()
+{
+    pthread_rwlock_wrlock(&bookings_lock);
+    pthread_rwlock_wrlock(&payments_lock);
+    mat_aggregates_free();
+    mat_aggregates_init();
+    mat_live = 1;
+    for (BookingNode *curr = first_booking(); curr != NULL; curr = next_booking(curr))
+    {
+        curr->counted = 1;
+        mat_booking_changed(curr, +1);
+    }
+    for (PaymentNode *curr = first_payment(); curr != NULL; curr = next_payment(curr))
+    {
+        BookingNode *booking = findBookingNodeById(curr->bookingId);
+        PaymentRecord record;
+        paged_read(&payment_pages, curr->rid, &record);
+        curr->workspaceId = booking ? booking->workspaceId : 0;
+        curr->counted = 1;
+        mat_payment_changed(curr, &record, +1);
+    }
+    pthread_rwlock_unlock(&payments_lock);
+    pthread_rwlock_unlock(&bookings_lock);
+}
+
+static MatAggregate *mat_find(const char *name)
+{
+    for (int i = 0; i < MAT_AGGREGATES; i++)
+        if (strcasecmp(mat_aggregates[i].name, name) == 0)
+            return &mat_aggregates[i];
+    return NULL;
+}
+
+// O(1): COUNT and SUM of one key (zeros if nothing is counted under it)
+DbStatus db_aggregate_get(const char *name, int key, int64_t *count, int64_t *sum)
+{
+    MatAggregate *agg = mat_find(name);
+    if (!agg)
+        return DB_NOT_FOUND;
+    table_rdlock(agg->table);
+    AggregateCell *cell = (AggregateCell *)index_find(&agg->cells, key);
+    *count = cell ? cell->count : 0;
+    *sum = cell ? cell->sum : 0;
+    table_unlock(agg->table);
+    return DB_OK;
+}
+
+// O(1): COUNT and SUM over every key
+DbStatus db_aggregate_total(const char *name, int64_t *count, int64_t *sum)
+{
+    MatAggregate *agg = mat_find(name);
+    if (!agg)
+        return DB_NOT_FOUND;
+    table_rdlock(agg->table);
+    *count = agg->count;
+    *sum = agg->sum;
+    table_unlock(agg->table);
+    return DB_OK;
+}
+
+// -- Verification --
+// Recounts every aggregate from the rows (looking each payment's booking up
+// again rather than trusting the cached workspaceId) and compares key by key.
+// Bookings and payments are read-locked together, so both sides are the
+// same instant. Returns the number of drifted keys and totals.
+size_t mat_aggregates_verify(MatVerifyReport *report)
+{
+    long long t = now_ns();
+    MatAggregate fresh[MAT_AGGREGATES];
+    for (int i = 0; i < MAT_AGGREGATES; i++)
+        mat_aggregate_init(&fresh[i], i);
+    memset(report, 0, sizeof(*report));
+
+    pthread_rwlock_rdlock(&bookings_lock);
+    pthread_rwlock_rdlock(&payments_lock);
+    for (BookingNode *curr = first_booking(); curr != NULL; curr = next_booking(curr))
+        mat_count_booking(fresh, curr->memberId, curr->cancelled, +1);
+    for (PaymentNode *curr = first_payment(); curr != NULL; curr = next_payment(curr))
+    {
+        PaymentRecord record;
+        paged_read(&payment_pages, curr->rid, &record);
+        BookingNode *booking = findBookingNodeById(record.bookingId);
+        mat_count_payment(fresh, booking ? booking->workspaceId : 0, &record, +1);
+    }
+
+    size_t drifted = 0;
+    for (int i = 0; i < MAT_AGGREGATES; i++)
+    {
+        MatAggregate *live = &mat_aggregates[i];
+        size_t matched = 0;
+        for (AggregateCell *cell = fresh[i].head; cell != NULL; cell = cell->next)
+        {
+            report->cells[i]++;
+            AggregateCell *kept = (AggregateCell *)index_find(&live->cells, cell->key);
+            if (kept)
+                matched++;
+            if (kept && kept->count == cell->count && kept->sum == cell->sum)
+                continue;
+            if (!report->drifted[i]++ && !report->first_drift[0])
+                snprintf(report->first_drift, sizeof(report->first_drift),
+                         "%s[%s=%d]: kept %lld/%lld, recounted %lld/%lld", live->name, live->key_name, cell->key,
+                         kept ? (long long)kept->count : 0LL, kept ? (long long)kept->sum : 0LL,
+                         (long long)cell->count, (long long)cell->sum);
+        }
+        // Keys that are still kept but no longer have any rows
+        size_t stale = index_count(&live->cells) - matched;
+        if (stale && !report->first_drift[0])
+            snprintf(report->first_drift, sizeof(report->first_drift), "%s: %zu key(s) kept with no rows",
+                     live->name, stale);
+        report->drifted[i] += stale;
+        if (live->count != fresh[i].count || live->sum != fresh[i].sum)
+        {
+            if (!report->first_drift[0])
+                snprintf(report->first_drift, sizeof(report->first_drift),
+                         "%s total: kept %lld/%lld, recounted %lld/%lld", live->name, (long long)live->count,
+                         (long long)live->sum, (long long)fresh[i].count, (long long)fresh[i].sum);
+            report->drifted[i]++;
+        }
+        drifted += report->drifted[i];
+    }
+    pthread_rwlock_unlock(&payments_lock);
+    pthread_rwlock_unlock(&bookings_lock);
+
+    for (int i = 0; i < MAT_AGGREGATES; i++)
+        mat_aggregate_free(&fresh[i]);
+    report->ms = (now_ns() - t) / 1e6;
+    return drifted;
+}
+
+void mat_print_stats()
+{
+    printf("\n--- Materialized Aggregates ---\n%-26s | %8s | %10s | %14s | %10s\n", "Aggregate", "Keys", "Count",
+           "Sum", "Updates");
+    printf("---------------------------|----------|------------|----------------|-----------\n");
+    for (int i = 0; i < MAT_AGGREGATES; i++)
+    {
+        MatAggregate *agg = &mat_aggregates[i];
+        table_rdlock(agg->table);
+        printf("%-26s | %8zu | %10lld | %14lld | %10lu\n", agg->name, index_count(&agg->cells),
+               (long long)agg->count, (long long)agg->sum, agg->updates);
+        table_unlock(agg->table);
+    }
+}
+
+// -- Dashboard --
+
+// Copies an aggregate's cells under its lock; the caller frees the array
+static AggregateCell *mat_copy_cells(int which, size_t *count)
+{
+    MatAggregate *agg = &mat_aggregates[which];
+    table_rdlock(agg->table);
+    size_t n = index_count(&agg->cells);
+    AggregateCell *cells = (AggregateCell *)malloc((n + 1) * sizeof(AggregateCell));
+    if (!cells) {
+        perror("Failed to allocate dashboard");
+        exit(1);
+    }
+    n = 0;
+    for (AggregateCell *cell = agg->head; cell != NULL; cell = cell->next)
+        cells[n++] = *cell;
+    table_unlock(agg->table);
+    *count = n;
+    return cells;
+}
+
+// Largest sum first, then largest count, then lowest key
+static int mat_cell_order(const void *a, const void *b)
+{
+    const AggregateCell *x = (const AggregateCell *)a, *y = (const AggregateCell *)b;
+    if (x->sum != y->sum)
+        return x->sum < y->sum ? 1 : -1;
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+void showDashboardTotals()
+{
+    int64_t paid_count, paid_sum, unpaid_count, unpaid_sum;
+    db_aggregate_get("payments_by_status", 1, &paid_count, &paid_sum);
+    db_aggregate_get("payments_by_status", 0, &unpaid_count, &unpaid_sum);
+    int64_t active, unused;
+    db_aggregate_total("active_bookings_by_member", &active, &unused);
+
+    printf("\n--- Dashboard Totals ---\n");
+    printf("Paid: %lld payment(s), $%.2f | Unpaid: %lld payment(s), $%.2f | Active bookings: %lld\n",
+           (long long)paid_count, paid_sum / 100.0, (long long)unpaid_count, unpaid_sum / 100.0, (long long)active);
+
+    size_t n;
+    AggregateCell *cells = mat_copy_cells(MAT_REVENUE_BY_WORKSPACE, &n);
+    qsort(cells, n, sizeof(AggregateCell), mat_cell_order);
+    printf("\nTop workspaces by revenue (%zu with paid payments):\n", n);
+    printf("%-10s | %-20s | %-20s | %9s | %12s\n", "Workspace", "Type", "Location", "Payments", "Revenue");
+    printf("-----------|----------------------|----------------------|-----------|-------------\n");
+    for (size_t i = 0; i < n && i < MAT_TOP_ROWS; i++)
+    {
+        Workspace w;
+        if (db_get_workspace(cells[i].key, &w) != DB_OK) {
+            strcpy(w.type, "(deleted)");
+            w.location[0] = '\0';
+        }
+        printf("%-10d | %-20.20s | %-20.20s | %9lld | %12.2f\n", cells[i].key, w.type, w.location,
+               (long long)cells[i].count, cells[i].sum / 100.0);
+    }
+    free(cells);
+
+    cells = mat_copy_cells(MAT_ACTIVE_BOOKINGS_BY_MEMBER, &n);
+    qsort(cells, n, sizeof(AggregateCell), mat_cell_order);
+    printf("\nTop members by active bookings (%zu with active bookings):\n", n);
+    printf("%-10s | %-24s | %9s\n", "Member", "Name", "Bookings");
+    printf("-----------|--------------------------|----------\n");
+    for (size_t i = 0; i < n && i < MAT_TOP_ROWS; i++)
+    {
+        Member m;
+        if (db_get_member(cells[i].key, &m) != DB_OK)
+            strcpy(m.name, "(deleted)");
+        printf("%-10d | %-24.24s | %9lld\n", cells[i].key, m.name, (long long)cells[i].count);
+    }
+    free(cells);
+}
+
+void verifyAggregates()
+{
+    MatVerifyReport report;
+    size_t drifted = mat_aggregates_verify(&report);
+    printf("\n--- Verify Aggregates ---\n");
+    for (int i = 0; i < MAT_AGGREGATES; i++)
+        printf("%-26s | %8zu keys recounted | %zu drifted\n", mat_aggregates[i].name, report.cells[i],
+               report.drifted[i]);
+    if (drifted)
+        printf("DRIFT: %zu difference(s); first: %s\n", drifted, report.first_drift);
+    else
+        printf("All aggregates match a full recount (%.2f ms).\n", report.ms);
+}
+
+/*
+ * ==========================================
+ * FILE I/O: BINARY SNAPSHOT
+ * ==========================================
+ */
+
+void load_all_data()
+{
+    int rc = load_snapshot(SNAPSHOT_FILE);
+    if (rc == SNAPSHOT_OK)
+    {
+        printf("All data loaded from %s.\n", SNAPSHOT_FILE);
+    }
+    else if (rc == SNAPSHOT_CORRUPT)
+    {
+        // Starting empty would overwrite the damaged file on the next save
+        printf("Error: %s is damaged (bad header or checksum). Refusing to start.\n", SNAPSHOT_FILE);
+        printf("Restore a backup, or move it aside to re-import the CSV files.\n");
+        exit(1);
+    }
+
+    else
+    {
+        // No snapshot yet (first run after upgrading): import the legacy CSV files
+        load_csv_data();
+        printf("All data loaded from CSV files.\n");
+        csv_print_load_stats();
+    }
+
+    // Changes made after the last checkpoint live only in the WAL
+    wal_recover();
+}
+
+// Checkpoint: snapshot everything, then drop the WAL records it now covers
+void save_all_data()
+{
+    if (wal_checkpoint() != 0)
+        printf("Error: could not write %s.\n", SNAPSHOT_FILE);
+}
+
+// Word-at-a-time FNV-style hash; fast enough to verify a snapshot at load speed
+uint64_t checksum64(const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = 0xcbf29ce484222325ULL ^ len;
+    while (len >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = (h ^ word) * 0x100000001b3ULL;
+        h ^= h >> 29;
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        h = (h ^ *p++) * 0x100000001b3ULL;
+    return hash_function(h);
+}
+
+// Records are chained one by one so writer and reader agree however they batch
+static void snapshot_write_record(FILE *file, SnapshotSection *section, const void *record)
+{
+    fwrite(record, section->record_size, 1, file);
+    section->checksum = hash_function(section->checksum ^ checksum64(record, section->record_size));
+    section->count++;
+}
+
+static void snapshot_begin_section(SnapshotSection *section, uint64_t offset, uint32_t record_size, int next_id)
+{
+    section->offset = offset;
+    section->count = 0;
+    section->record_size = record_size;
+    section->next_id = next_id;
+    section->checksum = 0;
+}
+
+static uint64_t snapshot_string_checksum(uint64_t checksum, const char *text, uint32_t length)
+{
+    return hash_function(checksum ^ checksum64(text, length) ^ length);
+}
+
+// Dictionary entries 0 .. count-1, written after the tables so every code
+// their records use is covered
+static void snapshot_write_strings(FILE *file, SnapshotSection *section, uint64_t offset, uint32_t count)
+{
+    snapshot_begin_section(section, offset, 0, 0);
+    for (StrCode code = 0; code < count; code++)
+    {
+        const char *text = str_text(code);
+        uint32_t length = (uint32_t)strlen(text);
+        fwrite(&length, sizeof(length), 1, file);
+        fwrite(text, length, 1, file);
+        section->checksum = snapshot_string_checksum(section->checksum, text, length);
+        section->count++;
+    }
+}
+
+// Opens path.tmp and writes a placeholder header (the real one goes in last)
+static FILE *snapshot_create(const char *tmp_path, SnapshotHeader *header)
+{
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file)
+        return NULL;
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->table_count = SNAP_TABLES;
+    fwrite(header, sizeof(*header), 1, file);
+    return file;
+}
+
+// Rewrites the header, fsyncs and renames path.tmp over path
+static int snapshot_commit(FILE *file, SnapshotHeader *header, const char *tmp_path, const char *path)
+{
+    header->header_checksum = checksum64(header, offsetof(SnapshotHeader, header_checksum));
+    fseek(file, 0, SEEK_SET);
+    fwrite(header, sizeof(*header), 1, file);
+
+    int ok = fflush(file) == 0 && !ferror(file) && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0)
+    {
+        unlink(tmp_path);
+        return -1;
+    }
+    sync_directory(); // Make the rename itself durable
+    return 0;
+}
+
+// Writes a complete snapshot to path.tmp, fsyncs it and renames it into place,
+// so a crash mid-save leaves the previous snapshot intact.
+int save_snapshot(const char *path)
+{
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    SnapshotHeader header;
+    FILE *file = snapshot_create(tmp_path, &header);
+    if (!file)
+        return -1;
+
+    // Copy every table at one instant, then write with no locks held
+    TableSnapshot snaps[SNAP_TABLES];
+    database_snapshot(snaps, COPY_RECORDS);
+
+    uint64_t offset = sizeof(header);
+    for (int table = 0; table < SNAP_TABLES; table++)
+    {
+        SnapshotSection *section = &header.sections[table];
+        snapshot_begin_section(section, offset, (uint32_t)snaps[table].row_size, snaps[table].next_id);
+        for (size_t i = 0; i < snaps[table].count; i++)
+            snapshot_write_record(file, section, (const char *)snaps[table].rows + i * section->record_size);
+        offset += section->count * section->record_size;
+        table_snapshot_free(&snaps[table]);
+    }
+    snapshot_write_strings(file, &header.strings, offset, str_count());
+    return snapshot_commit(file, &header, tmp_path, path);
+}
+
+// Same file straight from the live tables, for a background save child: its
+// memory is a frozen copy of the parent's, so there is nothing to lock or copy.
+static int save_snapshot_frozen(const char *path)
+{
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    SnapshotHeader header;
+    FILE *file = snapshot_create(tmp_path, &header);
+    if (!file)
+        return -1;
+
+    SnapshotSection *section = &header.sections[SNAP_MEMBERS];
+    uint64_t offset = sizeof(header);
+    snapshot_begin_section(section, offset, sizeof(Member), next_member_id);
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+        for (MemberNode *curr = member_stripes[i].head; curr != NULL; curr = curr->next)
+        {
+            Member row = {0};
+            member_decode(curr, &row);
+            snapshot_write_record(file, section, &row);
+        }
+    offset += section->count * section->record_size;
+
+    section = &header.sections[SNAP_WORKSPACES];
+    snapshot_begin_section(section, offset, sizeof(WorkspaceRecord), next_workspace_id);
+    for (WorkspaceNode *curr = workspace_head; curr != NULL; curr = curr->next)
+        snapshot_write_record(file, section, &curr->data);
+    offset += section->count * section->record_size;
+
+    section = &header.sections[SNAP_BOOKINGS];
+    snapshot_begin_section(section, offset, sizeof(BookingRecord), next_booking_id);
+    for (BookingNode *curr = first_booking(); curr != NULL; curr = next_booking(curr))
+    {
+        BookingRecord record;
+        paged_read(&booking_pages, curr->rid, &record);
+        snapshot_write_record(file, section, &record);
+    }
+    offset += section->count * section->record_size;
+
+    section = &header.sections[SNAP_PAYMENTS];
+    snapshot_begin_section(section, offset, sizeof(PaymentRecord), next_payment_id);
+    for (PaymentNode *curr = first_payment(); curr != NULL; curr = next_payment(curr))
+    {
+        PaymentRecord record;
+        paged_read(&payment_pages, curr->rid, &record);
+        snapshot_write_record(file, section, &record);
+    }
+    offset += section->count * section->record_size;
+
+    // strings.count directly: a parent thread may have held the dictionary lock at fork
+    snapshot_write_strings(file, &header.strings, offset, strings.count);
+    return snapshot_commit(file, &header, tmp_path, path);
+}
+
+// fsync the working directory so renames and newly created files survive a crash
+void sync_directory()
+{
+    int fd = open(".", O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Checks a section's bounds and checksum against the mapped file
+static int snapshot_section_valid(const char *map, size_t size, const SnapshotSection *section, size_t record_size)
+{
+    if (section->record_size != record_size || section->offset > size)
+        return 0;
+    if (section->count > (size - section->offset) / record_size)
+        return 0;
+
+    uint64_t checksum = 0;
+    const char *record = map + section->offset;
+    for (uint64_t i = 0; i < section->count; i++, record += record_size)
+        checksum = hash_function(checksum ^ checksum64(record, record_size));
+    return checksum == section->checksum;
+}
+
+// Checks the dictionary section and interns its entries; remap[file code]
+// is the live code. NULL if the section is damaged.
+static StrCode *snapshot_load_strings(const char *map, size_t size, const SnapshotSection *section)
+{
+    if (section->record_size != 0 || section->offset > size || section->count > (size - section->offset) / sizeof(uint32_t))
+        return NULL;
+    uint64_t checksum = 0;
+    size_t pos = section->offset;
+    for (uint64_t i = 0; i < section->count; i++)
+    {
+        uint32_t length;
+        if (size - pos < sizeof(length))
+            return NULL;
+        memcpy(&length, map + pos, sizeof(length));
+        pos += sizeof(length);
+        if (length > size - pos || memchr(map + pos, '\0', length))
+            return NULL;
+        checksum = snapshot_string_checksum(checksum, map + pos, length);
+        pos += length;
+    }
+    if (checksum != section->checksum)
+        return NULL;
+
+    StrCode *remap = (StrCode *)malloc((section->count + 1) * sizeof(StrCode));
+    if (!remap)
+        return NULL;
+    char text[256];
+    pos = section->offset;
+    for (uint64_t i = 0; i < section->count; i++)
+    {
+        uint32_t length;
+        memcpy(&length, map + pos, sizeof(length));
+        pos += sizeof(length);
+        snprintf(text, sizeof(text), "%.*s", (int)length, map + pos);
+        remap[i] = str_intern(text);
+        pos += length;
+    }
+    return remap;
+}
+
+// Every code a section's records use must be in the file's dictionary
+static int snapshot_codes_valid(const char *map, const SnapshotSection *sections, uint64_t strings)
+{
+    const WorkspaceRecord *workspaces = (const WorkspaceRecord *)(map + sections[SNAP_WORKSPACES].offset);
+    for (uint64_t i = 0; i < sections[SNAP_WORKSPACES].count; i++)
+        if (workspaces[i].type >= strings || workspaces[i].location >= strings)
+            return 0;
+    const BookingRecord *bookings = (const BookingRecord *)(map + sections[SNAP_BOOKINGS].offset);
+    for (uint64_t i = 0; i < sections[SNAP_BOOKINGS].count; i++)
+        if (bookings[i].status >= strings)
+            return 0;
+    const PaymentRecord *payments = (const PaymentRecord *)(map + sections[SNAP_PAYMENTS].offset);
+    for (uint64_t i = 0; i < sections[SNAP_PAYMENTS].count; i++)
+        if (payments[i].status >= strings)
+            return 0;
+    return 1;
+}
+
+// Bulk load: indexes are sized once up front instead of doubling row by row
+static void snapshot_load_members(const char *map, const SnapshotSection *section)
+{
+    const Member *members = (const Member *)(map + section->offset);
+    member_tables_reserve(section->count);
+    for (uint64_t i = 0; i < section->count; i++)
+        insert_member_node(&members[i]);
+    next_member_id = section->next_id;
+}
+
+// Files written before the string dictionary; the next checkpoint rewrites
+// them as the current version
+static int load_snapshot_v1(const char *map, size_t size)
+{
+    SnapshotHeaderV1 header;
+    memcpy(&header, map, sizeof(header));
+    const SnapshotSection *sections = header.sections;
+    if (header.table_count != SNAP_TABLES ||
+        header.header_checksum != checksum64(&header, offsetof(SnapshotHeaderV1, header_checksum)) ||
+        !snapshot_section_valid(map, size, &sections[SNAP_MEMBERS], sizeof(Member)) ||
+        !snapshot_section_valid(map, size, &sections[SNAP_WORKSPACES], sizeof(Workspace)) ||
+        !snapshot_section_valid(map, size, &sections[SNAP_BOOKINGS], sizeof(Booking)) ||
+        !snapshot_section_valid(map, size, &sections[SNAP_PAYMENTS], sizeof(Payment)))
+        return SNAPSHOT_CORRUPT;
+
+    snapshot_load_members(map, &sections[SNAP_MEMBERS]);
+
+    const Workspace *workspaces = (const Workspace *)(map + sections[SNAP_WORKSPACES].offset);
+    index_reserve(&workspace_index, sections[SNAP_WORKSPACES].count);
+    for (uint64_t i = 0; i < sections[SNAP_WORKSPACES].count; i++)
+        insert_workspace_node(&workspaces[i]);
+    next_workspace_id = sections[SNAP_WORKSPACES].next_id;
+
+    const Booking *bookings = (const Booking *)(map + sections[SNAP_BOOKINGS].offset);
+    index_reserve(&booking_index, sections[SNAP_BOOKINGS].count);
+    for (uint64_t i = 0; i < sections[SNAP_BOOKINGS].count; i++)
+        insert_booking_node(&bookings[i]);
+    next_booking_id = sections[SNAP_BOOKINGS].next_id;
+
+    const Payment *payments = (const Payment *)(map + sections[SNAP_PAYMENTS].offset);
+    index_reserve(&payment_index, sections[SNAP_PAYMENTS].count);
+    for (uint64_t i = 0; i < sections[SNAP_PAYMENTS].count; i++)
+        insert_payment_node(&payments[i]);
+    next_payment_id = sections[SNAP_PAYMENTS].next_id;
+    return SNAPSHOT_OK;
+}
+
+// Maps the snapshot and bulk-loads every table. Nothing is loaded unless the
+// header and all section checksums verify first.
+int load_snapshot(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return errno == ENOENT ? SNAPSHOT_MISSING : SNAPSHOT_CORRUPT;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeaderV1))
+    {
+        close(fd);
+        return SNAPSHOT_CORRUPT;
+    }
+    size_t size = (size_t)st.st_size;
+    char *map = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return SNAPSHOT_CORRUPT;
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    if (memcmp(map, SNAPSHOT_MAGIC, strlen(SNAPSHOT_MAGIC)) == 0 && ((const SnapshotHeaderV1 *)map)->version == 1)
+    {
+        int rc = load_snapshot_v1(map, size);
+        munmap(map, size);
+        return rc;
+    }
+
+    SnapshotHeader header;
+    if (size < sizeof(header))
+    {
+        munmap(map, size);
+        return SNAPSHOT_CORRUPT;
+    }
+    memcpy(&header, map, sizeof(header));
+    const SnapshotSection *sections = header.sections;
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION || header.table_count != SNAP_TABLES ||
+        header.header_checksum != checksum64(&header, offsetof(SnapshotHeader, header_checksum)) ||
+        !snapshot_section_valid(map, size, &sections[SNAP_MEMBERS], sizeof(Member)) ||
+        !snapshot_section_valid(map, size, &sections[SNAP_WORKSPACES], sizeof(WorkspaceRecord)) ||
+        !snapshot_section_valid(map, size, &sections[SNAP_BOOKINGS], sizeof(BookingRecord)) ||
+        !snapshot_section_valid(map, size, &sections[SNAP_PAYMENTS], sizeof(PaymentRecord)) ||
+        !snapshot_codes_valid(map, sections, header.strings.count))
+    {
+        munmap(map, size);
+        return SNAPSHOT_CORRUPT;
+    }
+    // Codes in the file are translated to this run's dictionary while loading
+    StrCode *remap = snapshot_load_strings(map, size, &header.strings);
+    if (!remap)
+    {
+        munmap(map, size);
+        return SNAPSHOT_CORRUPT;
+    }
+
+    snapshot_load_members(map, &sections[SNAP_MEMBERS]);
+
+    const WorkspaceRecord *workspaces = (const WorkspaceRecord *)(map + sections[SNAP_WORKSPACES].offset);
+    index_reserve(&workspace_index, sections[SNAP_WORKSPACES].count);
+    for (uint64_t i = 0; i < sections[SNAP_WORKSPACES].count; i++)
+    {
+        WorkspaceRecord record = workspaces[i];
+        record.type = remap[record.type];
+        record.location = remap[record.location];
+        insert_workspace_record(&record);
+    }
+    next_workspace_id = sections[SNAP_WORKSPACES].next_id;
+
+    const BookingRecord *bookings = (const BookingRecord *)(map + sections[SNAP_BOOKINGS].offset);
+    index_reserve(&booking_index, sections[SNAP_BOOKINGS].count);
+    for (uint64_t i = 0; i < sections[SNAP_BOOKINGS].count; i++)
+    {
+        BookingRecord record = bookings[i];
+        record.status = remap[record.status];
+        insert_booking_record(&record);
+    }
+    next_booking_id = sections[SNAP_BOOKINGS].next_id;
+
+    const PaymentRecord *payments = (const PaymentRecord *)(map + sections[SNAP_PAYMENTS].offset);
+    index_reserve(&payment_index, sections[SNAP_PAYMENTS].count);
+    for (uint64_t i = 0; i < sections[SNAP_PAYMENTS].count; i++)
+    {
+        PaymentRecord record = payments[i];
+        record.status = remap[record.status];
+        insert_payment_record(&record);
+    }
+    next_payment_id = sections[SNAP_PAYMENTS].next_id;
+
+    free(remap);
+    munmap(map, size);
+    return SNAPSHOT_OK;
+}
+
+/*
+ * ==========================================
+ * WRITE-AHEAD LOG
+ * ==========================================
+ */
+
+static uint64_t wal_record_checksum(uint8_t op, uint8_t table, const void *payload, uint32_t length)
+{
+    return hash_function(checksum64(payload, length) ^ ((uint64_t)op << 8) ^ table);
+}
+
+int wal_open()
+{
+    wal.capacity = wal.spare_capacity = 64 * 1024;
+    wal.buffer = (char *)malloc(wal.capacity);
+    wal.spare = (char *)malloc(wal.spare_capacity);
+    if (!wal.buffer || !wal.spare)
+    {
+        free(wal.buffer);
+        free(wal.spare);
+        wal.buffer = wal.spare = NULL;
+        return -1;
+    }
+    wal.fd = open(WAL_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (wal.fd < 0)
+    {
+        free(wal.buffer);
+        free(wal.spare);
+        wal.buffer = wal.spare = NULL;
+        return -1;
+    }
+    sync_directory();
+    pthread_mutex_init(&wal.mutex, NULL);
+    pthread_cond_init(&wal.flushed_cond, NULL);
+    wal.used = 0;
+    wal.appended_lsn = wal.durable_lsn = 0;
+    return 0;
+}
+
+void wal_close()
+{
+    if (wal.fd < 0) return;
+    wal_commit(wal.appended_lsn);
+    close(wal.fd);
+    wal.fd = -1;
+    free(wal.buffer);
+    free(wal.spare);
+    wal.buffer = wal.spare = NULL;
+    pthread_cond_destroy(&wal.flushed_cond);
+    pthread_mutex_destroy(&wal.mutex);
+}
+
+// Queue one record. Called under the table's write lock so the log order
+// matches the order changes were applied; returns the LSN to wait for.
+uint64_t wal_append(uint8_t op, uint8_t table, const void *payload, uint32_t length)
+{
+    if (wal.fd < 0) return 0;
+
+    WalRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.length = length;
+    header.op = op;
+    header.table = table;
+    header.checksum = wal_record_checksum(op, table, payload, length);
+
+    pthread_mutex_lock(&wal.mutex);
+    size_t needed = wal.used + sizeof(header) + length;
+    if (needed > wal.capacity)
+    {
+        size_t capacity = wal.capacity;
+        while (needed > capacity)
+            capacity *= 2;
+        char *grown = (char *)realloc(wal.buffer, capacity);
+        if (!grown)
+        {
+            perror("Fatal: out of memory growing the WAL buffer");
+            exit(1);
+        }
+        wal.buffer = grown;
+        wal.capacity = capacity;
+    }
+    memcpy(wal.buffer + wal.used, &header, sizeof(header));
+    memcpy(wal.buffer + wal.used + sizeof(header), payload, length);
+    wal.used = needed;
+    wal.appended_lsn += sizeof(header) + length;
+    wal.records++;
+    wal.batch_records++;
+    uint64_t lsn = wal.appended_lsn;
+    pthread_mutex_unlock(&wal.mutex);
+    return lsn;
+}
+
+// Block until everything up to lsn is on disk (group commit)
+void wal_commit(uint64_t lsn)
+{
+    if (wal.fd < 0 || lsn == 0) return;
+    if (wal_defer_commits)
+    {
+        if (lsn > wal_deferred_lsn)
+            wal_deferred_lsn = lsn;
+        return;
+    }
+
+    pthread_mutex_lock(&wal.mutex);
+    while (wal.durable_lsn < lsn)
+    {
+        if (wal.flushing)
+        {
+            // Someone else is syncing; our record rides along with the next batch
+            pthread_cond_wait(&wal.flushed_cond, &wal.mutex);
+            continue;
+        }
+
+        // Become the leader: take every pending record and let appenders keep going
+        char *batch = wal.buffer;
+        size_t batch_len = wal.used;
+        size_t batch_capacity = wal.capacity;
+        uint64_t target = wal.appended_lsn;
+        unsigned long batch_records = wal.batch_records;
+        int fd = wal.fd; // Stable while 'flushing' is set (checkpoints wait for it)
+        wal.buffer = wal.spare;
+        wal.capacity = wal.spare_capacity;
+        wal.used = 0;
+        wal.batch_records = 0;
+        wal.flushing = 1;
+        pthread_mutex_unlock(&wal.mutex);
+
+        size_t written = 0;
+        while (written < batch_len)
+        {
+            ssize_t n = write(fd, batch + written, batch_len - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                perror("Fatal: WAL write failed");
+                exit(1);
+            }
+            written += (size_t)n;
+        }
+        if (fdatasync(fd) != 0)
+        {
+            perror("Fatal: WAL fsync failed");
+            exit(1);
+        }
+
+        pthread_mutex_lock(&wal.mutex);
+        wal.spare = batch;
+        wal.spare_capacity = batch_capacity;
+        wal.durable_lsn = target;
+        wal.flushing = 0;
+        wal.syncs++;
+        if (batch_records > wal.max_batch)
+            wal.max_batch = batch_records;
+        pthread_cond_broadcast(&wal.flushed_cond);
+    }
+    pthread_mutex_unlock(&wal.mutex);
+}
+
+// Makes everything this thread committed in deferred mode durable
+void wal_commit_deferred()
+{
+    int deferred = wal_defer_commits;
+    wal_defer_commits = 0;
+    wal_commit(wal_deferred_lsn);
+    wal_deferred_lsn = 0;
+    wal_defer_commits = deferred;
+}
+
+// Replays of an insert whose id already exists (or an update) overwrite the
+// record in place, so running the same log twice is harmless.
+static void wal_apply(uint8_t op, uint8_t table, const void *payload)
+{
+    int id;
+    switch (table)
+    {
+    case SNAP_MEMBERS:
+    {
+        if (op == WAL_DELETE)
+        {
+            memcpy(&id, payload, sizeof(id));
+            MemberNode *node = findMemberNodeById(id);
+            if (node) remove_member_node(node);
+            break;
+        }
+        Member data;
+        memcpy(&data, payload, sizeof(data));
+        data.name[MEMBER_TEXT_MAX] = data.email[MEMBER_TEXT_MAX] = '\0';
+        MemberNode *node = findMemberNodeById(data.memberId);
+        if (node) // Replay runs before any reader, so no copy-on-write
+        {
+            MemberStripe *stripe = member_stripe(data.memberId);
+            member_email_unlink(node);
+            member_release_text(stripe, node);
+            member_encode(stripe, node, &data);
+            member_email_link(node);
+        }
+        else
+            insert_member_node(&data);
+        if (data.memberId >= next_member_id)
+            next_member_id = data.memberId + 1;
+        break;
+    }
+    case SNAP_WORKSPACES:
+    {
+        if (op == WAL_DELETE)
+        {
+            memcpy(&id, payload, sizeof(id));
+            WorkspaceNode *node = findWorkspaceNodeById(id);
+            if (node) remove_workspace_node(node);
+            break;
+        }
+        Workspace data;
+        memcpy(&data, payload, sizeof(data));
+        WorkspaceNode *node = findWorkspaceNodeById(data.workspaceId);
+        if (node) {
+            workspace_encode(&data, &node->data);
+            node->version = record_version_next();
+        }
+        else
+            insert_workspace_node(&data);
+        if (data.workspaceId >= next_workspace_id)
+            next_workspace_id = data.workspaceId + 1;
+        break;
+    }
+    case SNAP_BOOKINGS:
+    {
+        if (op == WAL_DELETE)
+        {
+            memcpy(&id, payload, sizeof(id));
+            BookingNode *node = findBookingNodeById(id);
+            if (node) remove_booking_node(node);
+            break;
+        }
+        Booking data;
+        memcpy(&data, payload, sizeof(data));
+        BookingNode *node = findBookingNodeById(data.bookingId);
+        if (node)
+        {
+            booking_fk_unlink(node);
+            set_booking_data(node, &data);
+            booking_fk_link(node);
+        }
+        else
+            insert_booking_node(&data);
+        if (data.bookingId >= next_booking_id)
+            next_booking_id = data.bookingId + 1;
+        break;
+    }
+    case SNAP_PAYMENTS:
+    {
+        if (op == WAL_DELETE)
+        {
+            memcpy(&id, payload, sizeof(id));
+            PaymentNode *node = findPaymentNodeById(id);
+            if (node) remove_payment_node(node);
+            break;
+        }
+        Payment data;
+        memcpy(&data, payload, sizeof(data));
+        PaymentNode *node = findPaymentNodeById(data.paymentId);
+        if (node)
+        {
+            payment_fk_unlink(node);
+            set_payment_data(node, &data);
+            payment_fk_link(node);
+        }
+        else
+            insert_payment_node(&data);
+        if (data.paymentId >= next_payment_id)
+            next_payment_id = data.paymentId + 1;
+        break;
+    }
+    }
+}
+
+static size_t wal_payload_size(uint8_t op, uint8_t table)
+{
+    if (op == WAL_DELETE)
+        return sizeof(int);
+    if (op != WAL_INSERT && op != WAL_UPDATE)
+        return 0;
+    switch (table)
+    {
+    case SNAP_MEMBERS: return sizeof(Member);
+    case SNAP_WORKSPACES: return sizeof(Workspace);
+    case SNAP_BOOKINGS: return sizeof(Booking);
+    case SNAP_PAYMENTS: return sizeof(Payment);
+    }
+    return 0;
+}
+
+// A WAL_TXN payload must be a whole number of well-formed changes
+static int wal_txn_valid(const char *payload, uint32_t length)
+{
+    uint32_t pos = 0;
+    while (pos < length)
+    {
+        WalRecordHeader header;
+        if (length - pos < sizeof(header))
+            return 0;
+        memcpy(&header, payload + pos, sizeof(header));
+        pos += sizeof(header);
+        if (header.op < WAL_INSERT || header.op > WAL_DELETE || header.table >= SNAP_TABLES || header.length > length - pos ||
+            header.length != wal_payload_size(header.op, header.table))
+            return 0;
+        pos += header.length;
+    }
+    return 1;
+}
+
+// Applies a transaction's changes in order; returns how many there were
+static unsigned long wal_apply_txn(const char *payload, uint32_t length)
+{
+    unsigned long applied = 0;
+    for (uint32_t pos = 0; pos < length; applied++)
+    {
+        WalRecordHeader header;
+        memcpy(&header, payload + pos, sizeof(header));
+        wal_apply(header.op, header.table, payload + pos + sizeof(header));
+        pos += sizeof(header) + header.length;
+    }
+    return applied;
+}
+
+// Applies every intact record of one log file. A torn or corrupt tail (crash
+// mid-write) ends the replay and is cut off so new appends start clean.
+static void wal_replay_file(const char *path)
+{
+    int fd = open(path, O_RDWR);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return;
+    }
+    size_t size = (size_t)st.st_size;
+    char *map = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(fd);
+        return;
+    }
+
+    size_t pos = 0;
+    unsigned long applied = 0;
+    while (pos + sizeof(WalRecordHeader) <= size)
+    {
+        WalRecordHeader header;
+        memcpy(&header, map + pos, sizeof(header));
+        const char *payload = map + pos + sizeof(header);
+        if (header.length > size - pos - sizeof(header) ||
+            header.checksum != wal_record_checksum(header.op, header.table, payload, header.length) ||
+            (header.op == WAL_TXN ? !wal_txn_valid(payload, header.length)
+                                  : header.length != wal_payload_size(header.op, header.table)))
+            break;
+        if (header.op == WAL_TXN)
+            applied += wal_apply_txn(payload, header.length);
+        else {
+            wal_apply(header.op, header.table, payload);
+            applied++;
+        }
+        pos += sizeof(header) + header.length;
+    }
+    munmap(map, size);
+
+    if (pos < size)
+    {
+        printf("Warning: discarding %zu damaged bytes at the end of %s.\n", size - pos, path);
+        if (ftruncate(fd, (off_t)pos) == 0)
+            fsync(fd);
+    }
+    close(fd);
+    wal.replayed += applied;
+}
+
+// Startup: the retired log of an interrupted checkpoint first, then the live one
+void wal_recover()
+{
+    unsigned long before = wal.replayed;
+    wal_replay_file(WAL_PREV_FILE);
+    wal_replay_file(WAL_FILE);
+    if (wal.replayed > before)
+        printf("Replayed %lu change(s) from the write-ahead log.\n", wal.replayed - before);
+}
+
+// Moves the live log aside before a snapshot. If an earlier retired log is
+// still there (its snapshot failed), nothing moves: the live log keeps growing
+// and still holds every record the next snapshot must cover.
+void wal_rotate()
+{
+    if (wal.fd < 0)
+        return;
+
+    // Swap files only between flushes; records still queued simply go to the
+    // new file, which is fine because the snapshot includes them too.
+    pthread_mutex_lock(&wal.mutex);
+    while (wal.flushing)
+        pthread_cond_wait(&wal.flushed_cond, &wal.mutex);
+    if (access(WAL_PREV_FILE, F_OK) != 0 && rename(WAL_FILE, WAL_PREV_FILE) == 0)
+    {
+        // dup2 swaps the file behind the same descriptor number, so the
+        // unlocked 'wal.fd < 0' checks in other threads never see a change
+        int fd = open(WAL_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd >= 0)
+        {
+            dup2(fd, wal.fd);
+            close(fd);
+        }
+        sync_directory();
+    }
+    pthread_mutex_unlock(&wal.mutex);
+}
+
+// Held from the rotation to the rename of the snapshot, so checkpoints take
+// turns: they share the .tmp file and the retired log. bgsave_start takes it
+// too and only lets go once its child is forked; a checkpoint then waits for
+// that child before starting.
+pthread_mutex_t checkpoint_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Rotate the log, write the snapshot, then delete the retired log. Anything
+// logged after the rotation lands in the new file, so a crash at any point
+// recovers from (snapshot + prev + current) with idempotent replay.
+int wal_checkpoint()
+{
+    pthread_mutex_lock(&checkpoint_lock);
+    bgsave_wait(); // One checkpoint at a time
+    wal_rotate();
+    int rc = save_snapshot(SNAPSHOT_FILE);
+    if (rc == 0)
+    {
+        unlink(WAL_PREV_FILE);
+        sync_directory();
+    }
+    pthread_mutex_unlock(&checkpoint_lock);
+    return rc != 0 ? -1 : 0;
+}
+
+void wal_print_stats()
+{
+    printf("\n--- Write-Ahead Log ---\n");
+    if (wal.fd < 0)
+    {
+        printf("WAL is not open.\n");
+        return;
+    }
+    pthread_mutex_lock(&wal.mutex);
+    printf("Records: %lu | Bytes: %llu | fsyncs: %lu | Avg records/fsync: %.2f | Max batch: %lu | Replayed at startup: %lu\n",
+           wal.records, (unsigned long long)wal.appended_lsn, wal.syncs,
+           wal.syncs ? (double)(wal.records - wal.batch_records) / wal.syncs : 0.0,
+           wal.max_batch, wal.replayed);
+    pthread_mutex_unlock(&wal.mutex);
+}
+
+/*
+ * ==========================================
+ * BACKGROUND SAVE (fork + copy-on-write)
+ * ==========================================
+ */
+// BGSAVE holds every table's read lock only long enough to fork(). The child
+// gets a copy-on-write image of the whole database at that instant, streams it
+// into a new snapshot and renames it into place, while the parent goes on
+// serving. Pages the parent modifies in the meantime are copied by the
+// kernel; the child reports how much that came to (Private_Dirty).
+//
+// The WAL is rotated before the fork, as in a checkpoint, and the retired log
+// is deleted only after the child succeeds. Booking and payment pages that
+// are not resident are read from the page file, which the pool keeps
+// unchanged for the child (shadow mode).
+
+typedef struct
+{
+    int ok;
+    uint64_t cow_bytes;     // Private_Dirty of the child at the end
+    long long write_ns;     // Time the child spent writing
+} BgsaveReport;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t done_cond;
+    int running;
+    pid_t pid;
+    int report_fd;          // Read end of the child's report pipe
+    pthread_t watcher;
+    int watcher_joinable;   // Finished or not, nobody has joined it yet
+    long long started_ns;
+
+    // Last completed save
+    unsigned long saves, failures;
+    int last_ok;
+    double last_pause_ms, last_total_ms, last_write_ms;
+    uint64_t last_cow_bytes;
+} BackgroundSave;
+
+BackgroundSave bgsave = { .mutex = PTHREAD_MUTEX_INITIALIZER, .done_cond = PTHREAD_COND_INITIALIZER, .last_ok = 1 };
+
+// Memory this process no longer shares with its parent, from /proc (0 if unavailable)
+static uint64_t private_dirty_bytes()
+{
+    FILE *file = fopen("/proc/self/smaps_rollup", "r");
+    if (!file)
+        return 0;
+    char line[256];
+    unsigned long long kb = 0;
+    while (fgets(line, sizeof(line), file))
+        if (sscanf(line, "Private_Dirty: %llu kB", &kb) == 1)
+            break;
+    fclose(file);
+    return (uint64_t)kb * 1024;
+}
+
+// Runs in the child: no other threads exist, and every lock may be held by a
+// parent thread that is not there, so nothing here may take one.
+static void bgsave_child(int report_fd)
+{
+    // Do not keep the parent's sockets and logs open while saving
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    for (int fd = 3; fd < max_fd && fd < 65536; fd++)
+        if (fd != report_fd && fd != pool.fd)
+            close(fd);
+    pool.forked_child = 1;
+
+    BgsaveReport report;
+    memset(&report, 0, sizeof(report));
+    long long t = now_ns();
+    report.ok = save_snapshot_frozen(SNAPSHOT_FILE) == 0;
+    report.write_ns = now_ns() - t;
+    report.cow_bytes = private_dirty_bytes();
+    if (write(report_fd, &report, sizeof(report)) != (ssize_t)sizeof(report))
+        _exit(2);
+    _exit(report.ok ? 0 : 1);
+}
+
+// Collects the child, finishes the checkpoint and records the numbers
+static void *bgsave_watch(void *arg)
+{
+    (void)arg;
+    BgsaveReport report;
+    memset(&report, 0, sizeof(report));
+    ssize_t got = read(bgsave.report_fd, &report, sizeof(report));
+    int status = 0;
+    while (waitpid(bgsave.pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    close(bgsave.report_fd);
+    pool_end_shadow();
+
+    int ok = got == (ssize_t)sizeof(report) && report.ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (ok)
+    {
+        unlink(WAL_PREV_FILE); // The new snapshot covers it
+        sync_directory();
+    }
+
+    char logMsg[120];
+    sprintf(logMsg, "Background save %s (%.1f ms)", ok ? "finished" : "FAILED",
+            (now_ns() - bgsave.started_ns) / 1e6);
+    log_operation(logMsg);
+
+    pthread_mutex_lock(&bgsave.mutex);
+    bgsave.last_ok = ok;
+    if (ok)
+        bgsave.saves++;
+    else
+        bgsave.failures++;
+    bgsave.last_total_ms = (now_ns() - bgsave.started_ns) / 1e6;
+    bgsave.last_write_ms = report.write_ns / 1e6;
+    bgsave.last_cow_bytes = report.cow_bytes;
+    bgsave.running = 0;
+    pthread_cond_broadcast(&bgsave.done_cond);
+    pthread_mutex_unlock(&bgsave.mutex);
+    return NULL;
+}
+
+// Returns BGSAVE_STARTED, BGSAVE_BUSY (a save or checkpoint is already
+// running) or BGSAVE_FAILED
+int bgsave_start()
+{
+    if (pthread_mutex_trylock(&checkpoint_lock) != 0)
+        return BGSAVE_BUSY;
+    pthread_mutex_lock(&bgsave.mutex);
+    if (bgsave.running)
+    {
+        pthread_mutex_unlock(&bgsave.mutex);
+        pthread_mutex_unlock(&checkpoint_lock);
+        return BGSAVE_BUSY;
+    }
+    if (bgsave.watcher_joinable)
+    {
+        pthread_join(bgsave.watcher, NULL); // Already past its last use of the mutex
+        bgsave.watcher_joinable = 0;
+    }
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0)
+    {
+        pthread_mutex_unlock(&bgsave.mutex);
+        pthread_mutex_unlock(&checkpoint_lock);
+        return BGSAVE_FAILED;
+    }
+    wal_rotate();
+
+    // Freeze writers just for the fork: with every table read-locked no row is
+    // half-written, and the pool lock keeps the frame table consistent too
+    long long t = now_ns();
+    for (int table = 0; table < SNAP_TABLES; table++)
+        table_rdlock(table);
+    pthread_mutex_lock(&pool.lock);
+    pool_begin_shadow_locked();
+    fflush(NULL); // Buffered output must not be written twice
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(pipe_fds[0]);
+        bgsave_child(pipe_fds[1]);
+    }
+    if (pid < 0)
+        pool.shadow = 0;
+    pthread_mutex_unlock(&pool.lock);
+    for (int table = SNAP_TABLES - 1; table >= 0; table--)
+        table_unlock(table);
+    long long pause_ns = now_ns() - t;
+    close(pipe_fds[1]);
+    if (pid < 0)
+    {
+        close(pipe_fds[0]);
+        bgsave.failures++;
+        pthread_mutex_unlock(&bgsave.mutex);
+        pthread_mutex_unlock(&checkpoint_lock);
+        return BGSAVE_FAILED;
+    }
+
+    bgsave.running = 1;
+    bgsave.pid = pid;
+    bgsave.report_fd = pipe_fds[0];
+    bgsave.started_ns = t;
+    bgsave.last_pause_ms = pause_ns / 1e6;
+    pthread_create(&bgsave.watcher, NULL, bgsave_watch, NULL);
+    bgsave.watcher_joinable = 1;
+    pthread_mutex_unlock(&bgsave.mutex);
+    pthread_mutex_unlock(&checkpoint_lock);
+    log_operation("Background save started");
+    return BGSAVE_STARTED;
+}
+
+// Blocks until no background save is running; returns whether the last one worked
+int bgsave_wait()
+{
+    pthread_mutex_lock(&bgsave.mutex);
+    while (bgsave.running)
+        pthread_cond_wait(&bgsave.done_cond, &bgsave.mutex);
+    int ok = bgsave.last_ok;
+    int join = bgsave.watcher_joinable;
+    pthread_t watcher = bgsave.watcher;
+    bgsave.watcher_joinable = 0;
+    pthread_mutex_unlock(&bgsave.mutex);
+    if (join)
+        pthread_join(watcher, NULL);
+    return ok;
+}
+
+void bgsave_print_stats()
+{
+    pthread_mutex_lock(&bgsave.mutex);
+    printf("\n--- Background Save ---\n");
+    if (bgsave.running)
+        printf("Running: pid %d for %.1f ms\n", (int)bgsave.pid, (now_ns() - bgsave.started_ns) / 1e6);
+    printf("Completed: %lu | Failed: %lu", bgsave.saves, bgsave.failures);
+    if (bgsave.saves + bgsave.failures)
+        printf(" | Last: %s, %.1f ms total (writers paused %.2f ms, child wrote %.1f ms), copy-on-write %.1f MB",
+               bgsave.last_ok ? "ok" : "failed", bgsave.last_total_ms, bgsave.last_pause_ms,
+               bgsave.last_write_ms, bgsave.last_cow_bytes / (1024.0 * 1024.0));
+    printf("\n");
+    pthread_mutex_unlock(&bgsave.mutex);
+}
+
+/*
+ * ==========================================
+ * FILE I/O: CSV IMPORT / EXPORT
+ * ==========================================
+ */
+
+// Legacy text format: used for the first import and by --import-csv/--export-csv.
+// Fields are not quoted, so names or locations containing commas do not round-trip.
+//
+// Loading: the four files load concurrently, one thread per table. Each file is
+// mmapped and cut into newline-aligned ranges that are parsed in parallel
+// straight out of the mapping. Each range fills its own array of records;
+// the table thread then inserts the arrays in file order, with the primary
+// index sized once for the total. Malformed lines are skipped and counted.
+
+typedef struct
+{
+    size_t offset; // Field position in the record struct
+    size_t size;   // Buffer size for text fields, 0 for ints
+} CsvField;
+
+typedef struct
+{
+    const char *path;
+    const char *name;
+    size_t record_size;
+    const CsvField *fields; // In file order; the first is the int id, the last takes the rest of the line
+    int field_count;
+} CsvTable;
+
+// Per-table timings of the last CSV load
+typedef struct
+{
+    int loaded; // The file existed
+    int ranges; // Slices parsed in parallel
+    size_t rows, skipped;
+    double parse_ms, build_ms;
+} CsvLoadStats;
+
+#define CSV_INT(type, field) { offsetof(type, field), 0 }
+#define CSV_TEXT(type, field) { offsetof(type, field), sizeof(((type *)0)->field) }
+
+static const CsvField member_fields[] = {
+    CSV_INT(Member, memberId), CSV_TEXT(Member, name), CSV_TEXT(Member, email)
+};
+static const CsvField workspace_fields[] = {
+    CSV_INT(Workspace, workspaceId), CSV_TEXT(Workspace, type), CSV_TEXT(Workspace, location),
+    CSV_INT(Workspace, capacity), CSV_INT(Workspace, price_in_cents)
+};
+static const CsvField booking_fields[] = {
+    CSV_INT(Booking, bookingId), CSV_INT(Booking, memberId), CSV_INT(Booking, workspaceId),
+    CSV_TEXT(Booking, startTime), CSV_TEXT(Booking, endTime), CSV_TEXT(Booking, status)
+};
+static const CsvField payment_fields[] = {
+    CSV_INT(Payment, paymentId), CSV_INT(Payment, bookingId), CSV_INT(Payment, amount_in_cents),
+    CSV_TEXT(Payment, paymentDate), CSV_TEXT(Payment, status)
+};
+
+#undef CSV_INT
+#undef CSV_TEXT
+
+static const CsvTable csv_tables[SNAP_TABLES] = {
+    { MEMBERS_FILE, "Members", sizeof(Member), member_fields, 3 },
+    { WORKSPACES_FILE, "Workspaces", sizeof(Workspace), workspace_fields, 5 },
+    { BOOKINGS_FILE, "Bookings", sizeof(Booking), booking_fields, 6 },
+    { PAYMENTS_FILE, "Payments", sizeof(Payment), payment_fields, 5 },
+};
+
+CsvLoadStats csv_load_stats[SNAP_TABLES]; // From the last load_csv_data
+
+typedef struct
+{
+    const CsvTable *table;
+    const char *begin, *end; // Whole lines of the mapped file
+    char *rows;              // Parsed records, in file order
+    size_t count, capacity;
+    size_t skipped;
+} CsvRange;
+
+// Like %d: optional blanks and sign, then digits filling the rest of the field
+static int csv_parse_int(const char *p, const char *end, int *out)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    int negative = p < end && (*p == '-' || *p == '+') ? *p++ == '-' : 0;
+    if (p == end)
+        return -1;
+    long long value = 0;
+    for (; p < end; p++)
+    {
+        if (*p < '0' || *p > '9' || value > INT32_MAX)
+            return -1;
+        value = value * 10 + (*p - '0');
+    }
+    value = negative ? -value : value;
+    if (value > INT32_MAX || value < INT32_MIN)
+        return -1;
+    *out = (int)value;
+    return 0;
+}
+
+// Fills 'row' from one line (without its newline); -1 if it does not fit the table
+static int csv_parse_line(const CsvTable *table, const char *p, const char *end, char *row)
+{
+    memset(row, 0, table->record_size); // Zero padding keeps snapshot checksums stable
+    for (int f = 0; f < table->field_count; f++)
+    {
+        const CsvField *field = &table->fields[f];
+        const char *stop = end;
+        if (f < table->field_count - 1)
+        {
+            stop = (const char *)memchr(p, ',', end - p);
+            if (!stop)
+                return -1;
+        }
+        if (field->size == 0)
+        {
+            if (csv_parse_int(p, stop, (int *)(row + field->offset)) != 0)
+                return -1;
+        }
+        else
+        {
+            size_t len = stop - p;
+            if (len == 0)
+                return -1;
+            if (len >= field->size) // Skipped rather than silently cut short
+                return -1;
+            memcpy(row + field->offset, p, len);
+        }
+        p = stop + 1;
+    }
+    return 0;
+}
+
+static void *csv_parse_range(void *arg)
+{
+    CsvRange *range = (CsvRange *)arg;
+    size_t record_size = range->table->record_size;
+    const char *p = range->begin;
+    while (p < range->end)
+    {
+        const char *eol = (const char *)memchr(p, '\n', range->end - p);
+        if (!eol)
+            eol = range->end;
+        const char *line_end = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+        if (line_end > p)
+        {
+            if (range->count == range->capacity)
+            {
+                range->capacity = range->capacity ? range->capacity * 2 : 1024;
+                range->rows = (char *)realloc(range->rows, range->capacity * record_size);
+                if (!range->rows) {
+                    perror("Failed to allocate CSV rows");
+                    exit(1);
+                }
+            }
+            if (csv_parse_line(range->table, p, line_end, range->rows + range->count * record_size) == 0)
+                range->count++;
+            else
+                range->skipped++;
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+// Bulk loads: size the primary index once for the whole file
+static void csv_reserve(int table, size_t rows)
+{
+    switch (table)
+    {
+    case SNAP_MEMBERS: member_tables_reserve(rows); break;
+    case SNAP_WORKSPACES: index_reserve(&workspace_index, rows); break;
+    case SNAP_BOOKINGS: index_reserve(&booking_index, rows); break;
+    default: index_reserve(&payment_index, rows); break;
+    }
+}
+
+// Returns 0 for rows that cannot be stored
+static int csv_insert(int table, const void *row)
+{
+    switch (table)
+    {
+    case SNAP_MEMBERS:
+        if (((const Member *)row)->memberId <= 0) // The id map only holds positive ids
+            return 0;
+        insert_member_node((const Member *)row);
+        break;
+    case SNAP_WORKSPACES: insert_workspace_node((const Workspace *)row); break;
+    case SNAP_BOOKINGS: insert_booking_node((const Booking *)row); break;
+    default: insert_payment_node((const Payment *)row); break;
+    }
+    return 1;
+}
+
+static void csv_set_next_id(int table, int next_id)
+{
+    switch (table)
+    {
+    case SNAP_MEMBERS: next_member_id = next_id; break;
+    case SNAP_WORKSPACES: next_workspace_id = next_id; break;
+    case SNAP_BOOKINGS: next_booking_id = next_id; break;
+    default: next_payment_id = next_id; break;
+    }
+}
+
+// One table, start to finish. Tables share no structures except the buffer
+// pool (which has its own lock), so the four run side by side.
+static void *csv_load_table(void *arg)
+{
+    int table = (int)(intptr_t)arg;
+    const CsvTable *desc = &csv_tables[table];
+    CsvLoadStats *stats = &csv_load_stats[table];
+    memset(stats, 0, sizeof(*stats));
+    long long started = now_ns();
+
+    int fd = open(desc->path, O_RDONLY);
+    if (fd < 0)
+        return NULL; // Missing file: the table stays empty, as before
+    stats->loaded = 1;
+    struct stat st;
+    size_t size = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    const char *map = size ? (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("Failed to map CSV file");
+        map = NULL;
+        size = 0;
+    }
+    if (map)
+        madvise((void *)map, size, MADV_SEQUENTIAL);
+
+    // One range per CSV_MIN_RANGE_BYTES, at most one per core
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int ranges = (int)(size / CSV_MIN_RANGE_BYTES) + 1;
+    if (ranges > CSV_MAX_RANGES)
+        ranges = CSV_MAX_RANGES;
+    if (cores > 0 && ranges > cores)
+        ranges = (int)cores;
+    stats->ranges = ranges;
+
+    CsvRange range[CSV_MAX_RANGES];
+    memset(range, 0, sizeof(range));
+    const char *cursor = map;
+    for (int i = 0; i < ranges; i++)
+    {
+        const char *end = map + size * (i + 1) / ranges;
+        if (end < cursor)
+            end = cursor;
+        if (i < ranges - 1)
+        {
+            const char *newline = (const char *)memchr(end, '\n', map + size - end);
+            end = newline ? newline + 1 : map + size;
+        }
+        range[i].table = desc;
+        range[i].begin = cursor;
+        range[i].end = end;
+        cursor = end;
+    }
+
+    // A range whose thread cannot start is parsed here afterwards
+    pthread_t workers[CSV_MAX_RANGES];
+    int threaded[CSV_MAX_RANGES] = { 0 };
+    for (int i = 1; i < ranges; i++)
+        threaded[i] = pthread_create(&workers[i], NULL, csv_parse_range, &range[i]) == 0;
+    csv_parse_range(&range[0]);
+    for (int i = 1; i < ranges; i++)
+    {
+        if (threaded[i])
+            pthread_join(workers[i], NULL);
+        else
+            csv_parse_range(&range[i]);
+    }
+    long long parsed = now_ns();
+
+    // Splice the ranges back together in file order
+    size_t total = 0;
+    for (int i = 0; i < ranges; i++)
+        total += range[i].count;
+    csv_reserve(table, total);
+    int max_id = 0;
+    for (int i = 0; i < ranges; i++)
+    {
+        stats->skipped += range[i].skipped;
+        for (size_t r = 0; r < range[i].count; r++)
+        {
+            const char *row = range[i].rows + r * desc->record_size;
+            if (!csv_insert(table, row))
+            {
+                stats->skipped++;
+                continue;
+            }
+            stats->rows++;
+            int id = *(const int *)(row + desc->fields[0].offset);
+            if (id > max_id)
+                max_id = id;
+        }
+        free(range[i].rows);
+    }
+    csv_set_next_id(table, max_id + 1);
+
+    if (map)
+        munmap((void *)map, size);
+    stats->parse_ms = (parsed - started) / 1e6;
+    stats->build_ms = (now_ns() - parsed) / 1e6;
+    return NULL;
+}
+
+void load_csv_data()
+{
+    // Payments load alongside their bookings, so they cannot look them up
+    // yet: the aggregates are rebuilt once every table is in
+    mat_live = 0;
+    pthread_t loaders[SNAP_TABLES];
+    int started[SNAP_TABLES];
+    for (int table = 0; table < SNAP_TABLES; table++)
+        started[table] = pthread_create(&loaders[table], NULL, csv_load_table, (void *)(intptr_t)table) == 0;
+    for (int table = 0; table < SNAP_TABLES; table++)
+    {
+        if (started[table])
+            pthread_join(loaders[table], NULL);
+        else
+            csv_load_table((void *)(intptr_t)table);
+    }
+    mat_aggregates_rebuild();
+}
+
+void csv_print_load_stats()
+{
+    for (int table = 0; table < SNAP_TABLES; table++)
+    {
+        const CsvLoadStats *stats = &csv_load_stats[table];
+        if (!stats->loaded)
+            continue;
+        printf("  %-10s %9zu rows in %7.1f ms (parse %.1f ms over %d range(s), build %.1f ms)",
+               csv_tables[table].name, stats->rows, stats->parse_ms + stats->build_ms,
+               stats->parse_ms, stats->ranges, stats->build_ms);
+        if (stats->skipped)
+            printf(", %zu malformed or too-long line(s) skipped", stats->skipped);
+        printf("\n");
+    }
+}
+
+void save_csv_data()
+{
+    FILE *file;
+    TableSnapshot snaps[SNAP_TABLES];
+    database_snapshot(snaps, COPY_ROWS);
+
+    // Save Members
+    file = fopen(MEMBERS_FILE, "w");
+    if (file)
+    {
+        const Member *rows = (const Member *)snaps[SNAP_MEMBERS].rows;
+        for (size_t i = 0; i < snaps[SNAP_MEMBERS].count; i++)
+        {
+            fprintf(file, "%d,%s,%s\n", rows[i].memberId, rows[i].name, rows[i].email);
+        }
+        fclose(file);
+    }
+    // Save Workspaces
+    file = fopen(WORKSPACES_FILE, "w");
+    if (file)
+    {
+        const Workspace *rows = (const Workspace *)snaps[SNAP_WORKSPACES].rows;
+        for (size_t i = 0; i < snaps[SNAP_WORKSPACES].count; i++)
+        {
+            fprintf(file, "%d,%s,%s,%d,%d\n", rows[i].workspaceId, rows[i].type, rows[i].location, rows[i].capacity, rows[i].price_in_cents);
+        }
+        fclose(file);
+    }
+    // Save Bookings
+    file = fopen(BOOKINGS_FILE, "w");
+    if (file)
+    {
+        const Booking *rows = (const Booking *)snaps[SNAP_BOOKINGS].rows;
+        for (size_t i = 0; i < snaps[SNAP_BOOKINGS].count; i++)
+        {
+            fprintf(file, "%d,%d,%d,%s,%s,%s\n", rows[i].bookingId, rows[i].memberId, rows[i].workspaceId, rows[i].startTime, rows[i].endTime, rows[i].status);
+        }
+        fclose(file);
+    }
+    // Save Payments
+    file = fopen(PAYMENTS_FILE, "w");
+    if (file)
+    {
+        const Payment *rows = (const Payment *)snaps[SNAP_PAYMENTS].rows;
+        for (size_t i = 0; i < snaps[SNAP_PAYMENTS].count; i++)
+        {
+            fprintf(file, "%d,%d,%d,%s,%s\n", rows[i].paymentId, rows[i].bookingId, rows[i].amount_in_cents, rows[i].paymentDate, rows[i].status);
+        }
+        fclose(file);
+    }
+
+    for (int table = 0; table < SNAP_TABLES; table++)
+        table_snapshot_free(&snaps[table]);
+}
+
+// All nodes live in their table's slab or node blocks, so teardown is a few
+// chunk frees
+void free_all_lists()
+{
+    bgsave_wait(); // A save child may still be reading the page file
+    member_rows_free();
+    slab_release(&workspace_slab);
+    workspace_head = workspace_tail = NULL;
+    paged_table_reset(&booking_pages);
+    paged_table_reset(&payment_pages);
+    pool_reset();
+}
+
+// Empties every table and index so data can be loaded again (tools/benchmarks)
+void reset_all_tables()
+{
+    free_all_lists();
+    free_index();
+    member_tables_init();
+    index_init(&workspace_index, "Workspace Index");
+    index_init(&booking_index, "Booking Index");
+    index_init(&payment_index, "Payment Index");
+    index_init(&schedule_index, "Schedule Index");
+    index_init(&bookings_by_member, "Bookings/Member");
+    index_init(&bookings_by_workspace, "Bookings/Space");
+    index_init(&payments_by_booking, "Payments/Booking");
+    ordered_init(&bookings_by_start, "Bookings/Start");
+    ordered_init(&payments_by_date, "Payments/Date");
+    mat_aggregates_init();
+    next_member_id = next_workspace_id = next_booking_id = next_payment_id = 1;
+}
+
+/*
+ * ==========================================
+ * CONCURRENCY BENCHMARK (Menu)
+ * ==========================================
+ */
+
+// Runs a short --bench in a child process, so the generated dataset never
+// touches the live tables, WAL or log of this session
+void run_concurrency_test() {
+    printf("\n--- Starting Concurrency Benchmark ---\n");
+    printf("4 threads drive the real CRUD paths (70%% read, 20%% write, 10%% lookup)\n");
+    printf("against a scratch copy of 10000 rows per table. See --help for the headless --bench mode.\n");
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        char *args[] = { "/proc/self/exe", "--bench", "--threads", "4", "--ops", "200000",
+                         "--size", "10000", NULL };
+        execv(args[0], args);
+        _exit(127);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        printf("Error: benchmark did not complete.\n");
+}
+
+/*
+ * ==========================================
+ * COMMAND DISPATCHER (batch mode and server)
+ * ==========================================
+ */
+// One command per line, fields separated by '|':
+//     ADD_MEMBER|Ann Lee|ann@example.com
+// Each command produces one response line, "OK|..." or "ERR|<STATUS>|...".
+// List commands answer "OK|<found>" followed by one "ROW|..." line per match.
+
+#define COMMAND_MAX_FIELDS 8
+#define COMMAND_MAX_ROWS 1000 // Rows returned by one list command
+
+void out_printf(OutBuffer *out, const char *fmt, ...)
+{
+    for (;;)
+    {
+        size_t room = out->capacity - out->used;
+        va_list args;
+        va_start(args, fmt);
+        int n = room ? vsnprintf(out->data + out->used, room, fmt, args) : -1;
+        va_end(args);
+        if (n >= 0 && (size_t)n < room)
+        {
+            out->used += (size_t)n;
+            return;
+        }
+        size_t needed = out->used + (n >= 0 ? (size_t)n + 1 : 256);
+        size_t capacity = out->capacity ? out->capacity : 4096;
+        while (capacity < needed)
+            capacity *= 2;
+        char *data = (char *)realloc(out->data, capacity);
+        if (!data) {
+            perror("Failed to grow response buffer");
+            exit(1);
+        }
+        out->data = data;
+        out->capacity = capacity;
+    }
+}
+
+// Parsed arguments: 'i' fields land in num[], every field is also in str[]
+typedef struct
+{
+    int num[COMMAND_MAX_FIELDS];
+    const char *str[COMMAND_MAX_FIELDS];
+    CommandSession *session;
+} CommandArgs;
+
+typedef struct
+{
+    const char *name;
+    const char *types; // One char per argument: 'i' integer, 's' string
+    int (*run)(const CommandArgs *args, OutBuffer *out);
+    int in_txn;        // 1: also accepted between BEGIN and COMMIT
+} CommandSpec;
+
+static void out_status(OutBuffer *out, DbStatus rc)
+{
+    if (rc == DB_OK)
+        out_printf(out, "OK\n");
+    else
+        out_printf(out, "ERR|%s\n", db_status_name(rc));
+}
+
+static void out_id(OutBuffer *out, DbStatus rc, int id)
+{
+    if (rc == DB_OK)
+        out_printf(out, "OK|%d\n", id);
+    else
+        out_status(out, rc);
+}
+
+static void out_delete(OutBuffer *out, DbStatus rc, const DbDeleteInfo *info)
+{
+    if (rc == DB_OK)
+        out_printf(out, "OK|%d|%d\n", info->bookings, info->payments);
+    else if (rc == DB_RESTRICTED)
+        out_printf(out, "ERR|RESTRICTED|%d\n", info->dependents);
+    else
+        out_status(out, rc);
+}
+
+static void out_booking_row(OutBuffer *out, const char *tag, const Booking *b)
+{
+    out_printf(out, "%s|%d|%d|%d|%s|%s|%s\n", tag, b->bookingId, b->memberId, b->workspaceId, b->startTime, b->endTime, b->status);
+}
+
+static void out_payment_row(OutBuffer *out, const char *tag, const Payment *p)
+{
+    out_printf(out, "%s|%d|%d|%d|%s|%s\n", tag, p->paymentId, p->bookingId, p->amount_in_cents, p->paymentDate, p->status);
+}
+
+// Page arguments of the range commands: a row limit and the cursor token the
+// previous page returned ("<time>:<id>", empty for the first page)
+static int parse_range_page(const CommandArgs *a, int64_t from, int *limit, OrderedKey *cursor)
+{
+    long long time;
+    int id, used = 0;
+    *limit = a->num[2];
+    if (*limit <= 0)
+        return -1;
+    if (*limit > COMMAND_MAX_ROWS)
+        *limit = COMMAND_MAX_ROWS;
+    *cursor = (OrderedKey){ from, 0 };
+    if (a->str[3][0] == '\0')
+        return 0;
+    if (sscanf(a->str[3], "%lld:%d%n", &time, &id, &used) != 2 || a->str[3][used] != '\0')
+        return -1;
+    *cursor = (OrderedKey){ time, id };
+    return 0;
+}
+
+// "OK|<rows>|<next cursor or END>"
+static void out_range_header(OutBuffer *out, int found, int more, const OrderedKey *cursor)
+{
+    if (more)
+        out_printf(out, "OK|%d|%lld:%d\n", found, (long long)cursor->time, cursor->id);
+    else
+        out_printf(out, "OK|%d|END\n", found);
+}
+
+// -- Members --
+static int cmd_add_member(const CommandArgs *a, OutBuffer *out)
+{
+    int id = 0;
+    DbStatus rc = db_add_member(a->str[0], a->str[1], &id);
+    out_id(out, rc, id);
+    return COMMAND_DONE;
+}
+
+static int cmd_get_member(const CommandArgs *a, OutBuffer *out)
+{
+    Member m;
+    Txn *txn = a->session->txn;
+    DbStatus rc = txn ? txn_get_member(txn, a->num[0], &m) : db_get_member(a->num[0], &m);
+    if (rc == DB_OK)
+        out_printf(out, "OK|%d|%s|%s\n", m.memberId, m.name, m.email);
+    else
+        out_status(out, rc);
+    return COMMAND_DONE;
+}
+
+static int cmd_find_member(const CommandArgs *a, OutBuffer *out)
+{
+    Member m;
+    if (db_find_member_by_email(a->str[0], &m) == DB_OK)
+        out_printf(out, "OK|%d|%s|%s\n", m.memberId, m.name, m.email);
+    else
+        out_status(out, DB_NOT_FOUND);
+    return COMMAND_DONE;
+}
+
+static int cmd_update_member(const CommandArgs *a, OutBuffer *out)
+{
+    out_status(out, db_update_member(a->num[0], a->str[1]));
+    return COMMAND_DONE;
+}
+
+static int cmd_delete_member(const CommandArgs *a, OutBuffer *out)
+{
+    DbDeleteInfo info;
+    out_delete(out, db_delete_member(a->num[0], &info), &info);
+    return COMMAND_DONE;
+}
+
+// -- Workspaces --
+static int cmd_add_workspace(const CommandArgs *a, OutBuffer *out)
+{
+    int id = 0;
+    DbStatus rc = db_add_workspace(a->str[0], a->str[1], a->num[2], a->num[3], &id);
+    out_id(out, rc, id);
+    return COMMAND_DONE;
+}
+
+static int cmd_get_workspace(const CommandArgs *a, OutBuffer *out)
+{
+    Workspace w;
+    Txn *txn = a->session->txn;
+    DbStatus rc = txn ? txn_get_workspace(txn, a->num[0], &w) : db_get_workspace(a->num[0], &w);
+    if (rc == DB_OK)
+        out_printf(out, "OK|%d|%s|%s|%d|%d\n", w.workspaceId, w.type, w.location, w.capacity, w.price_in_cents);
+    else
+        out_status(out, rc);
+    return COMMAND_DONE;
+}
+
+static int cmd_update_workspace(const CommandArgs *a, OutBuffer *out)
+{
+    Txn *txn = a->session->txn;
+    out_status(out, txn ? txn_update_workspace(txn, a->num[0], a->num[1], a->num[2])
+                        : db_update_workspace(a->num[0], a->num[1], a->num[2]));
+    return COMMAND_DONE;
+}
+
+static int cmd_delete_workspace(const CommandArgs *a, OutBuffer *out)
+{
+    DbDeleteInfo info;
+    out_delete(out, db_delete_workspace(a->num[0], &info), &info);
+    return COMMAND_DONE;
+}
+
+static int cmd_occupancy(const CommandArgs *a, OutBuffer *out)
+{
+    int64_t from = parse_booking_time(a->str[1]);
+    int64_t to = parse_booking_time(a->str[2]);
+    if (from < 0 || to <= from)
+    {
+        out_status(out, DB_INVALID);
+        return COMMAND_DONE;
+    }
+    Booking *rows = (Booking *)malloc(COMMAND_MAX_ROWS * sizeof(Booking));
+    if (!rows)
+    {
+        out_status(out, DB_NO_MEMORY);
+        return COMMAND_DONE;
+    }
+    int found = db_workspace_occupancy(a->num[0], from, to, rows, COMMAND_MAX_ROWS);
+    out_printf(out, "OK|%d\n", found);
+    for (int i = 0; i < found && i < COMMAND_MAX_ROWS; i++)
+        out_booking_row(out, "ROW", &rows[i]);
+    free(rows);
+    return COMMAND_DONE;
+}
+
+// -- Bookings --
+static int cmd_add_booking(const CommandArgs *a, OutBuffer *out)
+{
+    int id = 0, conflictId = 0;
+    Txn *txn = a->session->txn;
+    DbStatus rc = txn ? txn_add_booking(txn, a->num[0], a->num[1], a->str[2], a->str[3], a->str[4], &id)
+                      : db_add_booking(a->num[0], a->num[1], a->str[2], a->str[3], a->str[4], &id, &conflictId);
+    if (rc == DB_CONFLICT)
+        out_printf(out, "ERR|CONFLICT|%d\n", conflictId);
+    else
+        out_id(out, rc, id);
+    return COMMAND_DONE;
+}
+
+static int cmd_get_booking(const CommandArgs *a, OutBuffer *out)
+{
+    Booking b;
+    Txn *txn = a->session->txn;
+    DbStatus rc = txn ? txn_get_booking(txn, a->num[0], &b) : db_get_booking(a->num[0], &b);
+    if (rc == DB_OK)
+        out_booking_row(out, "OK", &b);
+    else
+        out_status(out, rc);
+    return COMMAND_DONE;
+}
+
+static int cmd_update_booking(const CommandArgs *a, OutBuffer *out)
+{
+    int conflictId = 0;
+    Txn *txn = a->session->txn;
+    DbStatus rc = txn ? txn_update_booking(txn, a->num[0], a->str[1]) : db_update_booking(a->num[0], a->str[1], &conflictId);
+    if (rc == DB_CONFLICT)
+        out_printf(out, "ERR|CONFLICT|%d\n", conflictId);
+    else
+        out_status(out, rc);
+    return COMMAND_DONE;
+}
+
+static int cmd_delete_booking(const CommandArgs *a, OutBuffer *out)
+{
+    if (a->session->txn) // Dependents are only counted at COMMIT
+    {
+        out_status(out, txn_delete_booking(a->session->txn, a->num[0]));
+        return COMMAND_DONE;
+    }
+    DbDeleteInfo info;
+    out_delete(out, db_delete_booking(a->num[0], &info), &info);
+    return COMMAND_DONE;
+}
+
+static int cmd_member_bookings(const CommandArgs *a, OutBuffer *out)
+{
+    Booking *rows = (Booking *)malloc(COMMAND_MAX_ROWS * sizeof(Booking));
+    if (!rows)
+    {
+        out_status(out, DB_NO_MEMORY);
+        return COMMAND_DONE;
+    }
+    int found = db_member_bookings(a->num[0], rows, COMMAND_MAX_ROWS);
+    out_printf(out, "OK|%d\n", found);
+    for (int i = 0; i < found && i < COMMAND_MAX_ROWS; i++)
+        out_booking_row(out, "ROW", &rows[i]);
+    free(rows);
+    return COMMAND_DONE;
+}
+
+static int cmd_bookings_between(const CommandArgs *a, OutBuffer *out)
+{
+    int64_t from = parse_booking_time(a->str[0]);
+    int64_t to = parse_booking_time(a->str[1]);
+    int limit, more;
+    OrderedKey cursor;
+    if (from < 0 || to <= from || parse_range_page(a, from, &limit, &cursor) != 0)
+    {
+        out_status(out, DB_INVALID);
+        return COMMAND_DONE;
+    }
+    Booking *rows = (Booking *)malloc(limit * sizeof(Booking));
+    if (!rows)
+    {
+        out_status(out, DB_NO_MEMORY);
+        return COMMAND_DONE;
+    }
+    int found = db_bookings_starting(from, to, &cursor, rows, limit, &more);
+    out_range_header(out, found, more, &cursor);
+    for (int i = 0; i < found; i++)
+        out_booking_row(out, "ROW", &rows[i]);
+    free(rows);
+    return COMMAND_DONE;
+}
+
+// -- Payments --
+static int cmd_add_payment(const CommandArgs *a, OutBuffer *out)
+{
+    int id = 0;
+    Txn *txn = a->session->txn;
+    DbStatus rc = txn ? txn_add_payment(txn, a->num[0], a->num[1], a->str[2], a->str[3], &id)
+                      : db_add_payment(a->num[0], a->num[1], a->str[2], a->str[3], &id);
+    out_id(out, rc, id);
+    return COMMAND_DONE;
+}
+
+static int cmd_get_payment(const CommandArgs *a, OutBuffer *out)
+{
+    Payment p;
+    Txn *txn = a->session->txn;
+    DbStatus rc = txn ? txn_get_payment(txn, a->num[0], &p) : db_get_payment(a->num[0], &p);
+    if (rc == DB_OK)
+        out_payment_row(out, "OK", &p);
+    else
+        out_status(out, rc);
+    return COMMAND_DONE;
+}
+
+static int cmd_update_payment(const CommandArgs *a, OutBuffer *out)
+{
+    Txn *txn = a->session->txn;
+    out_status(out, txn ? txn_update_payment(txn, a->num[0], a->str[1]) : db_update_payment(a->num[0], a->str[1]));
+    return COMMAND_DONE;
+}
+
+static int cmd_delete_payment(const CommandArgs *a, OutBuffer *out)
+{
+    Txn *txn = a->session->txn;
+    out_status(out, txn ? txn_delete_payment(txn, a->num[0]) : db_delete_payment(a->num[0]));
+    return COMMAND_DONE;
+}
+
+static int cmd_booking_payments(const CommandArgs *a, OutBuffer *out)
+{
+    Payment *rows = (Payment *)malloc(COMMAND_MAX_ROWS * sizeof(Payment));
+    if (!rows)
+    {
+        out_status(out, DB_NO_MEMORY);
+        return COMMAND_DONE;
+    }
+    int found = db_booking_payments(a->num[0], rows, COMMAND_MAX_ROWS);
+    out_printf(out, "OK|%d\n", found);
+    for (int i = 0; i < found && i < COMMAND_MAX_ROWS; i++)
+        out_payment_row(out, "ROW", &rows[i]);
+    free(rows);
+    return COMMAND_DONE;
+}
+
+static int cmd_payments_between(const CommandArgs *a, OutBuffer *out)
+{
+    int64_t from = parse_payment_date(a->str[0]);
+    int64_t to = parse_payment_date(a->str[1]);
+    int limit, more;
+    OrderedKey cursor;
+    if (from < 0 || to <= from || parse_range_page(a, from, &limit, &cursor) != 0)
+    {
+        out_status(out, DB_INVALID);
+        return COMMAND_DONE;
+    }
+    Payment *rows = (Payment *)malloc(limit * sizeof(Payment));
+    if (!rows)
+    {
+        out_status(out, DB_NO_MEMORY);
+        return COMMAND_DONE;
+    }
+    int found = db_payments_dated(from, to, &cursor, rows, limit, &more);
+    out_range_header(out, found, more, &cursor);
+    for (int i = 0; i < found; i++)
+        out_payment_row(out, "ROW", &rows[i]);
+    free(rows);
+    return COMMAND_DONE;
+}
+
+// -- Queries --
+// OK|<rows>, COLS|<names...>, then up to COMMAND_MAX_ROWS ROW lines;
+// EXPLAIN answers OK|<lines> and PLAN lines instead
+static int cmd_query(const CommandArgs *a, OutBuffer *out)
+{
+    QueryResult result;
+    char number[32];
+    if (db_query(a->str[0], &result) != DB_OK)
+    {
+        out_printf(out, "ERR|%s|%s\n", db_status_name(DB_INVALID), result.error);
+        return COMMAND_DONE;
+    }
+    if (result.explain)
+    {
+        out_printf(out, "OK|%d\n", result.plan_lines);
+        for (int i = 0; i < result.plan_lines; i++)
+            out_printf(out, "PLAN|%s\n", result.plan[i]);
+        query_result_free(&result);
+        return COMMAND_DONE;
+    }
+    out_printf(out, "OK|%zu\nCOLS", result.rows);
+    for (int c = 0; c < result.columns; c++)
+        out_printf(out, "|%s", result.names[c]);
+    out_printf(out, "\n");
+    for (size_t r = 0; r < result.rows && r < COMMAND_MAX_ROWS; r++)
+    {
+        out_printf(out, "ROW");
+        for (int c = 0; c < result.columns; c++)
+            out_printf(out, "|%s", query_cell_text(&result.cells[r * result.columns + c], number, sizeof(number)));
+        out_printf(out, "\n");
+    }
+    query_result_free(&result);
+    return COMMAND_DONE;
+}
+
+// OK|<members>|<expected>|<paid>|<pending>, then the first <limit> members
+// by balance as ROW|memberId|bookings|expected|paid|pending|balance
+static int cmd_reconcile(const CommandArgs *a, OutBuffer *out)
+{
+    if (a->num[0] < 0)
+    {
+        out_status(out, DB_INVALID);
+        return COMMAND_DONE;
+    }
+    ReconcileReport report;
+    db_reconcile_billing(&report, join_default_threads());
+    out_printf(out, "OK|%zu|%lld|%lld|%lld\n", report.count, (long long)report.expected, (long long)report.paid,
+               (long long)report.pending);
+    for (size_t i = 0; i < report.count && i < (size_t)a->num[0] && i < COMMAND_MAX_ROWS; i++)
+    {
+        const ReconcileRow *row = &report.rows[i];
+        out_printf(out, "ROW|%d|%d|%lld|%lld|%lld|%lld\n", row->memberId, row->bookings, (long long)row->expected,
+                   (long long)row->paid, (long long)row->pending, (long long)(row->expected - row->paid));
+    }
+    reconcile_report_free(&report);
+    return COMMAND_DONE;
+}
+
+// AGGREGATE|name|key answers one key's count and sum; key '*' the totals
+static int cmd_aggregate(const CommandArgs *a, OutBuffer *out)
+{
+    int64_t count, sum;
+    char *end;
+    long key = strtol(a->str[1], &end, 10);
+    DbStatus rc;
+    if (strcmp(a->str[1], "*") == 0)
+        rc = db_aggregate_total(a->str[0], &count, &sum);
+    else if (end != a->str[1] && *end == '\0' && key >= INT32_MIN && key <= INT32_MAX)
+        rc = db_aggregate_get(a->str[0], (int)key, &count, &sum);
+    else
+        rc = DB_INVALID;
+    if (rc != DB_OK)
+        out_status(out, rc);
+    else
+        out_printf(out, "OK|%lld|%lld\n", (long long)count, (long long)sum);
+    return COMMAND_DONE;
+}
+
+static int cmd_verify_aggregates(const CommandArgs *a, OutBuffer *out)
+{
+    (void)a;
+    MatVerifyReport report;
+    size_t drifted = mat_aggregates_verify(&report);
+    size_t cells = 0;
+    for (int i = 0; i < MAT_AGGREGATES; i++)
+        cells += report.cells[i];
+    out_printf(out, "OK|%zu|%zu\n", cells, drifted);
+    return COMMAND_DONE;
+}
+
+// -- Transactions --
+static int cmd_begin(const CommandArgs *a, OutBuffer *out)
+{
+    Txn *txn = (Txn *)malloc(sizeof(Txn));
+    if (!txn) {
+        perror("Failed to allocate transaction");
+        exit(1);
+    }
+    txn_begin(txn);
+    a->session->txn = txn;
+    out_printf(out, "OK\n");
+    return COMMAND_DONE;
+}
+
+// "OK|<statements>", or why nothing was applied
+static int cmd_commit(const CommandArgs *a, OutBuffer *out)
+{
+    Txn *txn = a->session->txn;
+    if (!txn)
+    {
+        out_printf(out, "ERR|NO_TRANSACTION\n");
+        return COMMAND_DONE;
+    }
+    DbStatus rc = txn_commit(txn);
+    if (rc == DB_OK)
+        out_printf(out, "OK|%d\n", txn->write_count);
+    else if (rc == DB_CONFLICT)
+        out_printf(out, "ERR|CONFLICT|%d\n", txn->conflict_id);
+    else
+        out_status(out, rc);
+    free(txn);
+    a->session->txn = NULL;
+    return COMMAND_DONE;
+}
+
+static int cmd_abort(const CommandArgs *a, OutBuffer *out)
+{
+    Txn *txn = a->session->txn;
+    if (!txn)
+    {
+        out_printf(out, "ERR|NO_TRANSACTION\n");
+        return COMMAND_DONE;
+    }
+    txn_abort(txn);
+    free(txn);
+    a->session->txn = NULL;
+    out_printf(out, "OK\n");
+    return COMMAND_DONE;
+}
+
+static int cmd_txn_stats(const CommandArgs *a, OutBuffer *out)
+{
+    (void)a;
+    out_printf(out, "OK|%lu|%lu|%lu|%lu|%lu\n", (unsigned long)atomic_load(&txn_begun),
+               (unsigned long)atomic_load(&txn_committed), (unsigned long)atomic_load(&txn_aborted),
+               (unsigned long)atomic_load(&txn_failed), (unsigned long)atomic_load(&txn_retries));
+    return COMMAND_DONE;
+}
+
+// -- Session --
+static int cmd_ping(const CommandArgs *a, OutBuffer *out)
+{
+    (void)a;
+    out_printf(out, "OK|PONG\n");
+    return COMMAND_DONE;
+}
+
+// Makes every earlier command durable before its response is released
+static int cmd_sync(const CommandArgs *a, OutBuffer *out)
+{
+    (void)a;
+    wal_commit_deferred();
+    out_printf(out, "OK\n");
+    return COMMAND_FLUSH;
+}
+
+// Checkpoint: snapshot + WAL rotation (as option 99, without exiting)
+static int cmd_save(const CommandArgs *a, OutBuffer *out)
+{
+    (void)a;
+    wal_commit_deferred();
+    if (wal_checkpoint() == 0)
+        out_printf(out, "OK\n");
+    else
+        out_printf(out, "ERR|IO_ERROR\n");
+    return COMMAND_FLUSH;
+}
+
+// Starts a background save and answers at once; SAVE waits for one to finish
+static int cmd_bgsave(const CommandArgs *a, OutBuffer *out)
+{
+    (void)a;
+    wal_commit_deferred();
+    switch (bgsave_start())
+    {
+    case BGSAVE_STARTED: out_printf(out, "OK\n"); break;
+    case BGSAVE_BUSY: out_printf(out, "ERR|BUSY\n"); break;
+    default: out_printf(out, "ERR|IO_ERROR\n");
+    }
+    return COMMAND_FLUSH;
+}
+
+static const CommandSpec command_table[] = {
+    { "ADD_MEMBER", "ss", cmd_add_member, 0 },
+    { "GET_MEMBER", "i", cmd_get_member, 1 },
+    { "FIND_MEMBER", "s", cmd_find_member, 0 },
+    { "UPDATE_MEMBER", "is", cmd_update_member, 0 },
+    { "DELETE_MEMBER", "i", cmd_delete_member, 0 },
+    { "ADD_WORKSPACE", "ssii", cmd_add_workspace, 0 },
+    { "GET_WORKSPACE", "i", cmd_get_workspace, 1 },
+    { "UPDATE_WORKSPACE", "iii", cmd_update_workspace, 1 },
+    { "DELETE_WORKSPACE", "i", cmd_delete_workspace, 0 },
+    { "OCCUPANCY", "iss", cmd_occupancy, 0 },
+    { "ADD_BOOKING", "iisss", cmd_add_booking, 1 },
+    { "GET_BOOKING", "i", cmd_get_booking, 1 },
+    { "UPDATE_BOOKING", "is", cmd_update_booking, 1 },
+    { "DELETE_BOOKING", "i", cmd_delete_booking, 1 },
+    { "MEMBER_BOOKINGS", "i", cmd_member_bookings, 0 },
+    { "BOOKINGS_BETWEEN", "ssis", cmd_bookings_between, 0 },
+    { "ADD_PAYMENT", "iiss", cmd_add_payment, 1 },
+    { "GET_PAYMENT", "i", cmd_get_payment, 1 },
+    { "UPDATE_PAYMENT", "is", cmd_update_payment, 1 },
+    { "DELETE_PAYMENT", "i", cmd_delete_payment, 1 },
+    { "BOOKING_PAYMENTS", "i", cmd_booking_payments, 0 },
+    { "PAYMENTS_BETWEEN", "ssis", cmd_payments_between, 0 },
+    { "QUERY", "s", cmd_query, 0 },
+    { "RECONCILE", "i", cmd_reconcile, 0 },
+    { "AGGREGATE", "ss", cmd_aggregate, 0 },
+    { "VERIFY_AGGREGATES", "", cmd_verify_aggregates, 0 },
+    { "BEGIN", "", cmd_begin, 0 },
+    { "COMMIT", "", cmd_commit, 1 },
+    { "ABORT", "", cmd_abort, 1 },
+    { "TXN_STATS", "", cmd_txn_stats, 1 },
+    { "PING", "", cmd_ping, 1 },
+    { "SYNC", "", cmd_sync, 0 },
+    { "SAVE", "", cmd_save, 0 },
+    { "BGSAVE", "", cmd_bgsave, 0 },
+};
+
+// 0 and *value set for a whole decimal int, -1 otherwise
+static int parse_int_field(const char *text, int *value)
+{
+    char *end;
+    errno = 0;
+    long n = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || n < INT32_MIN || n > INT32_MAX)
+        return -1;
+    *value = (int)n;
+    return 0;
+}
+
+// Runs one command line (modified in place). Blank lines and '#' comments
+// produce no response. Returns COMMAND_FLUSH when the caller should release
+// buffered responses now, COMMAND_SKIPPED for no-ops, otherwise COMMAND_DONE.
+int execute_command(char *line, OutBuffer *out, CommandSession *session)
+{
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#')
+        return COMMAND_SKIPPED;
+
+    char *fields[COMMAND_MAX_FIELDS + 1];
+    int count = 0;
+    for (char *cursor = line; count <= COMMAND_MAX_FIELDS; count++)
+    {
+        fields[count] = cursor;
+        cursor = strchr(cursor, '|');
+        if (!cursor)
+        {
+            count++;
+            break;
+        }
+        *cursor++ = '\0';
+    }
+
+    const CommandSpec *spec = NULL;
+    for (size_t i = 0; i < sizeof(command_table) / sizeof(command_table[0]); i++)
+        if (strcmp(command_table[i].name, fields[0]) == 0)
+            spec = &command_table[i];
+    if (!spec)
+    {
+        out_printf(out, "ERR|UNKNOWN_COMMAND|%s\n", fields[0]);
+        return COMMAND_DONE;
+    }
+    if (session->txn && !spec->in_txn)
+    {
+        out_printf(out, "ERR|IN_TRANSACTION|%s\n", spec->name);
+        return COMMAND_DONE;
+    }
+
+    int expected = (int)strlen(spec->types);
+    if (count - 1 != expected)
+    {
+        out_printf(out, "ERR|BAD_ARGS|%s expects %d field(s)\n", spec->name, expected);
+        return COMMAND_DONE;
+    }
+    CommandArgs args;
+    args.session = session;
+    for (int i = 0; i < expected; i++)
+    {
+        args.str[i] = fields[i + 1];
+        args.num[i] = 0;
+        if (spec->types[i] == 'i' && parse_int_field(fields[i + 1], &args.num[i]) != 0)
+        {
+            out_printf(out, "ERR|BAD_ARGS|field %d of %s must be a number\n", i + 1, spec->name);
+            return COMMAND_DONE;
+        }
+    }
+    return spec->run(&args, out);
+}
+
+/*
+ * ==========================================
+ * COMMAND-LINE TOOLS & BENCHMARKS
+ * ==========================================
+ */
+
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s                      Interactive menu\n", prog);
+    printf("       %s --import-csv         Convert the CSV files into %s\n", prog, SNAPSHOT_FILE);
+    printf("       %s --export-csv         Write %s out as CSV files\n", prog, SNAPSHOT_FILE);
+    printf("       %s --bench-index [N]    Index microbenchmark (default N = 1000000)\n", prog);
+    printf("       %s --bench-startup [N]  CSV vs snapshot load time (default N = 1000000)\n", prog);
+    printf("       %s --bench-range [N]    Time-range queries: list scan vs B+tree (default N = 1000000)\n", prog);
+    printf("       %s --bench-join [N]     Billing reconciliation: nested loop vs hash join (default N = 1000000)\n", prog);
+    printf("       %s --bench-aggregates [N]  Running totals vs scans, with drift check (default N = 1000000)\n", prog);
+    printf("       %s --bench-txn [N]      Book-and-pay transactions under a concurrent writer (default N = 100000)\n", prog);
+    printf("       %s --bench [options]    Multi-threaded CRUD load generator:\n", prog);
+    printf("           --threads N (4)  --ops N (1000000)  --size N rows per table (100000)\n");
+    printf("           --mix R:W:L read/write/lookup %% (70:20:10)  --dist uniform|zipf  --theta X (0.99)\n");
+    printf("           --seed N (42)  --no-wal\n");
+    printf("       %s --batch [FILE] [--sync-every N]\n", prog);
+    printf("           Run '|'-separated commands from FILE (or stdin); one response line each.\n");
+    printf("           Argument types after each name: i = number, s = text.\n");
+    printf("           *_BETWEEN take from|to|limit|cursor and answer OK|<rows>|<next cursor or END>.\n");
+    printf("           QUERY takes [EXPLAIN] SELECT ... FROM table [WHERE] [GROUP BY] [ORDER BY] [LIMIT].\n");
+    printf("           RECONCILE|limit answers expected/paid/pending totals and the top members by balance.\n");
+    printf("           AGGREGATE|name|key answers OK|count|sum from the running totals (key * = all keys).\n");
+    printf("           VERIFY_AGGREGATES recounts them from the rows and answers OK|<keys>|<drifted>.\n");
+    printf("           BEGIN ... COMMIT runs GET_*, UPDATE_WORKSPACE and booking/payment writes as one\n");
+    printf("           transaction (ABORT drops it); COMMIT answers OK|<statements> or ERR|ABORTED.\n");
+    printf("           Responses are released after their WAL group is durable (every N = %d).\n", BATCH_SYNC_EVERY);
+    size_t commands = sizeof(command_table) / sizeof(command_table[0]);
+    for (size_t i = 0; i < commands; i++)
+        printf("%s%s|%s", i % 6 == 0 ? (i ? "\n           " : "           Commands: ") : ", ",
+               command_table[i].name, command_table[i].types);
+    printf("\n");
+    printf("       %s --serve [--port N (%d)] [--bind ADDR (127.0.0.1)] [--workers N (%d)] [--save-every SEC]\n", prog,
+           SERVER_PORT, SERVER_WORKERS);
+    printf("           TCP server for the same commands. Frames are a 4-byte big-endian length\n");
+    printf("           followed by one command; each response frame holds that command's lines.\n");
+    printf("           --save-every runs a background save (BGSAVE) every SEC seconds.\n");
+    printf("       %s --loadtest [options]  Loopback client for --serve:\n", prog);
+    printf("           --host ADDR (127.0.0.1)  --port N  --connections N (8)  --ops N (200000)\n");
+    printf("           --pipeline N requests in flight per connection (16)  --keys N (10000)  --mix R:W (80:20)\n");
+}
+
+// Reads the optional [N] argument of a benchmark mode
+static int parse_count_arg(int argc, char *argv[], int fallback)
+{
+    int n = argc > 2 ? atoi(argv[2]) : fallback;
+    if (n <= 0)
+    {
+        printf("Error: N must be positive.\n");
+        return -1;
+    }
+    return n;
+}
+
+// CSV -> snapshot conversion (the CSV files are left untouched)
+static int import_csv_tool()
+{
+    init_database();
+    load_csv_data();
+    if (save_snapshot(SNAPSHOT_FILE) != 0)
+    {
+        printf("Error: could not write %s.\n", SNAPSHOT_FILE);
+        return 1;
+    }
+    // The old log described the database we just replaced
+    unlink(WAL_FILE);
+    unlink(WAL_PREV_FILE);
+    printf("Imported %zu members, %zu workspaces, %zu bookings, %zu payments into %s.\n",
+           member_count(), index_count(&workspace_index),
+           index_count(&booking_index), index_count(&payment_index), SNAPSHOT_FILE);
+    csv_print_load_stats();
+    reset_all_tables();
+    return 0;
+}
+
+// Snapshot -> CSV conversion
+static int export_csv_tool()
+{
+    init_database();
+    int rc = load_snapshot(SNAPSHOT_FILE);
+    if (rc != SNAPSHOT_OK)
+    {
+        printf("Error: %s is %s.\n", SNAPSHOT_FILE, rc == SNAPSHOT_MISSING ? "missing" : "damaged");
+        return 1;
+    }
+    wal_recover(); // Export what a restart would see, not just the last checkpoint
+    save_csv_data();
+    printf("Exported %zu members, %zu workspaces, %zu bookings, %zu payments to CSV.\n",
+           member_count(), index_count(&workspace_index),
+           index_count(&booking_index), index_count(&payment_index));
+    reset_all_tables();
+    return 0;
+}
+
+int run_command_line(int argc, char *argv[])
+{
+    if (strcmp(argv[1], "--import-csv") == 0)
+        return import_csv_tool();
+    if (strcmp(argv[1], "--export-csv") == 0)
+        return export_csv_tool();
+
+    if (strcmp(argv[1], "--bench-index") == 0)
+    {
+        int n = parse_count_arg(argc, argv, 1000000);
+        if (n < 0)
+            return 1;
+        run_index_benchmark(n);
+        return 0;
+    }
+    if (strcmp(argv[1], "--bench-startup") == 0)
+    {
+        int n = parse_count_arg(argc, argv, 1000000);
+        if (n < 0)
+            return 1;
+        run_startup_benchmark(n);
+        return 0;
+    }
+    if (strcmp(argv[1], "--bench-range") == 0)
+    {
+        int n = parse_count_arg(argc, argv, 1000000);
+        if (n < 0)
+            return 1;
+        run_range_benchmark(n);
+        return 0;
+    }
+    if (strcmp(argv[1], "--bench-join") == 0)
+    {
+        int n = parse_count_arg(argc, argv, 1000000);
+        if (n < 0)
+            return 1;
+        run_join_benchmark(n);
+        return 0;
+    }
+    if (strcmp(argv[1], "--bench-aggregates") == 0)
+    {
+        int n = parse_count_arg(argc, argv, 1000000);
+        if (n < 0)
+            return 1;
+        run_aggregate_benchmark(n);
+        return 0;
+    }
+    if (strcmp(argv[1], "--bench-txn") == 0)
+    {
+        int n = parse_count_arg(argc, argv, 100000);
+        if (n < 0)
+            return 1;
+        run_txn_benchmark(n);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "--bench") == 0)
+        return crud_bench_tool(argc, argv);
+    if (strcmp(argv[1], "--batch") == 0)
+        return batch_tool(argc, argv);
+    if (strcmp(argv[1], "--serve") == 0)
+        return server_tool(argc, argv);
+    if (strcmp(argv[1], "--loadtest") == 0)
+        return loadtest_tool(argc, argv);
+
+    print_usage(argv[0]);
+    return strcmp(argv[1], "--help") == 0 ? 0 : 1;
+}
+
+// xorshift64*: cheap deterministic randomness for benchmark key orders
+static uint64_t bench_rand(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+// -- Legacy Chained Index (baseline for --bench-index) --
+// The original fixed 1009-bucket chaining scheme, kept only for comparison.
+#define LEGACY_INDEX_SIZE 1009
+
+typedef struct LegacyIndexNode
+{
+    int key;
+    void *target;
+    struct LegacyIndexNode *next;
+} LegacyIndexNode;
+
+typedef struct
+{
+    LegacyIndexNode *buckets[LEGACY_INDEX_SIZE];
+    Slab nodes;
+} LegacyChainIndex;
+
+static void legacy_insert(LegacyChainIndex *idx, int key, void *target)
+{
+    LegacyIndexNode *node = (LegacyIndexNode *)slab_alloc(&idx->nodes);
+    node->key = key;
+    node->target = target;
+    node->next = idx->buckets[key % LEGACY_INDEX_SIZE];
+    idx->buckets[key % LEGACY_INDEX_SIZE] = node;
+}
+
+static void *legacy_find(LegacyChainIndex *idx, int key)
+{
+    for (LegacyIndexNode *curr = idx->buckets[key % LEGACY_INDEX_SIZE]; curr; curr = curr->next)
+        if (curr->key == key)
+            return curr->target;
+    return NULL;
+}
+
+static void legacy_remove(LegacyChainIndex *idx, int key)
+{
+    LegacyIndexNode **link = &idx->buckets[key % LEGACY_INDEX_SIZE];
+    while (*link)
+    {
+        if ((*link)->key == key)
+        {
+            LegacyIndexNode *dead = *link;
+            *link = dead->next;
+            slab_free(&idx->nodes, dead);
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+static void bench_report(const char *op, long long legacy_ns, long long robin_ns, int n)
+{
+    printf("%-22s | %14.1f | %14.1f | %7.1fx\n", op,
+           (double)legacy_ns / n, (double)robin_ns / n,
+           robin_ns > 0 ? (double)legacy_ns / robin_ns : 0.0);
+}
+
+// -- Legacy Member Rows (baseline for --bench-index) --
+// Fixed 100-byte name and email inside every node, as members were stored
+// before the string heap.
+typedef struct LegacyMemberNode
+{
+    Member data;
+    struct LegacyMemberNode *next;
+} LegacyMemberNode;
+
+// Same rows in both layouts, reached through the same pointer array, so only
+// the row format differs
+static void run_member_layout_benchmark(int n, const int *order)
+{
+    static const char *first[] = {"Ana", "Omar", "Li Wei", "Sofia", "Ahmed", "Grace", "Mateo", "Yuki"};
+    static const char *last[] = {"Haddad", "Ng", "Okafor", "Schmidt", "Rossi", "Park", "Costa", "Ali"};
+    Slab legacy_slab;
+    slab_init(&legacy_slab, "Legacy Members", sizeof(LegacyMemberNode));
+    LegacyMemberNode **legacy = (LegacyMemberNode **)calloc(n + 1, sizeof(LegacyMemberNode *));
+    MemberNode **compact = (MemberNode **)calloc(n + 1, sizeof(MemberNode *));
+    LegacyMemberNode *legacy_head = NULL, **legacy_tail = &legacy_head;
+
+    init_database();
+    for (int i = 1; i <= n; i++)
+    {
+        Member m;
+        memset(&m, 0, sizeof(m));
+        m.memberId = i;
+        snprintf(m.name, sizeof(m.name), "%s %s", first[i % 8], last[(i / 8) % 8]);
+        snprintf(m.email, sizeof(m.email), "member%d@flexdesk.io", i);
+
+        LegacyMemberNode *node = (LegacyMemberNode *)slab_alloc(&legacy_slab);
+        node->data = m;
+        node->next = NULL;
+        *legacy_tail = node;
+        legacy_tail = &node->next;
+        legacy[i] = node;
+        compact[i] = insert_member_node(&m);
+    }
+    next_member_id = n + 1;
+
+    long long t, legacy_scan, compact_scan, legacy_get, compact_get;
+    uintptr_t checksum = 0;
+    Member row;
+
+    // Full scan copying every row out, as snapshots and exports do
+    t = now_ns();
+    for (LegacyMemberNode *curr = legacy_head; curr; curr = curr->next)
+    {
+        row = curr->data;
+        checksum += row.memberId + (unsigned char)row.email[7];
+    }
+    legacy_scan = now_ns() - t;
+
+    t = now_ns();
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+        for (MemberNode *curr = member_stripes[i].head; curr; curr = curr->next)
+        {
+            member_decode(curr, &row);
+            checksum += row.memberId + (unsigned char)row.email[7];
+        }
+    compact_scan = now_ns() - t;
+
+    // Random lookups by id, copying the row out like db_get_member
+    t = now_ns();
+    for (int i = 0; i < n; i++)
+    {
+        row = legacy[order[i]]->data;
+        checksum += (unsigned char)row.name[0];
+    }
+    legacy_get = now_ns() - t;
+
+    t = now_ns();
+    for (int i = 0; i < n; i++)
+    {
+        member_decode(compact[order[i]], &row);
+        checksum += (unsigned char)row.name[0];
+    }
+    compact_get = now_ns() - t;
+
+    size_t heap_bytes = 0;
+    for (int i = 0; i < MEMBER_STRIPES; i++)
+        heap_bytes += member_stripes[i].heap.live_bytes;
+
+    printf("\n--- Member Row Layout (N = %d) ---\n", n);
+    printf("%-22s | %14s | %14s | %8s\n", "Operation (ns/op)", "Fixed 2x100", "Compact", "Speedup");
+    printf("-----------------------|----------------|----------------|---------\n");
+    bench_report("Scan (copy rows)", legacy_scan, compact_scan, n);
+    bench_report("Lookup by id (copy)", legacy_get, compact_get, n);
+    printf("%-22s | %14zu | %14.1f |\n", "Bytes per member", sizeof(LegacyMemberNode),
+           sizeof(MemberNode) + (double)heap_bytes / n);
+    printf("(checksum %lu)\n", (unsigned long)checksum);
+
+    reset_all_tables();
+    slab_release(&legacy_slab);
+    free(legacy);
+    free(compact);
+}
+
+void run_index_benchmark(int n)
+{
+    // Lookups run in a shuffled order so neither index gets sequential access for free
+    int *order = (int *)malloc(sizeof(int) * n);
+    uint64_t seed = 88172645463325252ULL;
+    for (int i = 0; i < n; i++)
+        order[i] = i + 1;
+    for (int i = n - 1; i > 0; i--)
+    {
+        int j = (int)(bench_rand(&seed) % (uint64_t)(i + 1));
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    LegacyChainIndex *legacy = (LegacyChainIndex *)calloc(1, sizeof(LegacyChainIndex));
+    slab_init(&legacy->nodes, "Legacy Index", sizeof(LegacyIndexNode));
+    HashIndex robin;
+    index_init(&robin, "Robin Hood");
+
+    long long t, legacy_ins, robin_ins, legacy_hit, robin_hit, legacy_miss, robin_miss, legacy_del, robin_del;
+    long long legacy_worst = 0, robin_worst = 0;
+    uintptr_t checksum = 0;
+
+    // Inserts (IDs arrive in ascending order, as they do from next_*_id)
+    t = now_ns();
+    for (int i = 1; i <= n; i++)
+    {
+        long long t0 = now_ns();
+        legacy_insert(legacy, i, (void *)(uintptr_t)i);
+        long long dt = now_ns() - t0;
+        if (dt > legacy_worst) legacy_worst = dt;
+    }
+    legacy_ins = now_ns() - t;
+
+    t = now_ns();
+    for (int i = 1; i <= n; i++)
+    {
+        long long t0 = now_ns();
+        index_insert(&robin, (uint64_t)i, (void *)(uintptr_t)i);
+        long long dt = now_ns() - t0;
+        if (dt > robin_worst) robin_worst = dt;
+    }
+    robin_ins = now_ns() - t;
+
+    // Successful lookups
+    t = now_ns();
+    for (int i = 0; i < n; i++)
+        checksum += (uintptr_t)legacy_find(legacy, order[i]);
+    legacy_hit = now_ns() - t;
+
+    t = now_ns();
+    for (int i = 0; i < n; i++)
+        checksum += (uintptr_t)index_find(&robin, (uint64_t)order[i]);
+    robin_hit = now_ns() - t;
+
+    // Failed lookups (IDs past the end)
+    t = now_ns();
+    for (int i = 0; i < n; i++)
+        checksum += (uintptr_t)legacy_find(legacy, n + order[i]);
+    legacy_miss = now_ns() - t;
+
+    t = now_ns();
+    for (int i = 0; i < n; i++)
+        checksum += (uintptr_t)index_find(&robin, (uint64_t)(n + order[i]));
+    robin_miss = now_ns() - t;
+
+    // Deletes
+    t = now_ns();
+    for (int i = 0; i < n; i++)
+        legacy_remove(legacy, order[i]);
+    legacy_del = now_ns() - t;
+
+    t = now_ns();
+    for (int i = 0; i < n; i++)
+        index_remove(&robin, (uint64_t)order[i]);
+    robin_del = now_ns() - t;
+
+    printf("\n--- Index Microbenchmark (N = %d) ---\n", n);
+    printf("%-22s | %14s | %14s | %8s\n", "Operation (ns/op)", "Chained(1009)", "Robin Hood", "Speedup");
+    printf("-----------------------|----------------|----------------|---------\n");
+    bench_report("Insert", legacy_ins, robin_ins, n);
+    bench_report("Lookup (hit)", legacy_hit, robin_hit, n);
+    bench_report("Lookup (miss)", legacy_miss, robin_miss, n);
+    bench_report("Delete", legacy_del, robin_del, n);
+    printf("%-22s | %14lld | %14lld |\n", "Worst insert (ns)", legacy_worst, robin_worst);
+    printf("Robin Hood resizes: %lu (incremental, %lu entries migrated)\n", robin.resizes, robin.migrated);
+    printf("(checksum %lu)\n", (unsigned long)checksum);
+
+    index_free(&robin);
+    slab_release(&legacy->nodes);
+    free(legacy);
+
+    run_member_layout_benchmark(n, order);
+    free(order);
+}
+
+// Fills every table with n synthetic rows (n / 10 workspaces) for benchmarks
+static void generate_bench_data(int n)
+{
+    int workspaces = n / 10 > 0 ? n / 10 : 1;
+    for (int i = 1; i <= n; i++)
+    {
+        Member m;
+        memset(&m, 0, sizeof(m));
+        m.memberId = i;
+        snprintf(m.name, sizeof(m.name), "Member %d", i);
+        snprintf(m.email, sizeof(m.email), "member%d@flexdesk.test", i);
+        insert_member_node(&m);
+    }
+    for (int i = 1; i <= workspaces; i++)
+    {
+        Workspace w;
+        memset(&w, 0, sizeof(w));
+        w.workspaceId = i;
+        strcpy(w.type, i % 5 == 0 ? "Meeting Room" : "Hot Desk");
+        snprintf(w.location, sizeof(w.location), "Floor %d", i % 12 + 1);
+        w.capacity = i % 5 == 0 ? 8 : 1;
+        w.price_in_cents = i % 5 == 0 ? 4500 : 1500;
+        insert_workspace_node(&w);
+    }
+    for (int i = 1; i <= n; i++)
+    {
+        Booking b;
+        memset(&b, 0, sizeof(b));
+        b.bookingId = i;
+        b.memberId = i;
+        b.workspaceId = i % workspaces + 1;
+        snprintf(b.startTime, sizeof(b.startTime), "2026-%02d-%02dT09:00", i % 12 + 1, i % 28 + 1);
+        snprintf(b.endTime, sizeof(b.endTime), "2026-%02d-%02dT17:00", i % 12 + 1, i % 28 + 1);
+        strcpy(b.status, "Confirmed");
+        insert_booking_node(&b);
+    }
+    for (int i = 1; i <= n; i++)
+    {
+        Payment p;
+        memset(&p, 0, sizeof(p));
+        p.paymentId = i;
+        p.bookingId = i;
+        p.amount_in_cents = 1500;
+        snprintf(p.paymentDate, sizeof(p.paymentDate), "2026-%02d-%02d", i % 12 + 1, i % 28 + 1);
+        strcpy(p.status, "Paid");
+        insert_payment_node(&p);
+    }
+    next_member_id = next_booking_id = next_payment_id = n + 1;
+    next_workspace_id = workspaces + 1;
+}
+
+static long long file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_size : 0;
+}
+
+// Writes the same dataset in both formats inside a scratch directory and
+// times a cold-process-style load of each (tables emptied in between).
+void run_startup_benchmark(int n)
+{
+    char original_dir[1024];
+    char scratch[] = "/tmp/flexdesk_bench_XXXXXX";
+    if (!getcwd(original_dir, sizeof(original_dir)) || !mkdtemp(scratch) || chdir(scratch) != 0)
+    {
+        printf("Error: could not create a scratch directory.\n");
+        return;
+    }
+
+    init_database();
+    generate_bench_data(n);
+    save_csv_data();
+    save_snapshot(SNAPSHOT_FILE);
+    long long csv_bytes = file_size(MEMBERS_FILE) + file_size(WORKSPACES_FILE) +
+                          file_size(BOOKINGS_FILE) + file_size(PAYMENTS_FILE);
+    long long snap_bytes = file_size(SNAPSHOT_FILE);
+
+    reset_all_tables();
+    long long t = now_ns();
+    load_csv_data();
+    long long csv_ns = now_ns() - t;
+    size_t csv_rows = member_count() + index_count(&workspace_index) +
+                      index_count(&booking_index) + index_count(&payment_index);
+
+    reset_all_tables();
+    t = now_ns();
+    int rc = load_snapshot(SNAPSHOT_FILE);
+    long long snap_ns = now_ns() - t;
+    size_t snap_rows = member_count() + index_count(&workspace_index) +
+                       index_count(&booking_index) + index_count(&payment_index);
+    reset_all_tables();
+
+    printf("\n--- Startup Benchmark (N = %d per table) ---\n", n);
+    printf("%-10s | %12s | %12s | %10s\n", "Format", "Rows", "File MB", "Load ms");
+    printf("-----------|--------------|--------------|-----------\n");
+    printf("%-10s | %12zu | %12.1f | %10.1f\n", "CSV", csv_rows, csv_bytes / (1024.0 * 1024.0), csv_ns / 1e6);
+    printf("%-10s | %12zu | %12.1f | %10.1f%s\n", "Snapshot", snap_rows, snap_bytes / (1024.0 * 1024.0), snap_ns / 1e6,
+           rc == SNAPSHOT_OK ? "" : "  (load failed)");
+    if (snap_ns > 0)
+        printf("Snapshot startup is %.1fx faster.\n", (double)csv_ns / snap_ns);
+    printf("CSV tables (loaded concurrently):\n");
+    csv_print_load_stats();
+
+    unlink(MEMBERS_FILE);
+    unlink(WORKSPACES_FILE);
+    unlink(BOOKINGS_FILE);
+    unlink(PAYMENTS_FILE);
+    unlink(SNAPSHOT_FILE);
+    if (chdir(original_dir) == 0)
+        rmdir(scratch);
+}
+
+// Range queries over n generated bookings and payments, answered by walking
+// the insertion-ordered list and comparing the time strings of every row (the
+// only way before the ordered indexes) and by the B+tree range scans
+void run_range_benchmark(int n)
+{
+    static const struct { const char *label, *from, *to; } booking_ranges[] = {
+        { "Bookings, one week", "2026-03-01T00:00", "2026-03-08T00:00" },
+        { "Bookings, one day", "2026-06-14T00:00", "2026-06-15T00:00" },
+    };
+    static const struct { const char *label, *from, *to; } payment_ranges[] = {
+        { "Payments, one month", "2026-03-01", "2026-04-01" },
+        { "Payments, one day", "2026-06-14", "2026-06-15" },
+    };
+    const int max = COMMAND_MAX_ROWS;
+    Booking *brows = (Booking *)malloc(max * sizeof(Booking));
+    Payment *prows = (Payment *)malloc(max * sizeof(Payment));
+
+    init_database();
+    long long t = now_ns();
+    generate_bench_data(n);
+    long long build_ns = now_ns() - t;
+
+    printf("\n--- Range Query Benchmark (N = %d bookings and payments) ---\n", n);
+    printf("%-22s | %10s | %14s | %14s | %8s\n", "Query", "Rows", "List scan ms", "B+tree ms", "Speedup");
+    printf("-----------------------|------------|----------------|----------------|---------\n");
+    for (size_t q = 0; q < sizeof(booking_ranges) / sizeof(booking_ranges[0]); q++)
+    {
+        const char *from = booking_ranges[q].from, *to = booking_ranges[q].to;
+        long scanned = 0, ranged = 0;
+        t = now_ns();
+        for (BookingNode *node = first_booking(); node; node = next_booking(node))
+        {
+            Booking b;
+            booking_read(node, &b);
+            if (strcmp(b.startTime, from) >= 0 && strcmp(b.startTime, to) < 0)
+                scanned++;
+        }
+        long long scan_ns = now_ns() - t;
+
+        t = now_ns();
+        OrderedKey cursor = { parse_booking_time(from), 0 };
+        int more;
+        do
+            ranged += db_bookings_starting(cursor.time, parse_booking_time(to), &cursor, brows, max, &more);
+        while (more);
+        long long tree_ns = now_ns() - t;
+        printf("%-22s | %10ld | %14.2f | %14.2f | %7.1fx%s\n", booking_ranges[q].label, ranged, scan_ns / 1e6,
+               tree_ns / 1e6, tree_ns > 0 ? (double)scan_ns / tree_ns : 0.0, scanned == ranged ? "" : "  (MISMATCH)");
+    }
+    for (size_t q = 0; q < sizeof(payment_ranges) / sizeof(payment_ranges[0]); q++)
+    {
+        const char *from = payment_ranges[q].from, *to = payment_ranges[q].to;
+        long scanned = 0, ranged = 0;
+        t = now_ns();
+        for (PaymentNode *node = first_payment(); node; node = next_payment(node))
+        {
+            Payment p;
+            payment_read(node, &p);
+            if (strcmp(p.paymentDate, from) >= 0 && strcmp(p.paymentDate, to) < 0)
+                scanned++;
+        }
+        long long scan_ns = now_ns() - t;
+
+        t = now_ns();
+        OrderedKey cursor = { parse_payment_date(from), 0 };
+        int more;
+        do
+            ranged += db_payments_dated(cursor.time, parse_payment_date(to), &cursor, prows, max, &more);
+        while (more);
+        long long tree_ns = now_ns() - t;
+        printf("%-22s | %10ld | %14.2f | %14.2f | %7.1fx%s\n", payment_ranges[q].label, ranged, scan_ns / 1e6,
+               tree_ns / 1e6, tree_ns > 0 ? (double)scan_ns / tree_ns : 0.0, scanned == ranged ? "" : "  (MISMATCH)");
+    }
+    printf("Load with both ordered indexes: %.1f ms. ", build_ns / 1e6);
+    printf("B+tree heights %d / %d, %lu + %lu nodes.\n", bookings_by_start.height, payments_by_date.height,
+           bookings_by_start.nodes.allocs - bookings_by_start.nodes.frees,
+           payments_by_date.nodes.allocs - payments_by_date.nodes.frees);
+
+    reset_all_tables();
+    free(brows);
+    free(prows);
+}
+
+// The same report as an index nested-loop join: one findWorkspaceNodeById
+// per booking and one findBookingNodeById per payment, under the read locks.
+static void reconcile_nested_loop(ReconcileReport *report)
+{
+    long long t = now_ns();
+    ReconcileAmounts *members = (ReconcileAmounts *)calloc((size_t)next_member_id + 1, sizeof(ReconcileAmounts));
+    if (!members) {
+        perror("Failed to allocate reconciliation");
+        exit(1);
+    }
+    memset(report, 0, sizeof(*report));
+    pthread_rwlock_rdlock(&workspaces_lock);
+    pthread_rwlock_rdlock(&bookings_lock);
+    pthread_rwlock_rdlock(&payments_lock);
+    for (BookingNode *b = first_booking(); b != NULL; b = next_booking(b))
+    {
+        WorkspaceNode *w = findWorkspaceNodeById(b->workspaceId);
+        if (!b->cancelled)
+        {
+            members[b->memberId].bookings++;
+            members[b->memberId].expected += w ? w->data.price_in_cents : 0;
+        }
+    }
+    for (PaymentNode *p = first_payment(); p != NULL; p = next_payment(p))
+    {
+        PaymentRecord record;
+        paged_read(&payment_pages, p->rid, &record);
+        BookingNode *b = findBookingNodeById(record.bookingId);
+        if (b && (str_flags(record.status) & STR_PAID) != 0)
+            members[b->memberId].paid += record.amount_in_cents;
+        else if (b)
+            members[b->memberId].pending += record.amount_in_cents;
+    }
+    pthread_rwlock_unlock(&payments_lock);
+    pthread_rwlock_unlock(&bookings_lock);
+    pthread_rwlock_unlock(&workspaces_lock);
+    report->extract_ms = (now_ns() - t) / 1e6;
+    reconcile_collect(members, next_member_id, report);
+    report->total_ms = (now_ns() - t) / 1e6;
+    free(members);
+}
+
+void run_join_benchmark(int n)
+{
+    int threads = join_default_threads();
+    init_database();
+    long long t = now_ns();
+    generate_bench_data(n);
+    // Every third payment pending, plus n/5 late payments for random bookings
     pthread_rwlock_wrlock(&payments_lock);
-    PaymentNode *node = findPaymentNodeById(id);
-    if (node)
+    int id = 0;
+    for (PaymentNode *node = first_payment(); node != NULL; node = next_payment(node))
+        if (++id % 3 == 0)
+        {
+            Payment p;
+            payment_read(node, &p);
+            strcpy(p.status, "Pending");
+            set_payment_data(node, &p);
+        }
+    pthread_rwlock_unlock(&payments_lock);
+    uint64_t seed = 42;
+    for (int i = 5; i <= n; i += 5)
+    {
+        Payment p = { next_payment_id, (int)(bench_rand(&seed) % n) + 1, 1500, "2026-07-01", "Paid" };
+        insert_payment_node(&p);
+        next_payment_id++;
+    }
+    long long build_ns = now_ns() - t;
+
+    printf("\n--- Hash Join Benchmark (%d bookings, %d payments, %d workspaces) ---\n", n,
+           next_payment_id - 1, next_workspace_id - 1);
+    printf("%-34s | %7s | %12s | %14s\n", "Method", "Threads", "Total ms", "Locks held ms");
+    printf("-----------------------------------|---------|--------------|---------------\n");
+    ReconcileReport loop;
+    reconcile_nested_loop(&loop);
+    printf("%-34s | %7d | %12.2f | %14.2f\n", "Nested loop (index lookup per row)", 1, loop.total_ms,
+           loop.extract_ms);
+
+    ReconcileReport report;
+    for (int pass = 0; pass < 2; pass++)
     {
-        printf("Updating Payment ID %d. Current status: %s\n", id, node->data.status);
-        getString("Enter new status (e.g., Refunded): ", node->data.status, 20);
+        int used = pass == 0 ? 1 : threads;
+        if (pass == 1 && threads == 1)
+            break;
+        if (pass == 1)
+            reconcile_report_free(&report);
+        db_reconcile_billing(&report, used);
+        int same = report.count == loop.count &&
+                   memcmp(report.rows, loop.rows, report.count * sizeof(ReconcileRow)) == 0;
+        printf("%-34s | %7d | %12.2f | %14.2f%s\n", "Partitioned hash join", used, report.total_ms,
+               report.extract_ms, same ? "" : "  (MISMATCH)");
+    }
+    printf("\nBoth rank every member by balance afterwards. Per join, partition + build/probe:\n");
+    print_join_stats("Bookings x Workspaces", &report.joins[0]);
+    print_join_stats("Payments x Bookings", &report.joins[1]);
+    printf("Expected $%.2f, paid $%.2f, pending $%.2f over %zu members. Load: %.1f ms.\n", report.expected / 100.0,
+           report.paid / 100.0, report.pending / 100.0, report.count, build_ns / 1e6);
+    reconcile_report_free(&report);
+    reconcile_report_free(&loop);
+    reset_all_tables();
+}
 
-        char logMsg[100];
-        sprintf(logMsg, "Updated Payment ID %d status", id);
-        log_operation(logMsg);
-        printf("Payment ID %d updated.\n", id);
+// -- Materialized Aggregates --
+// A random write mix (payment status flips, cancellations, payment deletes
+// and inserts) runs once without and once with the running totals, then one
+// dashboard figure is answered from them and by scanning every payment.
+
+static void aggregate_bench_writes(int n, int ops, uint64_t seed)
+{
+    pthread_rwlock_wrlock(&bookings_lock);
+    pthread_rwlock_wrlock(&payments_lock);
+    for (int i = 0; i < ops; i++)
+    {
+        int id = (int)(bench_rand(&seed) % n) + 1;
+        switch (bench_rand(&seed) % 4)
+        {
+        case 0: {
+            PaymentNode *node = findPaymentNodeById(id);
+            if (!node)
+                break;
+            Payment p;
+            payment_read(node, &p);
+            strcpy(p.status, strcmp(p.status, "Paid") == 0 ? "Pending" : "Paid");
+            set_payment_data(node, &p);
+            break;
+        }
+        case 1: {
+            BookingNode *node = findBookingNodeById(id);
+            if (!node)
+                break;
+            Booking b;
+            booking_read(node, &b);
+            strcpy(b.status, node->cancelled ? "Confirmed" : "Cancelled");
+            set_booking_data(node, &b);
+            break;
+        }
+        case 2: {
+            PaymentNode *node = findPaymentNodeById(id);
+            if (node)
+                remove_payment_node(node);
+            break;
+        }
+        default: {
+            Payment p = { next_payment_id++, id, 1500 + id % 7 * 500, "2026-08-01", "Paid" };
+            insert_payment_node(&p);
+        }
+        }
+    }
+    pthread_rwlock_unlock(&payments_lock);
+    pthread_rwlock_unlock(&bookings_lock);
+}
+
+// What revenue_by_workspace answers, the way a report without it would
+static int64_t aggregate_bench_scan(int workspaceId)
+{
+    int64_t revenue = 0;
+    pthread_rwlock_rdlock(&bookings_lock);
+    pthread_rwlock_rdlock(&payments_lock);
+    for (PaymentNode *curr = first_payment(); curr != NULL; curr = next_payment(curr))
+    {
+        PaymentRecord record;
+        paged_read(&payment_pages, curr->rid, &record);
+        BookingNode *booking = findBookingNodeById(record.bookingId);
+        if (booking && booking->workspaceId == workspaceId && (str_flags(record.status) & STR_PAID) != 0)
+            revenue += record.amount_in_cents;
     }
-    else
-        printf("Payment not found.\n");
     pthread_rwlock_unlock(&payments_lock);
+    pthread_rwlock_unlock(&bookings_lock);
+    return revenue;
+}
+
+void run_aggregate_benchmark(int n)
+{
+    int ops = n, reads = 100000, scans = 5;
+    init_database();
+    generate_bench_data(n);
+    int workspaces = next_workspace_id - 1;
+
+    printf("\n--- Materialized Aggregate Benchmark (%d bookings, %d payments, %d workspaces) ---\n", n, n,
+           workspaces);
+    mat_live = 0; // Pass 1: the same kind of writes with no totals to maintain
+    long long t = now_ns();
+    aggregate_bench_writes(n, ops, 7);
+    long long plain_ns = now_ns() - t;
+    mat_aggregates_rebuild();
+    t = now_ns();
+    aggregate_bench_writes(n, ops, 42);
+    long long kept_ns = now_ns() - t;
+    printf("%d writes without totals: %9.2f ms (%.0f ns/write)\n", ops, plain_ns / 1e6, (double)plain_ns / ops);
+    printf("%d writes keeping them:   %9.2f ms (%.0f ns/write)\n", ops, kept_ns / 1e6, (double)kept_ns / ops);
+
+    uint64_t seed = 99;
+    int64_t count, sum, checksum = 0;
+    t = now_ns();
+    for (int i = 0; i < reads; i++)
+    {
+        db_aggregate_get("revenue_by_workspace", (int)(bench_rand(&seed) % workspaces) + 1, &count, &sum);
+        checksum += sum;
+    }
+    long long read_ns = now_ns() - t;
+    int mismatches = 0;
+    t = now_ns();
+    for (int i = 0; i < scans; i++)
+    {
+        int w = (int)(bench_rand(&seed) % workspaces) + 1;
+        db_aggregate_get("revenue_by_workspace", w, &count, &sum);
+        mismatches += aggregate_bench_scan(w) != sum;
+    }
+    long long scan_ns = now_ns() - t;
+    printf("\nRevenue of one workspace, running total: %10.3f us/read (%d reads, checksum %lld)\n",
+           read_ns / 1e3 / reads, reads, (long long)checksum);
+    printf("Revenue of one workspace, payment scan:  %10.3f us/read (%d reads)%s\n", scan_ns / 1e3 / scans, scans,
+           mismatches ? "  (MISMATCH)" : "");
+
+    MatVerifyReport report;
+    size_t drifted = mat_aggregates_verify(&report);
+    printf("Verification: %zu drifted key(s) after %d writes (full recount %.2f ms).\n", drifted, 2 * ops, report.ms);
+    if (drifted)
+        printf("First drift: %s\n", report.first_drift);
+    mat_print_stats();
+    reset_all_tables();
+}
+
+// -- Transaction Benchmark --
+// Worker threads each book a slot and pay for it in one transaction while a
+// writer reprices the busiest workspaces and deletes members (cascade), so
+// some commits find a stale read and retry. Afterwards every surviving
+// transactional booking must still have its payment and nothing may dangle.
+
+#define TXN_BENCH_THREADS 4
+#define TXN_BENCH_HOT_WORKSPACES 16
+
+typedef struct
+{
+    int thread_id, ops, members;
+    uint64_t seed;
+    pthread_barrier_t *start;
+    atomic_int *finished;
+    int committed, rejected, gave_up;
+    int *bookings; // Booking ids this worker's transactions committed
+} TxnBenchWorker;
+
+typedef struct
+{
+    int memberId, workspaceId;
+    char startTime[20], endTime[20];
+    int bookingId;
+} TxnBenchOrder;
+
+static DbStatus txn_bench_book_and_pay(Txn *txn, void *ctx)
+{
+    TxnBenchOrder *o = (TxnBenchOrder *)ctx;
+    Workspace w;
+    DbStatus rc = txn_get_workspace(txn, o->workspaceId, &w);
+    if (rc == DB_OK)
+        rc = txn_add_booking(txn, o->memberId, o->workspaceId, o->startTime, o->endTime, "Confirmed", &o->bookingId);
+    if (rc == DB_OK)
+        rc = txn_add_payment(txn, o->bookingId, w.price_in_cents * 8, "2030-01-01", "Paid", NULL);
+    return rc;
+}
+
+static void *txn_bench_worker(void *arg)
+{
+    TxnBenchWorker *w = (TxnBenchWorker *)arg;
+    pthread_barrier_wait(w->start);
+    for (int i = 0; i < w->ops; i++)
+    {
+        // Hour-long slots that no other transaction uses, so a failure is
+        // a stale read or a deleted parent, never a double booking
+        TxnBenchOrder o;
+        o.memberId = (int)(bench_rand(&w->seed) % w->members) + 1;
+        o.workspaceId = (int)(bench_rand(&w->seed) % TXN_BENCH_HOT_WORKSPACES) + 1;
+        time_t slot = 1893456000 + ((time_t)i * TXN_BENCH_THREADS + w->thread_id) * 3600; // From 2030-01-01
+        struct tm tm;
+        gmtime_r(&slot, &tm);
+        strftime(o.startTime, sizeof(o.startTime), "%Y-%m-%dT%H:%M", &tm);
+        tm.tm_min = 45;
+        strftime(o.endTime, sizeof(o.endTime), "%Y-%m-%dT%H:%M", &tm);
+
+        DbStatus rc = txn_run(txn_bench_book_and_pay, &o);
+        if (rc == DB_OK)
+            w->bookings[w->committed++] = o.bookingId;
+        else if (rc == DB_ABORTED)
+            w->gave_up++;
+        else
+            w->rejected++;
+    }
+    atomic_fetch_add(w->finished, 1);
+    return NULL;
+}
+
+void run_txn_benchmark(int n)
+{
+    char original_dir[1024];
+    char scratch[] = "/tmp/flexdesk_bench_XXXXXX";
+    if (!getcwd(original_dir, sizeof(original_dir)) || !mkdtemp(scratch) || chdir(scratch) != 0)
+    {
+        printf("Error: could not create a scratch directory.\n");
+        return;
+    }
+
+    int size = 10000, saved_policy = fk_delete_policy;
+    init_database();
+    generate_bench_data(size);
+    fk_delete_policy = FK_CASCADE;
+    if (logger_start() != 0)
+        printf("Warning: audit logger unavailable, logging synchronously.\n");
+    if (wal_open() != 0)
+        printf("Warning: cannot open %s, running without the WAL.\n", WAL_FILE);
+
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, TXN_BENCH_THREADS + 1);
+    atomic_int finished = 0;
+    TxnBenchWorker workers[TXN_BENCH_THREADS];
+    pthread_t tids[TXN_BENCH_THREADS];
+    memset(workers, 0, sizeof(workers));
+    for (int i = 0; i < TXN_BENCH_THREADS; i++)
+    {
+        workers[i].thread_id = i;
+        workers[i].ops = n / TXN_BENCH_THREADS + (i < n % TXN_BENCH_THREADS);
+        workers[i].members = size;
+        workers[i].seed = 42 + i;
+        workers[i].start = &start;
+        workers[i].finished = &finished;
+        workers[i].bookings = (int *)malloc((workers[i].ops + 1) * sizeof(int));
+        pthread_create(&tids[i], NULL, txn_bench_worker, &workers[i]);
+    }
+
+    unsigned long begun = atomic_load(&txn_begun), aborted = atomic_load(&txn_aborted);
+    unsigned long retries = atomic_load(&txn_retries);
+    pthread_barrier_wait(&start);
+    long long t = now_ns();
+
+    // Runs on this thread until the workers finish: mostly repricing, with
+    // an occasional member delete that cascades to their bookings
+    int reprices = 0, deletes = 0;
+    uint64_t seed = 7;
+    while (atomic_load(&finished) < TXN_BENCH_THREADS)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            int id = (int)(bench_rand(&seed) % TXN_BENCH_HOT_WORKSPACES) + 1;
+            if (db_update_workspace(id, 1, 1500 + (int)(bench_rand(&seed) % 4) * 500) == DB_OK)
+                reprices++;
+        }
+        DbDeleteInfo info;
+        if (db_delete_member((int)(bench_rand(&seed) % size) + 1, &info) == DB_OK)
+            deletes++;
+        usleep(200);
+    }
+    double seconds = (now_ns() - t) / 1e9;
+    for (int i = 0; i < TXN_BENCH_THREADS; i++)
+        pthread_join(tids[i], NULL);
+
+    // Integrity: no orphans anywhere, and one payment per surviving booking
+    // a transaction created
+    int committed = 0, rejected = 0, gave_up = 0, orphans = 0, unpaid = 0;
+    for (BookingNode *curr = first_booking(); curr != NULL; curr = next_booking(curr))
+        orphans += !findMemberNodeById(curr->memberId) || !findWorkspaceNodeById(curr->workspaceId);
+    for (PaymentNode *curr = first_payment(); curr != NULL; curr = next_payment(curr))
+    {
+        Payment p;
+        payment_read(curr, &p);
+        orphans += !findBookingNodeById(p.bookingId);
+    }
+    for (int i = 0; i < TXN_BENCH_THREADS; i++)
+    {
+        committed += workers[i].committed;
+        rejected += workers[i].rejected;
+        gave_up += workers[i].gave_up;
+        for (int k = 0; k < workers[i].committed; k++)
+            unpaid += findBookingNodeById(workers[i].bookings[k]) && count_payments_of(workers[i].bookings[k]) != 1;
+        free(workers[i].bookings);
+    }
+    aborted = atomic_load(&txn_aborted) - aborted;
+    retries = atomic_load(&txn_retries) - retries;
+    begun = atomic_load(&txn_begun) - begun;
+
+    printf("\n--- Transaction Benchmark (%d threads, %d book-and-pay transactions, %d hot workspaces) ---\n",
+           TXN_BENCH_THREADS, n, TXN_BENCH_HOT_WORKSPACES);
+    printf("Committed: %d | Rejected (member deleted): %d | Gave up after %d retries: %d\n", committed, rejected,
+           TXN_MAX_RETRIES, gave_up);
+    printf("Stale-read aborts: %lu of %lu attempts (%.1f%%), retries: %lu\n", aborted, begun,
+           begun ? 100.0 * aborted / begun : 0.0, retries);
+    printf("Concurrent writer: %d reprices, %d member deletes (cascade)\n", reprices, deletes);
+    printf("Elapsed %.3f s, %.0f commits/sec (wal=%s).\n", seconds, committed / seconds, wal.fd >= 0 ? "on" : "off");
+    printf("Integrity: %d orphan row(s), %d booking(s) without their payment.\n", orphans, unpaid);
+
+    pthread_barrier_destroy(&start);
+    wal_close();
+    logger_stop();
+    fk_delete_policy = saved_policy;
+    reset_all_tables();
+
+    unlink(WAL_FILE);
+    unlink(LOG_FILE);
+    if (chdir(original_dir) == 0)
+        rmdir(scratch);
+}
+
+// -- CRUD Load Generator --
+// N threads drive the db_* core (the same paths the menu uses) against a
+// generated dataset in a scratch directory, with the WAL and audit logger on.
+
+enum { BENCH_READ, BENCH_LOOKUP, BENCH_UPDATE, BENCH_INSERT, BENCH_DELETE, BENCH_OPS };
+static const char *bench_op_names[BENCH_OPS] = { "read", "lookup", "update", "insert", "delete" };
+
+typedef struct
+{
+    int threads;
+    long long ops;      // Total operations across all threads
+    int size;           // Rows per table in the generated dataset
+    int mix[3];         // read : write : lookup percentages
+    int zipf;           // 0 = uniform keys, 1 = zipfian
+    double theta;       // Zipf skew
+    int wal;            // 0 = skip the write-ahead log (no fsync cost)
+    uint64_t seed;
+} BenchConfig;
+
+// Log-linear latency histogram: exact below 16 ns, then 16 sub-buckets per
+// power of two (~6% resolution), so percentiles need no stored samples.
+#define HIST_SUB_BUCKETS 16
+#define HIST_BUCKETS (61 * HIST_SUB_BUCKETS)
+
+typedef struct
+{
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total, ok, max_ns;
+} LatencyHistogram;
+
+static int hist_bucket(uint64_t ns)
+{
+    if (ns < HIST_SUB_BUCKETS)
+        return (int)ns;
+    int shift = 63 - __builtin_clzll(ns) - 4;
+    return (shift + 1) * HIST_SUB_BUCKETS + (int)((ns >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+static uint64_t hist_bucket_value(int bucket)
+{
+    if (bucket < HIST_SUB_BUCKETS)
+        return bucket;
+    int shift = bucket / HIST_SUB_BUCKETS - 1;
+    return (uint64_t)(HIST_SUB_BUCKETS + bucket % HIST_SUB_BUCKETS) << shift;
+}
+
+static void hist_record(LatencyHistogram *h, uint64_t ns, int ok)
+{
+    h->counts[hist_bucket(ns)]++;
+    h->total++;
+    h->ok += ok;
+    if (ns > h->max_ns)
+        h->max_ns = ns;
+}
+
+static void hist_merge(LatencyHistogram *into, const LatencyHistogram *from)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        into->counts[i] += from->counts[i];
+    into->total += from->total;
+    into->ok += from->ok;
+    if (from->max_ns > into->max_ns)
+        into->max_ns = from->max_ns;
+}
+
+static uint64_t hist_percentile(const LatencyHistogram *h, double pct)
+{
+    uint64_t rank = (uint64_t)(h->total * pct / 100.0);
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += h->counts[i];
+        if (seen > rank)
+            return hist_bucket_value(i);
+    }
+    return h->max_ns;
+}
+
+// Zipfian ranks (Gray et al., as used by YCSB), scrambled so hot keys are
+// spread over the id space instead of all being the lowest ids
+typedef struct
+{
+    uint64_t n;
+    double theta, alpha, zetan, eta;
+} ZipfGenerator;
+
+static void zipf_init(ZipfGenerator *z, uint64_t n, double theta)
+{
+    double zeta2 = 1.0 + pow(0.5, theta);
+    z->n = n;
+    z->theta = theta;
+    z->zetan = 0;
+    for (uint64_t i = 1; i <= n; i++)
+        z->zetan += 1.0 / pow((double)i, theta);
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+static uint64_t zipf_next(const ZipfGenerator *z, uint64_t *state)
+{
+    double u = (bench_rand(state) >> 11) * (1.0 / 9007199254740992.0);
+    double uz = u * z->zetan;
+    if (uz < 1.0)
+        return 0;
+    if (uz < 1.0 + pow(0.5, z->theta))
+        return 1;
+    uint64_t rank = (uint64_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+    return rank < z->n ? rank : z->n - 1;
+}
+
+typedef struct
+{
+    const BenchConfig *cfg;
+    const ZipfGenerator *zipf;
+    pthread_barrier_t *start;
+    int thread_id;
+    long long ops;
+    LatencyHistogram hist[BENCH_OPS];
+} BenchWorker;
+
+// generate_bench_data makes one workspace per ten rows of the other tables
+static int bench_workspace_rows(const BenchConfig *cfg)
+{
+    return cfg->size / 10 > 0 ? cfg->size / 10 : 1;
+}
+
+static int bench_key(BenchWorker *w, int table, uint64_t *state)
+{
+    int rows = table == SNAP_WORKSPACES ? bench_workspace_rows(w->cfg) : w->cfg->size;
+    if (!w->cfg->zipf)
+        return (int)(bench_rand(state) % rows) + 1;
+    return (int)(hash_function(zipf_next(w->zipf, state)) % rows) + 1;
+}
+
+// Runs one operation of the given kind on a random table; returns 1 on DB_OK
+static int bench_execute(BenchWorker *w, int op, uint64_t *state, long long seq)
+{
+    int table = (int)(bench_rand(state) % SNAP_TABLES);
+    int key = bench_key(w, table, state);
+    int newId, conflictId;
+    char text[100], start[20], end[20];
+    Booking bookings[8];
+    Payment payments[8];
+
+    switch (op)
+    {
+    case BENCH_READ:
+        switch (table)
+        {
+        case SNAP_MEMBERS: return db_get_member(key, NULL) == DB_OK;
+        case SNAP_WORKSPACES: return db_get_workspace(key, NULL) == DB_OK;
+        case SNAP_BOOKINGS: return db_get_booking(key, NULL) == DB_OK;
+        default: return db_get_payment(key, NULL) == DB_OK;
+        }
+    case BENCH_LOOKUP:
+        switch (table)
+        {
+        case SNAP_MEMBERS:
+            snprintf(text, sizeof(text), "member%d@flexdesk.test", key);
+            return db_find_member_by_email(text, NULL) == DB_OK;
+        case SNAP_WORKSPACES:
+        {
+            int64_t from = parse_booking_time("2026-01-01T00:00") + (int64_t)(bench_rand(state) % 365) * 1440;
+            return db_workspace_occupancy(key, from, from + 1440, bookings, 8) > 0;
+        }
+        case SNAP_BOOKINGS: return db_member_bookings(key, bookings, 8) > 0;
+        default: return db_booking_payments(key, payments, 8) > 0;
+        }
+    case BENCH_UPDATE:
+        switch (table)
+        {
+        case SNAP_MEMBERS:
+            snprintf(text, sizeof(text), "Member %d v%lld", key, seq);
+            return db_update_member(key, text) == DB_OK;
+        case SNAP_WORKSPACES: return db_update_workspace(key, 1 + key % 8, 1500 + (int)(seq % 100)) == DB_OK;
+        case SNAP_BOOKINGS: return db_update_booking(key, "Confirmed", &conflictId) == DB_OK;
+        default: return db_update_payment(key, seq & 1 ? "Paid" : "Pending") == DB_OK;
+        }
+    case BENCH_INSERT:
+        switch (table)
+        {
+        case SNAP_MEMBERS:
+        {
+            char email[100];
+            snprintf(text, sizeof(text), "Bench %d.%lld", w->thread_id, seq);
+            snprintf(email, sizeof(email), "bench%d.%lld@flexdesk.test", w->thread_id, seq);
+            return db_add_member(text, email, &newId) == DB_OK;
+        }
+        case SNAP_WORKSPACES: return db_add_workspace("Hot Desk", "Bench Floor", 1, 1500, &newId) == DB_OK;
+        case SNAP_BOOKINGS:
+        {
+            int month = (int)(bench_rand(state) % 12) + 1, day = (int)(bench_rand(state) % 28) + 1;
+            int hour = (int)(bench_rand(state) % 23);
+            snprintf(start, sizeof(start), "2027-%02d-%02dT%02d:00", month, day, hour);
+            snprintf(end, sizeof(end), "2027-%02d-%02dT%02d:00", month, day, hour + 1);
+            return db_add_booking(key, key % bench_workspace_rows(w->cfg) + 1, start, end, "Confirmed", &newId, &conflictId) == DB_OK;
+        }
+        default: return db_add_payment(key, 1500, "2027-01-01", "Paid", &newId) == DB_OK;
+        }
+    default:
+        switch (table)
+        {
+        case SNAP_MEMBERS: return db_delete_member(key, NULL) == DB_OK;
+        case SNAP_WORKSPACES: return db_delete_workspace(key, NULL) == DB_OK;
+        case SNAP_BOOKINGS: return db_delete_booking(key, NULL) == DB_OK;
+        default: return db_delete_payment(key) == DB_OK;
+        }
+    }
+}
+
+static void *bench_worker(void *arg)
+{
+    BenchWorker *w = (BenchWorker *)arg;
+    const BenchConfig *cfg = w->cfg;
+    uint64_t state = cfg->seed + 0x9E3779B97F4A7C15ULL * (uint64_t)(w->thread_id + 1);
+
+    pthread_barrier_wait(w->start);
+    for (long long i = 0; i < w->ops; i++)
+    {
+        // Writes are split 60% update, 20% insert, 20% delete
+        int pick = (int)(bench_rand(&state) % 100), op;
+        if (pick < cfg->mix[0])
+            op = BENCH_READ;
+        else if (pick < cfg->mix[0] + cfg->mix[1])
+        {
+            int write = (int)(bench_rand(&state) % 10);
+            op = write < 6 ? BENCH_UPDATE : write < 8 ? BENCH_INSERT : BENCH_DELETE;
+        }
+        else
+            op = BENCH_LOOKUP;
+
+        long long t = now_ns();
+        int ok = bench_execute(w, op, &state, i);
+        hist_record(&w->hist[op], (uint64_t)(now_ns() - t), ok);
+    }
+    return NULL;
+}
+
+static void bench_print_row(const char *name, const LatencyHistogram *h, double seconds)
+{
+    if (h->total == 0)
+        return;
+    printf("%-8s | %10llu | %6.1f%% | %12.0f | %9.2f | %9.2f | %9.2f | %9.2f\n", name,
+           (unsigned long long)h->total, 100.0 * h->ok / h->total, h->total / seconds,
+           hist_percentile(h, 50) / 1e3, hist_percentile(h, 99) / 1e3,
+           hist_percentile(h, 99.9) / 1e3, h->max_ns / 1e3);
+}
+
+void run_crud_benchmark(const BenchConfig *cfg)
+{
+    char original_dir[1024];
+    char scratch[] = "/tmp/flexdesk_bench_XXXXXX";
+    if (!getcwd(original_dir, sizeof(original_dir)) || !mkdtemp(scratch) || chdir(scratch) != 0)
+    {
+        printf("Error: could not create a scratch directory.\n");
+        return;
+    }
+
+    init_database();
+    generate_bench_data(cfg->size);
+    if (logger_start() != 0)
+        printf("Warning: audit logger unavailable, logging synchronously.\n");
+    if (cfg->wal && wal_open() != 0)
+        printf("Warning: cannot open %s, running without the WAL.\n", WAL_FILE);
+
+    ZipfGenerator zipf;
+    if (cfg->zipf)
+        zipf_init(&zipf, cfg->size, cfg->theta);
+
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, cfg->threads + 1);
+    BenchWorker *workers = (BenchWorker *)calloc(cfg->threads, sizeof(BenchWorker));
+    pthread_t *tids = (pthread_t *)malloc(cfg->threads * sizeof(pthread_t));
+    for (int i = 0; i < cfg->threads; i++)
+    {
+        workers[i].cfg = cfg;
+        workers[i].zipf = &zipf;
+        workers[i].start = &start;
+        workers[i].thread_id = i;
+        workers[i].ops = cfg->ops / cfg->threads + (i < cfg->ops % cfg->threads);
+        pthread_create(&tids[i], NULL, bench_worker, &workers[i]);
+    }
+
+    unsigned long hits_before, misses_before;
+    pool_counters(&hits_before, &misses_before);
+    pthread_barrier_wait(&start);
+    long long t = now_ns();
+    for (int i = 0; i < cfg->threads; i++)
+        pthread_join(tids[i], NULL);
+    double seconds = (now_ns() - t) / 1e9;
+    unsigned long hits, misses;
+    pool_counters(&hits, &misses);
+    hits -= hits_before;
+    misses -= misses_before;
+
+    LatencyHistogram merged[BENCH_OPS], all;
+    memset(merged, 0, sizeof(merged));
+    memset(&all, 0, sizeof(all));
+    for (int i = 0; i < cfg->threads; i++)
+        for (int op = 0; op < BENCH_OPS; op++)
+            hist_merge(&merged[op], &workers[i].hist[op]);
+    for (int op = 0; op < BENCH_OPS; op++)
+        hist_merge(&all, &merged[op]);
+
+    printf("\n--- CRUD Benchmark ---\n");
+    printf("threads=%d ops=%lld size=%d mix=%d:%d:%d dist=%s", cfg->threads, cfg->ops, cfg->size,
+           cfg->mix[0], cfg->mix[1], cfg->mix[2], cfg->zipf ? "zipf" : "uniform");
+    if (cfg->zipf)
+        printf(" theta=%.2f", cfg->theta);
+    printf(" wal=%s fk=%s seed=%llu\n", wal.fd >= 0 ? "on" : "off",
+           fk_delete_policy == FK_CASCADE ? "cascade" : "restrict", (unsigned long long)cfg->seed);
+    printf("%-8s | %10s | %7s | %12s | %9s | %9s | %9s | %9s\n",
+           "Op", "Count", "OK", "Ops/sec", "p50 us", "p99 us", "p999 us", "max us");
+    printf("---------|------------|---------|--------------|-----------|-----------|-----------|----------\n");
+    for (int op = 0; op < BENCH_OPS; op++)
+        bench_print_row(bench_op_names[op], &merged[op], seconds);
+    bench_print_row("total", &all, seconds);
+    printf("Elapsed %.3f s, throughput %.0f ops/sec.\n", seconds, all.total / seconds);
+    printf("Buffer pool: %zu frames, %lu hits, %lu misses (%.1f%% hit rate).\n", pool.frame_count,
+           hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+
+    free(workers);
+    free(tids);
+    pthread_barrier_destroy(&start);
+    wal_close();
+    logger_stop();
+    reset_all_tables();
+
+    unlink(WAL_FILE);
+    unlink(LOG_FILE);
+    if (chdir(original_dir) == 0)
+        rmdir(scratch);
+}
+
+// --bench [--threads N] [--ops N] [--size N] [--mix R:W:L] [--dist uniform|zipf]
+//         [--theta X] [--seed N] [--no-wal]
+static int parse_bench_args(int argc, char *argv[], BenchConfig *cfg)
+{
+    cfg->threads = 4;
+    cfg->ops = 1000000;
+    cfg->size = 100000;
+    cfg->mix[0] = 70, cfg->mix[1] = 20, cfg->mix[2] = 10;
+    cfg->zipf = 0;
+    cfg->theta = 0.99;
+    cfg->wal = 1;
+    cfg->seed = 42;
+
+    for (int i = 2; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--no-wal") == 0)
+        {
+            cfg->wal = 0;
+            continue;
+        }
+        if (!value)
+        {
+            printf("Error: %s needs a value.\n", arg);
+            return -1;
+        }
+        i++;
+        if (strcmp(arg, "--threads") == 0)
+            cfg->threads = atoi(value);
+        else if (strcmp(arg, "--ops") == 0)
+            cfg->ops = atoll(value);
+        else if (strcmp(arg, "--size") == 0)
+            cfg->size = atoi(value);
+        else if (strcmp(arg, "--seed") == 0)
+            cfg->seed = strtoull(value, NULL, 10);
+        else if (strcmp(arg, "--theta") == 0)
+            cfg->theta = atof(value);
+        else if (strcmp(arg, "--dist") == 0 && (strcmp(value, "uniform") == 0 || strcmp(value, "zipf") == 0))
+            cfg->zipf = strcmp(value, "zipf") == 0;
+        else if (strcmp(arg, "--mix") == 0 &&
+                 sscanf(value, "%d:%d:%d", &cfg->mix[0], &cfg->mix[1], &cfg->mix[2]) == 3 &&
+                 cfg->mix[0] >= 0 && cfg->mix[1] >= 0 && cfg->mix[2] >= 0 &&
+                 cfg->mix[0] + cfg->mix[1] + cfg->mix[2] == 100)
+            continue;
+        else
+        {
+            printf("Error: bad option %s %s.\n", arg, value);
+            return -1;
+        }
+    }
+    if (cfg->threads <= 0 || cfg->ops <= 0 || cfg->size <= 0 || cfg->theta <= 0 || cfg->theta >= 1)
+    {
+        printf("Error: threads, ops and size must be positive and theta in (0, 1).\n");
+        return -1;
+    }
+    return 0;
+}
+
+int crud_bench_tool(int argc, char *argv[])
+{
+    BenchConfig cfg;
+    if (parse_bench_args(argc, argv, &cfg) != 0)
+        return 1;
+    run_crud_benchmark(&cfg);
+    return 0;
 }
 
-void deletePayment()
+// Releases buffered responses, but only once the writes they acknowledge are durable
+static void batch_flush(OutBuffer *out)
 {
-    int id = getInt("Enter ID of payment to delete: ");
+    wal_commit_deferred();
+    fwrite(out->data, 1, out->used, stdout);
+    fflush(stdout);
+    out->used = 0;
+}
 
-    pthread_rwlock_wrlock(&payments_lock);
-    PaymentNode *node = findPaymentNodeById(id);
-    if (node)
+// --batch [FILE] [--sync-every N]: scripted workloads against the live database
+int batch_tool(int argc, char *argv[])
+{
+    const char *path = NULL;
+    int sync_every = BATCH_SYNC_EVERY;
+    for (int i = 2; i < argc; i++)
     {
-        if (node->prev)
-            node->prev->next = node->next;
+        if (strcmp(argv[i], "--sync-every") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            sync_every = atoi(argv[++i]);
+        else if (!path && argv[i][0] != '-')
+            path = argv[i];
         else
-            payment_head = node->next;
-        if (node->next)
-            node->next->prev = node->prev;
-        else
-            payment_tail = node->prev;
-        free(node);
+        {
+            fprintf(stderr, "Error: bad option %s.\n", argv[i]);
+            return 1;
+        }
+    }
 
-        char logMsg[100];
-        sprintf(logMsg, "Deleted Payment ID %d", id);
-        log_operation(logMsg);
-        printf("Payment ID %d deleted.\n", id);
+    FILE *in = path ? fopen(path, "r") : stdin;
+    if (!in)
+    {
+        fprintf(stderr, "Error: cannot open %s.\n", path);
+        return 1;
     }
-    else
-        printf("Payment not found.\n");
-    pthread_rwlock_unlock(&payments_lock);
+    setvbuf(in, NULL, _IOFBF, BATCH_IO_BUFFER);
+    setvbuf(stdout, NULL, _IOFBF, BATCH_IO_BUFFER);
+
+    // Startup messages go to stderr so stdout carries nothing but responses
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    init_database();
+    if (logger_start() != 0)
+        printf("Warning: audit logger unavailable, logging synchronously.\n");
+    log_operation("Batch Session Started");
+    load_all_data();
+    int wal_rc = wal_open();
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    if (wal_rc != 0)
+    {
+        fprintf(stderr, "Error: cannot open %s for writing.\n", WAL_FILE);
+        return 1;
+    }
+
+    OutBuffer out = { NULL, 0, 0 };
+    CommandSession session = { NULL };
+    char *line = NULL;
+    size_t line_capacity = 0;
+    long long commands = 0;
+    int pending = 0;
+
+    wal_defer_commits = 1;
+    long long t = now_ns();
+    while (getline(&line, &line_capacity, in) != -1)
+    {
+        int rc = execute_command(line, &out, &session);
+        if (rc == COMMAND_SKIPPED)
+            continue;
+        commands++;
+        if (rc == COMMAND_FLUSH || ++pending >= sync_every || out.used >= BATCH_OUTPUT_FLUSH)
+        {
+            batch_flush(&out);
+            pending = 0;
+        }
+    }
+    batch_flush(&out);
+    wal_defer_commits = 0;
+    if (session.txn) { // Never committed: its writes were never applied
+        txn_abort(session.txn);
+        free(session.txn);
+    }
+    double seconds = (now_ns() - t) / 1e9;
+    fprintf(stderr, "Batch: %lld command(s) in %.3f s (%.0f/s).\n", commands, seconds,
+            seconds > 0 ? commands / seconds : 0.0);
+
+    free(line);
+    free(out.data);
+    if (path)
+        fclose(in);
+    bgsave_wait(); // Let a running save finish before the WAL closes
+    wal_close();
+    log_operation("Batch Session Ended");
+    logger_stop();
+    reset_all_tables();
+    return 0;
 }
 
 /*
  * ==========================================
- * FILE I/O & CONCURRENCY DEMO
+ * NETWORK SERVER (epoll front end)
  * ==========================================
  */
+// Wire format: every frame is a 4-byte big-endian payload length followed by
+// the payload. A request payload is one dispatcher command without the
+// newline ("GET_MEMBER|7"). Its response frame carries exactly the lines
+// --batch would print for it. Responses come back in request order, so
+// clients may pipeline.
+//
+// One thread runs the epoll loop. It does every accept and read. A connection
+// holding complete requests is queued for the worker pool, and at most one
+// worker serves it at a time, which keeps its responses in order. A worker
+// runs a burst of requests with deferred WAL commits, makes them durable with
+// one group commit, then sends the responses. If the socket is full, the rest
+// waits for EPOLLOUT.
+
+typedef struct ServerConnection
+{
+    int fd;
+    pthread_mutex_t mutex;
+    char *in; // Bytes read but not yet taken by a worker
+    size_t in_used, in_capacity;
+    size_t in_framed; // Leading bytes of 'in' already known to be whole frames
+    OutBuffer out; // Response frames the socket has not accepted yet
+    size_t out_sent;
+    CommandSession session; // Touched only by the worker holding 'busy'
+
+    int busy;       // Queued for, or held by, a worker
+    int closing;    // Peer is gone; whoever holds 'busy' frees the connection
+    int want_read;  // EPOLLIN is armed
+    int want_write; // EPOLLOUT is armed
+    struct ServerConnection *next_job;
+} ServerConnection;
 
-void load_all_data()
+typedef struct
 {
-    FILE *file;
-    // Load Members (Updated to populate INDEX)
-    file = fopen(MEMBERS_FILE, "r");
-    if (file)
-    {
-        Member temp;
-        int maxId = 0;
-        while (fscanf(file, "%d,%99[^,],%99[^\n]\n", &temp.memberId, temp.name, temp.email) == 3)
-        {
-            MemberNode *newNode = (MemberNode *)malloc(sizeof(MemberNode));
-            newNode->data = temp;
-            newNode->next = newNode->prev = NULL;
-            if (!member_head)
-                member_head = member_tail = newNode;
-            else
-            {
-                member_tail->next = newNode;
-                newNode->prev = member_tail;
-                member_tail = newNode;
-            }
+    int epoll_fd, listen_fd;
+    pthread_mutex_t queue_mutex;
+    pthread_cond_t queue_cond;
+    ServerConnection *queue_head, *queue_tail;
+    int stopping;
+    ServerConnection *connections[SERVER_MAX_CONNECTIONS]; // By fd, epoll thread only
+    unsigned long accepted;
+    atomic_ulong requests;
+} Server;
+
+static Server server;
+static volatile sig_atomic_t server_stop_requested = 0;
+
+static void server_on_signal(int sig)
+{
+    (void)sig;
+    server_stop_requested = 1;
+}
 
-            // Populating Index during load
-            add_to_index(newNode);
+static uint32_t frame_length(const char *header)
+{
+    const unsigned char *b = (const unsigned char *)header;
+    return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8 | b[3];
+}
+
+static void put_frame_length(char *header, uint32_t length)
+{
+    header[0] = (char)(length >> 24);
+    header[1] = (char)(length >> 16);
+    header[2] = (char)(length >> 8);
+    header[3] = (char)length;
+}
 
-            if (temp.memberId > maxId)
-                maxId = temp.memberId;
+// Raw append; frames contain length bytes that out_printf cannot produce
+static void out_append(OutBuffer *out, const void *data, size_t length)
+{
+    if (out->capacity - out->used < length)
+    {
+        size_t capacity = out->capacity ? out->capacity : 4096;
+        while (capacity - out->used < length)
+            capacity *= 2;
+        char *grown = (char *)realloc(out->data, capacity);
+        if (!grown) {
+            perror("Failed to grow response buffer");
+            exit(1);
         }
-        next_member_id = maxId + 1;
-        fclose(file);
+        out->data = grown;
+        out->capacity = capacity;
     }
-    // Load Workspaces
-    file = fopen(WORKSPACES_FILE, "r");
-    if (file)
+    memcpy(out->data + out->used, data, length);
+    out->used += length;
+}
+
+// Bytes at the front of c->in that make up complete frames (at most
+// max_frames of them), or SIZE_MAX once a header announces an oversized frame
+static size_t complete_frames(const ServerConnection *c, int max_frames)
+{
+    size_t offset = 0;
+    for (int n = 0; n < max_frames && c->in_used - offset >= 4; n++)
     {
-        Workspace temp;
-        int maxId = 0;
-        while (fscanf(file, "%d,%49[^,],%99[^,],%d,%d\n", &temp.workspaceId, temp.type, temp.location, &temp.capacity, &temp.price_in_cents) == 5)
-        {
-            WorkspaceNode *newNode = (WorkspaceNode *)malloc(sizeof(WorkspaceNode));
-            newNode->data = temp;
-            newNode->next = newNode->prev = NULL;
-            if (!workspace_head)
-                workspace_head = workspace_tail = newNode;
-            else
-            {
-                workspace_tail->next = newNode;
-                newNode->prev = workspace_tail;
-                workspace_tail = newNode;
-            }
-            if (temp.workspaceId > maxId)
-                maxId = temp.workspaceId;
-        }
-        next_workspace_id = maxId + 1;
-        fclose(file);
+        uint32_t length = frame_length(c->in + offset);
+        if (length > SERVER_MAX_FRAME)
+            return SIZE_MAX;
+        if (c->in_used - offset - 4 < length)
+            break;
+        offset += 4 + length;
     }
-    // Load Bookings
-    file = fopen(BOOKINGS_FILE, "r");
-    if (file)
+    return offset;
+}
+
+// Extends c->in_framed over the frames that newly read bytes complete, so a
+// read only looks at what it added. Returns -1 once a header announces an
+// oversized frame.
+static int server_scan_frames(ServerConnection *c)
+{
+    while (c->in_used - c->in_framed >= 4)
+    {
+        uint32_t length = frame_length(c->in + c->in_framed);
+        if (length > SERVER_MAX_FRAME)
+            return -1;
+        if (c->in_used - c->in_framed - 4 < length)
+            break;
+        c->in_framed += 4 + (size_t)length;
+    }
+    return 0;
+}
+
+static void server_connection_free(ServerConnection *c)
+{
+    if (c->session.txn) // Client went away mid-transaction
+    {
+        txn_abort(c->session.txn);
+        free(c->session.txn);
+    }
+    close(c->fd);
+    pthread_mutex_destroy(&c->mutex);
+    free(c->in);
+    free(c->out.data);
+    free(c);
+}
+
+// Caller holds c->mutex (lock order: connection, then queue)
+static void server_queue_push(ServerConnection *c)
+{
+    pthread_mutex_lock(&server.queue_mutex);
+    c->next_job = NULL;
+    if (server.queue_tail)
+        server.queue_tail->next_job = c;
+    else
+        server.queue_head = c;
+    server.queue_tail = c;
+    pthread_cond_signal(&server.queue_cond);
+    pthread_mutex_unlock(&server.queue_mutex);
+}
+
+// Blocks for the next connection to serve; NULL once stopping and drained
+static ServerConnection *server_queue_pop()
+{
+    pthread_mutex_lock(&server.queue_mutex);
+    while (!server.queue_head && !server.stopping)
+        pthread_cond_wait(&server.queue_cond, &server.queue_mutex);
+    ServerConnection *c = server.queue_head;
+    if (c)
+    {
+        server.queue_head = c->next_job;
+        if (!server.queue_head)
+            server.queue_tail = NULL;
+    }
+    pthread_mutex_unlock(&server.queue_mutex);
+    return c;
+}
+
+// Hands the connection to the pool if it has requests and nobody serves it.
+// A client that stops reading its responses gets no more until it catches up.
+static void server_dispatch_locked(ServerConnection *c)
+{
+    if (c->busy || c->closing || c->out.used - c->out_sent >= SERVER_OUTPUT_LIMIT || c->in_framed == 0)
+        return;
+    c->busy = 1;
+    server_queue_push(c);
+}
+
+// Arms EPOLLOUT while output is pending, and EPOLLIN only while the client
+// has room: with SERVER_INPUT_LIMIT bytes unserved, or its output over the
+// limit, nothing more is read until a worker or the socket catches up. A
+// client that pipelines without reading its responses cannot grow either
+// buffer without bound.
+static void server_update_events_locked(ServerConnection *c)
+{
+    int want_read = c->in_used < SERVER_INPUT_LIMIT && c->out.used - c->out_sent < SERVER_OUTPUT_LIMIT;
+    int want_write = c->out.used > 0;
+    if (want_read == c->want_read && want_write == c->want_write)
+        return;
+    struct epoll_event ev = { .events = (want_read ? EPOLLIN : 0) | (want_write ? EPOLLOUT : 0), .data.ptr = c };
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->want_read = want_read;
+    c->want_write = want_write;
+}
+
+// Sends what the socket will take and arms EPOLLOUT for the rest
+static void server_flush_locked(ServerConnection *c)
+{
+    while (c->out_sent < c->out.used)
     {
-        Booking temp;
-        int maxId = 0;
-        while (fscanf(file, "%d,%d,%d,%19[^,],%19[^,],%19[^\n]\n", &temp.bookingId, &temp.memberId, &temp.workspaceId, temp.startTime, temp.endTime, temp.status) == 6)
+        ssize_t n = send(c->fd, c->out.data + c->out_sent, c->out.used - c->out_sent, MSG_NOSIGNAL);
+        if (n > 0)
         {
-            BookingNode *newNode = (BookingNode *)malloc(sizeof(BookingNode));
-            newNode->data = temp;
-            newNode->next = newNode->prev = NULL;
-            if (!booking_head)
-                booking_head = booking_tail = newNode;
-            else
-            {
-                booking_tail->next = newNode;
-                newNode->prev = booking_tail;
-                booking_tail = newNode;
-            }
-            if (temp.bookingId > maxId)
-                maxId = temp.bookingId;
+            c->out_sent += (size_t)n;
+            continue;
         }
-        next_booking_id = maxId + 1;
-        fclose(file);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        // Peer is gone: drop the output, the epoll loop will see the hangup
+        c->out_sent = c->out.used;
     }
-    // Load Payments
-    file = fopen(PAYMENTS_FILE, "r");
-    if (file)
+    if (c->out_sent == c->out.used)
+        c->out.used = c->out_sent = 0;
+    server_update_events_locked(c);
+}
+
+static void *server_worker(void *arg)
+{
+    (void)arg;
+    OutBuffer out = { NULL, 0, 0 };
+    char *batch = NULL;
+    size_t batch_capacity = 0;
+    char *line = (char *)malloc(SERVER_MAX_FRAME + 1);
+    if (!line) {
+        perror("Failed to allocate request buffer");
+        exit(1);
+    }
+    wal_defer_commits = 1;
+
+    ServerConnection *c;
+    while ((c = server_queue_pop()) != NULL)
     {
-        Payment temp;
-        int maxId = 0;
-        while (fscanf(file, "%d,%d,%d,%10[^,],%19[^\n]\n", &temp.paymentId, &temp.bookingId, &temp.amount_in_cents, temp.paymentDate, temp.status) == 5)
+        // Take a burst of whole frames so the epoll thread can keep reading
+        pthread_mutex_lock(&c->mutex);
+        if (c->closing)
         {
-            PaymentNode *newNode = (PaymentNode *)malloc(sizeof(PaymentNode));
-            newNode->data = temp;
-            newNode->next = newNode->prev = NULL;
-            if (!payment_head)
-                payment_head = payment_tail = newNode;
-            else
-            {
-                payment_tail->next = newNode;
-                newNode->prev = payment_tail;
-                payment_tail = newNode;
+            pthread_mutex_unlock(&c->mutex);
+            server_connection_free(c);
+            continue;
+        }
+        size_t take = complete_frames(c, SERVER_BATCH_FRAMES);
+        if (take == SIZE_MAX)
+            take = 0;
+        if (take > batch_capacity)
+        {
+            batch_capacity = take;
+            batch = (char *)realloc(batch, batch_capacity);
+            if (!batch) {
+                perror("Failed to allocate request buffer");
+                exit(1);
             }
-            if (temp.paymentId > maxId)
-                maxId = temp.paymentId;
         }
-        next_payment_id = maxId + 1;
-        fclose(file);
+        memcpy(batch, c->in, take);
+        memmove(c->in, c->in + take, c->in_used - take);
+        c->in_used -= take;
+        c->in_framed -= take;
+        pthread_mutex_unlock(&c->mutex);
+
+        unsigned long requests = 0;
+        for (size_t offset = 0; offset < take; requests++)
+        {
+            uint32_t length = frame_length(batch + offset);
+            memcpy(line, batch + offset + 4, length);
+            line[length] = '\0';
+            offset += 4 + (size_t)length;
+
+            size_t header = out.used;
+            out_printf(&out, "%4s", ""); // Length placeholder
+            execute_command(line, &out, &c->session);
+            put_frame_length(out.data + header, (uint32_t)(out.used - header - 4));
+        }
+        wal_commit_deferred(); // One group commit covers the whole burst
+        atomic_fetch_add(&server.requests, requests);
+
+        pthread_mutex_lock(&c->mutex);
+        if (c->closing)
+        {
+            pthread_mutex_unlock(&c->mutex);
+            server_connection_free(c);
+            out.used = 0;
+            continue;
+        }
+        if (c->out.used == 0)
+        {
+            // Nothing pending: hand over our buffer instead of copying it
+            OutBuffer drained = c->out;
+            c->out = out;
+            c->out_sent = 0;
+            out = drained;
+        }
+        else
+            out_append(&c->out, out.data, out.used);
+        out.used = 0;
+        server_flush_locked(c);
+        c->busy = 0;
+        server_dispatch_locked(c);
+        pthread_mutex_unlock(&c->mutex);
     }
-    printf("All data loaded from files.\n");
+
+    wal_defer_commits = 0;
+    free(line);
+    free(batch);
+    free(out.data);
+    return NULL;
 }
 
-void save_all_data()
+// Epoll thread only. A connection a worker still holds is freed by that worker.
+static void server_close(ServerConnection *c)
 {
-    FILE *file;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    server.connections[c->fd] = NULL;
+    pthread_mutex_lock(&c->mutex);
+    int busy = c->busy;
+    c->closing = 1;
+    pthread_mutex_unlock(&c->mutex);
+    if (!busy)
+        server_connection_free(c);
+}
 
-    // Save Members
-    file = fopen(MEMBERS_FILE, "w");
-    if (file)
+static void server_accept()
+{
+    for (;;)
     {
-        pthread_rwlock_rdlock(&members_lock);
-        for (MemberNode *curr = member_head; curr != NULL; curr = curr->next)
+        int fd = accept(server.listen_fd, NULL, NULL);
+        if (fd < 0)
         {
-            fprintf(file, "%d,%s,%s\n", curr->data.memberId, curr->data.name, curr->data.email);
+            if (errno == EINTR)
+                continue;
+            return; // EAGAIN: backlog drained
         }
-        pthread_rwlock_unlock(&members_lock);
-        fclose(file);
-    }
-    // Save Workspaces
-    file = fopen(WORKSPACES_FILE, "w");
-    if (file)
-    {
-        pthread_rwlock_rdlock(&workspaces_lock);
-        for (WorkspaceNode *curr = workspace_head; curr != NULL; curr = curr->next)
+        if (fd >= SERVER_MAX_CONNECTIONS)
         {
-            fprintf(file, "%d,%s,%s,%d,%d\n", curr->data.workspaceId, curr->data.type, curr->data.location, curr->data.capacity, curr->data.price_in_cents);
+            close(fd);
+            continue;
         }
-        pthread_rwlock_unlock(&workspaces_lock);
-        fclose(file);
-    }
-    // Save Bookings
-    file = fopen(BOOKINGS_FILE, "w");
-    if (file)
-    {
-        pthread_rwlock_rdlock(&bookings_lock);
-        for (BookingNode *curr = booking_head; curr != NULL; curr = curr->next)
+        int one = 1;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        ServerConnection *c = (ServerConnection *)calloc(1, sizeof(ServerConnection));
+        if (!c)
         {
-            fprintf(file, "%d,%d,%d,%s,%s,%s\n", curr->data.bookingId, curr->data.memberId, curr->data.workspaceId, curr->data.startTime, curr->data.endTime, curr->data.status);
+            close(fd);
+            continue;
         }
-        pthread_rwlock_unlock(&bookings_lock);
-        fclose(file);
+        c->fd = fd;
+        c->want_read = 1;
+        pthread_mutex_init(&c->mutex, NULL);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            server_connection_free(c);
+            continue;
+        }
+        server.connections[fd] = c;
+        server.accepted++;
     }
-    // Save Payments
-    file = fopen(PAYMENTS_FILE, "w");
-    if (file)
+}
+
+// Drains the socket into c->in, up to SERVER_INPUT_LIMIT. Returns 0 if the
+// connection was closed.
+static int server_read(ServerConnection *c)
+{
+    int open = 1;
+    pthread_mutex_lock(&c->mutex);
+    if (c->in_used >= SERVER_INPUT_LIMIT)
+    {
+        // Not reading (a hangup got us here): only check the peer is still there
+        char probe;
+        ssize_t n = recv(c->fd, &probe, 1, MSG_PEEK);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            open = 0;
+    }
+    while (open && c->in_used < SERVER_INPUT_LIMIT)
     {
-        pthread_rwlock_rdlock(&payments_lock);
-        for (PaymentNode *curr = payment_head; curr != NULL; curr = curr->next)
+        if (c->in_capacity - c->in_used < 4096)
         {
-            fprintf(file, "%d,%d,%d,%s,%s\n", curr->data.paymentId, curr->data.bookingId, curr->data.amount_in_cents, curr->data.paymentDate, curr->data.status);
+            size_t capacity = c->in_capacity ? c->in_capacity * 2 : 16384;
+            char *grown = (char *)realloc(c->in, capacity);
+            if (!grown) {
+                perror("Failed to grow request buffer");
+                exit(1);
+            }
+            c->in = grown;
+            c->in_capacity = capacity;
         }
-        pthread_rwlock_unlock(&payments_lock);
-        fclose(file);
+        size_t room = c->in_capacity - c->in_used;
+        if (room > SERVER_INPUT_LIMIT - c->in_used)
+            room = SERVER_INPUT_LIMIT - c->in_used;
+        ssize_t n = recv(c->fd, c->in + c->in_used, room, 0);
+        if (n > 0)
+        {
+            c->in_used += (size_t)n;
+            if ((size_t)n < room)
+                break; // Short read: the socket is drained
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        open = 0; // EOF or reset
+        break;
+    }
+    if (open && server_scan_frames(c) != 0)
+        open = 0; // Oversized frame: not a client we understand
+    if (open)
+    {
+        server_dispatch_locked(c);
+        server_update_events_locked(c);
     }
+    pthread_mutex_unlock(&c->mutex);
+
+    if (!open)
+        server_close(c);
+    return open;
 }
 
-void free_all_lists()
+// --serve [--port N] [--bind ADDR] [--workers N] [--save-every SEC]
+int server_tool(int argc, char *argv[])
 {
-    MemberNode *currentMember, *tmpMember;
-    currentMember = member_head;
-    while (currentMember)
+    int port = SERVER_PORT, workers = SERVER_WORKERS, save_every = 0;
+    const char *bind_addr = "127.0.0.1";
+    for (int i = 2; i < argc; i++)
+    {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value && strcmp(argv[i], "--port") == 0)
+            port = atoi(value);
+        else if (value && strcmp(argv[i], "--workers") == 0)
+            workers = atoi(value);
+        else if (value && strcmp(argv[i], "--bind") == 0)
+            bind_addr = value;
+        else if (value && strcmp(argv[i], "--save-every") == 0 && atoi(value) > 0)
+            save_every = atoi(value);
+        else
+        {
+            printf("Error: bad option %s.\n", argv[i]);
+            return 1;
+        }
+        i++;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (port <= 0 || port > 65535 || workers <= 0 || inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1)
     {
-        tmpMember = currentMember;
-        currentMember = currentMember->next;
-        free(tmpMember);
+        printf("Error: need a port in 1-65535, a positive worker count and an IPv4 address.\n");
+        return 1;
     }
-    WorkspaceNode *currentWorkspace, *tmpWorkspace;
-    currentWorkspace = workspace_head;
-    while (currentWorkspace)
+
+    init_database();
+    if (logger_start() != 0)
+        printf("Warning: audit logger unavailable, logging synchronously.\n");
+    log_operation("Server Started");
+    load_all_data();
+    if (wal_open() != 0)
     {
-        tmpWorkspace = currentWorkspace;
-        currentWorkspace = currentWorkspace->next;
-        free(tmpWorkspace);
+        printf("Error: cannot open %s for writing.\n", WAL_FILE);
+        return 1;
     }
-    BookingNode *currentBooking, *tmpBooking;
-    currentBooking = booking_head;
-    while (currentBooking)
+
+    int one = 1;
+    server.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    server.epoll_fd = epoll_create1(0);
+    if (server.listen_fd < 0 || server.epoll_fd < 0 ||
+        setsockopt(server.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(server.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server.listen_fd, SOMAXCONN) != 0)
     {
-        tmpBooking = currentBooking;
-        currentBooking = currentBooking->next;
-        free(tmpBooking);
+        perror("Error: cannot listen");
+        return 1;
     }
-    PaymentNode *currentPayment, *tmpPayment;
-    currentPayment = payment_head;
-    while (currentPayment)
+    fcntl(server.listen_fd, F_SETFL, fcntl(server.listen_fd, F_GETFL) | O_NONBLOCK);
+    struct epoll_event listen_ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &listen_ev);
+    pthread_mutex_init(&server.queue_mutex, NULL);
+    pthread_cond_init(&server.queue_cond, NULL);
+
+    // Workers start with SIGINT/SIGTERM blocked so the epoll loop sees them
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigset_t stop_signals, previous;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &previous);
+    pthread_t *tids = (pthread_t *)malloc(workers * sizeof(pthread_t));
+    for (int i = 0; i < workers; i++)
+        pthread_create(&tids[i], NULL, server_worker, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    printf("FlexDesk server listening on %s:%d with %d worker(s). Ctrl+C stops it.\n",
+           bind_addr, port, workers);
+    fflush(stdout);
+
+    struct epoll_event events[256];
+    long long next_save = save_every ? now_ns() + save_every * 1000000000LL : 0;
+    while (!server_stop_requested)
     {
-        tmpPayment = currentPayment;
-        currentPayment = currentPayment->next;
-        free(tmpPayment);
+        // Periodic checkpoint without stopping the service (skipped while one runs)
+        if (next_save && now_ns() >= next_save)
+        {
+            bgsave_start();
+            next_save = now_ns() + save_every * 1000000000LL;
+        }
+        int n = epoll_wait(server.epoll_fd, events, 256, 500);
+        if (n < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            ServerConnection *c = (ServerConnection *)events[i].data.ptr;
+            if (!c)
+            {
+                server_accept();
+                continue;
+            }
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !server_read(c))
+                continue;
+            if (events[i].events & EPOLLOUT)
+            {
+                pthread_mutex_lock(&c->mutex);
+                server_flush_locked(c);
+                server_dispatch_locked(c);
+                pthread_mutex_unlock(&c->mutex);
+            }
+        }
     }
+
+    // Stop accepting, let the workers finish what is queued, then drop clients
+    close(server.listen_fd);
+    pthread_mutex_lock(&server.queue_mutex);
+    server.stopping = 1;
+    pthread_cond_broadcast(&server.queue_cond);
+    pthread_mutex_unlock(&server.queue_mutex);
+    for (int i = 0; i < workers; i++)
+        pthread_join(tids[i], NULL);
+    free(tids);
+    for (int fd = 0; fd < SERVER_MAX_CONNECTIONS; fd++)
+        if (server.connections[fd])
+            server_close(server.connections[fd]);
+    close(server.epoll_fd);
+    pthread_cond_destroy(&server.queue_cond);
+    pthread_mutex_destroy(&server.queue_mutex);
+
+    printf("\nServer stopped: %lu connection(s), %lu request(s).\n", server.accepted,
+           (unsigned long)atomic_load(&server.requests));
+    bgsave_wait(); // Let a running save finish before the WAL closes
+    wal_close();
+    log_operation("Server Stopped");
+    logger_stop();
+    reset_all_tables();
+    return 0;
 }
 
-// Demo functions for concurrency (Reader/Writer)
-void *demo_reader(void *arg) {
-    int id = *(int*)arg;
-    printf("[Thread R%d] Requesting READ lock...\n", id);
+// -- Load Test Client --
+typedef struct
+{
+    struct sockaddr_in addr;
+    int connections;
+    long long ops; // Total requests across all connections
+    int pipeline;  // Requests in flight per connection
+    int keys;      // Members created for the run (and deleted after it)
+    int read_pct;
+} LoadTestConfig;
+
+typedef struct
+{
+    const LoadTestConfig *cfg;
+    const int *member_ids;
+    pthread_barrier_t *start;
+    long long ops;
+    uint64_t seed;
+    int failed;
+    LatencyHistogram hist[2]; // GET_MEMBER, UPDATE_MEMBER
+} LoadTestClient;
+
+static int send_all(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
 
-    pthread_rwlock_rdlock(&members_lock);
-    printf("   [Thread R%d] GRANTED Read Lock. Reading database...\n", id);
-    sleep(2);
-    printf("   [Thread R%d] Done reading. Releasing lock.\n", id);
+static int recv_all(int fd, char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = recv(fd, data, length, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
 
-    pthread_rwlock_unlock(&members_lock);
-    return NULL;
+static void loadtest_request(OutBuffer *out, const char *command)
+{
+    char header[4];
+    size_t length = strlen(command);
+    put_frame_length(header, (uint32_t)length);
+    out_append(out, header, 4);
+    out_append(out, command, length);
 }
 
-void *demo_writer(void *arg) {
-    int id = *(int*)arg;
-    printf("[Thread W%d] Requesting WRITE lock (Exclusive)...\n", id);
+// Reads one response frame into 'reply' (NUL-terminated); returns its length or -1
+static int loadtest_response(int fd, OutBuffer *reply)
+{
+    char header[4];
+    if (recv_all(fd, header, 4) != 0)
+        return -1;
+    uint32_t length = frame_length(header);
+    reply->used = 0;
+    if (length > SERVER_OUTPUT_LIMIT)
+        return -1;
+    if (reply->capacity < (size_t)length + 1)
+    {
+        reply->capacity = (size_t)length + 1;
+        reply->data = (char *)realloc(reply->data, reply->capacity);
+        if (!reply->data) {
+            perror("Failed to grow reply buffer");
+            exit(1);
+        }
+    }
+    if (recv_all(fd, reply->data, length) != 0)
+        return -1;
+    reply->data[length] = '\0';
+    reply->used = length;
+    return (int)length;
+}
 
-    pthread_rwlock_wrlock(&members_lock);
-    printf("   >>> [Thread W%d] GRANTED Write Lock. Modifying database... <<<\n", id);
-    sleep(2);
-    printf("   >>> [Thread W%d] Done writing. Releasing lock. <<<\n", id);
+static int loadtest_connect(const LoadTestConfig *cfg)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (const struct sockaddr *)&cfg->addr, sizeof(cfg->addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
 
-    pthread_rwlock_unlock(&members_lock);
-    return NULL;
+// Setup and teardown: runs the commands pipelined over one connection and
+// keeps the id from each "OK|<id>" response (0 for errors)
+static int loadtest_run_all(int fd, char **commands, int count, int *ids)
+{
+    OutBuffer requests = { NULL, 0, 0 }, reply = { NULL, 0, 0 };
+    int rc = 0;
+    for (int done = 0; done < count && rc == 0; )
+    {
+        int burst = count - done < 256 ? count - done : 256;
+        requests.used = 0;
+        for (int i = 0; i < burst; i++)
+            loadtest_request(&requests, commands[done + i]);
+        if (send_all(fd, requests.data, requests.used) != 0)
+            rc = -1;
+        for (int i = 0; i < burst && rc == 0; i++, done++)
+        {
+            if (loadtest_response(fd, &reply) < 0)
+                rc = -1;
+            else if (ids)
+                ids[done] = strncmp(reply.data, "OK|", 3) == 0 ? atoi(reply.data + 3) : 0;
+        }
+    }
+    free(requests.data);
+    free(reply.data);
+    return rc;
 }
 
-void run_concurrency_test() {
-    printf("\n--- Starting Concurrency Stress Test ---\n");
-    printf("Goal: Show that Readers can overlap, but Writers block everyone.\n");
-    printf("1. Launching Reader 1\n");
-    printf("2. Launching Reader 2 (Should start immediately - overlapping R1)\n");
-    printf("3. Launching Writer 1 (Should WAIT until Readers finish)\n\n");
+static void *loadtest_client(void *arg)
+{
+    LoadTestClient *w = (LoadTestClient *)arg;
+    const LoadTestConfig *cfg = w->cfg;
+    int fd = loadtest_connect(cfg);
+    pthread_barrier_wait(w->start);
+    if (fd < 0)
+    {
+        w->failed = 1;
+        return NULL;
+    }
 
-    pthread_t r1, r2, w1;
-    int id1 = 1, id2 = 2, id3 = 1;
+    OutBuffer requests = { NULL, 0, 0 }, reply = { NULL, 0, 0 };
+    int *kinds = (int *)malloc(cfg->pipeline * sizeof(int));
+    char command[96];
+    for (long long sent = 0; sent < w->ops && !w->failed; )
+    {
+        int burst = w->ops - sent < cfg->pipeline ? (int)(w->ops - sent) : cfg->pipeline;
+        requests.used = 0;
+        for (int i = 0; i < burst; i++)
+        {
+            int id = w->member_ids[bench_rand(&w->seed) % cfg->keys];
+            kinds[i] = (int)(bench_rand(&w->seed) % 100) >= cfg->read_pct;
+            if (kinds[i] == 0)
+                snprintf(command, sizeof(command), "GET_MEMBER|%d", id);
+            else
+                snprintf(command, sizeof(command), "UPDATE_MEMBER|%d|Load Test %lld", id, sent + i);
+            loadtest_request(&requests, command);
+        }
 
-    pthread_create(&r1, NULL, demo_reader, &id1);
-    usleep(100000);
+        // Latency runs from sending the burst to each response arriving
+        long long t0 = now_ns();
+        if (send_all(fd, requests.data, requests.used) != 0)
+            w->failed = 1;
+        for (int i = 0; i < burst && !w->failed; i++)
+        {
+            if (loadtest_response(fd, &reply) < 0)
+            {
+                w->failed = 1;
+                break;
+            }
+            hist_record(&w->hist[kinds[i]], (uint64_t)(now_ns() - t0), strncmp(reply.data, "OK", 2) == 0);
+        }
+        sent += burst;
+    }
 
-    pthread_create(&r2, NULL, demo_reader, &id2);
-    usleep(100000);
+    free(kinds);
+    free(requests.data);
+    free(reply.data);
+    close(fd);
+    return NULL;
+}
 
-    pthread_create(&w1, NULL, demo_writer, &id3);
+// --loadtest [--host ADDR] [--port N] [--connections N] [--ops N] [--pipeline N]
+//            [--keys N] [--mix R:W]
+int loadtest_tool(int argc, char *argv[])
+{
+    LoadTestConfig cfg;
+    const char *host = "127.0.0.1";
+    int port = SERVER_PORT, write_pct = 20;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.connections = 8;
+    cfg.ops = 200000;
+    cfg.pipeline = 16;
+    cfg.keys = 10000;
+    cfg.read_pct = 80;
+    for (int i = 2; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[++i] : NULL;
+        if (!value)
+        {
+            printf("Error: %s needs a value.\n", arg);
+            return 1;
+        }
+        if (strcmp(arg, "--host") == 0)
+            host = value;
+        else if (strcmp(arg, "--port") == 0)
+            port = atoi(value);
+        else if (strcmp(arg, "--connections") == 0)
+            cfg.connections = atoi(value);
+        else if (strcmp(arg, "--ops") == 0)
+            cfg.ops = atoll(value);
+        else if (strcmp(arg, "--pipeline") == 0)
+            cfg.pipeline = atoi(value);
+        else if (strcmp(arg, "--keys") == 0)
+            cfg.keys = atoi(value);
+        else if (strcmp(arg, "--mix") == 0 && sscanf(value, "%d:%d", &cfg.read_pct, &write_pct) == 2 &&
+                 cfg.read_pct >= 0 && write_pct >= 0 && cfg.read_pct + write_pct == 100)
+            continue;
+        else
+        {
+            printf("Error: bad option %s %s.\n", arg, value);
+            return 1;
+        }
+    }
+    cfg.addr.sin_family = AF_INET;
+    cfg.addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &cfg.addr.sin_addr) != 1 || port <= 0 || port > 65535 ||
+        cfg.connections <= 0 || cfg.ops <= 0 || cfg.pipeline <= 0 || cfg.keys <= 0)
+    {
+        printf("Error: need an IPv4 host, a valid port and positive counts.\n");
+        return 1;
+    }
 
-    pthread_join(r1, NULL);
-    pthread_join(r2, NULL);
-    pthread_join(w1, NULL);
+    int fd = loadtest_connect(&cfg);
+    if (fd < 0)
+    {
+        printf("Error: cannot connect to %s:%d (is --serve running?).\n", host, port);
+        return 1;
+    }
 
-    printf("\n--- Test Complete: Check output order above ---\n");
+    // Setup: members with run-unique emails, so repeated runs never collide
+    char **commands = (char **)malloc(cfg.keys * sizeof(char *));
+    int *ids = (int *)calloc(cfg.keys, sizeof(int));
+    long long run = (long long)getpid() * 1000003LL + now_ns() % 1000003LL;
+    for (int i = 0; i < cfg.keys; i++)
+    {
+        commands[i] = (char *)malloc(96);
+        snprintf(commands[i], 96, "ADD_MEMBER|Load Test|load%lld-%d@example.com", run, i);
+    }
+    int ready = loadtest_run_all(fd, commands, cfg.keys, ids) == 0;
+    for (int i = 0; ready && i < cfg.keys; i++)
+        ready = ids[i] > 0;
+    if (!ready)
+    {
+        printf("Error: could not create the %d load-test members.\n", cfg.keys);
+        close(fd);
+        return 1;
+    }
+    printf("Load test: %lld request(s) over %d connection(s), pipeline %d, %d keys, mix %d:%d.\n",
+           cfg.ops, cfg.connections, cfg.pipeline, cfg.keys, cfg.read_pct, write_pct);
+
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, cfg.connections + 1);
+    LoadTestClient *clients = (LoadTestClient *)calloc(cfg.connections, sizeof(LoadTestClient));
+    pthread_t *tids = (pthread_t *)malloc(cfg.connections * sizeof(pthread_t));
+    for (int i = 0; i < cfg.connections; i++)
+    {
+        clients[i].cfg = &cfg;
+        clients[i].member_ids = ids;
+        clients[i].start = &start;
+        clients[i].ops = cfg.ops / cfg.connections + (i < cfg.ops % cfg.connections);
+        clients[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+        pthread_create(&tids[i], NULL, loadtest_client, &clients[i]);
+    }
+    pthread_barrier_wait(&start);
+    long long t = now_ns();
+    for (int i = 0; i < cfg.connections; i++)
+        pthread_join(tids[i], NULL);
+    double seconds = (now_ns() - t) / 1e9;
+
+    static LatencyHistogram merged[2], all;
+    int failed = 0;
+    for (int i = 0; i < cfg.connections; i++)
+    {
+        failed += clients[i].failed;
+        for (int k = 0; k < 2; k++)
+        {
+            hist_merge(&merged[k], &clients[i].hist[k]);
+            hist_merge(&all, &clients[i].hist[k]);
+        }
+    }
+    printf("%-8s | %10s | %7s | %12s | %9s | %9s | %9s | %9s\n",
+           "Op", "Count", "OK", "Ops/sec", "p50 us", "p99 us", "p999 us", "max us");
+    printf("---------|------------|---------|--------------|-----------|-----------|-----------|----------\n");
+    bench_print_row("get", &merged[0], seconds);
+    bench_print_row("update", &merged[1], seconds);
+    bench_print_row("total", &all, seconds);
+    printf("Elapsed %.3f s, throughput %.0f requests/sec.\n", seconds, all.total / seconds);
+    if (failed)
+        printf("Warning: %d connection(s) failed before finishing.\n", failed);
+
+    // Teardown: remove the members this run created
+    for (int i = 0; i < cfg.keys; i++)
+        snprintf(commands[i], 96, "DELETE_MEMBER|%d", ids[i]);
+    loadtest_run_all(fd, commands, cfg.keys, NULL);
+    close(fd);
+
+    for (int i = 0; i < cfg.keys; i++)
+        free(commands[i]);
+    free(commands);
+    free(ids);
+    free(clients);
+    free(tids);
+    pthread_barrier_destroy(&start);
+    return failed ? 1 : 0;
 }